@@ -0,0 +1,110 @@
+/**
+ * @file CullingKernelBenchmark.cpp
+ * @brief Measures the batched culling kernels against per-object lmFrustum::test calls.
+ *
+ * One million random boxes scattered around a perspective camera are culled, so that roughly a
+ * tenth of them is visible. Every kernel is checked against the lmFrustum::test reference.
+ */
+
+#include "../ecs/CullingKernel.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+    using namespace lm;
+
+    constexpr size_t BOX_COUNT = 1000000;
+    constexpr int ITERATIONS = 20;
+
+    struct SoAData {
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+
+        lmAabbSoA view() const {
+            return lmAabbSoA{
+                centerX.data(), centerY.data(), centerZ.data(),
+                extentX.data(), extentY.data(), extentZ.data(),
+                centerX.size() };
+        }
+    };
+
+    template <typename Func>
+    double measure(Func&& fn) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            fn();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+    }
+
+} // namespace
+
+int main() {
+    std::mt19937 rng{ 42 };
+    std::uniform_real_distribution<float> position{ -100.f, 100.f };
+    std::uniform_real_distribution<float> extent{ 0.1f, 3.f };
+
+    const glm::mat4 projection = glm::perspective(glm::radians(50.f), 16.f / 9.f, 0.1f, 100.f);
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 2.f, -5.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+    const lmFrustum frustum = lmFrustum::fromMatrix(projection * view);
+
+    SoAData data;
+    std::vector<lmAabb> boxes;
+    boxes.reserve(BOX_COUNT);
+    for (size_t i = 0; i < BOX_COUNT; i++) {
+        const glm::vec3 center{ position(rng), position(rng), position(rng) };
+        const glm::vec3 extents{ extent(rng), extent(rng), extent(rng) };
+        boxes.push_back(lmAabb::fromCenterExtents(center, extents));
+
+        data.centerX.push_back(center.x);
+        data.centerY.push_back(center.y);
+        data.centerZ.push_back(center.z);
+        data.extentX.push_back(extents.x);
+        data.extentY.push_back(extents.y);
+        data.extentZ.push_back(extents.z);
+    }
+
+    std::vector<uint8_t> reference(BOX_COUNT), visible(BOX_COUNT);
+
+    size_t referenceCount = 0;
+    const double baseline = measure([&]() {
+        referenceCount = 0;
+        for (size_t i = 0; i < BOX_COUNT; i++) {
+            reference[i] = frustum.intersects(boxes[i]) ? 1 : 0;
+            referenceCount += reference[i];
+        }
+    });
+
+    std::printf("Boxes: %zu, %zu visible, %d iterations\n", BOX_COUNT, referenceCount, ITERATIONS);
+    std::printf("%-8s %10s %8s %10s\n", "Kernel", "Time (ms)", "Speedup", "Mismatches");
+    std::printf("%-8s %10.3f %7.2fx %10s\n", "test()", baseline, 1.0, "-");
+
+    const lmAabbSoA input = data.view();
+    for (lmCullingKernel kernel : { lmCullingKernel::Scalar, lmCullingKernel::SSE, lmCullingKernel::AVX2 }) {
+        if (!isCullingKernelAvailable(kernel)) {
+            continue;
+        }
+
+        size_t visibleCount = 0;
+        const double time = measure([&]() {
+            visibleCount = cullAabbs(frustum, input, visible.data(), kernel);
+        });
+
+        size_t mismatches = visibleCount == referenceCount ? 0 : 1;
+        for (size_t i = 0; i < BOX_COUNT; i++) {
+            mismatches += visible[i] != reference[i] ? 1 : 0;
+        }
+
+        std::printf("%-8s %10.3f %7.2fx %10zu\n", getCullingKernelName(kernel), time, baseline / time, mismatches);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file EcsIterationBenchmark.cpp
+ * @brief Compares iterating the archetype registry against the former lmGameObject::Map layout.
+ *
+ * Both layouts are filled with the same scene (mostly models, some point lights) and walked the way
+ * RenderSystem::renderGameObjects and PointLightSystem::update do. The lookup pass resolves every
+ * light by ID the way PointLightSystem::render does after sorting.
+ *
+ * The view passes compare a reused lmView against forEach, and parallelEach against a single
+ * threaded view for the heavier matrix pass.
+ */
+
+#include "../ecs/GameObject.h"
+#include "../core/ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    using namespace lm;
+
+    // Layout of lmGameObject before the archetype registry replaced it
+    struct LegacyGameObject {
+        glm::vec3 color{};
+        TransformComponent transform{};
+        std::shared_ptr<lmModel> model{};
+        std::unique_ptr<PointLightComponent> pointLight = nullptr;
+    };
+
+    using LegacyMap = std::unordered_map<unsigned int, LegacyGameObject>;
+
+    constexpr size_t ENTITY_COUNT = 100000;
+    constexpr size_t LIGHT_EVERY = 10;
+    constexpr int ITERATIONS = 50;
+
+    // Never dereferenced, only used so that the model pointers are non-null
+    std::shared_ptr<lmModel> dummyModel() {
+        static int token = 0;
+        return std::shared_ptr<lmModel>(std::make_shared<int>(0), reinterpret_cast<lmModel*>(&token));
+    }
+
+    template <typename Func>
+    double measure(Func&& fn) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            fn();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+    }
+
+} // namespace
+
+int main() {
+    auto model = dummyModel();
+
+    LegacyMap legacy;
+    lmRegistry registry;
+
+    std::vector<unsigned int> legacyLightIds;
+    std::vector<lmEntity> lightEntities;
+
+    for (size_t i = 0; i < ENTITY_COUNT; i++) {
+        const glm::vec3 position{ static_cast<float>(i % 100), 0.f, static_cast<float>(i / 100) };
+
+        LegacyGameObject object{};
+        object.transform.setTranslation(position);
+
+        lmEntity entity = lmGameObject::createGameObject(registry);
+        registry.get<TransformComponent>(entity).setTranslation(position);
+
+        if (i % LIGHT_EVERY == 0) {
+            object.pointLight = std::make_unique<PointLightComponent>();
+            registry.add<PointLightComponent>(entity);
+            legacyLightIds.push_back(static_cast<unsigned int>(i));
+            lightEntities.push_back(entity);
+        }
+        else {
+            object.model = model;
+            registry.add<ModelComponent>(entity, ModelComponent{ model });
+        }
+
+        legacy.emplace(static_cast<unsigned int>(i), std::move(object));
+    }
+
+    glm::mat4 sink{ 0.f };
+    glm::vec3 lightSink{ 0.f };
+
+    const double legacyModels = measure([&]() {
+        for (auto& kv : legacy) {
+            auto& obj = kv.second;
+            if (obj.model == nullptr) continue;
+            sink += obj.transform.getMatrix();
+        }
+    });
+
+    const double registryModels = measure([&]() {
+        registry.forEach<TransformComponent, ModelComponent>(
+            [&](lmEntity, TransformComponent& transform, ModelComponent&) {
+                sink += transform.getMatrix();
+            });
+    });
+
+    auto modelView = registry.view<TransformComponent, ModelComponent>();
+    const double viewModels = measure([&]() {
+        modelView.each([&](TransformComponent& transform, ModelComponent&) {
+            sink += transform.getMatrix();
+        });
+    });
+
+    // update() rebuilds the matrices unconditionally, so both passes do the same work on every transform
+    auto staticView = registry.view<TransformComponent>(exclude<PointLightComponent>);
+    const double singleThreadUpdate = measure([&]() {
+        staticView.each([](TransformComponent& transform) {
+            transform.update();
+        });
+    });
+
+    lmThreadPool threadPool{};
+    const double parallelUpdate = measure([&]() {
+        staticView.parallelEach(threadPool, [](TransformComponent& transform) {
+            transform.update();
+        });
+    });
+
+    const double legacyLights = measure([&]() {
+        for (auto& kv : legacy) {
+            auto& obj = kv.second;
+            if (obj.pointLight == nullptr) continue;
+            lightSink += obj.transform.translation * obj.pointLight->lightIntensity;
+        }
+    });
+
+    const double registryLights = measure([&]() {
+        registry.forEach<TransformComponent, PointLightComponent>(
+            [&](lmEntity, TransformComponent& transform, PointLightComponent& pointLight) {
+                lightSink += transform.translation * pointLight.lightIntensity;
+            });
+    });
+
+    const double legacyLookup = measure([&]() {
+        for (unsigned int id : legacyLightIds) {
+            lightSink += legacy.at(id).transform.translation;
+        }
+    });
+
+    const double registryLookup = measure([&]() {
+        for (lmEntity entity : lightEntities) {
+            lightSink += registry.get<TransformComponent>(entity).translation;
+        }
+    });
+
+    std::printf("Entities: %zu (%zu lights), %d iterations\n", ENTITY_COUNT, ENTITY_COUNT / LIGHT_EVERY, ITERATIONS);
+    std::printf("%-28s %10s %10s %8s\n", "Pass", "Map (ms)", "ECS (ms)", "Speedup");
+    std::printf("%-28s %10.3f %10.3f %7.2fx\n", "Transform + Model", legacyModels, registryModels, legacyModels / registryModels);
+    std::printf("%-28s %10.3f %10.3f %7.2fx\n", "Transform + PointLight", legacyLights, registryLights, legacyLights / registryLights);
+    std::printf("%-28s %10.3f %10.3f %7.2fx\n", "Lookup by ID", legacyLookup, registryLookup, legacyLookup / registryLookup);
+
+    std::printf("\n%-28s %10s %10s %8s\n", "Pass", "Base (ms)", "View (ms)", "Speedup");
+    std::printf("%-28s %10.3f %10.3f %7.2fx\n", "forEach vs reused view", registryModels, viewModels, registryModels / viewModels);
+    std::printf("%-28s %10.3f %10.3f %7.2fx  (%u threads)\n", "each vs parallelEach",
+        singleThreadUpdate, parallelUpdate, singleThreadUpdate / parallelUpdate, threadPool.getThreadCount());
+
+    // Keep the accumulated results observable so the loops are not optimized away
+    return (sink[0][0] + lightSink.x) == 0.123f ? EXIT_FAILURE : EXIT_SUCCESS;
+}
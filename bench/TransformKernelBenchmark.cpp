@@ -0,0 +1,152 @@
+/**
+ * @file TransformKernelBenchmark.cpp
+ * @brief Measures the batched transform kernels against the former per-object TransformComponent::update.
+ *
+ * One million random transforms are turned into model and normal matrices, once with non-uniform
+ * scales and once declared uniformly scaled. Every kernel is checked against the glm reference.
+ */
+
+#include "../ecs/TransformKernel.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+    using namespace lm;
+
+    constexpr size_t TRANSFORM_COUNT = 1000000;
+    constexpr int ITERATIONS = 20;
+
+    struct SoAData {
+        std::vector<float> translationX, translationY, translationZ;
+        std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<float> scaleX, scaleY, scaleZ;
+
+        lmTransformSoA view(bool uniformScale) const {
+            lmTransformSoA input{};
+            input.translationX = translationX.data();
+            input.translationY = translationY.data();
+            input.translationZ = translationZ.data();
+            input.rotationX = rotationX.data();
+            input.rotationY = rotationY.data();
+            input.rotationZ = rotationZ.data();
+            input.rotationW = rotationW.data();
+            input.scaleX = scaleX.data();
+            input.scaleY = uniformScale ? nullptr : scaleY.data();
+            input.scaleZ = uniformScale ? nullptr : scaleZ.data();
+            input.count = translationX.size();
+            return input;
+        }
+    };
+
+    // TransformComponent::update before the kernel replaced it
+    void legacyUpdate(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale,
+        glm::mat4& transform, glm::mat3& normalMatrix) {
+        transform = glm::mat4(1.0f);
+        transform = glm::translate(transform, translation);
+        transform = transform * glm::mat4_cast(rotation);
+        transform = glm::scale(transform, scale);
+        normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    }
+
+    template <typename Func>
+    double measure(Func&& fn) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            fn();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+    }
+
+    float maxError(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b,
+        const std::vector<glm::mat3>& na, const std::vector<glm::mat3>& nb) {
+        float error = 0.f;
+        for (size_t i = 0; i < a.size(); i++) {
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    error = std::fmax(error, std::fabs(a[i][c][r] - b[i][c][r]));
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                for (int r = 0; r < 3; r++) {
+                    error = std::fmax(error, std::fabs(na[i][c][r] - nb[i][c][r]));
+                }
+            }
+        }
+        return error;
+    }
+
+} // namespace
+
+int main() {
+    std::mt19937 rng{ 42 };
+    std::uniform_real_distribution<float> position{ -100.f, 100.f };
+    std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+    std::uniform_real_distribution<float> scaleDistribution{ 0.5f, 2.f };
+
+    SoAData data;
+    for (size_t i = 0; i < TRANSFORM_COUNT; i++) {
+        const glm::quat q = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng)));
+
+        data.translationX.push_back(position(rng));
+        data.translationY.push_back(position(rng));
+        data.translationZ.push_back(position(rng));
+        data.rotationX.push_back(q.x);
+        data.rotationY.push_back(q.y);
+        data.rotationZ.push_back(q.z);
+        data.rotationW.push_back(q.w);
+        data.scaleX.push_back(scaleDistribution(rng));
+        data.scaleY.push_back(scaleDistribution(rng));
+        data.scaleZ.push_back(scaleDistribution(rng));
+    }
+
+    std::vector<glm::mat4> referenceModels(TRANSFORM_COUNT), models(TRANSFORM_COUNT);
+    std::vector<glm::mat3> referenceNormals(TRANSFORM_COUNT), normals(TRANSFORM_COUNT);
+
+    std::printf("Transforms: %zu, %d iterations\n", TRANSFORM_COUNT, ITERATIONS);
+    std::printf("%-10s %-8s %10s %8s %10s\n", "Scale", "Kernel", "Time (ms)", "Speedup", "Max error");
+
+    for (bool uniformScale : { false, true }) {
+        const char* scaleName = uniformScale ? "uniform" : "per-axis";
+
+        const double legacy = measure([&]() {
+            for (size_t i = 0; i < TRANSFORM_COUNT; i++) {
+                const float sx = data.scaleX[i];
+                const glm::vec3 scale = uniformScale ? glm::vec3(sx) : glm::vec3(sx, data.scaleY[i], data.scaleZ[i]);
+                legacyUpdate(
+                    { data.translationX[i], data.translationY[i], data.translationZ[i] },
+                    glm::quat(data.rotationW[i], data.rotationX[i], data.rotationY[i], data.rotationZ[i]),
+                    scale,
+                    referenceModels[i],
+                    referenceNormals[i]);
+            }
+        });
+        std::printf("%-10s %-8s %10.3f %7.2fx %10s\n", scaleName, "glm", legacy, 1.0, "-");
+
+        for (lmTransformKernel kernel : { lmTransformKernel::Scalar, lmTransformKernel::SSE }) {
+            if (!isTransformKernelAvailable(kernel)) {
+                continue;
+            }
+
+            const lmTransformSoA input = data.view(uniformScale);
+            const double time = measure([&]() {
+                computeTransforms(input, models.data(), normals.data(), kernel);
+            });
+
+            const float error = maxError(referenceModels, models, referenceNormals, normals);
+            std::printf("%-10s %-8s %10.3f %7.2fx %10.2e\n",
+                scaleName, getTransformKernelName(kernel), time, legacy / time, error);
+        }
+    }
+
+    // Keep the results observable so the loops are not optimized away
+    return (models[0][0][0] + normals[0][0][0]) == 0.123f ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -10,6 +10,8 @@
 #include "../systems/PointLightSystem.h"
 #include "../render/Camera.h"
 #include "../render/Buffer.h"
+#include "../ecs/Scheduler.h"
+#include "SceneSnapshot.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -19,11 +21,21 @@
 
 #include <memory>
 #include <array>
+#include <chrono>
 #include <functional>
 
 /// Define maximum frame time as the inverse of 30 fps
 constexpr float MAX_FRAME_TIME = 1.0f / 30.0f;
 
+/// Scene snapshot written next to the models after an import
+constexpr const char* SCENE_SNAPSHOT_FILE = "scene.lmscene";
+
+/// Interval in seconds between two logs of the per-system timings
+constexpr float TIMING_LOG_INTERVAL = 5.0f;
+
+/// Draws are recorded into secondary command buffers, split across the thread pool by the render system
+constexpr VkSubpassContents SUBPASS_CONTENTS = VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+
 namespace lm {
 	
 	App::App() : globalPool(lmDescriptorPool::Builder(lmDevice)
@@ -33,6 +45,8 @@ namespace lm {
 
 		/// Load game objects on application startup
 		loadGameObjects();
+		uploadQueue.submit();
+		lmDevice.logMemoryStats();
 	}
 	
 	App::~App() {}
@@ -54,10 +68,15 @@ namespace lm {
 			uboBuffer->map();
 		}
 
-		// Define descriptor set layout for global uniform buffer
-		auto globalSetLayout = lmDescriptorSetLayout::Builder(lmDevice)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
-			.build();
+		// Define descriptor set layout for global uniform buffer, shared by every graphics pipeline
+		// and visible to the stages reading it
+		const lmPipelineInterface globalInterface = pipelineRegistry.reflectShaders({
+			"shaders/shader.vert.spv",
+			"shaders/shader.frag.spv",
+			"shaders/point_light.vert.spv",
+			"shaders/point_light.frag.spv" });
+		globalInterface.checkUniformBlock(0, 0, sizeof(GlobalUbo), "GlobalUbo");
+		auto globalSetLayout = globalInterface.buildSetLayout(lmDevice, 0);
 
 		// Allocate and write descriptor sets for each frame in flight
 		std::vector<VkDescriptorSet> globalDescriptorSets;
@@ -73,12 +92,20 @@ namespace lm {
 		// Instantiate the render system and point light system
 		RenderSystem renderSystem{
 			lmDevice,
+			registry,
+			geometryArena,
+			pipelineRegistry,
 			lmRenderer.getSwapChainRenderPass(),
 			globalSetLayout->getDescriptorSetLayout()
 		};
+		renderSystem.setMode(RenderSystem::Mode::Indirect);
+		renderSystem.setCulling(RenderSystem::Culling::GPU);
+		renderSystem.setOcclusionCulling(lmRenderer.isDepthKept());
 
 		PointLightSystem pointLightSystem{
 			lmDevice,
+			registry,
+			pipelineRegistry,
 			lmRenderer.getSwapChainRenderPass(),
 			globalSetLayout->getDescriptorSetLayout()
 		};
@@ -87,14 +114,111 @@ namespace lm {
 		lmCamera camera{};
 		camera.setViewTarget(glm::vec3(-1.f, 2.f, 2.f), glm::vec3(0.f, 0.f, 2.5f)); // The second param corresponds to the center of the model
 
-		auto viewerObject = lmGameObject::createGameObject();
-		viewerObject.transform.translation.z = -2.5f;
+		TransformComponent viewerTransform{};
+		viewerTransform.translation.z = -2.5f;
 		KeyboardMovementController cameraController{};
 
 		// Initialize frame timing variables
 		float currentTime = static_cast<float>(glfwGetTime());
 		float lastTime = currentTime;
 		float frameTime = 0.0f;
+		float lastTimingLog = currentTime;
+
+		// Per-frame state shared with the scheduled systems
+		FrameInfo* currentFrame = nullptr;
+		GlobalUbo ubo{};
+
+		// Register the per-frame systems; systems that do not conflict on their declared access run in parallel
+		lmScheduler scheduler{ threadPool };
+
+		scheduler.addSystem(
+			"KeyboardMovementController",
+			lmSystemAccess{}.writeResource<lmCamera>().mainThread(),
+			[&]() {
+				// Handle camera movement input
+				cameraController.moveInPlaneXZ(lmWindow.getGLFWwindow(), currentFrame->frameTime, viewerTransform);
+				glm::vec3 eulerRotation = glm::eulerAngles(viewerTransform.rotation);
+				camera.setViewYXZ(viewerTransform.translation, eulerRotation);
+
+				// Update the projection matrix of the camera
+				float aspect = lmRenderer.getAspectRatio();
+				camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 10.f);
+			});
+
+		scheduler.addSystem(
+			"PointLightSystem::update",
+			lmSystemAccess{}.read<PointLightComponent>().write<TransformComponent>().writeResource<GlobalUbo>(),
+			[&]() { pointLightSystem.update(*currentFrame, ubo); });
+
+		scheduler.addSystem(
+			"GlobalUbo upload",
+			lmSystemAccess{}.readResource<lmCamera>().writeResource<GlobalUbo>(),
+			[&]() {
+				ubo.projection = camera.getProjection();
+				ubo.view = camera.getView();
+				ubo.inverseView = camera.getInverseView();
+				uboBuffers[currentFrame->frameIndex]->writeToBuffer(&ubo);
+				// uboBuffers[frameIndex]->flush(); // No need to do it manually since we added VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+			});
+
+		scheduler.addSystem(
+			"TransformHierarchy::update",
+			lmSystemAccess{}.write<TransformComponent>().writeResource<lmTransformHierarchy>(),
+			[&]() {
+				transformHierarchy.syncLocalMatrices(registry, &threadPool);
+				transformHierarchy.update(registry, &threadPool);
+			});
+
+		scheduler.addSystem(
+			"SpatialIndex::sync",
+			lmSystemAccess{}.read<TransformComponent>().read<BoundsComponent>().readResource<lmTransformHierarchy>().writeResource<lmSpatialIndex>(),
+			[&]() { spatialIndex.sync(registry, transformHierarchy, &threadPool); });
+
+		// Order matters: these record into the frame's command buffer, so they run in registration order
+		// The culling pass may dispatch compute work, so it is recorded before the render pass begins
+		scheduler.addSystem(
+			"RenderSystem::prepareFrame",
+			lmSystemAccess{}.write<TransformComponent>().read<ModelComponent>().readResource<lmTransformHierarchy>().readResource<lmCamera>().writeResource<VkCommandBuffer>(),
+			[&]() { renderSystem.prepareFrame(*currentFrame); });
+
+		scheduler.addSystem(
+			"Renderer::beginSwapChainRenderPass",
+			lmSystemAccess{}.writeResource<VkCommandBuffer>(),
+			[&]() { lmRenderer.beginSwapChainRenderPass(currentFrame->commandBuffer, currentFrame->subpassContents); });
+
+		scheduler.addSystem(
+			"RenderSystem::renderGameObjects",
+			lmSystemAccess{}.write<TransformComponent>().read<ModelComponent>().readResource<lmTransformHierarchy>().writeResource<VkCommandBuffer>(),
+			[&]() { renderSystem.renderGameObjects(*currentFrame); });
+
+		// A kept depth ends the render pass early, so the late occlusion phase can read it, and the
+		// resumed render pass presents. Without occlusion culling the late systems record nothing
+		if (lmRenderer.isDepthKept()) {
+			scheduler.addSystem(
+				"Renderer::endSwapChainRenderPass",
+				lmSystemAccess{}.writeResource<VkCommandBuffer>(),
+				[&]() { lmRenderer.endSwapChainRenderPass(currentFrame->commandBuffer); });
+
+			scheduler.addSystem(
+				"RenderSystem::cullLate",
+				lmSystemAccess{}.read<TransformComponent>().read<ModelComponent>().readResource<lmCamera>().writeResource<VkCommandBuffer>(),
+				[&]() { renderSystem.cullLate(*currentFrame); });
+
+			scheduler.addSystem(
+				"Renderer::resumeSwapChainRenderPass",
+				lmSystemAccess{}.writeResource<VkCommandBuffer>(),
+				[&]() { lmRenderer.resumeSwapChainRenderPass(currentFrame->commandBuffer, currentFrame->subpassContents); });
+
+			scheduler.addSystem(
+				"RenderSystem::renderLateGameObjects",
+				lmSystemAccess{}.read<TransformComponent>().read<ModelComponent>().writeResource<VkCommandBuffer>(),
+				[&]() { renderSystem.renderLateGameObjects(*currentFrame); });
+		}
+
+		scheduler.addSystem(
+			"PointLightSystem::render",
+			lmSystemAccess{}.read<TransformComponent>().read<PointLightComponent>().readResource<lmCamera>().readResource<lmSpatialIndex>().writeResource<VkCommandBuffer>(),
+			[&]() { pointLightSystem.render(*currentFrame); });
 
 		// Main loop of the application
 		while (!lmWindow.shouldClose()) {
@@ -108,47 +232,60 @@ namespace lm {
 			// Cap frame time to max frame time
 			frameTime = std::fmin(frameTime, MAX_FRAME_TIME);
 
-			// Handle camera movement input
-			cameraController.moveInPlaneXZ(lmWindow.getGLFWwindow(), static_cast<float>(frameTime), viewerObject);
-			glm::vec3 eulerRotation = glm::eulerAngles(viewerObject.transform.rotation);
-			camera.setViewYXZ(viewerObject.transform.translation, eulerRotation);
-
-			// Update the projection matrix of the camera
-			float aspect = lmRenderer.getAspectRatio();
-			camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 10.f);
+			// Uploads staged since the last frame are submitted ahead of it on the same queue
+			uploadQueue.submit();
+			uploadQueue.collect();
 
 			// Begin a new frame
 			if (auto commandBuffer = lmRenderer.beginFrame()) {
 				int frameIndex = lmRenderer.getFrameIndex();
 
+				// The frame's fence has signaled, so the geometry freed the last time this index was recorded is unused
+				geometryArena.beginFrame(static_cast<uint32_t>(frameIndex));
+
 				// Prepare frame info
 				FrameInfo frameInfo{
 					frameIndex,
 					frameTime,
 					commandBuffer,
+					lmRenderer.getSwapChainExtent(),
+					lmRenderer.isDepthKept() ? lmRenderer.getCurrentDepthImageView() : VK_NULL_HANDLE,
+					SUBPASS_CONTENTS,
+					lmRenderer,
 					camera,
 					globalDescriptorSets[frameIndex],
-					gameObjects
+					registry,
+					entityCommands,
+					transformHierarchy,
+					spatialIndex,
+					threadPool
 				};
 
-				// Update global uniform buffer object
-				GlobalUbo ubo{};
-				ubo.projection = camera.getProjection();
-				ubo.view = camera.getView();
-				ubo.inverseView = camera.getInverseView();
-				pointLightSystem.update(frameInfo, ubo);
-				uboBuffers[frameIndex]->writeToBuffer(&ubo);
-				// uboBuffers[frameIndex]->flush(); // No need to do it manually since we added VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-
-				// Render
-				lmRenderer.beginSwapChainRenderPass(commandBuffer);
-
-				// Order matters
-				renderSystem.renderGameObjects(frameInfo);
-				pointLightSystem.render(frameInfo);
+				// Update and render the frame
+				ubo = GlobalUbo{};
+				currentFrame = &frameInfo;
 
+				// The render pass is begun by a scheduled system, after the compute work of the frame
+				scheduler.run();
 				lmRenderer.endSwapChainRenderPass(commandBuffer);
 				lmRenderer.endFrame();
+
+				// Sync point: close the change tracking frame, then apply the structural changes recorded
+				// by the systems so that they show up in the next frame's changed lists
+				registry.nextFrame();
+				entityCommands.apply(registry);
+
+				currentFrame = nullptr;
+			}
+
+			if (currentTime - lastTimingLog >= TIMING_LOG_INTERVAL) {
+				scheduler.logTimings();
+				LOG_INFO("{} culling ({}): {} visible, {} culled",
+					renderSystem.isOcclusionCullingEnabled() ? "Frustum and occlusion" : "Frustum",
+					renderSystem.getCulling() == RenderSystem::Culling::GPU ? "GPU" : getCullingKernelName(getBestCullingKernel()),
+					renderSystem.getLastVisibleCount(),
+					renderSystem.getLastCulledCount());
+				lastTimingLog = currentTime;
 			}
 		}
 
@@ -157,30 +294,69 @@ namespace lm {
 	}
 	
 	void App::loadGameObjects() {
+		const auto start = std::chrono::high_resolution_clock::now();
+		auto elapsedMilliseconds = [&start]() {
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+
+		const std::string snapshotPath = std::string(MODEL_DIRECTORY) + SCENE_SNAPSHOT_FILE;
+		const uint64_t sourceKey = lmSceneSnapshot::computeSourceKey({
+			std::string(MODEL_DIRECTORY) + "smooth_vase.obj",
+			std::string(MODEL_DIRECTORY) + "floor.obj" });
+
+		// Restore the scene from the snapshot of a previous launch when the models did not change
+		if (lmSceneSnapshot::load(snapshotPath, sourceKey, geometryArena, registry, transformHierarchy)) {
+			LOG_INFO("Scene restored from snapshot in {:.2f} ms", elapsedMilliseconds());
+			geometryArena.logStats();
+			return;
+		}
+
+		if (!importGameObjects()) {
+			importedModelData.clear();
+			return;
+		}
+		LOG_INFO("Scene imported with Assimp in {:.2f} ms", elapsedMilliseconds());
+		geometryArena.logStats();
+
+		lmSceneSnapshot::save(snapshotPath, sourceKey, registry, transformHierarchy, [this](const lmModel* model) {
+			auto it = importedModelData.find(model);
+			return it != importedModelData.end() ? &it->second : nullptr;
+		});
+		importedModelData.clear();
+	}
+
+	bool App::importGameObjects() {
 		// Load the vase model using Assimp
 		const std::string modelPath = std::string(MODEL_DIRECTORY) + "smooth_vase.obj";
 		const aiScene* scene = assimpImporter->ReadFile(modelPath, aiProcess_Triangulate | aiProcess_GenNormals);
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 			LOG_ERROR("Failed to load model: {}", assimpImporter->GetErrorString());
-			return;
+			return false;
 		}
 
 		// Extract the directory path from the model path
 		std::string modelDirectory = modelPath.substr(0, modelPath.find_last_of('/'));
 
-		// Process the scene and create game objects
-		processAiNode(scene->mRootNode, scene, modelDirectory, glm::vec3(2.5f), glm::vec3(0.f, 0.5f, 0.f));
+		// Process the scene and create game objects under a root placing the whole model
+		auto vase = lmGameObject::createGameObject(registry);
+		registry.get<TransformComponent>(vase).setScale(glm::vec3(2.5f));
+		registry.get<TransformComponent>(vase).setTranslation(glm::vec3(0.f, 0.5f, 0.f));
+		transformHierarchy.add(vase);
+		processAiNode(scene->mRootNode, scene, modelDirectory, vase);
 
 		// Load the floor model using Assimp
 		const std::string floorModelPath = std::string(MODEL_DIRECTORY) + "floor.obj";
 		const aiScene* floorScene = assimpImporter->ReadFile(floorModelPath, aiProcess_Triangulate | aiProcess_GenNormals);
 		if (!floorScene || floorScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !floorScene->mRootNode) {
 			LOG_ERROR("Failed to load model: {}", assimpImporter->GetErrorString());
-			return;
+			return false;
 		}
 
-		// Process the scene and create game objects
-		processAiNode(floorScene->mRootNode, floorScene, modelDirectory, glm::vec3(1.f), glm::vec3(0.f, 0.5f, 0.f));
+		// Process the scene and create game objects under a root placing the whole model
+		auto floor = lmGameObject::createGameObject(registry);
+		registry.get<TransformComponent>(floor).setTranslation(glm::vec3(0.f, 0.5f, 0.f));
+		transformHierarchy.add(floor);
+		processAiNode(floorScene->mRootNode, floorScene, modelDirectory, floor);
 
 		std::vector<glm::vec3> lightColors{
 			{1.f, .1f, .1f},
@@ -192,15 +368,16 @@ namespace lm {
 		};
 
 		for (int i = 0; i < lightColors.size(); i++) {
-			auto pointLight = lmGameObject::makePointLight(0.2f);
-			pointLight.color = lightColors[i];
+			auto pointLight = lmGameObject::makePointLight(registry, 0.2f);
+			registry.get<PointLightComponent>(pointLight).color = lightColors[i];
 			auto rotateLight = glm::rotate(
 				glm::mat4(1.f),
 				(i * glm::two_pi<float>()) / lightColors.size(),
 				{ 0.f, -1.f, 0.f });
-			pointLight.transform.translation = glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
-			gameObjects.emplace(pointLight.getID(), std::move(pointLight));
+			registry.get<TransformComponent>(pointLight).translation = glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
 		}
+
+		return true;
 	}
 	
 	lmModel::Data App::processAiMesh(aiMesh* mesh, const aiScene* scene, const std::string& modelDirectory) {
@@ -241,23 +418,40 @@ namespace lm {
 		return modelData;
 	}
 	
-	void App::processAiNode(aiNode* node, const aiScene* scene, const std::string& modelDirectory, const glm::vec3& scale, const glm::vec3& position) {
-		// Process meshes in the current node
+	void App::processAiNode(aiNode* node, const aiScene* scene, const std::string& modelDirectory, lmEntity parent) {
+		// Create the entity of the node, placed relative to its parent by the node's own transformation
+		auto nodeObject = lmGameObject::createGameObject(registry);
+		transformHierarchy.add(nodeObject, parent);
+
+		aiVector3D scaling;
+		aiQuaternion rotation;
+		aiVector3D position;
+		node->mTransformation.Decompose(scaling, rotation, position);
+
+		auto& nodeTransform = registry.get<TransformComponent>(nodeObject);
+		nodeTransform.setScale({ scaling.x, scaling.y, scaling.z });
+		nodeTransform.setRotation(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z));
+		nodeTransform.setTranslation({ position.x, position.y, position.z });
+
+		// Process meshes in the current node, each one is a child entity at the node's origin
 		for (uint32_t i = 0; i < node->mNumMeshes; ++i) {
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 			lmModel::Data modelData = processAiMesh(mesh, scene, modelDirectory);
-			auto modelInstance = std::make_shared<lmModel>(lmDevice, modelData);
 
-			auto gameObject = lmGameObject::createGameObject();
-			gameObject.model = modelInstance;
-			gameObject.transform.setScale(scale);
-			gameObject.transform.setTranslation(position);
-			gameObjects.emplace(gameObject.getID(), std::move(gameObject));
+			auto modelInstance = std::make_shared<lmModel>(geometryArena, modelData);
+
+			// Keep the geometry until the scene snapshot has been written
+			importedModelData.emplace(modelInstance.get(), std::move(modelData));
+
+			auto gameObject = lmGameObject::createGameObject(registry);
+			registry.add<ModelComponent>(gameObject, ModelComponent{ modelInstance });
+			registry.add<BoundsComponent>(gameObject, BoundsComponent{ modelInstance->getBoundingBox(), SPATIAL_LAYER_MODELS });
+			transformHierarchy.add(gameObject, nodeObject);
 		}
 
 		// Process child nodes recursively
 		for (uint32_t i = 0; i < node->mNumChildren; ++i) {
-			processAiNode(node->mChildren[i], scene, modelDirectory, scale, position);
+			processAiNode(node->mChildren[i], scene, modelDirectory, nodeObject);
 		}
 	}
 
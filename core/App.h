@@ -2,10 +2,18 @@
 
 #include "Window.h"
 #include "Utils.h"
+#include "ThreadPool.h"
 #include "../render/Device.h"
 #include "../render/Renderer.h"
 #include "../ecs/GameObject.h"
+#include "../ecs/EntityCommandBuffer.h"
+#include "../ecs/TransformHierarchy.h"
+#include "../ecs/SpatialIndex.h"
 #include "../render/Model.h"
+#include "../render/GeometryArena.h"
+#include "../render/UploadQueue.h"
+#include "../render/ShaderLibrary.h"
+#include "../render/PipelineRegistry.h"
 #include "../render/Descriptors.h"
 
 #include <assimp/Importer.hpp>
@@ -13,6 +21,7 @@
 #include <assimp/postprocess.h>
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace lm {
@@ -60,6 +69,7 @@ namespace lm {
 
     private:
         void loadGameObjects();
+        bool importGameObjects();
 
         lmModel::Data processAiMesh(
 			aiMesh* mesh,
@@ -70,18 +80,33 @@ namespace lm {
 			aiNode* node,
 			const aiScene* scene,
 			const std::string& modelDirectory,
-			const glm::vec3& scale,
-			const glm::vec3& position);
+			lmEntity parent);
 
         lmWindow lmWindow{ WIDTH, HEIGHT, "Little Maya Engine" };
         lmDevice lmDevice{ lmWindow };
-        lmRenderer lmRenderer{ lmWindow, lmDevice };
+        lmThreadPool threadPool{};
+        // The depth is kept for occlusion culling when the device can build a depth pyramid, and every
+        // thread of the pool may record secondary command buffers
+        lmRenderer lmRenderer{ lmWindow, lmDevice, lmDevice.hasStorageImageExtendedFormats(), threadPool.getThreadCount() };
+        // Compiles the pipelines of the systems on its own thread, from shader modules shared by all of them
+        lmShaderLibrary shaderLibrary{ lmDevice };
+        lmPipelineRegistry pipelineRegistry{ lmDevice, shaderLibrary };
 
         // NOTE: order of declarations matter
         std::unique_ptr<lmDescriptorPool> globalPool{};
 
-        lmGameObject::Map gameObjects;
+        // Declared before the registry so every model is destroyed before the buffer holding its geometry
+        lmUploadQueue uploadQueue{ lmDevice };
+        lmGeometryArena geometryArena{ lmDevice, uploadQueue };
+
+        lmRegistry registry;
+        lmEntityCommandQueue entityCommands{ threadPool.getThreadCount() };
+        lmTransformHierarchy transformHierarchy;
+        lmSpatialIndex spatialIndex;
         std::unique_ptr<Assimp::Importer> assimpImporter;
+
+        // Geometry of the models created by the last import, kept for the scene snapshot
+        std::unordered_map<const lmModel*, lmModel::Data> importedModelData;
     };
 
 } // namespace lm
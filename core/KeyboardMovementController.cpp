@@ -3,7 +3,7 @@
 namespace lm {
 
 	void KeyboardMovementController::moveInPlaneXZ(
-		GLFWwindow* window, float deltaTime, lmGameObject& gameObject) {
+		GLFWwindow* window, float deltaTime, TransformComponent& transform) {
 
 		glm::vec3 rotate{ 0 };
 
@@ -20,11 +20,11 @@ namespace lm {
 			glm::quat rotationDelta = glm::angleAxis(glm::length(rotate) * deltaTime * lookSpeed, rotate);
 
 			// Apply rotation
-			gameObject.transform.rotation = rotationDelta * gameObject.transform.rotation;
+			transform.rotation = rotationDelta * transform.rotation;
 		}
 
 		// Retrieve rotation matrix from current rotation quaternion
-		glm::mat3 rotationMatrix = glm::mat3_cast(gameObject.transform.rotation);
+		glm::mat3 rotationMatrix = glm::mat3_cast(transform.rotation);
 
 		// Set forward, right and up directions based on rotation matrix
 		const glm::vec3 forwardDir = rotationMatrix * glm::vec3(0.0f, 0.0f, -1.0f);
@@ -40,9 +40,9 @@ namespace lm {
 		if (glfwGetKey(window, keys.moveUp) == GLFW_PRESS) moveDir -= upDir;
 		if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS) moveDir += upDir;
 
-		// Here, you would apply moveDir to your game object's position
+		// Here, you would apply moveDir to the transform's position
 		if (glm::dot(moveDir, moveDir) > std::numeric_limits<float>::epsilon()) {
-			gameObject.transform.translation += moveSpeed * deltaTime * glm::normalize(moveDir);
+			transform.translation += moveSpeed * deltaTime * glm::normalize(moveDir);
 		}
 	}
 
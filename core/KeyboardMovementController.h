@@ -21,7 +21,7 @@ namespace lm {
             int escape = GLFW_KEY_ESCAPE;
         };
 
-        void moveInPlaneXZ(GLFWwindow* window, float deltaTime, lmGameObject& gameObject);
+        void moveInPlaneXZ(GLFWwindow* window, float deltaTime, TransformComponent& transform);
 
         KeyMappings keys{};
         float moveSpeed{ 3.f };
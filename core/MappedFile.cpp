@@ -0,0 +1,154 @@
+/**
+ * @file MappedFile.cpp
+ * @brief Read-only file mappings on Windows and POSIX systems.
+ */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+namespace lm {
+
+	/**
+	 * @brief Maps a file, check isOpen() for success.
+	 * @param path The file to map.
+	 */
+	lmMappedFile::lmMappedFile(const std::string& path) {
+		open(path);
+	}
+
+	/**
+	 * @brief Unmaps the file.
+	 */
+	lmMappedFile::~lmMappedFile() {
+		close();
+	}
+
+	/**
+	 * @brief Move constructor, takes over the mapping of the other file.
+	 * @param other The mapping to move from.
+	 */
+	lmMappedFile::lmMappedFile(lmMappedFile&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	/**
+	 * @brief Move assignment, releases the current mapping and takes over the other one.
+	 * @param other The mapping to move from.
+	 * @return This mapping.
+	 */
+	lmMappedFile& lmMappedFile::operator=(lmMappedFile&& other) noexcept {
+		if (this != &other) {
+			close();
+			std::swap(mapping, other.mapping);
+			std::swap(mappedSize, other.mappedSize);
+#ifdef _WIN32
+			std::swap(fileHandle, other.fileHandle);
+			std::swap(mappingHandle, other.mappingHandle);
+#endif
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief Maps a whole file read-only, replacing any previous mapping.
+	 * @param path The file to map.
+	 * @return True if the file exists, is not empty and could be mapped.
+	 */
+	bool lmMappedFile::open(const std::string& path) {
+		close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!fileMapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			CloseHandle(fileMapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		fileHandle = file;
+		mappingHandle = fileMapping;
+		mapping = view;
+		mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+		const int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+
+		struct stat fileStat {};
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+			::close(file);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		// The mapping keeps its own reference to the file
+		::close(file);
+
+		if (view == MAP_FAILED) {
+			return false;
+		}
+
+		mapping = view;
+		mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+		return true;
+	}
+
+	/**
+	 * @brief Releases the mapping, does nothing if no file is mapped.
+	 */
+	void lmMappedFile::close() {
+		if (!mapping) {
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+		CloseHandle(static_cast<HANDLE>(mappingHandle));
+		CloseHandle(static_cast<HANDLE>(fileHandle));
+		fileHandle = nullptr;
+		mappingHandle = nullptr;
+#else
+		munmap(mapping, mappedSize);
+#endif
+
+		mapping = nullptr;
+		mappedSize = 0;
+	}
+
+} // namespace lm
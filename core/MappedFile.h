@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace lm {
+
+	// Read-only memory mapping of a whole file
+	class lmMappedFile {
+	public:
+		lmMappedFile() = default;
+		explicit lmMappedFile(const std::string& path);
+		~lmMappedFile();
+
+		lmMappedFile(const lmMappedFile&) = delete;
+		lmMappedFile& operator = (const lmMappedFile&) = delete;
+		lmMappedFile(lmMappedFile&& other) noexcept;
+		lmMappedFile& operator = (lmMappedFile&& other) noexcept;
+
+		bool open(const std::string& path);
+		void close();
+
+		bool isOpen() const { return mapping != nullptr; }
+		const std::byte* data() const { return static_cast<const std::byte*>(mapping); }
+		size_t size() const { return mappedSize; }
+
+	private:
+		void* mapping = nullptr;
+		size_t mappedSize = 0;
+
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+
+} // namespace lm
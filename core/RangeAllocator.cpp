@@ -0,0 +1,139 @@
+/**
+ * @file RangeAllocator.cpp
+ * @brief First fit range suballocation with free block coalescing.
+ */
+
+#include "RangeAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace lm {
+
+	/**
+	 * @brief Creates an allocator whose whole space is free.
+	 * @param initialCapacity The number of elements in the space.
+	 */
+	lmRangeAllocator::lmRangeAllocator(uint32_t initialCapacity) {
+		reset(initialCapacity);
+	}
+
+	/**
+	 * @brief Allocates a range from the first free block large enough.
+	 * @param count The number of elements, must not be 0.
+	 * @return The offset of the range, or INVALID_OFFSET if the space is too full or fragmented.
+	 */
+	uint32_t lmRangeAllocator::allocate(uint32_t count) {
+		assert(count > 0 && "Cannot allocate an empty range");
+
+		for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+			if (it->second < count) {
+				continue;
+			}
+
+			const uint32_t offset = it->first;
+			const uint32_t remaining = it->second - count;
+			freeBlocks.erase(it);
+			if (remaining > 0) {
+				freeBlocks.emplace(offset + count, remaining);
+			}
+
+			used += count;
+			return offset;
+		}
+
+		return INVALID_OFFSET;
+	}
+
+	/**
+	 * @brief Releases a range, merging it with the adjacent free blocks.
+	 * @param offset The offset returned by allocate().
+	 * @param count The count passed to allocate().
+	 */
+	void lmRangeAllocator::free(uint32_t offset, uint32_t count) {
+		assert(count > 0 && offset + count <= capacity && "Range is outside of the allocator");
+
+		uint32_t blockOffset = offset;
+		uint32_t blockSize = count;
+
+		auto next = freeBlocks.lower_bound(offset);
+		assert((next == freeBlocks.end() || next->first >= offset + count) && "Range overlaps a free block");
+
+		if (next != freeBlocks.begin()) {
+			auto previous = std::prev(next);
+			assert(previous->first + previous->second <= offset && "Range overlaps a free block");
+			if (previous->first + previous->second == offset) {
+				blockOffset = previous->first;
+				blockSize += previous->second;
+				freeBlocks.erase(previous);
+			}
+		}
+
+		if (next != freeBlocks.end() && next->first == offset + count) {
+			blockSize += next->second;
+			freeBlocks.erase(next);
+		}
+
+		freeBlocks.emplace(blockOffset, blockSize);
+		used -= count;
+	}
+
+	/**
+	 * @brief Extends the space, the added elements join the last free block when it ends at the old capacity.
+	 * @param newCapacity The new number of elements, must not be smaller than the current one.
+	 */
+	void lmRangeAllocator::grow(uint32_t newCapacity) {
+		assert(newCapacity >= capacity && "Cannot shrink a range allocator");
+		if (newCapacity == capacity) {
+			return;
+		}
+
+		const uint32_t oldCapacity = capacity;
+		capacity = newCapacity;
+		used += newCapacity - oldCapacity;
+		free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	/**
+	 * @brief Frees everything and marks a prefix of the space as allocated.
+	 * @param newCapacity The number of elements in the space.
+	 * @param usedCount The number of leading elements that are in use, e.g. after compacting.
+	 */
+	void lmRangeAllocator::reset(uint32_t newCapacity, uint32_t usedCount) {
+		assert(usedCount <= newCapacity && "Used range exceeds the capacity");
+
+		capacity = newCapacity;
+		used = usedCount;
+		freeBlocks.clear();
+		if (usedCount < newCapacity) {
+			freeBlocks.emplace(usedCount, newCapacity - usedCount);
+		}
+	}
+
+	/**
+	 * @brief Retrieves the size of the largest free block.
+	 * @return The largest count a single allocate() can currently satisfy.
+	 */
+	uint32_t lmRangeAllocator::getLargestFreeBlock() const {
+		uint32_t largest = 0;
+		for (const auto& [offset, size] : freeBlocks) {
+			largest = std::max(largest, size);
+		}
+		return largest;
+	}
+
+	/**
+	 * @brief Measures how scattered the free space is.
+	 * @return 1 - largest free block / total free space, 0 when nothing is free.
+	 */
+	float lmRangeAllocator::getFragmentation() const {
+		const uint32_t freeCount = capacity - used;
+		if (freeCount == 0) {
+			return 0.f;
+		}
+
+		return 1.f - static_cast<float>(getLargestFreeBlock()) / static_cast<float>(freeCount);
+	}
+
+} // namespace lm
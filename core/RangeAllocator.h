@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+
+namespace lm {
+
+	/*
+	* First fit allocator of [offset, offset + count) ranges in a linear space of capacity elements.
+	*
+	* Only bookkeeping: the owner maps offsets to actual storage. Free ranges are kept sorted by offset
+	* and merged with their neighbours when released, so the free list stays as short as the holes.
+	*/
+	class lmRangeAllocator {
+	public:
+		static constexpr uint32_t INVALID_OFFSET = std::numeric_limits<uint32_t>::max();
+
+		explicit lmRangeAllocator(uint32_t initialCapacity = 0);
+
+		// Returns INVALID_OFFSET when no free range is large enough
+		uint32_t allocate(uint32_t count);
+		void free(uint32_t offset, uint32_t count);
+
+		// Extends the space, the new elements are free
+		void grow(uint32_t newCapacity);
+
+		// Frees everything, then marks [0, usedCount) as allocated
+		void reset(uint32_t newCapacity, uint32_t usedCount = 0);
+
+		uint32_t getCapacity() const { return capacity; }
+		uint32_t getUsed() const { return used; }
+		uint32_t getFreeBlockCount() const { return static_cast<uint32_t>(freeBlocks.size()); }
+		uint32_t getLargestFreeBlock() const;
+
+		// 0 when all free space is one block, approaching 1 as it splits into many small holes
+		float getFragmentation() const;
+
+	private:
+		uint32_t capacity = 0;
+		uint32_t used = 0;
+
+		// Offset to size of every free range
+		std::map<uint32_t, uint32_t> freeBlocks;
+	};
+
+} // namespace lm
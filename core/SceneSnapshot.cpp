@@ -0,0 +1,351 @@
+/**
+ * @file SceneSnapshot.cpp
+ * @brief Writing and memory-mapped loading of binary scene snapshots.
+ */
+
+#include "SceneSnapshot.h"
+#include "SnapshotFormat.h"
+#include "MappedFile.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+namespace lm {
+
+	namespace {
+
+		static_assert(std::is_trivially_copyable_v<lmModel::Vertex>, "Snapshot vertices are copied as raw bytes");
+
+		void writePadding(std::ofstream& out, uint64_t target) {
+			static constexpr char zeros[SNAPSHOT_SECTION_ALIGNMENT] = {};
+			const uint64_t position = static_cast<uint64_t>(out.tellp());
+			out.write(zeros, static_cast<std::streamsize>(target - position));
+		}
+
+		template <typename T>
+		void writeArray(std::ofstream& out, uint64_t offset, const T* data, size_t count) {
+			writePadding(out, offset);
+			out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+		}
+
+	} // namespace
+
+	/**
+	 * @brief Writes the scene stored in the registry to a snapshot file.
+	 *
+	 * Every entity owning a TransformComponent is written, sorted by hierarchy depth. The file is
+	 * written next to the target and renamed over it once complete.
+	 *
+	 * @param path The snapshot file.
+	 * @param sourceKey The key of the imported files, see computeSourceKey.
+	 * @param registry The registry holding the scene.
+	 * @param hierarchy The hierarchy holding the parent relationships.
+	 * @param modelDataLookup Provides the geometry of every referenced model.
+	 * @return True if the snapshot was written.
+	 */
+	bool lmSceneSnapshot::save(
+		const std::string& path,
+		uint64_t sourceKey,
+		lmRegistry& registry,
+		const lmTransformHierarchy& hierarchy,
+		const ModelDataLookup& modelDataLookup) {
+
+		// Gather the entities with their depth so that parents are written before their children
+		std::vector<std::pair<uint32_t, lmEntity>> ordered;
+		registry.view<TransformComponent>().each([&](lmEntity entity, TransformComponent&) {
+			uint32_t depth = 0;
+			for (lmEntity parent = hierarchy.getParent(entity); !parent.isNull(); parent = hierarchy.getParent(parent)) {
+				depth++;
+			}
+			ordered.emplace_back(depth, entity);
+		});
+		std::stable_sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		std::unordered_map<lmEntity, uint32_t> entityIndices;
+		for (uint32_t i = 0; i < ordered.size(); i++) {
+			entityIndices.emplace(ordered[i].second, i);
+		}
+
+		std::vector<SnapshotEntity> entities;
+		std::vector<SnapshotModel> models;
+		std::vector<const lmModel::Data*> modelData;
+		std::unordered_map<const lmModel*, uint32_t> modelIndices;
+		uint64_t vertexCount = 0;
+		uint64_t indexCount = 0;
+
+		entities.reserve(ordered.size());
+		for (const auto& [depth, entity] : ordered) {
+			const TransformComponent& transform = registry.get<TransformComponent>(entity);
+
+			SnapshotEntity record{};
+			record.parent = SNAPSHOT_NO_INDEX;
+			record.model = SNAPSHOT_NO_INDEX;
+			std::memcpy(record.translation, &transform.translation[0], sizeof(record.translation));
+			record.rotation[0] = transform.rotation.x;
+			record.rotation[1] = transform.rotation.y;
+			record.rotation[2] = transform.rotation.z;
+			record.rotation[3] = transform.rotation.w;
+			std::memcpy(record.scale, &transform.scale[0], sizeof(record.scale));
+
+			if (hierarchy.contains(entity)) {
+				record.flags |= SNAPSHOT_ENTITY_IN_HIERARCHY;
+				const lmEntity parent = hierarchy.getParent(entity);
+				if (!parent.isNull()) {
+					record.parent = entityIndices.at(parent);
+				}
+			}
+
+			if (const PointLightComponent* pointLight = registry.tryGet<PointLightComponent>(entity)) {
+				record.flags |= SNAPSHOT_ENTITY_POINT_LIGHT;
+				record.lightIntensity = pointLight->lightIntensity;
+				std::memcpy(record.lightColor, &pointLight->color[0], sizeof(record.lightColor));
+			}
+
+			if (const ModelComponent* modelComponent = registry.tryGet<ModelComponent>(entity); modelComponent && modelComponent->model) {
+				const lmModel* model = modelComponent->model.get();
+				auto it = modelIndices.find(model);
+
+				if (it == modelIndices.end()) {
+					const lmModel::Data* data = modelDataLookup(model);
+					if (!data) {
+						LOG_WARN("Scene snapshot not written: no geometry available for a referenced model");
+						return false;
+					}
+
+					SnapshotModel snapshotModel{};
+					snapshotModel.firstVertex = vertexCount;
+					snapshotModel.firstIndex = indexCount;
+					snapshotModel.vertexCount = static_cast<uint32_t>(data->vertices.size());
+					snapshotModel.indexCount = static_cast<uint32_t>(data->indices.size());
+					vertexCount += data->vertices.size();
+					indexCount += data->indices.size();
+
+					it = modelIndices.emplace(model, static_cast<uint32_t>(models.size())).first;
+					models.push_back(snapshotModel);
+					modelData.push_back(data);
+				}
+
+				record.model = it->second;
+			}
+
+			entities.push_back(record);
+		}
+
+		SnapshotHeader header{};
+		std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.version = VERSION;
+		header.vertexSize = sizeof(lmModel::Vertex);
+		header.sourceKey = sourceKey;
+		header.modelCount = static_cast<uint32_t>(models.size());
+		header.entityCount = static_cast<uint32_t>(entities.size());
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.modelsOffset = alignSnapshotSection(sizeof(SnapshotHeader));
+		header.verticesOffset = alignSnapshotSection(header.modelsOffset + models.size() * sizeof(SnapshotModel));
+		header.indicesOffset = alignSnapshotSection(header.verticesOffset + vertexCount * sizeof(lmModel::Vertex));
+		header.entitiesOffset = alignSnapshotSection(header.indicesOffset + indexCount * sizeof(uint32_t));
+		header.fileSize = header.entitiesOffset + entities.size() * sizeof(SnapshotEntity);
+
+		const std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				LOG_WARN("Scene snapshot not written: cannot open {}", temporaryPath);
+				return false;
+			}
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			writeArray(out, header.modelsOffset, models.data(), models.size());
+
+			writePadding(out, header.verticesOffset);
+			for (const lmModel::Data* data : modelData) {
+				out.write(reinterpret_cast<const char*>(data->vertices.data()),
+					static_cast<std::streamsize>(data->vertices.size() * sizeof(lmModel::Vertex)));
+			}
+
+			writePadding(out, header.indicesOffset);
+			for (const lmModel::Data* data : modelData) {
+				out.write(reinterpret_cast<const char*>(data->indices.data()),
+					static_cast<std::streamsize>(data->indices.size() * sizeof(uint32_t)));
+			}
+
+			writeArray(out, header.entitiesOffset, entities.data(), entities.size());
+
+			if (!out) {
+				LOG_WARN("Scene snapshot not written: write to {} failed", temporaryPath);
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error) {
+			LOG_WARN("Scene snapshot not written: {}", error.message());
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+
+		LOG_INFO("Scene snapshot written to {} ({} entities, {} models, {} bytes)", path, entities.size(), models.size(), header.fileSize);
+		return true;
+	}
+
+	/**
+	 * @brief Restores a scene from a snapshot file.
+	 * @param path The snapshot file.
+	 * @param sourceKey The key of the files the scene would otherwise be imported from.
+	 * @param geometryArena The arena receiving the geometry of the models.
+	 * @param registry The registry receiving the entities.
+	 * @param hierarchy The hierarchy receiving the parent relationships.
+	 * @return True if the scene was restored.
+	 */
+	bool lmSceneSnapshot::load(
+		const std::string& path,
+		uint64_t sourceKey,
+		lmGeometryArena& geometryArena,
+		lmRegistry& registry,
+		lmTransformHierarchy& hierarchy) {
+
+		lmMappedFile file{ path };
+		if (!file.isOpen()) {
+			return false;
+		}
+
+		// Validate every reference before touching the registry
+		SnapshotSections sections;
+		std::string reason;
+		switch (checkSnapshot(file.data(), file.size(), VERSION, sizeof(lmModel::Vertex), sourceKey, sections, reason)) {
+		case SnapshotCheck::Valid:
+			break;
+		case SnapshotCheck::Mismatch:
+			LOG_INFO("Ignoring scene snapshot {}: {}", path, reason);
+			return false;
+		case SnapshotCheck::Corrupted:
+			LOG_WARN("Ignoring scene snapshot {}: {}", path, reason);
+			return false;
+		}
+
+		// The mapping is page aligned, so the records can be read in place
+		const SnapshotHeader& header = sections.header;
+		const SnapshotModel* models = sections.models;
+		const auto* vertices = reinterpret_cast<const lmModel::Vertex*>(sections.vertices);
+		const uint32_t* indices = sections.indices;
+		const SnapshotEntity* entities = sections.entities;
+
+		std::vector<std::shared_ptr<lmModel>> restoredModels;
+		restoredModels.reserve(header.modelCount);
+
+		lmModel::Data data;
+		for (uint32_t i = 0; i < header.modelCount; i++) {
+			const SnapshotModel& model = models[i];
+			data.vertices.assign(vertices + model.firstVertex, vertices + model.firstVertex + model.vertexCount);
+			data.indices.assign(indices + model.firstIndex, indices + model.firstIndex + model.indexCount);
+			restoredModels.push_back(std::make_shared<lmModel>(geometryArena, data));
+		}
+
+		// Entities with the same components are created in one batch, straight into their archetype
+		constexpr uint32_t WITH_MODEL = 1;
+		constexpr uint32_t WITH_LIGHT = 2;
+		std::array<std::vector<uint32_t>, 4> recordsByLayout;
+		for (uint32_t i = 0; i < header.entityCount; i++) {
+			const uint32_t layout = (entities[i].model != SNAPSHOT_NO_INDEX ? WITH_MODEL : 0)
+				| ((entities[i].flags & SNAPSHOT_ENTITY_POINT_LIGHT) ? WITH_LIGHT : 0);
+			recordsByLayout[layout].push_back(i);
+		}
+
+		std::vector<lmEntity> restoredEntities(header.entityCount);
+		std::vector<lmEntity> batch;
+		for (uint32_t layout = 0; layout < recordsByLayout.size(); layout++) {
+			const std::vector<uint32_t>& layoutRecords = recordsByLayout[layout];
+			if (layoutRecords.empty()) {
+				continue;
+			}
+
+			batch.clear();
+			switch (layout) {
+			case 0:
+				registry.createBatch<TransformComponent>(layoutRecords.size(), batch);
+				break;
+			case WITH_MODEL:
+				registry.createBatch<TransformComponent, ModelComponent, BoundsComponent>(layoutRecords.size(), batch);
+				break;
+			case WITH_LIGHT:
+				registry.createBatch<TransformComponent, PointLightComponent, BoundsComponent>(layoutRecords.size(), batch);
+				break;
+			default:
+				registry.createBatch<TransformComponent, ModelComponent, PointLightComponent, BoundsComponent>(layoutRecords.size(), batch);
+				break;
+			}
+
+			for (size_t i = 0; i < layoutRecords.size(); i++) {
+				restoredEntities[layoutRecords[i]] = batch[i];
+			}
+		}
+
+		// Filled in file order, which puts every parent in the hierarchy before its children
+		for (uint32_t i = 0; i < header.entityCount; i++) {
+			const SnapshotEntity& record = entities[i];
+			const lmEntity entity = restoredEntities[i];
+
+			if (record.model != SNAPSHOT_NO_INDEX) {
+				registry.get<ModelComponent>(entity).model = restoredModels[record.model];
+				registry.get<BoundsComponent>(entity) = BoundsComponent{ restoredModels[record.model]->getBoundingBox(), SPATIAL_LAYER_MODELS };
+			}
+
+			// A light's bounds take precedence over its model's
+			if (record.flags & SNAPSHOT_ENTITY_POINT_LIGHT) {
+				auto& pointLight = registry.get<PointLightComponent>(entity);
+				pointLight.lightIntensity = record.lightIntensity;
+				pointLight.color = glm::vec3(record.lightColor[0], record.lightColor[1], record.lightColor[2]);
+				registry.get<BoundsComponent>(entity) = BoundsComponent{ lmAabb{ glm::vec3(-1.f), glm::vec3(1.f) }, SPATIAL_LAYER_LIGHTS };
+			}
+
+			auto& transform = registry.get<TransformComponent>(entity);
+			transform.setTranslation(glm::vec3(record.translation[0], record.translation[1], record.translation[2]));
+			transform.setRotation(glm::quat(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]));
+			transform.setScale(glm::vec3(record.scale[0], record.scale[1], record.scale[2]));
+
+			if (record.flags & SNAPSHOT_ENTITY_IN_HIERARCHY) {
+				hierarchy.add(entity, record.parent == SNAPSHOT_NO_INDEX ? NULL_ENTITY : restoredEntities[record.parent]);
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Computes the key identifying the state of the files a scene is imported from.
+	 * @param sourcePaths The imported files.
+	 * @return FNV-1a hash of the snapshot version and each path, size and modification time.
+	 */
+	uint64_t lmSceneSnapshot::computeSourceKey(const std::vector<std::string>& sourcePaths) {
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&hash](const void* data, size_t size) {
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+
+		mix(&VERSION, sizeof(VERSION));
+
+		for (const std::string& sourcePath : sourcePaths) {
+			mix(sourcePath.data(), sourcePath.size());
+
+			std::error_code error;
+			const uint64_t size = static_cast<uint64_t>(std::filesystem::file_size(sourcePath, error));
+			const int64_t modified = static_cast<int64_t>(std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count());
+			mix(&size, sizeof(size));
+			mix(&modified, sizeof(modified));
+		}
+
+		return hash;
+	}
+
+} // namespace lm
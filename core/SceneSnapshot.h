@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../ecs/GameObject.h"
+#include "../ecs/TransformHierarchy.h"
+#include "../render/GeometryArena.h"
+#include "../render/Model.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lm {
+
+	/*
+	* Versioned binary snapshot of the scene: model geometry, entities with their transforms,
+	* hierarchy parents, point lights and model references.
+	*
+	* The file is a header followed by 16-byte aligned sections (models, vertices, indices, entities)
+	* laid out exactly as they are read, so loading maps the file and restores the world with one
+	* bulk copy per model and one pass over the entity records. A snapshot is rejected when its
+	* version, vertex layout or source key (derived from the imported files) does not match.
+	*/
+	class lmSceneSnapshot {
+	public:
+		static constexpr uint32_t VERSION = 2;
+
+		// Returns the CPU copy of a model's geometry, or nullptr if it is unknown
+		using ModelDataLookup = std::function<const lmModel::Data* (const lmModel*)>;
+
+		static bool save(
+			const std::string& path,
+			uint64_t sourceKey,
+			lmRegistry& registry,
+			const lmTransformHierarchy& hierarchy,
+			const ModelDataLookup& modelDataLookup);
+
+		// Leaves the registry untouched and returns false if the snapshot is missing, stale or invalid
+		static bool load(
+			const std::string& path,
+			uint64_t sourceKey,
+			lmGeometryArena& geometryArena,
+			lmRegistry& registry,
+			lmTransformHierarchy& hierarchy);
+
+		// Hash of the paths, sizes and modification times of the files the scene was imported from
+		static uint64_t computeSourceKey(const std::vector<std::string>& sourcePaths);
+	};
+
+} // namespace lm
@@ -0,0 +1,112 @@
+/**
+ * @file SnapshotFormat.cpp
+ * @brief Validation of scene snapshot files before anything is read from them.
+ */
+
+#include "SnapshotFormat.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lm {
+
+	namespace {
+
+		// Checks that [offset, offset + count * elementSize) lies inside the file
+		bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize) {
+			return offset % SNAPSHOT_SECTION_ALIGNMENT == 0
+				&& offset <= fileSize
+				&& count <= (fileSize - offset) / elementSize;
+		}
+
+	} // namespace
+
+	/**
+	 * @brief Checks that a snapshot matches the expected format and that every reference stays in bounds.
+	 *
+	 * Once this returns Valid, every model range, index and entity reference can be followed without
+	 * further checks.
+	 *
+	 * @param data The snapshot file contents, at least 16-byte aligned.
+	 * @param size The size of the contents in bytes.
+	 * @param version The snapshot version the reader understands.
+	 * @param vertexSize The size of the reader's vertex.
+	 * @param sourceKey The key of the files the scene would otherwise be imported from.
+	 * @param sections Receives the header and the location of each section when valid.
+	 * @param reason Receives why the snapshot was rejected otherwise.
+	 * @return Valid, or why the snapshot cannot be used.
+	 */
+	SnapshotCheck checkSnapshot(
+		const std::byte* data,
+		size_t size,
+		uint32_t version,
+		uint32_t vertexSize,
+		uint64_t sourceKey,
+		SnapshotSections& sections,
+		std::string& reason) {
+
+		if (size < sizeof(SnapshotHeader)) {
+			reason = "file too small";
+			return SnapshotCheck::Corrupted;
+		}
+
+		SnapshotHeader& header = sections.header;
+		std::memcpy(&header, data, sizeof(header));
+
+		if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+			|| header.version != version
+			|| header.vertexSize != vertexSize
+			|| header.fileSize != size) {
+			reason = "different format or version";
+			return SnapshotCheck::Mismatch;
+		}
+
+		if (header.sourceKey != sourceKey) {
+			reason = "source files changed";
+			return SnapshotCheck::Mismatch;
+		}
+
+		if (!sectionFits(header.modelsOffset, header.modelCount, sizeof(SnapshotModel), header.fileSize)
+			|| !sectionFits(header.verticesOffset, header.vertexCount, vertexSize, header.fileSize)
+			|| !sectionFits(header.indicesOffset, header.indexCount, sizeof(uint32_t), header.fileSize)
+			|| !sectionFits(header.entitiesOffset, header.entityCount, sizeof(SnapshotEntity), header.fileSize)) {
+			reason = "corrupted section table";
+			return SnapshotCheck::Corrupted;
+		}
+
+		// The sections are 16-byte aligned, so the records can be read in place
+		sections.models = reinterpret_cast<const SnapshotModel*>(data + header.modelsOffset);
+		sections.vertices = data + header.verticesOffset;
+		sections.indices = reinterpret_cast<const uint32_t*>(data + header.indicesOffset);
+		sections.entities = reinterpret_cast<const SnapshotEntity*>(data + header.entitiesOffset);
+
+		for (uint32_t i = 0; i < header.modelCount; i++) {
+			// Written so that no sum can wrap around
+			const SnapshotModel& model = sections.models[i];
+			if (model.firstVertex > header.vertexCount || model.vertexCount > header.vertexCount - model.firstVertex
+				|| model.firstIndex > header.indexCount || model.indexCount > header.indexCount - model.firstIndex) {
+				reason = "model " + std::to_string(i) + " out of range";
+				return SnapshotCheck::Corrupted;
+			}
+
+			// The indices go straight into the index buffer, where an out-of-range one reads past the model
+			const uint32_t* modelIndices = sections.indices + model.firstIndex;
+			if (std::any_of(modelIndices, modelIndices + model.indexCount, [&](uint32_t index) { return index >= model.vertexCount; })) {
+				reason = "model " + std::to_string(i) + " has an index outside of its vertices";
+				return SnapshotCheck::Corrupted;
+			}
+		}
+
+		for (uint32_t i = 0; i < header.entityCount; i++) {
+			const SnapshotEntity& record = sections.entities[i];
+			if ((record.parent != SNAPSHOT_NO_INDEX && (record.parent >= i || !(sections.entities[record.parent].flags & SNAPSHOT_ENTITY_IN_HIERARCHY)))
+				|| (record.model != SNAPSHOT_NO_INDEX && record.model >= header.modelCount)) {
+				reason = "entity " + std::to_string(i) + " has an invalid reference";
+				return SnapshotCheck::Corrupted;
+			}
+		}
+
+		return SnapshotCheck::Valid;
+	}
+
+} // namespace lm
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace lm {
+
+	/*
+	* On-disk layout of a scene snapshot, see lmSceneSnapshot.
+	*
+	* Kept free of the renderer so that a file can be validated without a device: the vertex
+	* layout only enters as its size, which the header records and the loader compares.
+	*/
+
+	constexpr char SNAPSHOT_MAGIC[8] = { 'L', 'M', 'S', 'C', 'E', 'N', 'E', '\0' };
+	constexpr uint64_t SNAPSHOT_SECTION_ALIGNMENT = 16;
+	constexpr uint32_t SNAPSHOT_NO_INDEX = 0xFFFFFFFFu;
+
+	constexpr uint32_t SNAPSHOT_ENTITY_IN_HIERARCHY = 1u << 0;
+	constexpr uint32_t SNAPSHOT_ENTITY_POINT_LIGHT = 1u << 1;
+
+	struct SnapshotHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint64_t sourceKey;
+		uint64_t fileSize;
+		uint32_t modelCount;
+		uint32_t entityCount;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t modelsOffset;
+		uint64_t verticesOffset;
+		uint64_t indicesOffset;
+		uint64_t entitiesOffset;
+	};
+
+	// Indices are relative to the model's first vertex, so each one is below vertexCount
+	struct SnapshotModel {
+		uint64_t firstVertex;
+		uint64_t firstIndex;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+	};
+
+	// Parents always precede their children, so parent < own index
+	struct SnapshotEntity {
+		uint32_t parent;
+		uint32_t model;
+		uint32_t flags;
+		float lightIntensity;
+		float translation[3];
+		float rotation[4];		// x, y, z, w
+		float scale[3];
+		float lightColor[3];
+	};
+
+	static_assert(std::is_trivially_copyable_v<SnapshotHeader>, "Snapshot header is copied as raw bytes");
+	static_assert(std::is_trivially_copyable_v<SnapshotEntity>, "Snapshot entities are copied as raw bytes");
+
+	inline uint64_t alignSnapshotSection(uint64_t offset) {
+		return (offset + SNAPSHOT_SECTION_ALIGNMENT - 1) & ~(SNAPSHOT_SECTION_ALIGNMENT - 1);
+	}
+
+	// Sections of a validated snapshot, pointing into the buffer it was read from
+	struct SnapshotSections {
+		SnapshotHeader header;
+		const SnapshotModel* models;
+		const std::byte* vertices;
+		const uint32_t* indices;
+		const SnapshotEntity* entities;
+	};
+
+	enum class SnapshotCheck {
+		Valid,
+		Mismatch,	// Another version, vertex layout or source key: expected, the snapshot is just stale
+		Corrupted
+	};
+
+	SnapshotCheck checkSnapshot(
+		const std::byte* data,
+		size_t size,
+		uint32_t version,
+		uint32_t vertexSize,
+		uint64_t sourceKey,
+		SnapshotSections& sections,
+		std::string& reason);
+
+} // namespace lm
@@ -0,0 +1,181 @@
+/**
+ * @file ThreadPool.cpp
+ * @brief A fixed size pool of worker threads consuming a shared task queue.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace lm {
+
+	namespace {
+		thread_local uint32_t currentThreadIndex = 0;
+	}
+
+	/**
+	 * @brief Starts the worker threads.
+	 * @param workerCount The number of worker threads, the owning thread is not counted.
+	 */
+	lmThreadPool::lmThreadPool(uint32_t workerCount) {
+		workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(&lmThreadPool::workerLoop, this, i + 1);
+		}
+	}
+
+	/**
+	 * @brief Finishes the queued tasks and joins the worker threads.
+	 */
+	lmThreadPool::~lmThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	/**
+	 * @brief Retrieves the number of workers to use when none is specified.
+	 * @return One worker per hardware thread, minus the thread that owns the pool.
+	 */
+	uint32_t lmThreadPool::getDefaultWorkerCount() {
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	/**
+	 * @brief Retrieves the index of the calling thread inside the pool.
+	 * @return 0 for threads outside the pool, otherwise the 1-based worker index.
+	 */
+	uint32_t lmThreadPool::getCurrentThreadIndex() {
+		return currentThreadIndex;
+	}
+
+	/**
+	 * @brief Queues a task for execution on a worker thread.
+	 * @param task The task to run.
+	 */
+	void lmThreadPool::submit(std::function<void()> task) {
+		if (workers.empty()) {
+			task();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(std::move(task));
+		}
+		condition.notify_one();
+	}
+
+	/**
+	 * @brief Runs one pending task on the calling thread, used by threads waiting on pool work.
+	 * @return True if a task was run.
+	 */
+	bool lmThreadPool::tryRunPendingTask() {
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tasks.empty()) {
+				return false;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task();
+		return true;
+	}
+
+	/**
+	 * @brief Runs a range based loop across the pool and the calling thread.
+	 * @param count The number of iterations.
+	 * @param grainSize The number of iterations handed out at once.
+	 * @param fn Called with [begin, end) sub ranges.
+	 */
+	void lmThreadPool::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn) {
+		if (count == 0) {
+			return;
+		}
+
+		grainSize = std::max<size_t>(grainSize, 1);
+		const size_t chunkCount = (count + grainSize - 1) / grainSize;
+
+		if (chunkCount == 1 || workers.empty()) {
+			fn(0, count);
+			return;
+		}
+
+		// Shared so that helpers starting after the loop finished still see valid counters
+		struct State {
+			std::atomic<size_t> nextChunk{ 0 };
+			std::atomic<size_t> finishedChunks{ 0 };
+			size_t count;
+			size_t grainSize;
+			size_t chunkCount;
+			std::function<void(size_t, size_t)> fn;
+		};
+
+		auto state = std::make_shared<State>();
+		state->count = count;
+		state->grainSize = grainSize;
+		state->chunkCount = chunkCount;
+		state->fn = fn;
+
+		auto runChunks = [](State& s) {
+			size_t chunk;
+			while ((chunk = s.nextChunk.fetch_add(1)) < s.chunkCount) {
+				const size_t begin = chunk * s.grainSize;
+				s.fn(begin, std::min(begin + s.grainSize, s.count));
+				s.finishedChunks.fetch_add(1, std::memory_order_release);
+			}
+		};
+
+		const size_t helperCount = std::min<size_t>(chunkCount - 1, workers.size());
+		for (size_t i = 0; i < helperCount; i++) {
+			submit([state, runChunks]() { runChunks(*state); });
+		}
+
+		runChunks(*state);
+
+		while (state->finishedChunks.load(std::memory_order_acquire) < chunkCount) {
+			if (!tryRunPendingTask()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	/**
+	 * @brief Main loop of a worker thread.
+	 * @param threadIndex The 1-based index of the worker.
+	 */
+	void lmThreadPool::workerLoop(uint32_t threadIndex) {
+		currentThreadIndex = threadIndex;
+
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+				if (stopping && tasks.empty()) {
+					return;
+				}
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+} // namespace lm
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lm {
+
+	class lmThreadPool {
+	public:
+		explicit lmThreadPool(uint32_t workerCount = getDefaultWorkerCount());
+		~lmThreadPool();
+
+		lmThreadPool(const lmThreadPool&) = delete;
+		lmThreadPool& operator = (const lmThreadPool&) = delete;
+
+		void submit(std::function<void()> task);
+
+		// Runs one queued task on the calling thread, returns false if the queue was empty
+		bool tryRunPendingTask();
+
+		// Splits [0, count) into grainSize ranges and runs fn(begin, end) on the pool, the caller helps and blocks until done
+		void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& fn);
+
+		uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+		uint32_t getThreadCount() const { return getWorkerCount() + 1; }
+
+		// 0 for threads not owned by the pool (e.g. the main thread), 1..workerCount for the workers
+		static uint32_t getCurrentThreadIndex();
+		static uint32_t getDefaultWorkerCount();
+
+	private:
+		void workerLoop(uint32_t threadIndex);
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+	};
+
+} // namespace lm
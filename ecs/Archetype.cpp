@@ -0,0 +1,212 @@
+/**
+ * @file Archetype.cpp
+ * @brief Type-erased component columns and the archetype tables built from them.
+ */
+
+#include "Archetype.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace lm {
+
+    namespace {
+
+        // A deque keeps the references returned by getComponentInfo valid while new types register
+        std::deque<lmComponentInfo>& componentInfos() {
+            static std::deque<lmComponentInfo> infos;
+            return infos;
+        }
+
+        std::mutex& componentInfoMutex() {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+    } // namespace
+
+    /**
+     * @brief Registers a new component type and assigns it the next free component ID.
+     * @param info The size, alignment and lifetime functions of the component type.
+     * @return The ID used to address the component's column in every archetype.
+     */
+    lmComponentId registerComponent(const lmComponentInfo& info) {
+        std::lock_guard<std::mutex> lock(componentInfoMutex());
+        auto& infos = componentInfos();
+        assert(infos.size() < MAX_COMPONENTS && "Too many component types registered");
+
+        infos.push_back(info);
+        return static_cast<lmComponentId>(infos.size() - 1);
+    }
+
+    /**
+     * @brief Retrieves the type information of a registered component.
+     * @param id The component ID returned by registerComponent.
+     * @return The component type information.
+     */
+    const lmComponentInfo& getComponentInfo(lmComponentId id) {
+        std::lock_guard<std::mutex> lock(componentInfoMutex());
+        return componentInfos()[id];
+    }
+
+    /**
+     * @class lmComponentColumn
+     * @brief A contiguous array of one component type.
+     */
+
+    /**
+     * @brief Constructs an empty column for the given component type.
+     * @param componentId The component ID stored in this column.
+     */
+    lmComponentColumn::lmComponentColumn(lmComponentId componentId) : id{ componentId }, info{ &getComponentInfo(componentId) } {}
+
+    /**
+     * @brief Move constructor, steals the storage of the other column.
+     * @param other The column to move from.
+     */
+    lmComponentColumn::lmComponentColumn(lmComponentColumn&& other) noexcept
+        : id{ other.id }, info{ other.info }, data{ other.data }, count{ other.count }, capacity{ other.capacity },
+          versions{ std::move(other.versions) } {
+        other.data = nullptr;
+        other.count = 0;
+        other.capacity = 0;
+    }
+
+    /**
+     * @brief Destroys every stored component and releases the storage.
+     */
+    lmComponentColumn::~lmComponentColumn() {
+        for (size_t i = 0; i < count; i++) {
+            info->destroy(get(i));
+        }
+
+        if (data) {
+            ::operator delete(data, std::align_val_t{ std::max(info->alignment, CACHE_LINE_SIZE) });
+        }
+    }
+
+    /**
+     * @brief Reallocates the column so that it can hold at least newCapacity elements.
+     * @param newCapacity The requested number of elements.
+     */
+    void lmComponentColumn::reserve(size_t newCapacity) {
+        if (newCapacity <= capacity) {
+            return;
+        }
+
+        const std::align_val_t alignment{ std::max(info->alignment, CACHE_LINE_SIZE) };
+        auto* newData = static_cast<std::byte*>(::operator new(newCapacity * info->size, alignment));
+
+        for (size_t i = 0; i < count; i++) {
+            info->moveConstruct(newData + i * info->size, get(i));
+            info->destroy(get(i));
+        }
+
+        if (data) {
+            ::operator delete(data, alignment);
+        }
+
+        data = newData;
+        capacity = newCapacity;
+    }
+
+    /**
+     * @brief Grows the column by one element without constructing it.
+     * @return Pointer to the storage of the new element, whose version starts at 0.
+     */
+    void* lmComponentColumn::pushUninitialized() {
+        if (count == capacity) {
+            reserve(capacity == 0 ? 16 : capacity * 2);
+        }
+
+        versions.push_back(0);
+        return get(count++);
+    }
+
+    /**
+     * @brief Appends an element by move-constructing it from another instance of the same type.
+     * @param src Pointer to the component to move from.
+     */
+    void lmComponentColumn::pushMoved(void* src) {
+        void* dst = pushUninitialized();
+        info->moveConstruct(dst, src);
+    }
+
+    /**
+     * @brief Removes an element by moving the last element into its place.
+     * @param row The index of the element to remove.
+     */
+    void lmComponentColumn::swapRemove(size_t row) {
+        assert(row < count && "Column row out of range");
+
+        const size_t last = count - 1;
+        info->destroy(get(row));
+
+        if (row != last) {
+            info->moveConstruct(get(row), get(last));
+            info->destroy(get(last));
+            versions[row] = versions[last];
+        }
+
+        versions.pop_back();
+        count--;
+    }
+
+    /**
+     * @class lmArchetype
+     * @brief A table of entities that all own the same set of components.
+     */
+
+    /**
+     * @brief Constructs an archetype with one column per component bit set in the mask.
+     * @param signature The component signature of this archetype.
+     */
+    lmArchetype::lmArchetype(lmComponentMask signature) : mask{ signature } {
+        columnIndex.fill(-1);
+
+        for (lmComponentId id = 0; id < MAX_COMPONENTS; id++) {
+            if (has(id)) {
+                columnIndex[id] = static_cast<int8_t>(columns.size());
+                columns.emplace_back(id);
+            }
+        }
+    }
+
+    /**
+     * @brief Adds an entity to the entity list of this archetype.
+     * @param entity The entity to add.
+     * @return The row the entity occupies.
+     */
+    size_t lmArchetype::pushEntity(lmEntity entity) {
+        entities.push_back(entity);
+        return entities.size() - 1;
+    }
+
+    /**
+     * @brief Removes a row from the archetype, keeping the columns dense.
+     * @param row The row to remove.
+     * @return The entity that now occupies the row, or NULL_ENTITY if the last row was removed.
+     */
+    lmEntity lmArchetype::swapRemove(size_t row) {
+        assert(row < entities.size() && "Archetype row out of range");
+
+        for (auto& column : columns) {
+            column.swapRemove(row);
+        }
+
+        const size_t last = entities.size() - 1;
+        lmEntity moved = NULL_ENTITY;
+
+        if (row != last) {
+            entities[row] = entities[last];
+            moved = entities[row];
+        }
+
+        entities.pop_back();
+        return moved;
+    }
+
+} // namespace lm
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Entity.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lm {
+
+    using lmComponentId = uint32_t;
+    using lmComponentMask = uint64_t;
+
+    constexpr uint32_t MAX_COMPONENTS = 64;
+
+    // Type-erased description of a component type, used by the columns to move and destroy elements
+    struct lmComponentInfo {
+        size_t size;
+        size_t alignment;
+        void (*moveConstruct)(void* dst, void* src);
+        void (*destroy)(void* ptr);
+    };
+
+    lmComponentId registerComponent(const lmComponentInfo& info);
+    const lmComponentInfo& getComponentInfo(lmComponentId id);
+
+    // ID of a component type once registered, MAX_COMPONENTS before. Read without the guard of a function
+    // local static, which MSVC checks through thread local storage on every call of componentId()
+    template <typename T>
+    inline std::atomic<lmComponentId> registeredComponentId{ MAX_COMPONENTS };
+
+    template <typename T>
+    lmComponentId registerComponentType() {
+        static_assert(std::is_move_constructible_v<T>, "Components must be move constructible");
+
+        static const lmComponentId id = registerComponent(lmComponentInfo{
+            sizeof(T),
+            alignof(T),
+            [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); },
+            [](void* ptr) { static_cast<T*>(ptr)->~T(); } });
+
+        registeredComponentId<T>.store(id, std::memory_order_relaxed);
+        return id;
+    }
+
+    template <typename T>
+    lmComponentId componentId() {
+        const lmComponentId id = registeredComponentId<T>.load(std::memory_order_relaxed);
+        return id != MAX_COMPONENTS ? id : registerComponentType<T>();
+    }
+
+    template <typename... Ts>
+    lmComponentMask componentMask() {
+        return (lmComponentMask{ 0 } | ... | (lmComponentMask{ 1 } << componentId<Ts>()));
+    }
+
+    // Contiguous, cache-line aligned array holding every instance of one component type in an archetype
+    class lmComponentColumn {
+    public:
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        explicit lmComponentColumn(lmComponentId componentId);
+        ~lmComponentColumn();
+
+        lmComponentColumn(const lmComponentColumn&) = delete;
+        lmComponentColumn& operator=(const lmComponentColumn&) = delete;
+        lmComponentColumn(lmComponentColumn&& other) noexcept;
+        lmComponentColumn& operator=(lmComponentColumn&&) = delete;
+
+        lmComponentId getComponentId() const { return id; }
+        size_t size() const { return count; }
+
+        void* get(size_t row) { return data + row * info->size; }
+        void* getData() { return data; }
+
+        // Registry version at which the element in a row was last added or marked changed
+        uint32_t getVersion(size_t row) const { return versions[row]; }
+        void setVersion(size_t row, uint32_t version) { versions[row] = version; }
+
+        // Grows the column by one element and returns the uninitialized storage, the caller constructs in place
+        void* pushUninitialized();
+        void pushMoved(void* src);
+        void swapRemove(size_t row);
+
+    private:
+        void reserve(size_t newCapacity);
+
+        lmComponentId id;
+        const lmComponentInfo* info;
+        std::byte* data = nullptr;
+        size_t count = 0;
+        size_t capacity = 0;
+        std::vector<uint32_t> versions;
+    };
+
+    // Stores all entities sharing the exact same set of components, one column per component type
+    class lmArchetype {
+    public:
+        explicit lmArchetype(lmComponentMask signature);
+
+        lmArchetype(const lmArchetype&) = delete;
+        lmArchetype& operator=(const lmArchetype&) = delete;
+
+        lmComponentMask getMask() const { return mask; }
+        size_t size() const { return entities.size(); }
+        bool has(lmComponentId id) const { return (mask >> id) & 1; }
+        bool matches(lmComponentMask required) const { return (mask & required) == required; }
+
+        const std::vector<lmEntity>& getEntities() const { return entities; }
+        std::vector<lmComponentColumn>& getColumns() { return columns; }
+
+        lmComponentColumn* getColumn(lmComponentId id) {
+            return columnIndex[id] < 0 ? nullptr : &columns[columnIndex[id]];
+        }
+
+        template <typename T>
+        T* getComponentArray() {
+            lmComponentColumn* column = getColumn(componentId<T>());
+            return column ? static_cast<T*>(column->getData()) : nullptr;
+        }
+
+        // Appends the entity without touching the columns, the caller must grow every column by one
+        size_t pushEntity(lmEntity entity);
+
+        // Removes a row from every column; returns the entity that was moved into that row, if any
+        lmEntity swapRemove(size_t row);
+
+        std::array<lmArchetype*, MAX_COMPONENTS> addEdges{};
+        std::array<lmArchetype*, MAX_COMPONENTS> removeEdges{};
+
+    private:
+        lmComponentMask mask;
+        std::vector<lmComponentColumn> columns;
+        std::array<int8_t, MAX_COMPONENTS> columnIndex;
+        std::vector<lmEntity> entities;
+    };
+
+} // namespace lm
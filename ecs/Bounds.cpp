@@ -0,0 +1,104 @@
+/**
+ * @file Bounds.cpp
+ * @brief Bounding box transforms and frustum plane tests.
+ */
+
+#include "Bounds.h"
+
+#include <cmath>
+
+namespace lm {
+
+    /**
+     * @brief Transforms the box and returns the axis aligned box enclosing the result.
+     *
+     * Transforms the center and sums the absolute rotated extents (Arvo's method), which gives the
+     * same box as transforming all 8 corners for a fraction of the work.
+     *
+     * @param matrix An affine transform.
+     * @return The enclosing box, empty if this box is empty.
+     */
+    lmAabb lmAabb::transformed(const glm::mat4& matrix) const {
+        if (isEmpty()) {
+            return lmAabb{};
+        }
+
+        const glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.f));
+        const glm::vec3 extents = getExtents();
+        const glm::vec3 worldExtents =
+            glm::abs(glm::vec3(matrix[0])) * extents.x +
+            glm::abs(glm::vec3(matrix[1])) * extents.y +
+            glm::abs(glm::vec3(matrix[2])) * extents.z;
+
+        return fromCenterExtents(center, worldExtents);
+    }
+
+    /**
+     * @brief Extracts the frustum planes from a combined projection and view matrix (Gribb-Hartmann).
+     * @param viewProjection The projection * view matrix, using the [0, 1] depth range of GLM_FORCE_DEPTH_ZERO_TO_ONE.
+     * @return The normalized frustum planes, pointing inwards.
+     */
+    lmFrustum lmFrustum::fromMatrix(const glm::mat4& viewProjection) {
+        // GLM matrices are column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        auto row = [&viewProjection](int i) {
+            return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        };
+
+        lmFrustum frustum;
+        frustum.planes[Left] = row(3) + row(0);
+        frustum.planes[Right] = row(3) - row(0);
+        frustum.planes[Bottom] = row(3) + row(1);
+        frustum.planes[Top] = row(3) - row(1);
+        frustum.planes[Near] = row(2);
+        frustum.planes[Far] = row(3) - row(2);
+
+        for (glm::vec4& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+
+        return frustum;
+    }
+
+    /**
+     * @brief Classifies a box against the frustum.
+     * @param box The box to test.
+     * @return Outside if the box is fully behind a plane, Inside if it is in front of all planes, Intersects otherwise.
+     */
+    lmFrustumTest lmFrustum::test(const lmAabb& box) const {
+        const glm::vec3 center = box.getCenter();
+        const glm::vec3 extents = box.getExtents();
+
+        lmFrustumTest result = lmFrustumTest::Inside;
+        for (const glm::vec4& plane : planes) {
+            const glm::vec3 normal{ plane };
+            const float distance = glm::dot(normal, center) + plane.w;
+            const float radius = glm::dot(glm::abs(normal), extents);
+
+            if (distance < -radius) {
+                return lmFrustumTest::Outside;
+            }
+            if (distance < radius) {
+                result = lmFrustumTest::Intersects;
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Tests whether a sphere is at least partially inside the frustum.
+     * @param center The center of the sphere.
+     * @param radius The radius of the sphere.
+     * @return False if the sphere is fully behind one of the planes.
+     */
+    bool lmFrustum::intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+} // namespace lm
@@ -0,0 +1,92 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <limits>
+
+namespace lm {
+
+    // Axis aligned bounding box, default constructed empty so that expanding it by a point yields that point
+    struct lmAabb {
+        glm::vec3 min{ std::numeric_limits<float>::max() };
+        glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+        lmAabb() = default;
+        lmAabb(const glm::vec3& minCorner, const glm::vec3& maxCorner) : min{ minCorner }, max{ maxCorner } {}
+
+        static lmAabb fromCenterExtents(const glm::vec3& center, const glm::vec3& extents) {
+            return lmAabb{ center - extents, center + extents };
+        }
+
+        static lmAabb merge(const lmAabb& a, const lmAabb& b) {
+            return lmAabb{ glm::min(a.min, b.min), glm::max(a.max, b.max) };
+        }
+
+        bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+        glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+        glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+        float getSurfaceArea() const {
+            const glm::vec3 size = max - min;
+            return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        void expand(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        bool contains(const lmAabb& other) const {
+            return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+        }
+
+        bool overlaps(const lmAabb& other) const {
+            return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+        }
+
+        // Squared distance from a point to the box, 0 inside
+        float distanceSquared(const glm::vec3& point) const {
+            const glm::vec3 offset = glm::max(glm::max(min - point, point - max), glm::vec3(0.f));
+            return glm::dot(offset, offset);
+        }
+
+        bool overlapsSphere(const glm::vec3& center, float radius) const {
+            return distanceSquared(center) <= radius * radius;
+        }
+
+        // Smallest box enclosing this box once transformed by an affine matrix
+        lmAabb transformed(const glm::mat4& matrix) const;
+    };
+
+    // Bounding sphere, looser than a box on elongated meshes but cheap to transform and test
+    struct lmSphere {
+        glm::vec3 center{ 0.f };
+        float radius = 0.f;
+    };
+
+    enum class lmFrustumTest {
+        Outside,
+        Intersects,
+        Inside
+    };
+
+    // Six inward facing planes (xyz normal, w distance) normalized so that dot(normal, p) + w is a distance
+    struct lmFrustum {
+        enum Plane { Left, Right, Bottom, Top, Near, Far, PLANE_COUNT };
+
+        std::array<glm::vec4, PLANE_COUNT> planes{};
+
+        // Extracts the planes of a projection * view matrix with a [0, 1] depth range
+        static lmFrustum fromMatrix(const glm::mat4& viewProjection);
+
+        lmFrustumTest test(const lmAabb& box) const;
+        bool intersects(const lmAabb& box) const { return test(box) != lmFrustumTest::Outside; }
+        bool intersectsSphere(const glm::vec3& center, float radius) const;
+        bool intersects(const lmSphere& sphere) const { return intersectsSphere(sphere.center, sphere.radius); }
+    };
+
+} // namespace lm
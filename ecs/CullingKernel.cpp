@@ -0,0 +1,251 @@
+/**
+ * @file CullingKernel.cpp
+ * @brief Scalar and SSE kernels testing SoA bounding boxes against the frustum planes, and the runtime kernel selection.
+ *
+ * A box is outside when, for one plane, the signed distance of its center is below minus its
+ * projected radius dot(abs(normal), extents). The SIMD kernels hold 4 or 8 boxes per register,
+ * broadcast each plane and accumulate the outside mask over the six planes, so a batch costs the
+ * same six plane tests whether its boxes are visible or not.
+ *
+ * The AVX2 kernel lives in CullingKernelAVX2.cpp, the only source compiled with AVX2, and is only
+ * picked when CPUID reports AVX2 support, so enabling it never makes the binary require AVX2.
+ */
+
+#include "CullingKernel.h"
+#include "CullingKernelSimd.h"
+
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LM_CULLING_KERNEL_SSE 1
+#include <immintrin.h>
+#endif
+
+// LM_ENABLE_AVX2 is defined by the build when CullingKernelAVX2.cpp is compiled with AVX2
+#if defined(LM_CULLING_KERNEL_SSE) && defined(LM_ENABLE_AVX2)
+#define LM_CULLING_KERNEL_AVX2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace lm {
+
+    namespace {
+
+        /**
+         * @brief Runs the scalar path for the boxes in [begin, end).
+         * @return The number of visible boxes in the range.
+         */
+        size_t cullAabbsScalar(const lmFrustum& frustum, const lmAabbSoA& in, size_t begin, size_t end, uint8_t* visible) {
+            size_t visibleCount = 0;
+            for (size_t i = begin; i < end; i++) {
+                bool outside = false;
+                for (const glm::vec4& plane : frustum.planes) {
+                    const float distance = plane.x * in.centerX[i] + plane.y * in.centerY[i] + plane.z * in.centerZ[i] + plane.w;
+                    const float radius = std::abs(plane.x) * in.extentX[i] + std::abs(plane.y) * in.extentY[i] + std::abs(plane.z) * in.extentZ[i];
+                    if (distance < -radius) {
+                        outside = true;
+                        break;
+                    }
+                }
+
+                visible[i] = outside ? 0 : 1;
+                visibleCount += outside ? 0 : 1;
+            }
+
+            return visibleCount;
+        }
+
+#if defined(LM_CULLING_KERNEL_SSE)
+
+        /**
+         * @brief Runs the SSE path for the boxes in [begin, end), end - begin must be a multiple of 4.
+         * @return The number of visible boxes in the range.
+         */
+        size_t cullAabbsSSE(const lmFrustum& frustum, const lmAabbSoA& in, size_t begin, size_t end, uint8_t* visible) {
+            const __m128 signMask = _mm_set1_ps(-0.f);
+
+            __m128 nx[lmFrustum::PLANE_COUNT], ny[lmFrustum::PLANE_COUNT], nz[lmFrustum::PLANE_COUNT], nw[lmFrustum::PLANE_COUNT];
+            __m128 ax[lmFrustum::PLANE_COUNT], ay[lmFrustum::PLANE_COUNT], az[lmFrustum::PLANE_COUNT];
+            for (int p = 0; p < lmFrustum::PLANE_COUNT; p++) {
+                nx[p] = _mm_set1_ps(frustum.planes[p].x);
+                ny[p] = _mm_set1_ps(frustum.planes[p].y);
+                nz[p] = _mm_set1_ps(frustum.planes[p].z);
+                nw[p] = _mm_set1_ps(frustum.planes[p].w);
+                ax[p] = _mm_andnot_ps(signMask, nx[p]);
+                ay[p] = _mm_andnot_ps(signMask, ny[p]);
+                az[p] = _mm_andnot_ps(signMask, nz[p]);
+            }
+
+            size_t visibleCount = 0;
+            for (size_t i = begin; i < end; i += 4) {
+                const __m128 cx = _mm_loadu_ps(in.centerX + i);
+                const __m128 cy = _mm_loadu_ps(in.centerY + i);
+                const __m128 cz = _mm_loadu_ps(in.centerZ + i);
+                const __m128 ex = _mm_loadu_ps(in.extentX + i);
+                const __m128 ey = _mm_loadu_ps(in.extentY + i);
+                const __m128 ez = _mm_loadu_ps(in.extentZ + i);
+
+                __m128 outside = _mm_setzero_ps();
+                for (int p = 0; p < lmFrustum::PLANE_COUNT; p++) {
+                    const __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                        _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+                    const __m128 radius = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)),
+                        _mm_mul_ps(az[p], ez));
+
+                    // distance < -radius  <=>  distance + radius < 0
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+                }
+
+                const int outsideBits = _mm_movemask_ps(outside);
+                const uint32_t bytes = CULLING_VISIBLE_BYTES[outsideBits];
+                std::memcpy(visible + i, &bytes, sizeof(bytes));
+                visibleCount += 4 - static_cast<size_t>(std::popcount(static_cast<unsigned>(outsideBits)));
+            }
+
+            return visibleCount;
+        }
+
+#endif
+
+#if defined(LM_CULLING_KERNEL_AVX2)
+
+        /**
+         * @brief Queries CPUID for AVX2, and whether the OS saves the YMM registers across context switches.
+         * @return True if the AVX2 kernel can run on this CPU.
+         */
+        bool detectAVX2() {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+
+            // OSXSAVE and AVX, then XCR0 must enable the SSE and AVX state
+            __cpuid(info, 1);
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 0x6) != 0x6) {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            // Also checks the OS support through XGETBV
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        bool hasAVX2() {
+            static const bool supported = detectAVX2();
+            return supported;
+        }
+
+#endif
+
+    } // namespace
+
+    /**
+     * @brief Retrieves the widest culling kernel this binary can run on this CPU.
+     * @return AVX2 when built with AVX2 enabled and supported by the CPU, SSE on x86-64, otherwise scalar.
+     */
+    lmCullingKernel getBestCullingKernel() {
+#if defined(LM_CULLING_KERNEL_AVX2)
+        if (hasAVX2()) {
+            return lmCullingKernel::AVX2;
+        }
+#endif
+
+#if defined(LM_CULLING_KERNEL_SSE)
+        return lmCullingKernel::SSE;
+#else
+        return lmCullingKernel::Scalar;
+#endif
+    }
+
+    /**
+     * @brief Checks whether a kernel was compiled into this binary and runs on this CPU.
+     * @param kernel The kernel to check.
+     * @return True if cullAabbs can run the kernel.
+     */
+    bool isCullingKernelAvailable(lmCullingKernel kernel) {
+        switch (kernel) {
+        case lmCullingKernel::Scalar:
+            return true;
+        case lmCullingKernel::SSE:
+#if defined(LM_CULLING_KERNEL_SSE)
+            return true;
+#else
+            return false;
+#endif
+        case lmCullingKernel::AVX2:
+#if defined(LM_CULLING_KERNEL_AVX2)
+            return hasAVX2();
+#else
+            return false;
+#endif
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Retrieves a printable name for a kernel.
+     * @param kernel The kernel.
+     * @return The name of the kernel.
+     */
+    const char* getCullingKernelName(lmCullingKernel kernel) {
+        switch (kernel) {
+        case lmCullingKernel::Scalar:
+            return "Scalar";
+        case lmCullingKernel::SSE:
+            return "SSE";
+        case lmCullingKernel::AVX2:
+            return "AVX2";
+        }
+
+        return "Unknown";
+    }
+
+    /**
+     * @brief Tests a batch of boxes against the frustum.
+     * @param frustum The frustum, with normalized inward facing planes.
+     * @param boxes The SoA box centers and half extents.
+     * @param visible Receives boxes.count flags, 1 for boxes intersecting the frustum.
+     * @param kernel The kernel to use, must be available (see isCullingKernelAvailable).
+     * @return The number of visible boxes.
+     */
+    size_t cullAabbs(const lmFrustum& frustum, const lmAabbSoA& boxes, uint8_t* visible, lmCullingKernel kernel) {
+        assert(isCullingKernelAvailable(kernel) && "Culling kernel not available on this CPU or not compiled into this binary");
+
+        size_t done = 0;
+        size_t visibleCount = 0;
+
+#if defined(LM_CULLING_KERNEL_AVX2)
+        if (kernel == lmCullingKernel::AVX2) {
+            const size_t batched = boxes.count & ~size_t{ 7 };
+            visibleCount += cullAabbsAVX2(frustum.planes.data(), boxes, 0, batched, visible);
+            done = batched;
+        }
+#endif
+
+#if defined(LM_CULLING_KERNEL_SSE)
+        if (kernel != lmCullingKernel::Scalar) {
+            const size_t batched = boxes.count & ~size_t{ 3 };
+            visibleCount += cullAabbsSSE(frustum, boxes, done, batched, visible);
+            done = batched;
+        }
+#endif
+
+        visibleCount += cullAabbsScalar(frustum, boxes, done, boxes.count, visible);
+        return visibleCount;
+    }
+
+} // namespace lm
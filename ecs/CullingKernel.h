@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Bounds.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lm {
+
+    // Structure of arrays input of cullAabbs: world space boxes as centers and half extents, count elements each
+    struct lmAabbSoA {
+        const float* centerX = nullptr;
+        const float* centerY = nullptr;
+        const float* centerZ = nullptr;
+        const float* extentX = nullptr;
+        const float* extentY = nullptr;
+        const float* extentZ = nullptr;
+
+        size_t count = 0;
+    };
+
+    enum class lmCullingKernel {
+        Scalar,
+        SSE,    // 4 boxes per iteration
+        AVX2    // 8 boxes per iteration
+    };
+
+    // Widest kernel compiled into this binary that the CPU supports, AVX2 is detected at runtime
+    lmCullingKernel getBestCullingKernel();
+    bool isCullingKernelAvailable(lmCullingKernel kernel);
+    const char* getCullingKernelName(lmCullingKernel kernel);
+
+    // Writes 1 to visible[i] if box i intersects the frustum, 0 if it is fully outside, returns the number of visible boxes
+    size_t cullAabbs(
+        const lmFrustum& frustum, const lmAabbSoA& boxes, uint8_t* visible,
+        lmCullingKernel kernel = getBestCullingKernel());
+
+} // namespace lm
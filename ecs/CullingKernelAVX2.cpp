@@ -0,0 +1,86 @@
+/**
+ * @file CullingKernelAVX2.cpp
+ * @brief AVX2 kernel of cullAabbs, the only source compiled with AVX2 code generation.
+ *
+ * cullAabbs only calls it once CPUID reported AVX2 support, so the binary still runs on older CPUs.
+ * Inline functions instantiated here would be compiled with AVX2 and the linker may keep this copy
+ * for every translation unit, so the kernel only works on raw pointers and plain arithmetic.
+ */
+
+#include "CullingKernelSimd.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace lm {
+
+#if defined(__AVX2__)
+
+    namespace {
+
+        // Number of set bits among the 8 lanes of a movemask
+        unsigned countLanes(unsigned bits) {
+            bits = bits - ((bits >> 1) & 0x55u);
+            bits = (bits & 0x33u) + ((bits >> 2) & 0x33u);
+            return (bits + (bits >> 4)) & 0x0Fu;
+        }
+
+    } // namespace
+
+    /**
+     * @brief Runs the AVX2 path for the boxes in [begin, end), end - begin must be a multiple of 8.
+     * @param planes The lmFrustum::PLANE_COUNT normalized inward facing planes.
+     * @return The number of visible boxes in the range.
+     */
+    size_t cullAabbsAVX2(const glm::vec4* planes, const lmAabbSoA& in, size_t begin, size_t end, uint8_t* visible) {
+        const __m256 signMask = _mm256_set1_ps(-0.f);
+
+        __m256 nx[lmFrustum::PLANE_COUNT], ny[lmFrustum::PLANE_COUNT], nz[lmFrustum::PLANE_COUNT], nw[lmFrustum::PLANE_COUNT];
+        __m256 ax[lmFrustum::PLANE_COUNT], ay[lmFrustum::PLANE_COUNT], az[lmFrustum::PLANE_COUNT];
+        for (int p = 0; p < lmFrustum::PLANE_COUNT; p++) {
+            nx[p] = _mm256_set1_ps(planes[p].x);
+            ny[p] = _mm256_set1_ps(planes[p].y);
+            nz[p] = _mm256_set1_ps(planes[p].z);
+            nw[p] = _mm256_set1_ps(planes[p].w);
+            ax[p] = _mm256_andnot_ps(signMask, nx[p]);
+            ay[p] = _mm256_andnot_ps(signMask, ny[p]);
+            az[p] = _mm256_andnot_ps(signMask, nz[p]);
+        }
+
+        size_t visibleCount = 0;
+        for (size_t i = begin; i < end; i += 8) {
+            const __m256 cx = _mm256_loadu_ps(in.centerX + i);
+            const __m256 cy = _mm256_loadu_ps(in.centerY + i);
+            const __m256 cz = _mm256_loadu_ps(in.centerZ + i);
+            const __m256 ex = _mm256_loadu_ps(in.extentX + i);
+            const __m256 ey = _mm256_loadu_ps(in.extentY + i);
+            const __m256 ez = _mm256_loadu_ps(in.extentZ + i);
+
+            __m256 outside = _mm256_setzero_ps();
+            for (int p = 0; p < lmFrustum::PLANE_COUNT; p++) {
+                const __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+                    _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nw[p]));
+                const __m256 radius = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+                    _mm256_mul_ps(az[p], ez));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+
+            const unsigned outsideBits = static_cast<unsigned>(_mm256_movemask_ps(outside));
+            const uint32_t low = CULLING_VISIBLE_BYTES[outsideBits & 0xF];
+            const uint32_t high = CULLING_VISIBLE_BYTES[outsideBits >> 4];
+            std::memcpy(visible + i, &low, sizeof(low));
+            std::memcpy(visible + i + 4, &high, sizeof(high));
+            visibleCount += 8 - countLanes(outsideBits);
+        }
+
+        return visibleCount;
+    }
+
+#endif
+
+} // namespace lm
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "CullingKernel.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lm {
+
+    // Internal to the culling kernels, shared by CullingKernel.cpp and CullingKernelAVX2.cpp
+
+    // Visibility bytes of the 4 lanes of a mask, indexed by the movemask of the outside mask
+    inline constexpr uint32_t CULLING_VISIBLE_BYTES[16] = {
+        0x01010101, 0x01010100, 0x01010001, 0x01010000, 0x01000101, 0x01000100, 0x01000001, 0x01000000,
+        0x00010101, 0x00010100, 0x00010001, 0x00010000, 0x00000101, 0x00000100, 0x00000001, 0x00000000
+    };
+
+    // Defined in the only source compiled with AVX2, must not be called unless the CPU supports it.
+    // Takes the lmFrustum::PLANE_COUNT planes as a plain array, see CullingKernelAVX2.cpp
+    size_t cullAabbsAVX2(const glm::vec4* planes, const lmAabbSoA& in, size_t begin, size_t end, uint8_t* visible);
+
+} // namespace lm
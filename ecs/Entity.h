@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+namespace lm {
+
+    /*
+    * Generational handle packing a slot index and a generation counter into one integer.
+    *
+    * The index addresses a slot in a dense table, the generation is bumped every time
+    * the slot is freed, so a handle that outlives its object no longer compares equal
+    * to the slot's current generation and is detected as stale.
+    */
+    template <typename Storage, uint32_t IndexBits>
+    struct lmHandle {
+        static_assert(std::is_unsigned_v<Storage>, "Handle storage must be an unsigned integer");
+        static_assert(IndexBits > 0 && IndexBits < sizeof(Storage) * 8, "Handle needs both index and generation bits");
+
+        using storage_type = Storage;
+
+        static constexpr uint32_t INDEX_BITS = IndexBits;
+        static constexpr uint32_t GENERATION_BITS = sizeof(Storage) * 8 - IndexBits;
+        static constexpr Storage INDEX_MASK = (Storage{ 1 } << IndexBits) - 1;
+        static constexpr Storage GENERATION_MASK = std::numeric_limits<Storage>::max() >> IndexBits;
+
+        // The all-ones index is reserved for the null handle
+        static constexpr uint32_t MAX_INDEX = static_cast<uint32_t>(INDEX_MASK - 1);
+        static constexpr uint32_t MAX_GENERATION = static_cast<uint32_t>(GENERATION_MASK);
+
+        Storage value = std::numeric_limits<Storage>::max();
+
+        constexpr lmHandle() = default;
+        constexpr lmHandle(uint32_t index, uint32_t generation)
+            : value{ static_cast<Storage>((static_cast<Storage>(generation) << IndexBits) | (static_cast<Storage>(index) & INDEX_MASK)) } {}
+
+        constexpr uint32_t index() const { return static_cast<uint32_t>(value & INDEX_MASK); }
+        constexpr uint32_t generation() const { return static_cast<uint32_t>(value >> IndexBits); }
+        constexpr bool isNull() const { return value == std::numeric_limits<Storage>::max(); }
+
+        constexpr bool operator==(const lmHandle& other) const { return value == other.value; }
+        constexpr bool operator!=(const lmHandle& other) const { return value != other.value; }
+        constexpr bool operator<(const lmHandle& other) const { return value < other.value; }
+    };
+
+    // 64-bit handle: 32-bit slot index, 32-bit generation
+    using lmEntity = lmHandle<uint64_t, 32>;
+
+    // Compact 32-bit handle for tables that stay below a million slots: 20-bit index, 12-bit generation
+    using lmCompactHandle = lmHandle<uint32_t, 20>;
+
+    constexpr lmEntity NULL_ENTITY{};
+
+} // namespace lm
+
+namespace std {
+
+    template <typename Storage, uint32_t IndexBits>
+    struct hash<lm::lmHandle<Storage, IndexBits>> {
+        size_t operator()(const lm::lmHandle<Storage, IndexBits>& handle) const {
+            return std::hash<Storage>{}(handle.value);
+        }
+    };
+
+} // namespace std
@@ -0,0 +1,190 @@
+/**
+ * @file EntityCommandBuffer.cpp
+ * @brief Recording and batched playback of structural registry changes.
+ */
+
+#include "EntityCommandBuffer.h"
+#include "../core/ThreadPool.h"
+
+#include <algorithm>
+#include <new>
+
+namespace lm {
+
+    namespace {
+        constexpr size_t BLOCK_ALIGNMENT = lmComponentColumn::CACHE_LINE_SIZE;
+    }
+
+    /**
+     * @brief Releases a block of the component arena.
+     * @param block The block to release.
+     */
+    void lmEntityCommandBuffer::BlockDeleter::operator()(std::byte* block) const {
+        ::operator delete[](block, std::align_val_t{ BLOCK_ALIGNMENT });
+    }
+
+    /**
+     * @brief Destroys the components of commands that were never applied.
+     */
+    lmEntityCommandBuffer::~lmEntityCommandBuffer() {
+        clear();
+    }
+
+    /**
+     * @brief Records the creation of an entity.
+     * @return A pending entity usable in later commands of this buffer.
+     */
+    lmEntity lmEntityCommandBuffer::create() {
+        assert(pendingCount < lmEntity::MAX_INDEX && "Too many pending entities");
+
+        const lmEntity pending{ pendingCount++, PENDING_GENERATION };
+        commands.push_back(Command{ CommandType::Create, 0, pending, nullptr });
+        return pending;
+    }
+
+    /**
+     * @brief Records the destruction of an entity.
+     * @param entity The entity to destroy, either alive in the registry or pending in this buffer.
+     */
+    void lmEntityCommandBuffer::destroy(lmEntity entity) {
+        commands.push_back(Command{ CommandType::Destroy, 0, entity, nullptr });
+    }
+
+    /**
+     * @brief Applies every recorded command to the registry in recording order.
+     *
+     * Commands targeting entities that are no longer alive at that point (e.g. destroyed by another
+     * buffer applied earlier) are skipped and their components destroyed.
+     *
+     * @param registry The registry to modify.
+     */
+    void lmEntityCommandBuffer::apply(lmRegistry& registry) {
+        createdEntities.assign(pendingCount, NULL_ENTITY);
+
+        for (Command& command : commands) {
+            if (command.type == CommandType::Create) {
+                createdEntities[command.entity.index()] = registry.create();
+                continue;
+            }
+
+            const lmEntity entity = resolve(command.entity);
+            const bool alive = registry.isAlive(entity);
+
+            switch (command.type) {
+            case CommandType::Destroy:
+                registry.destroy(entity);
+                break;
+            case CommandType::Add: {
+                const lmComponentInfo& info = getComponentInfo(command.component);
+                if (alive) {
+                    info.moveConstruct(registry.addUninitialized(entity, command.component), command.data);
+                }
+                info.destroy(command.data);
+                command.data = nullptr;
+                break;
+            }
+            case CommandType::Remove:
+                if (alive) {
+                    registry.remove(entity, command.component);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        clear();
+    }
+
+    /**
+     * @brief Drops every recorded command, destroying the components that were not applied.
+     */
+    void lmEntityCommandBuffer::clear() {
+        for (const Command& command : commands) {
+            if (command.type == CommandType::Add && command.data) {
+                getComponentInfo(command.component).destroy(command.data);
+            }
+        }
+
+        commands.clear();
+        createdEntities.clear();
+        pendingCount = 0;
+        currentBlock = 0;
+        blockOffset = 0;
+    }
+
+    /**
+     * @brief Reserves storage for a recorded component in the block arena.
+     * @param size The size of the component.
+     * @param alignment The alignment of the component.
+     * @return Uninitialized storage that stays valid until the buffer is applied or cleared.
+     */
+    void* lmEntityCommandBuffer::allocate(size_t size, size_t alignment) {
+        assert(alignment <= BLOCK_ALIGNMENT && "Component alignment exceeds the arena alignment");
+
+        while (currentBlock < blocks.size()) {
+            Block& block = blocks[currentBlock];
+            const size_t offset = (blockOffset + alignment - 1) & ~(alignment - 1);
+
+            if (offset + size <= block.size) {
+                blockOffset = offset + size;
+                return block.data.get() + offset;
+            }
+
+            currentBlock++;
+            blockOffset = 0;
+        }
+
+        Block block{};
+        block.size = std::max(BLOCK_SIZE, size);
+        block.data.reset(static_cast<std::byte*>(::operator new[](block.size, std::align_val_t{ BLOCK_ALIGNMENT })));
+        blocks.push_back(std::move(block));
+
+        currentBlock = blocks.size() - 1;
+        blockOffset = size;
+        return blocks.back().data.get();
+    }
+
+    /**
+     * @brief Maps a pending entity to the entity created for it during apply.
+     * @param entity A registry entity or a pending entity of this buffer.
+     * @return The registry entity.
+     */
+    lmEntity lmEntityCommandBuffer::resolve(lmEntity entity) const {
+        if (!isPending(entity)) {
+            return entity;
+        }
+
+        assert(entity.index() < createdEntities.size() && "Pending entity recorded by another command buffer");
+        return createdEntities[entity.index()];
+    }
+
+    /**
+     * @brief Creates one command buffer per thread.
+     * @param threadCount The number of threads recording, typically lmThreadPool::getThreadCount.
+     */
+    lmEntityCommandQueue::lmEntityCommandQueue(uint32_t threadCount) : buffers(std::max<uint32_t>(threadCount, 1)) {}
+
+    /**
+     * @brief Retrieves the command buffer of the calling thread.
+     * @return The buffer indexed by lmThreadPool::getCurrentThreadIndex.
+     */
+    lmEntityCommandBuffer& lmEntityCommandQueue::local() {
+        const uint32_t threadIndex = lmThreadPool::getCurrentThreadIndex();
+        assert(threadIndex < buffers.size() && "Command queue has fewer buffers than the pool has threads");
+        return buffers[threadIndex];
+    }
+
+    /**
+     * @brief Applies the buffers of every thread, the main thread's buffer first.
+     * @param registry The registry to modify.
+     */
+    void lmEntityCommandQueue::apply(lmRegistry& registry) {
+        for (auto& buffer : buffers) {
+            if (!buffer.empty()) {
+                buffer.apply(registry);
+            }
+        }
+    }
+
+} // namespace lm
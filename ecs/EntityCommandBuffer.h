@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Archetype.h"
+#include "Entity.h"
+#include "Registry.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * Records structural changes (create, destroy, add and remove component) so they can be
+    * applied to an lmRegistry in one batch once no system is iterating it anymore.
+    *
+    * Recording never touches the registry, so a buffer may be filled from inside forEach or
+    * from a worker thread as long as each thread records into its own buffer. Added components
+    * are constructed into the buffer's block arena and moved into the registry on apply.
+    *
+    * create() returns a pending entity that is only meaningful to this buffer: it can be used
+    * in later commands of the same buffer and is resolved to a real entity when the buffer is applied.
+    */
+    class lmEntityCommandBuffer {
+    public:
+        lmEntityCommandBuffer() = default;
+        ~lmEntityCommandBuffer();
+
+        lmEntityCommandBuffer(const lmEntityCommandBuffer&) = delete;
+        lmEntityCommandBuffer& operator=(const lmEntityCommandBuffer&) = delete;
+        lmEntityCommandBuffer(lmEntityCommandBuffer&&) = default;
+        lmEntityCommandBuffer& operator=(lmEntityCommandBuffer&&) = default;
+
+        lmEntity create();
+        void destroy(lmEntity entity);
+
+        template <typename T, typename... Args>
+        void add(lmEntity entity, Args&&... args) {
+            const lmComponentId id = componentId<T>();
+            void* data = allocate(sizeof(T), alignof(T));
+            new (data) T(std::forward<Args>(args)...);
+            commands.push_back(Command{ CommandType::Add, id, entity, data });
+        }
+
+        template <typename T>
+        void remove(lmEntity entity) {
+            commands.push_back(Command{ CommandType::Remove, componentId<T>(), entity, nullptr });
+        }
+
+        // Replays the recorded commands in order and leaves the buffer empty
+        void apply(lmRegistry& registry);
+
+        // Drops the recorded commands without applying them
+        void clear();
+
+        bool empty() const { return commands.empty(); }
+        size_t size() const { return commands.size(); }
+
+        static bool isPending(lmEntity entity) { return !entity.isNull() && entity.generation() == PENDING_GENERATION; }
+
+    private:
+        // Live generations never reach the retired generation, so it is free to tag pending entities
+        static constexpr uint32_t PENDING_GENERATION = lmEntity::MAX_GENERATION;
+        static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+        enum class CommandType : uint8_t {
+            Create,
+            Destroy,
+            Add,
+            Remove
+        };
+
+        struct Command {
+            CommandType type;
+            lmComponentId component;
+            lmEntity entity;
+            void* data;
+        };
+
+        struct BlockDeleter {
+            void operator()(std::byte* block) const;
+        };
+
+        struct Block {
+            std::unique_ptr<std::byte, BlockDeleter> data;
+            size_t size = 0;
+        };
+
+        void* allocate(size_t size, size_t alignment);
+        lmEntity resolve(lmEntity entity) const;
+
+        std::vector<Command> commands;
+        uint32_t pendingCount = 0;
+        std::vector<lmEntity> createdEntities;
+
+        // Blocks are kept between frames, only the write position is reset
+        std::vector<Block> blocks;
+        size_t currentBlock = 0;
+        size_t blockOffset = 0;
+    };
+
+    /*
+    * One lmEntityCommandBuffer per thread of an lmThreadPool, so parallel systems record
+    * without locking. The buffers are applied in thread order at the frame's sync point.
+    */
+    class lmEntityCommandQueue {
+    public:
+        explicit lmEntityCommandQueue(uint32_t threadCount);
+
+        lmEntityCommandQueue(const lmEntityCommandQueue&) = delete;
+        lmEntityCommandQueue& operator=(const lmEntityCommandQueue&) = delete;
+
+        // The buffer owned by the calling thread
+        lmEntityCommandBuffer& local();
+
+        void apply(lmRegistry& registry);
+
+    private:
+        std::vector<lmEntityCommandBuffer> buffers;
+    };
+
+} // namespace lm
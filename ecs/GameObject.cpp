@@ -4,6 +4,7 @@
 */
 
 #include "GameObject.h"
+#include "TransformKernel.h"
 
 namespace lm {   
 
@@ -99,66 +100,45 @@ namespace lm {
      * @brief Updates the transformation and normal matrices of the TransformComponent.
      */
     void TransformComponent::update() {
-        transform = glm::mat4(1.0f);
-        transform = glm::translate(transform, translation);
-        transform = transform * glm::mat4_cast(rotation);
-        transform = glm::scale(transform, scale);
-        normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        computeTransform(translation, rotation, scale, transform, normalMatrix);
         dirty = false;
     }
 
     /**
      * @class lmGameObject
-     * @brief A class for managing game objects.
+     * @brief Factory functions for creating game object entities.
      */
 
-     /**
-      * @brief Constructor for lmGameObject with a specified object ID.
-      * @param objectID The unique ID for the new object.
-      */
-    lmGameObject::lmGameObject(lmGameObject::id_type objectID) : id(objectID) {}
-
     /**
-     * @brief Retrieves the unique ID of the lmGameObject.
-     * @return The unique ID of the object.
+     * @brief Creates a new entity with a default TransformComponent.
+     * @param registry The registry to create the entity in.
+     * @return The new entity.
      */
-    lmGameObject::id_type lmGameObject::getID() const {
-        return id;
+    lmEntity lmGameObject::createGameObject(lmRegistry& registry) {
+        lmEntity entity = registry.create();
+        registry.add<TransformComponent>(entity);
+        return entity;
     }
 
     /**
-     * @brief Rotates the lmGameObject by a specified angle around a specified axis.
-     * @param angle The angle to rotate by.
-     * @param axis The axis to rotate around.
-     */
-    void lmGameObject::rotate(float angle, const glm::vec3& axis) {
-        transform.rotate(angle, axis);
-    }
-
-    /**
-     * @brief Creates a new lmGameObject with an automatically generated unique ID.
-     * @return The new lmGameObject.
-     */
-    lmGameObject lmGameObject::createGameObject() {
-        static std::atomic<id_type> currentID = 0;
-        return lmGameObject{ currentID++ };
-    }
-
-    /**
-     * @brief Creates a new lmGameObject representing a point light source.
+     * @brief Creates a new entity representing a point light source.
+     * @param registry The registry to create the entity in.
      * @param intensity The intensity of the light source.
      * @param radius The radius of the light source.
      * @param color The color of the light source.
-     * @return The new lmGameObject.
+     * @return The new entity.
      */
-    lmGameObject lmGameObject::makePointLight(float intensity, float radius, glm::vec4 color) {
-        lmGameObject gameObj = lmGameObject::createGameObject();
-        gameObj.color = color;
-        gameObj.transform.scale.x = radius;
-        gameObj.pointLight = std::make_unique<PointLightComponent>();
-        gameObj.pointLight->lightIntensity = intensity;
-
-        return gameObj;
+    lmEntity lmGameObject::makePointLight(lmRegistry& registry, float intensity, float radius, glm::vec4 color) {
+        lmEntity entity = createGameObject(registry);
+        // The light is drawn as a billboard of the given radius, a uniform scale keeps its bounds a cube
+        registry.get<TransformComponent>(entity).setScale(glm::vec3(radius));
+        registry.add<BoundsComponent>(entity, BoundsComponent{ lmAabb{ glm::vec3(-1.f), glm::vec3(1.f) }, SPATIAL_LAYER_LIGHTS });
+
+        auto& pointLight = registry.add<PointLightComponent>(entity);
+        pointLight.lightIntensity = intensity;
+        pointLight.color = glm::vec3(color);
+
+        return entity;
     }
 
 }  // namespace lm
@@ -1,21 +1,29 @@
 #pragma once
 
-#include "../render/Model.h"
+#include "Bounds.h"
+#include "Registry.h"
 
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
 
 namespace lm {
 
+    class lmModel;
+
     struct TransformComponent {
     public:
         glm::vec3 translation{};
         glm::vec3 scale{ 1.f, 1.f, 1.f };
         glm::quat rotation{1, 0, 0, 0};
 
+        // Set by the setters. Code changing a transform after its creation must also mark it changed in the registry,
+        // lmTransformHierarchy::syncLocalMatrices only recomputes the changed ones
         bool dirty = true;
         glm::mat4 transform;
 
@@ -41,38 +49,34 @@ namespace lm {
 
     struct PointLightComponent {
         float lightIntensity = 1.f;
+        glm::vec3 color{ 1.f };
     };
 
-    class lmGameObject {
-    public:
-        using id_type = unsigned int;
-        using Map = std::unordered_map<id_type, lmGameObject>;
-
-        static lmGameObject createGameObject();
-
-        static lmGameObject makePointLight(
-            float intensity = 10.f, float radius = 0.1f, glm::vec4 color = glm::vec4(1.f));
-
-        lmGameObject(const lmGameObject&) = delete;
-        lmGameObject& operator=(const lmGameObject&) = delete;
-        lmGameObject(lmGameObject&&) = default;
-        lmGameObject& operator=(lmGameObject&&) = default;
+    struct ModelComponent {
+        std::shared_ptr<lmModel> model{};
+    };
 
-        id_type getID() const;
+    // Spatial query layers, an entity may belong to several and queries take a mask of the layers to visit
+    inline constexpr uint32_t SPATIAL_LAYER_DEFAULT = 1u << 0;
+    inline constexpr uint32_t SPATIAL_LAYER_MODELS = 1u << 1;
+    inline constexpr uint32_t SPATIAL_LAYER_LIGHTS = 1u << 2;
+    inline constexpr uint32_t SPATIAL_LAYER_ALL = ~0u;
 
-        void rotate(float angle, const glm::vec3& axis);
+    // Bounds in the entity's local space, entities owning one are tracked by lmSpatialIndex
+    struct BoundsComponent {
+        lmAabb localBounds{};
+        uint32_t layers = SPATIAL_LAYER_DEFAULT;
+    };
 
-        
-        glm::vec3 color{};
-        TransformComponent transform{};
+    // Factory functions creating the common entity layouts in a registry
+    class lmGameObject {
+    public:
+        lmGameObject() = delete;
 
-        // Optional pointer components
-        std::shared_ptr<lmModel> model{};
-        std::unique_ptr<PointLightComponent> pointLight = nullptr;
+        static lmEntity createGameObject(lmRegistry& registry);
 
-    private:
-        lmGameObject(id_type objectID);
-        id_type id;
+        static lmEntity makePointLight(
+            lmRegistry& registry, float intensity = 10.f, float radius = 0.1f, glm::vec4 color = glm::vec4(1.f));
     };
 
 } // namespace lm
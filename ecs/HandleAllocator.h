@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Entity.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * Slot allocator handing out generational handles.
+    *
+    * Freed slots go into a FIFO free list and are only recycled once at least
+    * MIN_FREE_SLOTS of them are queued, which spreads generation increments over
+    * many slots and keeps stale handles detectable for longer. A slot whose
+    * generation would wrap around is retired instead of being reused.
+    */
+    template <typename Handle>
+    class lmHandleAllocator {
+    public:
+        static constexpr size_t MIN_FREE_SLOTS = 1024;
+
+        Handle allocate() {
+            uint32_t index;
+
+            if (freeSlots.size() > MIN_FREE_SLOTS) {
+                index = freeSlots.front();
+                freeSlots.pop_front();
+            }
+            else {
+                assert(generations.size() <= Handle::MAX_INDEX && "Handle slots exhausted");
+                index = static_cast<uint32_t>(generations.size());
+                generations.push_back(0);
+            }
+
+            aliveCount++;
+            return Handle{ index, generations[index] };
+        }
+
+        void free(Handle handle) {
+            assert(isAlive(handle) && "Freeing a stale or null handle");
+            const uint32_t index = handle.index();
+
+            aliveCount--;
+
+            generations[index]++;
+
+            // Retire the slot rather than wrap the generation and resurrect old handles
+            if (generations[index] != RETIRED) {
+                freeSlots.push_back(index);
+            }
+        }
+
+        bool isAlive(Handle handle) const {
+            const uint32_t index = handle.index();
+            return !handle.isNull() && index < generations.size() && generations[index] == handle.generation();
+        }
+
+        // Number of slots ever created, i.e. the required size of tables indexed by Handle::index()
+        size_t capacity() const { return generations.size(); }
+        size_t size() const { return aliveCount; }
+
+    private:
+        // Reserved generation of slots that are never handed out again
+        static constexpr uint32_t RETIRED = Handle::MAX_GENERATION;
+
+        std::vector<uint32_t> generations;
+        std::deque<uint32_t> freeSlots;
+        size_t aliveCount = 0;
+    };
+
+} // namespace lm
@@ -0,0 +1,288 @@
+/**
+ * @file Registry.cpp
+ * @brief Entity bookkeeping and archetype transitions for lmRegistry.
+ */
+
+#include "Registry.h"
+
+namespace lm {
+
+    /**
+     * @brief Constructs a registry containing only the empty root archetype.
+     */
+    lmRegistry::lmRegistry() {
+        rootArchetype = findOrCreateArchetype(0);
+    }
+
+    /**
+     * @brief Destroys the registry together with every component it stores.
+     */
+    lmRegistry::~lmRegistry() {}
+
+    /**
+     * @brief Creates a new entity without any components.
+     * @return The new entity.
+     */
+    lmEntity lmRegistry::create() {
+        const lmEntity entity = entityAllocator.allocate();
+
+        if (records.size() < entityAllocator.capacity()) {
+            records.resize(entityAllocator.capacity());
+        }
+
+        EntityRecord& record = records[entity.index()];
+        record.archetype = rootArchetype;
+        record.row = static_cast<uint32_t>(rootArchetype->pushEntity(entity));
+        record.generation = entity.generation();
+
+        return entity;
+    }
+
+    /**
+     * @brief Creates entities directly in the archetype of a component signature, leaving their components for the caller to construct in place.
+     *
+     * Every component counts as added, so it is marked changed like add() does.
+     *
+     * @param mask The component signature of the new entities.
+     * @param count The number of entities to create.
+     * @param entities Receives the new entities, appended in row order.
+     * @return The archetype holding the entities, whose columns have uninitialized storage in their rows.
+     */
+    lmArchetype* lmRegistry::createUninitialized(lmComponentMask mask, size_t count, std::vector<lmEntity>& entities) {
+        lmArchetype* archetype = findOrCreateArchetype(mask);
+        entities.reserve(entities.size() + count);
+
+        for (size_t i = 0; i < count; i++) {
+            const lmEntity entity = entityAllocator.allocate();
+
+            if (records.size() < entityAllocator.capacity()) {
+                records.resize(entityAllocator.capacity());
+            }
+
+            EntityRecord& record = records[entity.index()];
+            record.archetype = archetype;
+            record.row = static_cast<uint32_t>(archetype->pushEntity(entity));
+            record.generation = entity.generation();
+
+            for (auto& column : archetype->getColumns()) {
+                column.pushUninitialized();
+                column.setVersion(record.row, version);
+                changedEntities[column.getComponentId()].push_back(entity);
+            }
+
+            entities.push_back(entity);
+        }
+
+        return archetype;
+    }
+
+    /**
+     * @brief Destroys an entity and all of its components.
+     * @param entity The entity to destroy.
+     */
+    void lmRegistry::destroy(lmEntity entity) {
+        if (!isAlive(entity)) {
+            return;
+        }
+
+        EntityRecord& record = records[entity.index()];
+        const lmEntity moved = record.archetype->swapRemove(record.row);
+
+        if (!moved.isNull()) {
+            records[moved.index()].row = record.row;
+        }
+
+        record.archetype = nullptr;
+        record.row = 0;
+        entityAllocator.free(entity);
+        destroyedEntities.push_back(entity);
+    }
+
+    /**
+     * @brief Checks whether an entity exists in the registry.
+     * @param entity The entity to check.
+     * @return True if the entity has been created and not destroyed, false for stale handles.
+     */
+    bool lmRegistry::isAlive(lmEntity entity) const {
+        return entityAllocator.isAlive(entity);
+    }
+
+    /**
+     * @brief Gives an entity a component and returns its storage for the caller to construct in place.
+     *
+     * If the entity already owns the component, the existing instance is destroyed and its storage reused.
+     *
+     * @param entity The entity receiving the component.
+     * @param id The component being added.
+     * @return Uninitialized storage for the component.
+     */
+    void* lmRegistry::addUninitialized(lmEntity entity, lmComponentId id) {
+        assert(isAlive(entity) && "Cannot add a component to a dead entity");
+        EntityRecord& record = records[entity.index()];
+
+        if (lmComponentColumn* column = record.archetype->getColumn(id)) {
+            void* storage = column->get(record.row);
+            getComponentInfo(id).destroy(storage);
+            markChanged(entity, id);
+            return storage;
+        }
+
+        const size_t row = moveEntity(entity, getAddTarget(record.archetype, id));
+        markChanged(entity, id);
+        return records[entity.index()].archetype->getColumn(id)->get(row);
+    }
+
+    /**
+     * @brief Removes a component from an entity, does nothing if the entity does not own it.
+     * @param entity The entity losing the component.
+     * @param id The component being removed.
+     */
+    void lmRegistry::remove(lmEntity entity, lmComponentId id) {
+        assert(isAlive(entity) && "Cannot remove a component from a dead entity");
+        EntityRecord& record = records[entity.index()];
+
+        if (!record.archetype->has(id)) {
+            return;
+        }
+
+        moveEntity(entity, getRemoveTarget(record.archetype, id));
+    }
+
+    /**
+     * @brief Records that a component of an entity changed during the current frame.
+     *
+     * The component's version is set to the registry version and the entity is appended to the
+     * component's changed list, at most once per frame. Marking component T is only safe from the
+     * thread, or scheduled system, that has write access to T.
+     *
+     * @param entity The entity owning the component.
+     * @param id The component that changed.
+     */
+    void lmRegistry::markChanged(lmEntity entity, lmComponentId id) {
+        if (!isAlive(entity)) {
+            return;
+        }
+
+        const EntityRecord& record = records[entity.index()];
+        lmComponentColumn* column = record.archetype->getColumn(id);
+        if (!column || column->getVersion(record.row) == version) {
+            return;
+        }
+
+        column->setVersion(record.row, version);
+        changedEntities[id].push_back(entity);
+    }
+
+    /**
+     * @brief Retrieves the version at which a component of an entity last changed.
+     * @param entity The entity owning the component.
+     * @param id The component.
+     * @return The version, or 0 if the entity does not own the component.
+     */
+    uint32_t lmRegistry::getChangedVersion(lmEntity entity, lmComponentId id) const {
+        if (!isAlive(entity)) {
+            return 0;
+        }
+
+        const EntityRecord& record = records[entity.index()];
+        const lmComponentColumn* column = record.archetype->getColumn(id);
+        return column ? column->getVersion(record.row) : 0;
+    }
+
+    /**
+     * @brief Ends the current change frame: bumps the version and empties the changed and destroyed lists.
+     */
+    void lmRegistry::nextFrame() {
+        version++;
+
+        for (auto& changed : changedEntities) {
+            changed.clear();
+        }
+        destroyedEntities.clear();
+    }
+
+    /**
+     * @brief Retrieves the archetype for a component signature, creating it on first use.
+     * @param mask The component signature.
+     * @return The archetype storing entities with exactly this signature.
+     */
+    lmArchetype* lmRegistry::findOrCreateArchetype(lmComponentMask mask) {
+        auto it = archetypeLookup.find(mask);
+        if (it != archetypeLookup.end()) {
+            return it->second;
+        }
+
+        archetypes.push_back(std::make_unique<lmArchetype>(mask));
+        lmArchetype* archetype = archetypes.back().get();
+        archetypeLookup.emplace(mask, archetype);
+        return archetype;
+    }
+
+    /**
+     * @brief Finds the archetype reached by adding a component, caching the transition on the source.
+     * @param source The current archetype of the entity.
+     * @param id The component being added.
+     * @return The archetype with the component added.
+     */
+    lmArchetype* lmRegistry::getAddTarget(lmArchetype* source, lmComponentId id) {
+        if (!source->addEdges[id]) {
+            source->addEdges[id] = findOrCreateArchetype(source->getMask() | (lmComponentMask{ 1 } << id));
+        }
+
+        return source->addEdges[id];
+    }
+
+    /**
+     * @brief Finds the archetype reached by removing a component, caching the transition on the source.
+     * @param source The current archetype of the entity.
+     * @param id The component being removed.
+     * @return The archetype with the component removed.
+     */
+    lmArchetype* lmRegistry::getRemoveTarget(lmArchetype* source, lmComponentId id) {
+        if (!source->removeEdges[id]) {
+            source->removeEdges[id] = findOrCreateArchetype(source->getMask() & ~(lmComponentMask{ 1 } << id));
+        }
+
+        return source->removeEdges[id];
+    }
+
+    /**
+     * @brief Moves an entity and its shared components into another archetype.
+     *
+     * Components present in both archetypes are moved, components only present in the target are
+     * left uninitialized for the caller to construct, and components only present in the source are destroyed.
+     *
+     * @param entity The entity to move.
+     * @param target The destination archetype.
+     * @return The row of the entity in the destination archetype.
+     */
+    size_t lmRegistry::moveEntity(lmEntity entity, lmArchetype* target) {
+        EntityRecord& record = records[entity.index()];
+        lmArchetype* source = record.archetype;
+        const size_t sourceRow = record.row;
+
+        const size_t targetRow = target->pushEntity(entity);
+
+        for (auto& column : target->getColumns()) {
+            lmComponentColumn* sourceColumn = source->getColumn(column.getComponentId());
+
+            if (sourceColumn) {
+                column.pushMoved(sourceColumn->get(sourceRow));
+                column.setVersion(targetRow, sourceColumn->getVersion(sourceRow));
+            }
+            else {
+                column.pushUninitialized();
+            }
+        }
+
+        const lmEntity moved = source->swapRemove(sourceRow);
+        if (!moved.isNull()) {
+            records[moved.index()].row = static_cast<uint32_t>(sourceRow);
+        }
+
+        record.archetype = target;
+        record.row = static_cast<uint32_t>(targetRow);
+        return targetRow;
+    }
+
+} // namespace lm
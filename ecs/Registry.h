@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Archetype.h"
+#include "Entity.h"
+#include "HandleAllocator.h"
+#include "View.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * Archetype based entity registry.
+    *
+    * Entities sharing the same set of components are stored together in an lmArchetype,
+    * where every component type lives in its own contiguous column. Systems iterate
+    * archetypes whose signature contains the requested components, so entities
+    * that lack a component are never visited.
+    *
+    * Entities are generational handles: the index addresses a dense record table
+    * pointing at the entity's archetype row, and destroyed slots are recycled while
+    * stale handles are rejected. The 16-byte record also keeps the generation of the
+    * live entity, so a lookup checks the handle and finds the row with one record read.
+    */
+    class lmRegistry {
+    public:
+        lmRegistry();
+        ~lmRegistry();
+
+        lmRegistry(const lmRegistry&) = delete;
+        lmRegistry& operator=(const lmRegistry&) = delete;
+
+        lmEntity create();
+        void destroy(lmEntity entity);
+
+        // Creates count entities owning default constructed Ts and appends them to entities. They are placed
+        // straight into the archetype of Ts, where create() and one add() per component move every entity
+        // through each intermediate archetype
+        template <typename... Ts>
+        void createBatch(size_t count, std::vector<lmEntity>& entities) {
+            const size_t first = entities.size();
+            lmArchetype* archetype = createUninitialized(componentMask<Ts...>(), count, entities);
+
+            for (size_t i = first; i < entities.size(); i++) {
+                const size_t row = records[entities[i].index()].row;
+                (new (archetype->getColumn(componentId<Ts>())->get(row)) Ts(), ...);
+            }
+        }
+        bool isAlive(lmEntity entity) const;
+
+        size_t size() const { return entityAllocator.size(); }
+        const std::vector<std::unique_ptr<lmArchetype>>& getArchetypes() const { return archetypes; }
+
+        template <typename T, typename... Args>
+        T& add(lmEntity entity, Args&&... args) {
+            return *new (addUninitialized(entity, componentId<T>())) T(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        void remove(lmEntity entity) {
+            remove(entity, componentId<T>());
+        }
+
+        // Type-erased variants used to replay recorded structural changes (see lmEntityCommandBuffer)
+        void* addUninitialized(lmEntity entity, lmComponentId id);
+        void remove(lmEntity entity, lmComponentId id);
+        lmArchetype* createUninitialized(lmComponentMask mask, size_t count, std::vector<lmEntity>& entities);
+
+        template <typename T>
+        bool has(lmEntity entity) const {
+            const EntityRecord* record = findRecord(entity);
+            return record && record->archetype->has(componentId<T>());
+        }
+
+        template <typename T>
+        T& get(lmEntity entity) {
+            T* component = tryGet<T>(entity);
+            assert(component && "Entity does not have the requested component");
+            return *component;
+        }
+
+        template <typename T>
+        T* tryGet(lmEntity entity) {
+            const EntityRecord* record = findRecord(entity);
+            if (!record) {
+                return nullptr;
+            }
+
+            lmComponentColumn* column = record->archetype->getColumn(componentId<T>());
+            return column ? static_cast<T*>(column->getData()) + record->row : nullptr;
+        }
+
+        // Change tracking. Adding a component marks it changed, in-place modifications must call markChanged.
+        // Every component remembers the registry version of its last change, and each component type keeps
+        // the list of entities changed since the last nextFrame(), so consumers only revisit what changed.
+        template <typename T>
+        void markChanged(lmEntity entity) {
+            markChanged(entity, componentId<T>());
+        }
+
+        template <typename T>
+        uint32_t getChangedVersion(lmEntity entity) const {
+            return getChangedVersion(entity, componentId<T>());
+        }
+
+        template <typename T>
+        bool changedSince(lmEntity entity, uint32_t sinceVersion) const {
+            return getChangedVersion<T>(entity) > sinceVersion;
+        }
+
+        // Entities whose T changed this frame, may contain entities destroyed since then
+        template <typename T>
+        const std::vector<lmEntity>& getChanged() const {
+            return changedEntities[componentId<T>()];
+        }
+
+        // Entities destroyed this frame, so consumers can drop what they cached about them
+        const std::vector<lmEntity>& getDestroyed() const { return destroyedEntities; }
+
+        void markChanged(lmEntity entity, lmComponentId id);
+        uint32_t getChangedVersion(lmEntity entity, lmComponentId id) const;
+
+        uint32_t getVersion() const { return version; }
+        void nextFrame();
+
+        // Typed query over the entities owning all of Ts and none of the excluded components
+        template <typename... Ts, typename... Es>
+        lmView<Ts...> view(lmExclude<Es...> = {}) {
+            return lmView<Ts...>(archetypes, componentMask<Es...>());
+        }
+
+        // Calls fn(entity, Ts&...) for every entity owning all of Ts. Must not create, destroy, add or remove while
+        // iterating, record those changes in an lmEntityCommandBuffer and apply it once the iteration is done.
+        template <typename... Ts, typename Func>
+        void forEach(Func&& fn) {
+            view<Ts...>().each(fn);
+        }
+
+    private:
+        // The archetype is nullptr once the entity is destroyed, rows fit 32 bits like entity indices
+        struct EntityRecord {
+            lmArchetype* archetype = nullptr;
+            uint32_t row = 0;
+            uint32_t generation = 0;
+        };
+
+        // The record of a live entity, nullptr for null and stale handles
+        const EntityRecord* findRecord(lmEntity entity) const {
+            const uint32_t index = entity.index();
+            if (index >= records.size()) {
+                return nullptr;
+            }
+
+            const EntityRecord& record = records[index];
+            return record.archetype && record.generation == entity.generation() ? &record : nullptr;
+        }
+
+        lmArchetype* findOrCreateArchetype(lmComponentMask mask);
+        lmArchetype* getAddTarget(lmArchetype* source, lmComponentId id);
+        lmArchetype* getRemoveTarget(lmArchetype* source, lmComponentId id);
+        size_t moveEntity(lmEntity entity, lmArchetype* target);
+
+        lmHandleAllocator<lmEntity> entityAllocator;
+        std::vector<EntityRecord> records;
+        std::vector<std::unique_ptr<lmArchetype>> archetypes;
+        std::unordered_map<lmComponentMask, lmArchetype*> archetypeLookup;
+        lmArchetype* rootArchetype = nullptr;
+
+        // Starts at 1 so that version 0 means "never changed"
+        uint32_t version = 1;
+        std::array<std::vector<lmEntity>, MAX_COMPONENTS> changedEntities;
+        std::vector<lmEntity> destroyedEntities;
+    };
+
+} // namespace lm
@@ -0,0 +1,197 @@
+/**
+ * @file Scheduler.cpp
+ * @brief Dependency graph construction and parallel execution of systems.
+ */
+
+#include "Scheduler.h"
+#include "../core/Logger.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+
+namespace lm {
+
+    // Weight of the latest sample in the running average reported by logTimings
+    constexpr double TIMING_SMOOTHING = 0.1;
+
+    /**
+     * @brief Assigns the next resource ID, called once per resource type by resourceMask.
+     * @return The resource ID.
+     */
+    uint32_t registerResource() {
+        static std::atomic<uint32_t> resourceCount{ 0 };
+
+        const uint32_t id = resourceCount++;
+        assert(id < MAX_RESOURCES && "Too many resource types registered");
+        return id;
+    }
+
+    /**
+     * @brief Constructs a scheduler executing systems on the given thread pool.
+     * @param pool The pool running systems that are not bound to the main thread.
+     */
+    lmScheduler::lmScheduler(lmThreadPool& pool) : threadPool{ pool } {}
+
+    /**
+     * @brief Registers a system.
+     * @param name The name reported in the timings.
+     * @param access The component and resource types the system reads and writes.
+     * @param function The work of the system.
+     * @return The scheduler, for chaining.
+     */
+    lmScheduler& lmScheduler::addSystem(const std::string& name, const lmSystemAccess& access, SystemFunction function) {
+        systems.push_back(System{ name, access, std::move(function) });
+
+        lmSystemTiming timing{};
+        timing.name = name;
+        timings.push_back(timing);
+
+        return *this;
+    }
+
+    /**
+     * @brief Builds the dependency graph of the registered systems.
+     */
+    void lmScheduler::buildGraph() {
+        const size_t count = systems.size();
+        dependents.assign(count, {});
+        dependencyCounts.assign(count, 0);
+
+        for (size_t later = 0; later < count; later++) {
+            for (size_t earlier = 0; earlier < later; earlier++) {
+                if (systems[earlier].access.conflictsWith(systems[later].access)) {
+                    dependents[earlier].push_back(later);
+                    dependencyCounts[later]++;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Runs every registered system once and blocks until all of them have finished.
+     */
+    void lmScheduler::run() {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        buildGraph();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            remainingDependencies = dependencyCounts;
+            completedSystems = 0;
+            mainThreadQueue.clear();
+            readyQueue.clear();
+
+            for (size_t i = 0; i < systems.size(); i++) {
+                if (remainingDependencies[i] == 0) {
+                    dispatch(i);
+                }
+            }
+        }
+
+        // Run main thread systems as they become ready and help with the other ready systems while waiting.
+        // The tasks submitted for the systems the main thread took still run, so they are waited for too
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() {
+                return !mainThreadQueue.empty()
+                    || !readyQueue.empty()
+                    || (completedSystems == systems.size() && pendingTasks == 0);
+            });
+
+            std::deque<size_t>& queue = !mainThreadQueue.empty() ? mainThreadQueue : readyQueue;
+            if (queue.empty()) {
+                break;
+            }
+
+            const size_t system = queue.front();
+            queue.pop_front();
+            lock.unlock();
+
+            execute(system);
+        }
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        lastRunMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    /**
+     * @brief Hands a system whose dependencies are complete to the thread that will run it.
+     * @note Called with the scheduler mutex held.
+     * @param system The index of the system.
+     */
+    void lmScheduler::dispatch(size_t system) {
+        if (systems[system].access.mainThreadOnly || threadPool.getWorkerCount() == 0) {
+            mainThreadQueue.push_back(system);
+            condition.notify_all();
+            return;
+        }
+
+        readyQueue.push_back(system);
+        pendingTasks++;
+        condition.notify_all();
+        threadPool.submit([this]() { runReadySystem(); });
+    }
+
+    /**
+     * @brief Pool task submitted for every ready system, runs the next ready system unless the main thread took them all.
+     */
+    void lmScheduler::runReadySystem() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!readyQueue.empty()) {
+            const size_t system = readyQueue.front();
+            readyQueue.pop_front();
+            lock.unlock();
+
+            execute(system);
+            lock.lock();
+        }
+
+        // The scheduler may be gone as soon as the mutex is released
+        pendingTasks--;
+        condition.notify_all();
+    }
+
+    /**
+     * @brief Runs a system, records its timing and releases the systems depending on it.
+     * @param system The index of the system.
+     */
+    void lmScheduler::execute(size_t system) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        systems[system].function();
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        lmSystemTiming& timing = timings[system];
+        timing.lastMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        timing.averageMilliseconds = timing.averageMilliseconds == 0.0
+            ? timing.lastMilliseconds
+            : timing.averageMilliseconds + TIMING_SMOOTHING * (timing.lastMilliseconds - timing.averageMilliseconds);
+        timing.threadIndex = lmThreadPool::getCurrentThreadIndex();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t dependent : dependents[system]) {
+            assert(remainingDependencies[dependent] > 0);
+            if (--remainingDependencies[dependent] == 0) {
+                dispatch(dependent);
+            }
+        }
+
+        completedSystems++;
+        condition.notify_all();
+    }
+
+    /**
+     * @brief Logs the last and average execution time of every system.
+     */
+    void lmScheduler::logTimings() const {
+        LOG_INFO("System timings ({} worker threads, last run {:.3f} ms):", threadPool.getWorkerCount(), lastRunMilliseconds);
+
+        for (const auto& timing : timings) {
+            LOG_INFO("\t{:<36} last {:.3f} ms, avg {:.3f} ms, thread {}",
+                timing.name, timing.lastMilliseconds, timing.averageMilliseconds, timing.threadIndex);
+        }
+    }
+
+} // namespace lm
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Archetype.h"
+#include "../core/ThreadPool.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lm {
+
+    using lmResourceMask = uint64_t;
+
+    constexpr uint32_t MAX_RESOURCES = 64;
+
+    // Shared resources (e.g. the camera or the frame's command buffer) are numbered apart from the
+    // components, so they neither use up component IDs nor appear as component types
+    uint32_t registerResource();
+
+    template <typename T>
+    lmResourceMask resourceMask() {
+        static const uint32_t id = registerResource();
+        return lmResourceMask{ 1 } << id;
+    }
+
+    // Declares which component types and shared resources a system reads and writes
+    class lmSystemAccess {
+    public:
+        template <typename T>
+        lmSystemAccess& read() {
+            reads |= componentMask<T>();
+            return *this;
+        }
+
+        template <typename T>
+        lmSystemAccess& write() {
+            writes |= componentMask<T>();
+            return *this;
+        }
+
+        template <typename T>
+        lmSystemAccess& readResource() {
+            resourceReads |= resourceMask<T>();
+            return *this;
+        }
+
+        template <typename T>
+        lmSystemAccess& writeResource() {
+            resourceWrites |= resourceMask<T>();
+            return *this;
+        }
+
+        // The system must run on the thread calling lmScheduler::run (e.g. GLFW input)
+        lmSystemAccess& mainThread() {
+            mainThreadOnly = true;
+            return *this;
+        }
+
+        bool conflictsWith(const lmSystemAccess& other) const {
+            return (writes & (other.reads | other.writes)) || (other.writes & reads)
+                || (resourceWrites & (other.resourceReads | other.resourceWrites)) || (other.resourceWrites & resourceReads);
+        }
+
+        lmComponentMask reads = 0;
+        lmComponentMask writes = 0;
+        lmResourceMask resourceReads = 0;
+        lmResourceMask resourceWrites = 0;
+        bool mainThreadOnly = false;
+    };
+
+    struct lmSystemTiming {
+        std::string name;
+        double lastMilliseconds = 0.0;
+        double averageMilliseconds = 0.0;
+        uint32_t threadIndex = 0;
+    };
+
+    /*
+    * Runs systems in parallel according to their declared access sets.
+    *
+    * Every run builds a dependency graph in which a system depends on each earlier
+    * registered system it conflicts with (write/write or read/write on the same type),
+    * so registration order decides the order of conflicting systems. Systems without
+    * dependencies between them run concurrently on the thread pool.
+    *
+    * Ready systems wait in a queue of the scheduler, popped by the pool tasks submitted
+    * for them and by the thread calling run() while it waits, which therefore never runs
+    * pool work unrelated to the systems (e.g. a long task submitted by another subsystem).
+    */
+    class lmScheduler {
+    public:
+        using SystemFunction = std::function<void()>;
+
+        explicit lmScheduler(lmThreadPool& pool);
+
+        lmScheduler(const lmScheduler&) = delete;
+        lmScheduler& operator=(const lmScheduler&) = delete;
+
+        lmScheduler& addSystem(const std::string& name, const lmSystemAccess& access, SystemFunction function);
+
+        void run();
+
+        const std::vector<lmSystemTiming>& getTimings() const { return timings; }
+        double getLastRunMilliseconds() const { return lastRunMilliseconds; }
+        void logTimings() const;
+
+    private:
+        struct System {
+            std::string name;
+            lmSystemAccess access;
+            SystemFunction function;
+        };
+
+        void buildGraph();
+        void dispatch(size_t system);
+        void runReadySystem();
+        void execute(size_t system);
+
+        lmThreadPool& threadPool;
+        std::vector<System> systems;
+        std::vector<lmSystemTiming> timings;
+        double lastRunMilliseconds = 0.0;
+
+        // Per run dependency graph
+        std::vector<std::vector<size_t>> dependents;
+        std::vector<uint32_t> dependencyCounts;
+        std::vector<uint32_t> remainingDependencies;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<size_t> mainThreadQueue;
+        std::deque<size_t> readyQueue;
+        size_t completedSystems = 0;
+        size_t pendingTasks = 0;	// Submitted runReadySystem() tasks that have not returned, run() waits for them
+    };
+
+} // namespace lm
@@ -0,0 +1,498 @@
+/**
+ * @file SpatialIndex.cpp
+ * @brief Dynamic AABB tree over entity bounds, kept in sync with the registry's change tracking.
+ */
+
+#include "SpatialIndex.h"
+#include "TransformHierarchy.h"
+#include "TransformKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+namespace lm {
+
+    /**
+     * @brief Inserts an entity or moves it to new world bounds.
+     *
+     * Nothing but the exact bounds is updated while the new bounds stay inside the entity's fat box.
+     * Otherwise the leaf is reinserted with a fat box extended in the direction the entity moved.
+     *
+     * @param entity The entity to insert or move.
+     * @param worldBounds The bounds of the entity in world space, must not be empty.
+     * @param layers The spatial layers the entity belongs to.
+     * @return True if the leaf was inserted or reinserted.
+     */
+    bool lmSpatialIndex::update(lmEntity entity, const lmAabb& worldBounds, uint32_t layers) {
+        assert(!entity.isNull() && "Cannot index the null entity");
+        assert(!worldBounds.isEmpty() && "Cannot index empty bounds");
+
+        if (entityLeaves.size() <= entity.index()) {
+            entityLeaves.resize(static_cast<size_t>(entity.index()) + 1, NULL_NODE);
+        }
+
+        // A leaf left behind by a destroyed entity whose slot has been recycled
+        uint32_t leaf = entityLeaves[entity.index()];
+        if (leaf != NULL_NODE && nodes[leaf].entity != entity) {
+            remove(nodes[leaf].entity);
+            leaf = NULL_NODE;
+        }
+
+        glm::vec3 displacement{ 0.f };
+        if (leaf != NULL_NODE) {
+            Node& node = nodes[leaf];
+            if (node.layers == layers && node.bounds.contains(worldBounds)) {
+                node.worldBounds = worldBounds;
+                return false;
+            }
+
+            displacement = worldBounds.getCenter() - node.worldBounds.getCenter();
+            removeLeaf(leaf);
+        }
+        else {
+            leaf = allocateNode();
+            entityLeaves[entity.index()] = leaf;
+            leafCount++;
+        }
+
+        Node& node = nodes[leaf];
+        node.entity = entity;
+        node.worldBounds = worldBounds;
+        node.layers = layers;
+        node.height = 0;
+        node.child1 = NULL_NODE;
+        node.child2 = NULL_NODE;
+
+        // Grow the fat box by the margin, then towards where the entity is heading
+        node.bounds = lmAabb{ worldBounds.min - glm::vec3(FAT_MARGIN), worldBounds.max + glm::vec3(FAT_MARGIN) };
+        const glm::vec3 predicted = displacement * DISPLACEMENT_MULTIPLIER;
+        node.bounds.min += glm::min(predicted, glm::vec3(0.f));
+        node.bounds.max += glm::max(predicted, glm::vec3(0.f));
+
+        insertLeaf(leaf);
+        return true;
+    }
+
+    /**
+     * @brief Removes an entity from the index, does nothing if it is not indexed.
+     * @param entity The entity to remove.
+     */
+    void lmSpatialIndex::remove(lmEntity entity) {
+        const uint32_t leaf = findLeaf(entity);
+        if (leaf == NULL_NODE) {
+            return;
+        }
+
+        removeLeaf(leaf);
+        freeNode(leaf);
+        entityLeaves[entity.index()] = NULL_NODE;
+        leafCount--;
+    }
+
+    /**
+     * @brief Removes every entity from the index.
+     */
+    void lmSpatialIndex::clear() {
+        nodes.clear();
+        entityLeaves.clear();
+        root = NULL_NODE;
+        freeList = NULL_NODE;
+        leafCount = 0;
+    }
+
+    /**
+     * @brief Checks whether an entity is indexed.
+     * @param entity The entity to check.
+     * @return True if the entity has a leaf in the tree.
+     */
+    bool lmSpatialIndex::contains(lmEntity entity) const {
+        return findLeaf(entity) != NULL_NODE;
+    }
+
+    /**
+     * @brief Retrieves the world bounds an entity was last indexed with.
+     * @param entity The entity, which must be indexed.
+     * @return The exact world bounds of the entity.
+     */
+    const lmAabb& lmSpatialIndex::getBounds(lmEntity entity) const {
+        const uint32_t leaf = findLeaf(entity);
+        assert(leaf != NULL_NODE && "Entity is not part of the spatial index");
+        return nodes[leaf].worldBounds;
+    }
+
+    /**
+     * @brief Brings the index up to date with the changes of the current frame.
+     *
+     * Visits only the entities the registry reports as changed or destroyed and the entities whose world
+     * matrix the hierarchy recomputed, so it must run after the hierarchy update and before the registry
+     * moves to the next frame. World bounds are computed in parallel when many entities changed, the tree
+     * itself is then updated on the calling thread.
+     *
+     * @param registry The registry owning the BoundsComponents and TransformComponents.
+     * @param hierarchy The hierarchy providing the world matrices of its members.
+     * @param threadPool Optional pool used for large batches.
+     */
+    void lmSpatialIndex::sync(lmRegistry& registry, const lmTransformHierarchy& hierarchy, lmThreadPool* threadPool) {
+        for (const lmEntity entity : registry.getDestroyed()) {
+            remove(entity);
+        }
+
+        // An entity may be listed more than once, refreshing it again is harmless
+        syncCandidates.clear();
+        const auto& changedTransforms = registry.getChanged<TransformComponent>();
+        const auto& changedBounds = registry.getChanged<BoundsComponent>();
+        const auto& movedEntities = hierarchy.getUpdatedEntities();
+        syncCandidates.insert(syncCandidates.end(), changedTransforms.begin(), changedTransforms.end());
+        syncCandidates.insert(syncCandidates.end(), changedBounds.begin(), changedBounds.end());
+        syncCandidates.insert(syncCandidates.end(), movedEntities.begin(), movedEntities.end());
+
+        pendingUpdates.resize(syncCandidates.size());
+
+        auto computeBounds = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const lmEntity entity = syncCandidates[i];
+                PendingUpdate& pending = pendingUpdates[i];
+                pending.entity = entity;
+
+                const BoundsComponent* bounds = registry.tryGet<BoundsComponent>(entity);
+                pending.remove = !bounds || bounds->localBounds.isEmpty();
+                if (pending.remove) {
+                    continue;
+                }
+
+                glm::mat4 world{ 1.f };
+                if (hierarchy.contains(entity)) {
+                    world = hierarchy.getWorldMatrix(entity);
+                }
+                else if (const TransformComponent* transform = registry.tryGet<TransformComponent>(entity)) {
+                    if (transform->dirty) {
+                        glm::mat3 normal;
+                        computeTransform(transform->translation, transform->rotation, transform->scale, world, normal);
+                    }
+                    else {
+                        world = transform->transform;
+                    }
+                }
+
+                pending.worldBounds = bounds->localBounds.transformed(world);
+                pending.layers = bounds->layers;
+            }
+        };
+
+        if (threadPool && syncCandidates.size() >= PARALLEL_THRESHOLD) {
+            threadPool->parallelFor(syncCandidates.size(), PARALLEL_GRAIN_SIZE, computeBounds);
+        }
+        else {
+            computeBounds(0, syncCandidates.size());
+        }
+
+        lastReinsertCount = 0;
+        for (const PendingUpdate& pending : pendingUpdates) {
+            if (pending.remove) {
+                remove(pending.entity);
+            }
+            else if (update(pending.entity, pending.worldBounds, pending.layers)) {
+                lastReinsertCount++;
+            }
+        }
+
+        lastSyncCount = syncCandidates.size();
+    }
+
+    /**
+     * @brief Finds the k entities nearest to a point with a best first traversal.
+     *
+     * Nodes are visited by increasing distance from the point and the search stops once the closest
+     * unvisited node is farther than the k-th result found so far.
+     *
+     * @param point The query point.
+     * @param k The maximum number of entities to return.
+     * @param results Receives the entities sorted by increasing distance of their world bounds.
+     * @param layers The spatial layers to search.
+     * @param maxDistance Entities farther than this are ignored.
+     */
+    void lmSpatialIndex::queryNearest(
+        const glm::vec3& point,
+        size_t k,
+        std::vector<lmEntity>& results,
+        uint32_t layers,
+        float maxDistance) const {
+        results.clear();
+        if (root == NULL_NODE || k == 0) {
+            return;
+        }
+
+        const float maxDistanceSquared = maxDistance < std::sqrt(std::numeric_limits<float>::max())
+            ? maxDistance * maxDistance
+            : std::numeric_limits<float>::max();
+
+        using Candidate = std::pair<float, uint32_t>;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> open;
+        std::priority_queue<std::pair<float, lmEntity>> nearest;
+
+        auto kthDistance = [&]() {
+            return nearest.size() < k ? maxDistanceSquared : nearest.top().first;
+        };
+
+        open.emplace(nodes[root].bounds.distanceSquared(point), root);
+        while (!open.empty()) {
+            const auto [distanceSquared, index] = open.top();
+            open.pop();
+
+            if (distanceSquared > kthDistance()) {
+                break;
+            }
+
+            const Node& node = nodes[index];
+            if ((node.layers & layers) == 0) {
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                const float leafDistance = node.worldBounds.distanceSquared(point);
+                if (leafDistance <= kthDistance()) {
+                    nearest.emplace(leafDistance, node.entity);
+                    if (nearest.size() > k) {
+                        nearest.pop();
+                    }
+                }
+                continue;
+            }
+
+            for (const uint32_t child : { node.child1, node.child2 }) {
+                const float childDistance = nodes[child].bounds.distanceSquared(point);
+                if (childDistance <= kthDistance()) {
+                    open.emplace(childDistance, child);
+                }
+            }
+        }
+
+        results.resize(nearest.size());
+        for (size_t i = results.size(); i > 0; i--) {
+            results[i - 1] = nearest.top().second;
+            nearest.pop();
+        }
+    }
+
+    /**
+     * @brief Finds the leaf of an entity.
+     * @param entity The entity.
+     * @return The leaf node, or NULL_NODE if the entity is not indexed.
+     */
+    uint32_t lmSpatialIndex::findLeaf(lmEntity entity) const {
+        if (entity.isNull() || entity.index() >= entityLeaves.size()) {
+            return NULL_NODE;
+        }
+
+        const uint32_t leaf = entityLeaves[entity.index()];
+        return leaf != NULL_NODE && nodes[leaf].entity == entity ? leaf : NULL_NODE;
+    }
+
+    /**
+     * @brief Takes a node from the free list, or appends one.
+     * @return The index of a default initialized node.
+     */
+    uint32_t lmSpatialIndex::allocateNode() {
+        if (freeList == NULL_NODE) {
+            nodes.emplace_back();
+            return static_cast<uint32_t>(nodes.size() - 1);
+        }
+
+        const uint32_t index = freeList;
+        freeList = nodes[index].parent;
+        nodes[index] = Node{};
+        return index;
+    }
+
+    /**
+     * @brief Returns a node to the free list.
+     * @param index The node to release.
+     */
+    void lmSpatialIndex::freeNode(uint32_t index) {
+        nodes[index] = Node{};
+        nodes[index].parent = freeList;
+        freeList = index;
+    }
+
+    /**
+     * @brief Links a leaf into the tree next to the sibling that minimizes the growth in surface area.
+     * @param leaf The leaf to insert, its fat bounds must be set.
+     */
+    void lmSpatialIndex::insertLeaf(uint32_t leaf) {
+        if (root == NULL_NODE) {
+            root = leaf;
+            nodes[leaf].parent = NULL_NODE;
+            return;
+        }
+
+        // Descend towards the cheapest sibling, the cost of a subtree is the area it would gain
+        const lmAabb leafBounds = nodes[leaf].bounds;
+        uint32_t index = root;
+        while (!nodes[index].isLeaf()) {
+            const Node& node = nodes[index];
+            const float area = node.bounds.getSurfaceArea();
+            const float combinedArea = lmAabb::merge(node.bounds, leafBounds).getSurfaceArea();
+
+            // Cost of making the leaf a sibling of this node, and the growth pushed down to the children otherwise
+            const float cost = 2.f * combinedArea;
+            const float inheritanceCost = 2.f * (combinedArea - area);
+
+            auto descendCost = [&](uint32_t child) {
+                const lmAabb merged = lmAabb::merge(nodes[child].bounds, leafBounds);
+                return nodes[child].isLeaf()
+                    ? merged.getSurfaceArea() + inheritanceCost
+                    : merged.getSurfaceArea() - nodes[child].bounds.getSurfaceArea() + inheritanceCost;
+            };
+
+            const float cost1 = descendCost(node.child1);
+            const float cost2 = descendCost(node.child2);
+
+            if (cost < cost1 && cost < cost2) {
+                break;
+            }
+
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        // Replace the sibling with a new parent holding both
+        const uint32_t sibling = index;
+        const uint32_t oldParent = nodes[sibling].parent;
+        const uint32_t newParent = allocateNode();
+
+        Node& parent = nodes[newParent];
+        parent.parent = oldParent;
+        parent.child1 = sibling;
+        parent.child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent == NULL_NODE) {
+            root = newParent;
+        }
+        else if (nodes[oldParent].child1 == sibling) {
+            nodes[oldParent].child1 = newParent;
+        }
+        else {
+            nodes[oldParent].child2 = newParent;
+        }
+
+        refit(newParent);
+    }
+
+    /**
+     * @brief Unlinks a leaf from the tree, its sibling takes the place of their parent.
+     * @param leaf The leaf to unlink, the node itself is kept.
+     */
+    void lmSpatialIndex::removeLeaf(uint32_t leaf) {
+        if (leaf == root) {
+            root = NULL_NODE;
+            return;
+        }
+
+        const uint32_t parent = nodes[leaf].parent;
+        const uint32_t grandParent = nodes[parent].parent;
+        const uint32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+        nodes[leaf].parent = NULL_NODE;
+
+        if (grandParent == NULL_NODE) {
+            root = sibling;
+            return;
+        }
+
+        if (nodes[grandParent].child1 == parent) {
+            nodes[grandParent].child1 = sibling;
+        }
+        else {
+            nodes[grandParent].child2 = sibling;
+        }
+
+        refit(grandParent);
+    }
+
+    /**
+     * @brief Recomputes the bounds, height and layers of a node and all its ancestors, rebalancing on the way up.
+     * @param index The lowest node to refit.
+     */
+    void lmSpatialIndex::refit(uint32_t index) {
+        while (index != NULL_NODE) {
+            fitNode(index);
+            index = balance(index);
+            index = nodes[index].parent;
+        }
+    }
+
+    /**
+     * @brief Recomputes the bounds, height and layers of an internal node from its children.
+     * @param index The node to fit.
+     */
+    void lmSpatialIndex::fitNode(uint32_t index) {
+        Node& node = nodes[index];
+        const Node& child1 = nodes[node.child1];
+        const Node& child2 = nodes[node.child2];
+        node.bounds = lmAabb::merge(child1.bounds, child2.bounds);
+        node.height = 1 + std::max(child1.height, child2.height);
+        node.layers = child1.layers | child2.layers;
+    }
+
+    /**
+     * @brief Rotates the taller grandchild up when the subtrees of a node differ in height by more than one.
+     * @param index The node to balance, its children must be up to date.
+     * @return The node now at the position of index.
+     */
+    uint32_t lmSpatialIndex::balance(uint32_t index) {
+        Node& a = nodes[index];
+        if (a.isLeaf() || a.height < 2) {
+            return index;
+        }
+
+        // Moves the child up in place of a, a keeps the other child and the shorter grandchild
+        auto rotateUp = [&](uint32_t upIndex, bool upIsChild2) {
+            Node& up = nodes[upIndex];
+            const uint32_t tallIndex = nodes[up.child1].height > nodes[up.child2].height ? up.child1 : up.child2;
+            const uint32_t shortIndex = tallIndex == up.child1 ? up.child2 : up.child1;
+
+            up.child1 = index;
+            up.child2 = tallIndex;
+            up.parent = a.parent;
+            a.parent = upIndex;
+
+            if (up.parent == NULL_NODE) {
+                root = upIndex;
+            }
+            else if (nodes[up.parent].child1 == index) {
+                nodes[up.parent].child1 = upIndex;
+            }
+            else {
+                nodes[up.parent].child2 = upIndex;
+            }
+
+            if (upIsChild2) {
+                a.child2 = shortIndex;
+            }
+            else {
+                a.child1 = shortIndex;
+            }
+            nodes[shortIndex].parent = index;
+
+            fitNode(index);
+            fitNode(upIndex);
+            return upIndex;
+        };
+
+        const int32_t heightDifference = nodes[a.child2].height - nodes[a.child1].height;
+        if (heightDifference > 1) {
+            return rotateUp(a.child2, true);
+        }
+        if (heightDifference < -1) {
+            return rotateUp(a.child1, false);
+        }
+
+        return index;
+    }
+
+} // namespace lm
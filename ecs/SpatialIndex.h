@@ -0,0 +1,224 @@
+#pragma once
+
+#include "Bounds.h"
+#include "Entity.h"
+#include "GameObject.h"
+#include "Registry.h"
+#include "../core/ThreadPool.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace lm {
+
+    class lmTransformHierarchy;
+
+    /*
+    * Dynamic AABB tree over the world bounds of entities, answering frustum, sphere, box and
+    * k-nearest queries in logarithmic time instead of scanning every entity.
+    *
+    * Leaves store a "fat" box: the world bounds grown by a margin and by the last displacement.
+    * Moving an entity only touches the tree once it leaves its fat box, so objects that move a
+    * little every frame are reinserted every few frames rather than every frame. Insertions pick
+    * the sibling with the surface area heuristic and the tree is kept balanced with AVL rotations.
+    *
+    * sync() keeps the tree up to date from the registry's change tracking: entities whose
+    * TransformComponent or BoundsComponent changed, entities moved by the transform hierarchy and
+    * destroyed entities. Removing only the BoundsComponent of a live entity requires calling remove().
+    *
+    * Every leaf carries the layers of its BoundsComponent and every node the union of its subtree,
+    * so queries restricted to some layers skip whole subtrees.
+    */
+    class lmSpatialIndex {
+    public:
+        static constexpr uint32_t NULL_NODE = std::numeric_limits<uint32_t>::max();
+
+        lmSpatialIndex() = default;
+
+        lmSpatialIndex(const lmSpatialIndex&) = delete;
+        lmSpatialIndex& operator=(const lmSpatialIndex&) = delete;
+
+        // Inserts the entity or moves it to new world bounds, returns true if the tree had to be modified
+        bool update(lmEntity entity, const lmAabb& worldBounds, uint32_t layers = SPATIAL_LAYER_DEFAULT);
+        void remove(lmEntity entity);
+        void clear();
+
+        bool contains(lmEntity entity) const;
+        const lmAabb& getBounds(lmEntity entity) const;
+
+        // Pulls the changes of the frame from the registry and the hierarchy, the pool is optional
+        void sync(lmRegistry& registry, const lmTransformHierarchy& hierarchy, lmThreadPool* threadPool = nullptr);
+
+        // Query callbacks are called as fn(lmEntity) once per matching entity, in no particular order
+        template <typename Func>
+        void queryAabb(const lmAabb& box, Func&& fn, uint32_t layers = SPATIAL_LAYER_ALL) const {
+            traverse(
+                [&box](const Node& node) { return node.bounds.overlaps(box); },
+                [&box](const Node& node) { return node.worldBounds.overlaps(box); },
+                fn, layers);
+        }
+
+        template <typename Func>
+        void querySphere(const glm::vec3& center, float radius, Func&& fn, uint32_t layers = SPATIAL_LAYER_ALL) const {
+            traverse(
+                [&](const Node& node) { return node.bounds.overlapsSphere(center, radius); },
+                [&](const Node& node) { return node.worldBounds.overlapsSphere(center, radius); },
+                fn, layers);
+        }
+
+        // Subtrees fully inside the frustum are reported without testing their leaves
+        template <typename Func>
+        void queryFrustum(const lmFrustum& frustum, Func&& fn, uint32_t layers = SPATIAL_LAYER_ALL) const;
+
+        // The k entities whose world bounds are closest to point, nearest first
+        void queryNearest(
+            const glm::vec3& point,
+            size_t k,
+            std::vector<lmEntity>& results,
+            uint32_t layers = SPATIAL_LAYER_ALL,
+            float maxDistance = std::numeric_limits<float>::max()) const;
+
+        size_t size() const { return leafCount; }
+        int getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+        // Entities visited and leaves reinserted by the last sync
+        size_t getLastSyncCount() const { return lastSyncCount; }
+        size_t getLastReinsertCount() const { return lastReinsertCount; }
+
+    private:
+        // Absolute growth of the fat boxes and scale of the predicted displacement added in the direction of motion
+        static constexpr float FAT_MARGIN = 0.05f;
+        static constexpr float DISPLACEMENT_MULTIPLIER = 4.f;
+
+        // Enough for any AVL balanced tree addressable with 32-bit node indices
+        static constexpr size_t MAX_QUERY_DEPTH = 128;
+
+        // Entities to refresh in one sync above which their world bounds are computed on the pool
+        static constexpr size_t PARALLEL_THRESHOLD = 1024;
+        static constexpr size_t PARALLEL_GRAIN_SIZE = 256;
+
+        struct Node {
+            lmAabb bounds;          // Fat bounds for leaves, union of the children otherwise
+            lmAabb worldBounds;     // Exact world bounds, leaves only
+            lmEntity entity = NULL_ENTITY;
+            uint32_t parent = NULL_NODE;    // Next free node while on the free list
+            uint32_t child1 = NULL_NODE;
+            uint32_t child2 = NULL_NODE;
+            uint32_t layers = 0;
+            int32_t height = -1;    // 0 for leaves, -1 for free nodes
+
+            bool isLeaf() const { return child1 == NULL_NODE; }
+        };
+
+        // An entity refreshed by sync()
+        struct PendingUpdate {
+            lmEntity entity;
+            lmAabb worldBounds;
+            uint32_t layers;
+            bool remove;
+        };
+
+        template <typename NodeTest, typename LeafTest, typename Func>
+        void traverse(NodeTest&& nodeTest, LeafTest&& leafTest, Func& fn, uint32_t layers) const {
+            if (root == NULL_NODE) {
+                return;
+            }
+
+            std::array<uint32_t, MAX_QUERY_DEPTH> stack;
+            size_t stackSize = 0;
+            stack[stackSize++] = root;
+
+            while (stackSize > 0) {
+                const Node& node = nodes[stack[--stackSize]];
+                if ((node.layers & layers) == 0 || !nodeTest(node)) {
+                    continue;
+                }
+
+                if (node.isLeaf()) {
+                    if (leafTest(node)) {
+                        fn(node.entity);
+                    }
+                    continue;
+                }
+
+                assert(stackSize + 2 <= MAX_QUERY_DEPTH && "Spatial index query stack overflow");
+                stack[stackSize++] = node.child1;
+                stack[stackSize++] = node.child2;
+            }
+        }
+
+        uint32_t findLeaf(lmEntity entity) const;
+        uint32_t allocateNode();
+        void freeNode(uint32_t index);
+        void insertLeaf(uint32_t leaf);
+        void removeLeaf(uint32_t leaf);
+        void refit(uint32_t index);
+        void fitNode(uint32_t index);
+        uint32_t balance(uint32_t index);
+
+        std::vector<Node> nodes;
+        uint32_t root = NULL_NODE;
+        uint32_t freeList = NULL_NODE;
+        size_t leafCount = 0;
+
+        // Leaf node of every entity, indexed by entity index
+        std::vector<uint32_t> entityLeaves;
+
+        std::vector<lmEntity> syncCandidates;
+        std::vector<PendingUpdate> pendingUpdates;
+        size_t lastSyncCount = 0;
+        size_t lastReinsertCount = 0;
+    };
+
+    template <typename Func>
+    void lmSpatialIndex::queryFrustum(const lmFrustum& frustum, Func&& fn, uint32_t layers) const {
+        if (root == NULL_NODE) {
+            return;
+        }
+
+        // Subtrees whose bounds are inside the frustum are pushed as inside and never tested again
+        struct Entry {
+            uint32_t node;
+            bool inside;
+        };
+
+        std::array<Entry, MAX_QUERY_DEPTH> stack;
+        size_t stackSize = 0;
+        stack[stackSize++] = Entry{ root, false };
+
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            const Node& node = nodes[entry.node];
+            if ((node.layers & layers) == 0) {
+                continue;
+            }
+
+            bool inside = entry.inside;
+            if (!inside) {
+                const lmFrustumTest result = frustum.test(node.isLeaf() ? node.worldBounds : node.bounds);
+                if (result == lmFrustumTest::Outside) {
+                    continue;
+                }
+                inside = result == lmFrustumTest::Inside;
+            }
+
+            if (node.isLeaf()) {
+                fn(node.entity);
+                continue;
+            }
+
+            assert(stackSize + 2 <= MAX_QUERY_DEPTH && "Spatial index query stack overflow");
+            stack[stackSize++] = Entry{ node.child1, inside };
+            stack[stackSize++] = Entry{ node.child2, inside };
+        }
+    }
+
+} // namespace lm
@@ -0,0 +1,492 @@
+/**
+ * @file TransformHierarchy.cpp
+ * @brief Depth-sorted transform hierarchy with dirty subtree propagation.
+ */
+
+#include "TransformHierarchy.h"
+#include "GameObject.h"
+#include "TransformKernel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lm {
+
+    /**
+     * @brief Adds an entity to the hierarchy, replacing the node of a destroyed entity that used the same index.
+     * @param entity The entity to add.
+     * @param parent The parent entity, which must already be part of the hierarchy, or NULL_ENTITY for a root.
+     */
+    void lmTransformHierarchy::add(lmEntity entity, lmEntity parent) {
+        assert(!entity.isNull() && "Cannot add the null entity to the hierarchy");
+        assert(!contains(entity) && "Entity is already part of the hierarchy");
+
+        if (nodes.size() <= entity.index()) {
+            nodes.resize(static_cast<size_t>(entity.index()) + 1);
+        }
+
+        // The index may be recycled before update() saw the destruction, the stale node is still linked
+        if (Node& stale = nodes[entity.index()]; !stale.entity.isNull()) {
+            remove(stale.entity);
+        }
+
+        Node& node = nodes[entity.index()];
+        node = Node{};
+        node.entity = entity;
+        link(node, parent);
+
+        nodeCount++;
+        layoutDirty = true;
+    }
+
+    /**
+     * @brief Removes an entity from the hierarchy, its children become roots.
+     * @param entity The entity to remove.
+     */
+    void lmTransformHierarchy::remove(lmEntity entity) {
+        Node* node = findNode(entity);
+        if (!node) {
+            return;
+        }
+
+        while (!node->firstChild.isNull()) {
+            Node& child = nodes[node->firstChild.index()];
+            unlink(child);
+            link(child, NULL_ENTITY);
+        }
+
+        unlink(*node);
+        *node = Node{};
+
+        nodeCount--;
+        layoutDirty = true;
+    }
+
+    /**
+     * @brief Moves an entity under another parent, keeping its local matrix.
+     * @param entity The entity to move.
+     * @param parent The new parent or NULL_ENTITY to make the entity a root.
+     */
+    void lmTransformHierarchy::setParent(lmEntity entity, lmEntity parent) {
+        Node* node = findNode(entity);
+        assert(node && "Entity is not part of the hierarchy");
+
+        if (node->parent == parent) {
+            return;
+        }
+
+        for (lmEntity ancestor = parent; !ancestor.isNull(); ancestor = nodes[ancestor.index()].parent) {
+            assert(ancestor != entity && "Reparenting would create a cycle");
+        }
+
+        unlink(*node);
+        link(*node, parent);
+        layoutDirty = true;
+    }
+
+    /**
+     * @brief Checks whether an entity is part of the hierarchy.
+     * @param entity The entity to check.
+     * @return True if the entity has been added and not removed.
+     */
+    bool lmTransformHierarchy::contains(lmEntity entity) const {
+        return findNode(entity) != nullptr;
+    }
+
+    /**
+     * @brief Retrieves the parent of an entity.
+     * @param entity The entity.
+     * @return The parent entity or NULL_ENTITY for roots and entities outside the hierarchy.
+     */
+    lmEntity lmTransformHierarchy::getParent(lmEntity entity) const {
+        const Node* node = findNode(entity);
+        return node ? node->parent : NULL_ENTITY;
+    }
+
+    /**
+     * @brief Sets the matrix of an entity relative to its parent and queues its subtree for update.
+     * @param entity The entity.
+     * @param local The local matrix.
+     */
+    void lmTransformHierarchy::setLocalMatrix(lmEntity entity, const glm::mat4& local) {
+        setLocalMatrix(entity, local, glm::transpose(glm::inverse(glm::mat3(local))));
+    }
+
+    /**
+     * @brief Sets the matrix of an entity relative to its parent and queues its subtree for update.
+     * @param entity The entity.
+     * @param local The local matrix.
+     * @param localNormal The normal matrix of the local matrix, transpose(inverse(mat3(local))).
+     */
+    void lmTransformHierarchy::setLocalMatrix(lmEntity entity, const glm::mat4& local, const glm::mat3& localNormal) {
+        Node* node = findNode(entity);
+        assert(node && "Entity is not part of the hierarchy");
+
+        node->local = local;
+        node->localNormal = localNormal;
+
+        // Until the next rebuild the node is either unplaced or about to be recomputed anyway
+        if (!layoutDirty) {
+            localMatrices[node->slot] = local;
+            localNormalMatrices[node->slot] = localNormal;
+            queue(node->slot);
+        }
+    }
+
+    /**
+     * @brief Retrieves the world matrix computed by the last update.
+     * @param entity The entity.
+     * @return The world matrix.
+     */
+    const glm::mat4& lmTransformHierarchy::getWorldMatrix(lmEntity entity) const {
+        const Node* node = findNode(entity);
+        assert(node && node->slot != INVALID_SLOT && "Entity has not been placed in the hierarchy by update()");
+        return worldMatrices[node->slot];
+    }
+
+    /**
+     * @brief Retrieves the world normal matrix computed by the last update.
+     * @param entity The entity.
+     * @return transpose(inverse(mat3(world matrix))).
+     */
+    const glm::mat3& lmTransformHierarchy::getNormalMatrix(lmEntity entity) const {
+        const Node* node = findNode(entity);
+        assert(node && node->slot != INVALID_SLOT && "Entity has not been placed in the hierarchy by update()");
+        return normalMatrices[node->slot];
+    }
+
+    /**
+     * @brief Recomputes the dirty TransformComponents and copies the local matrices of the member entities.
+     *
+     * Only the registry's changed list of TransformComponent is walked: adding a transform marks it changed,
+     * and code modifying one in place marks it changed as the registry requires. The dirty transforms are
+     * gathered into SoA arrays and run through the batched transform kernel, then written back to their
+     * components, which are no longer dirty when the render systems read them.
+     *
+     * @param registry The registry storing the TransformComponents.
+     * @param threadPool The pool used to split large batches, or nullptr.
+     */
+    void lmTransformHierarchy::syncLocalMatrices(lmRegistry& registry, lmThreadPool* threadPool) {
+        TransformBatch& batch = transformBatch;
+        batch.clear();
+
+        // The list may hold destroyed entities, and transforms already recomputed by getMatrix()
+        for (lmEntity entity : registry.getChanged<TransformComponent>()) {
+            TransformComponent* component = registry.tryGet<TransformComponent>(entity);
+            if (!component || !component->dirty) {
+                continue;
+            }
+
+            const TransformComponent& transform = *component;
+            batch.entities.push_back(entity);
+            batch.components.push_back(component);
+            batch.translationX.push_back(transform.translation.x);
+            batch.translationY.push_back(transform.translation.y);
+            batch.translationZ.push_back(transform.translation.z);
+            batch.rotationX.push_back(transform.rotation.x);
+            batch.rotationY.push_back(transform.rotation.y);
+            batch.rotationZ.push_back(transform.rotation.z);
+            batch.rotationW.push_back(transform.rotation.w);
+            batch.scaleX.push_back(transform.scale.x);
+            batch.scaleY.push_back(transform.scale.y);
+            batch.scaleZ.push_back(transform.scale.z);
+        }
+
+        const size_t count = batch.entities.size();
+        if (count == 0) {
+            return;
+        }
+
+        batch.models.resize(count);
+        batch.normals.resize(count);
+
+        auto computeRange = [&batch](size_t begin, size_t end) {
+            lmTransformSoA input{};
+            input.translationX = batch.translationX.data() + begin;
+            input.translationY = batch.translationY.data() + begin;
+            input.translationZ = batch.translationZ.data() + begin;
+            input.rotationX = batch.rotationX.data() + begin;
+            input.rotationY = batch.rotationY.data() + begin;
+            input.rotationZ = batch.rotationZ.data() + begin;
+            input.rotationW = batch.rotationW.data() + begin;
+            input.scaleX = batch.scaleX.data() + begin;
+            input.scaleY = batch.scaleY.data() + begin;
+            input.scaleZ = batch.scaleZ.data() + begin;
+            input.count = end - begin;
+
+            computeTransforms(input, batch.models.data() + begin, batch.normals.data() + begin);
+        };
+
+        if (threadPool) {
+            threadPool->parallelFor(count, TRANSFORM_BATCH_GRAIN_SIZE, computeRange);
+        }
+        else {
+            computeRange(0, count);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            TransformComponent& transform = *batch.components[i];
+            transform.transform = batch.models[i];
+            transform.normalMatrix = batch.normals[i];
+            // The dirty flag is consumed here, the changed list the entity came from keeps the information for later stages
+            transform.dirty = false;
+
+            if (contains(batch.entities[i])) {
+                setLocalMatrix(batch.entities[i], batch.models[i], batch.normals[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Empties the scratch arrays while keeping their capacity.
+     */
+    void lmTransformHierarchy::TransformBatch::clear() {
+        entities.clear();
+        components.clear();
+        translationX.clear();
+        translationY.clear();
+        translationZ.clear();
+        rotationX.clear();
+        rotationY.clear();
+        rotationZ.clear();
+        rotationW.clear();
+        scaleX.clear();
+        scaleY.clear();
+        scaleZ.clear();
+    }
+
+    /**
+     * @brief Recomputes the world matrices of every queued node and of their descendants.
+     *
+     * The entities destroyed this frame are removed first, so that their children become roots instead
+     * of inheriting a stale world matrix. Levels are then processed top down. A level's queued nodes only
+     * read their parent's world matrix, which was finalized by the previous level, so each level can be
+     * split across the pool.
+     *
+     * @param registry The registry whose destroyed list is applied, must not have moved to the next frame.
+     * @param threadPool The pool used for large levels, or nullptr to update on the calling thread.
+     */
+    void lmTransformHierarchy::update(const lmRegistry& registry, lmThreadPool* threadPool) {
+        for (const lmEntity entity : registry.getDestroyed()) {
+            remove(entity);
+        }
+
+        if (layoutDirty) {
+            rebuild();
+        }
+
+        lastUpdateCount = 0;
+        updatedEntities.clear();
+
+        for (size_t level = 0; level < dirtySlots.size(); level++) {
+            std::vector<uint32_t>& slots = dirtySlots[level];
+            if (slots.empty()) {
+                continue;
+            }
+
+            updateLevel(slots, threadPool);
+            lastUpdateCount += slots.size();
+
+            // Children of a node are contiguous in the next level
+            for (uint32_t slot : slots) {
+                queued[slot] = 0;
+                updatedEntities.push_back(slotEntities[slot]);
+
+                const uint32_t firstChild = firstChildSlots[slot];
+                for (uint32_t child = firstChild; child < firstChild + childCounts[slot]; child++) {
+                    queue(child);
+                }
+            }
+
+            slots.clear();
+        }
+    }
+
+    /**
+     * @brief Computes the world matrices of the queued nodes of one level.
+     * @param slots The queued slots of the level.
+     * @param threadPool The pool used when the level is large enough, may be nullptr.
+     */
+    void lmTransformHierarchy::updateLevel(std::vector<uint32_t>& slots, lmThreadPool* threadPool) {
+        // Walking the slots in memory order keeps the parent and local reads sequential
+        std::sort(slots.begin(), slots.end());
+
+        auto computeRange = [this, &slots](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const uint32_t slot = slots[i];
+                const uint32_t parent = parentSlots[slot];
+
+                // The inverse transpose of a product is the product of the inverse transposes
+                if (parent == INVALID_SLOT) {
+                    worldMatrices[slot] = localMatrices[slot];
+                    normalMatrices[slot] = localNormalMatrices[slot];
+                }
+                else {
+                    worldMatrices[slot] = worldMatrices[parent] * localMatrices[slot];
+                    normalMatrices[slot] = normalMatrices[parent] * localNormalMatrices[slot];
+                }
+            }
+        };
+
+        if (threadPool && slots.size() >= PARALLEL_THRESHOLD) {
+            threadPool->parallelFor(slots.size(), PARALLEL_GRAIN_SIZE, computeRange);
+        }
+        else {
+            computeRange(0, slots.size());
+        }
+    }
+
+    /**
+     * @brief Retrieves the node record of an entity.
+     * @param entity The entity.
+     * @return The node or nullptr if the entity is not part of the hierarchy.
+     */
+    lmTransformHierarchy::Node* lmTransformHierarchy::findNode(lmEntity entity) {
+        if (entity.isNull() || entity.index() >= nodes.size() || nodes[entity.index()].entity != entity) {
+            return nullptr;
+        }
+
+        return &nodes[entity.index()];
+    }
+
+    /**
+     * @brief Retrieves the node record of an entity.
+     * @param entity The entity.
+     * @return The node or nullptr if the entity is not part of the hierarchy.
+     */
+    const lmTransformHierarchy::Node* lmTransformHierarchy::findNode(lmEntity entity) const {
+        if (entity.isNull() || entity.index() >= nodes.size() || nodes[entity.index()].entity != entity) {
+            return nullptr;
+        }
+
+        return &nodes[entity.index()];
+    }
+
+    /**
+     * @brief Inserts a node at the head of its new parent's child list.
+     * @param node The detached node.
+     * @param parent The new parent or NULL_ENTITY.
+     */
+    void lmTransformHierarchy::link(Node& node, lmEntity parent) {
+        node.parent = parent;
+        node.previousSibling = NULL_ENTITY;
+        node.nextSibling = NULL_ENTITY;
+
+        if (parent.isNull()) {
+            return;
+        }
+
+        Node* parentNode = findNode(parent);
+        assert(parentNode && "Parent is not part of the hierarchy");
+
+        if (!parentNode->firstChild.isNull()) {
+            nodes[parentNode->firstChild.index()].previousSibling = node.entity;
+            node.nextSibling = parentNode->firstChild;
+        }
+
+        parentNode->firstChild = node.entity;
+    }
+
+    /**
+     * @brief Removes a node from its parent's child list.
+     * @param node The node to detach.
+     */
+    void lmTransformHierarchy::unlink(Node& node) {
+        if (!node.previousSibling.isNull()) {
+            nodes[node.previousSibling.index()].nextSibling = node.nextSibling;
+        }
+        else if (!node.parent.isNull()) {
+            nodes[node.parent.index()].firstChild = node.nextSibling;
+        }
+
+        if (!node.nextSibling.isNull()) {
+            nodes[node.nextSibling.index()].previousSibling = node.previousSibling;
+        }
+
+        node.parent = NULL_ENTITY;
+        node.previousSibling = NULL_ENTITY;
+        node.nextSibling = NULL_ENTITY;
+    }
+
+    /**
+     * @brief Queues a slot for recomputation on its level, ignoring slots already queued.
+     * @param slot The slot to queue.
+     */
+    void lmTransformHierarchy::queue(uint32_t slot) {
+        if (queued[slot]) {
+            return;
+        }
+
+        queued[slot] = 1;
+        dirtySlots[depths[slot]].push_back(slot);
+    }
+
+    /**
+     * @brief Lays the nodes out breadth first and queues every root, so the next pass recomputes everything.
+     */
+    void lmTransformHierarchy::rebuild() {
+        slotEntities.clear();
+        slotEntities.reserve(nodeCount);
+        parentSlots.clear();
+        depths.clear();
+        levelStarts.clear();
+
+        for (Node& node : nodes) {
+            if (!node.entity.isNull() && node.parent.isNull()) {
+                node.slot = static_cast<uint32_t>(slotEntities.size());
+                slotEntities.push_back(node.entity);
+                parentSlots.push_back(INVALID_SLOT);
+                depths.push_back(0);
+            }
+        }
+
+        firstChildSlots.assign(nodeCount, 0);
+        childCounts.assign(nodeCount, 0);
+
+        // Appending the children of each slot in order keeps siblings contiguous and levels sorted
+        for (size_t slot = 0; slot < slotEntities.size(); slot++) {
+            firstChildSlots[slot] = static_cast<uint32_t>(slotEntities.size());
+
+            const Node& parent = nodes[slotEntities[slot].index()];
+            for (lmEntity child = parent.firstChild; !child.isNull(); child = nodes[child.index()].nextSibling) {
+                assert(depths[slot] < std::numeric_limits<uint16_t>::max() && "Hierarchy is too deep");
+
+                nodes[child.index()].slot = static_cast<uint32_t>(slotEntities.size());
+                slotEntities.push_back(child);
+                parentSlots.push_back(static_cast<uint32_t>(slot));
+                depths.push_back(static_cast<uint16_t>(depths[slot] + 1));
+                childCounts[slot]++;
+            }
+        }
+
+        assert(slotEntities.size() == nodeCount && "Hierarchy node count mismatch");
+
+        for (uint32_t slot = 0; slot < slotEntities.size(); slot++) {
+            if (slot == 0 || depths[slot] != depths[slot - 1]) {
+                levelStarts.push_back(slot);
+            }
+        }
+        levelStarts.push_back(static_cast<uint32_t>(slotEntities.size()));
+
+        localMatrices.resize(nodeCount);
+        worldMatrices.resize(nodeCount);
+        localNormalMatrices.resize(nodeCount);
+        normalMatrices.resize(nodeCount);
+        for (size_t slot = 0; slot < slotEntities.size(); slot++) {
+            const Node& node = nodes[slotEntities[slot].index()];
+            localMatrices[slot] = node.local;
+            localNormalMatrices[slot] = node.localNormal;
+        }
+
+        queued.assign(nodeCount, 0);
+        dirtySlots.assign(getLevelCount(), {});
+
+        const uint32_t rootCount = levelStarts.size() > 1 ? levelStarts[1] : 0;
+        for (uint32_t slot = 0; slot < rootCount; slot++) {
+            queue(slot);
+        }
+
+        layoutDirty = false;
+    }
+
+} // namespace lm
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Entity.h"
+#include "Registry.h"
+#include "../core/ThreadPool.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * Parent/child relationships between entities and their world matrices.
+    *
+    * Nodes are stored breadth first in depth-sorted SoA arrays: every level is a contiguous
+    * range, a parent always precedes its children and the children of a node are contiguous
+    * in the next level. Changing a local matrix queues the node on its level; update() walks
+    * the levels top down, recomputes the queued nodes (in parallel when a level is large enough)
+    * and queues their children, so only the dirty subtrees are visited.
+    *
+    * Attaching, detaching or reparenting only edits the linked node records and flags the layout,
+    * which is rebuilt by the next update() together with a full recompute.
+    */
+    struct TransformComponent;
+
+    class lmTransformHierarchy {
+    public:
+        static constexpr uint32_t INVALID_SLOT = std::numeric_limits<uint32_t>::max();
+
+        lmTransformHierarchy() = default;
+
+        lmTransformHierarchy(const lmTransformHierarchy&) = delete;
+        lmTransformHierarchy& operator=(const lmTransformHierarchy&) = delete;
+
+        void add(lmEntity entity, lmEntity parent = NULL_ENTITY);
+        void remove(lmEntity entity);
+        void setParent(lmEntity entity, lmEntity parent);
+
+        bool contains(lmEntity entity) const;
+        lmEntity getParent(lmEntity entity) const;
+
+        void setLocalMatrix(lmEntity entity, const glm::mat4& local);
+        void setLocalMatrix(lmEntity entity, const glm::mat4& local, const glm::mat3& localNormal);
+        const glm::mat4& getWorldMatrix(lmEntity entity) const;
+        const glm::mat3& getNormalMatrix(lmEntity entity) const;
+
+        // Recomputes the dirty TransformComponents changed this frame (see lmRegistry::getChanged) in one SIMD
+        // batch and pulls the local matrices of the members, the unchanged transforms are never visited
+        void syncLocalMatrices(lmRegistry& registry, lmThreadPool* threadPool = nullptr);
+
+        // Removes the entities the registry destroyed this frame, then recomputes the world matrices of
+        // the dirty subtrees, the pool is optional
+        void update(const lmRegistry& registry, lmThreadPool* threadPool = nullptr);
+
+        size_t size() const { return nodeCount; }
+        size_t getLevelCount() const { return levelStarts.empty() ? 0 : levelStarts.size() - 1; }
+        size_t getLastUpdateCount() const { return lastUpdateCount; }
+
+        // Entities whose world matrix was recomputed by the last update, including descendants of moved nodes
+        const std::vector<lmEntity>& getUpdatedEntities() const { return updatedEntities; }
+
+    private:
+        // Levels with fewer queued nodes than this are updated on the calling thread
+        static constexpr size_t PARALLEL_THRESHOLD = 1024;
+        static constexpr size_t PARALLEL_GRAIN_SIZE = 256;
+        static constexpr size_t TRANSFORM_BATCH_GRAIN_SIZE = 4096;
+
+        // Authoritative tree structure, indexed by entity index
+        struct Node {
+            lmEntity entity = NULL_ENTITY;
+            lmEntity parent = NULL_ENTITY;
+            lmEntity firstChild = NULL_ENTITY;
+            lmEntity nextSibling = NULL_ENTITY;
+            lmEntity previousSibling = NULL_ENTITY;
+            uint32_t slot = INVALID_SLOT;
+            glm::mat4 local{ 1.f };
+            glm::mat3 localNormal{ 1.f };
+        };
+
+        // Scratch SoA of the dirty TransformComponents gathered by syncLocalMatrices
+        struct TransformBatch {
+            std::vector<lmEntity> entities;
+            std::vector<TransformComponent*> components;
+            std::vector<float> translationX, translationY, translationZ;
+            std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+            std::vector<float> scaleX, scaleY, scaleZ;
+            std::vector<glm::mat4> models;
+            std::vector<glm::mat3> normals;
+
+            void clear();
+        };
+
+        Node* findNode(lmEntity entity);
+        const Node* findNode(lmEntity entity) const;
+        void link(Node& node, lmEntity parent);
+        void unlink(Node& node);
+        void queue(uint32_t slot);
+        void rebuild();
+        void updateLevel(std::vector<uint32_t>& slots, lmThreadPool* threadPool);
+
+        std::vector<Node> nodes;
+        size_t nodeCount = 0;
+        bool layoutDirty = false;
+
+        // Depth-sorted SoA, indexed by slot
+        std::vector<lmEntity> slotEntities;
+        std::vector<uint32_t> parentSlots;
+        std::vector<uint32_t> firstChildSlots;
+        std::vector<uint32_t> childCounts;
+        std::vector<uint16_t> depths;
+        std::vector<uint8_t> queued;
+        std::vector<glm::mat4> localMatrices;
+        std::vector<glm::mat4> worldMatrices;
+        std::vector<glm::mat3> localNormalMatrices;
+        std::vector<glm::mat3> normalMatrices;
+
+        // levelStarts[d] is the first slot of level d, the last entry is the slot count
+        std::vector<uint32_t> levelStarts;
+        std::vector<std::vector<uint32_t>> dirtySlots;
+        size_t lastUpdateCount = 0;
+        std::vector<lmEntity> updatedEntities;
+
+        TransformBatch transformBatch;
+    };
+
+} // namespace lm
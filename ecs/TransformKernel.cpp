@@ -0,0 +1,268 @@
+/**
+ * @file TransformKernel.cpp
+ * @brief Scalar and SSE kernels building model and normal matrices from SoA transforms.
+ *
+ * The rotation part of T * R * S is R * S, whose inverse transpose is R * S^-1 because R is
+ * orthonormal. The normal matrix therefore only needs one reciprocal per scale axis (a single one
+ * when the scale is uniform) instead of a general 3x3 inverse.
+ *
+ * The SSE kernel computes every matrix element for 4 objects at once, one object per lane, and
+ * transposes 4x4 blocks to write the column-major glm matrices of each object. There is no AVX2
+ * kernel: the transposes and stores dominate and are 128-bit either way, so 8 lanes measured no
+ * faster than SSE in TransformKernelBenchmark.
+ */
+
+#include "TransformKernel.h"
+
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LM_TRANSFORM_KERNEL_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace lm {
+
+    namespace {
+
+        /**
+         * @brief Runs the scalar path for the objects in [begin, end).
+         */
+        void computeTransformsScalar(
+            const lmTransformSoA& in, size_t begin, size_t end, glm::mat4* models, glm::mat3* normals) {
+
+            for (size_t i = begin; i < end; i++) {
+                const float sx = in.scaleX[i];
+                const glm::vec3 scale = in.scaleY ? glm::vec3(sx, in.scaleY[i], in.scaleZ[i]) : glm::vec3(sx);
+
+                glm::mat3 normal;
+                computeTransform(
+                    { in.translationX[i], in.translationY[i], in.translationZ[i] },
+                    glm::quat(in.rotationW[i], in.rotationX[i], in.rotationY[i], in.rotationZ[i]),
+                    scale,
+                    models[i],
+                    normal);
+
+                if (normals) {
+                    normals[i] = normal;
+                }
+            }
+        }
+
+#if defined(LM_TRANSFORM_KERNEL_SSE)
+
+        // Writes column c of 4 objects given the 4 rows of that column across the objects
+        inline void storeModelColumn(glm::mat4* models, int column, __m128 r0, __m128 r1, __m128 r2, __m128 r3) {
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&models[0][column][0], r0);
+            _mm_storeu_ps(&models[1][column][0], r1);
+            _mm_storeu_ps(&models[2][column][0], r2);
+            _mm_storeu_ps(&models[3][column][0], r3);
+        }
+
+        // Writes a 3 float column without touching the float that follows it
+        inline void storeVec3(float* dst, __m128 v) {
+            _mm_storel_pi(reinterpret_cast<__m64*>(dst), v);
+            _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+        }
+
+        // Writes the 3x3 normal matrices of 4 objects, each argument holds one element across the objects
+        inline void storeNormals(
+            glm::mat3* normals,
+            __m128 n00, __m128 n01, __m128 n02,
+            __m128 n10, __m128 n11, __m128 n12,
+            __m128 n20, __m128 n21, __m128 n22) {
+
+            const __m128 zero = _mm_setzero_ps();
+            __m128 c0[4] = { n00, n01, n02, zero };
+            __m128 c1[4] = { n10, n11, n12, zero };
+            __m128 c2[4] = { n20, n21, n22, zero };
+            _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+            _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+            _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+
+            for (int object = 0; object < 4; object++) {
+                float* dst = &normals[object][0][0];
+                storeVec3(dst, c0[object]);
+                storeVec3(dst + 3, c1[object]);
+                storeVec3(dst + 6, c2[object]);
+            }
+        }
+
+        /**
+         * @brief Runs the SSE path for the objects in [begin, end), end - begin must be a multiple of 4.
+         */
+        void computeTransformsSSE(
+            const lmTransformSoA& in, size_t begin, size_t end, glm::mat4* models, glm::mat3* normals) {
+
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.f);
+            const __m128 two = _mm_set1_ps(2.f);
+
+            for (size_t i = begin; i < end; i += 4) {
+                const __m128 qx = _mm_loadu_ps(in.rotationX + i);
+                const __m128 qy = _mm_loadu_ps(in.rotationY + i);
+                const __m128 qz = _mm_loadu_ps(in.rotationZ + i);
+                const __m128 qw = _mm_loadu_ps(in.rotationW + i);
+
+                const __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+                const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+                const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+                // Rotation matrix, rCR is column C row R
+                const __m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+                const __m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+                const __m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+                const __m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+                const __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+                const __m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+                const __m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+                const __m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+                const __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+                const __m128 sx = _mm_loadu_ps(in.scaleX + i);
+                __m128 sy = sx;
+                __m128 sz = sx;
+                bool uniform = true;
+
+                if (in.scaleY) {
+                    sy = _mm_loadu_ps(in.scaleY + i);
+                    sz = _mm_loadu_ps(in.scaleZ + i);
+                    uniform = _mm_movemask_ps(_mm_and_ps(_mm_cmpeq_ps(sx, sy), _mm_cmpeq_ps(sx, sz))) == 0xF;
+                }
+
+                glm::mat4* batchModels = models + i;
+                storeModelColumn(batchModels, 0, _mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), zero);
+                storeModelColumn(batchModels, 1, _mm_mul_ps(r10, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), zero);
+                storeModelColumn(batchModels, 2, _mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), _mm_mul_ps(r22, sz), zero);
+                storeModelColumn(batchModels, 3,
+                    _mm_loadu_ps(in.translationX + i),
+                    _mm_loadu_ps(in.translationY + i),
+                    _mm_loadu_ps(in.translationZ + i),
+                    one);
+
+                if (!normals) {
+                    continue;
+                }
+
+                // Uniform scale: a single division shared by the three columns
+                const __m128 ix = _mm_div_ps(one, sx);
+                const __m128 iy = uniform ? ix : _mm_div_ps(one, sy);
+                const __m128 iz = uniform ? ix : _mm_div_ps(one, sz);
+
+                storeNormals(normals + i,
+                    _mm_mul_ps(r00, ix), _mm_mul_ps(r01, ix), _mm_mul_ps(r02, ix),
+                    _mm_mul_ps(r10, iy), _mm_mul_ps(r11, iy), _mm_mul_ps(r12, iy),
+                    _mm_mul_ps(r20, iz), _mm_mul_ps(r21, iz), _mm_mul_ps(r22, iz));
+            }
+        }
+
+#endif
+
+    } // namespace
+
+    /**
+     * @brief Retrieves the widest transform kernel compiled into this binary.
+     * @return SSE on x86-64, otherwise scalar.
+     */
+    lmTransformKernel getBestTransformKernel() {
+#if defined(LM_TRANSFORM_KERNEL_SSE)
+        return lmTransformKernel::SSE;
+#else
+        return lmTransformKernel::Scalar;
+#endif
+    }
+
+    /**
+     * @brief Checks whether a kernel was compiled into this binary.
+     * @param kernel The kernel to check.
+     * @return True if computeTransforms can run the kernel.
+     */
+    bool isTransformKernelAvailable(lmTransformKernel kernel) {
+        switch (kernel) {
+        case lmTransformKernel::Scalar:
+            return true;
+        case lmTransformKernel::SSE:
+#if defined(LM_TRANSFORM_KERNEL_SSE)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Retrieves a printable name for a kernel.
+     * @param kernel The kernel.
+     * @return The name of the kernel.
+     */
+    const char* getTransformKernelName(lmTransformKernel kernel) {
+        switch (kernel) {
+        case lmTransformKernel::Scalar:
+            return "Scalar";
+        case lmTransformKernel::SSE:
+            return "SSE";
+        }
+
+        return "Unknown";
+    }
+
+    /**
+     * @brief Builds the model and normal matrices of one object.
+     * @param translation The translation.
+     * @param rotation The rotation, a unit quaternion.
+     * @param scale The scale along each local axis.
+     * @param modelMatrix Receives T * R * S.
+     * @param normalMatrix Receives transpose(inverse(mat3(modelMatrix))).
+     */
+    void computeTransform(
+        const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale,
+        glm::mat4& modelMatrix, glm::mat3& normalMatrix) {
+
+        const glm::mat3 r = glm::mat3_cast(rotation);
+
+        modelMatrix[0] = glm::vec4(r[0] * scale.x, 0.f);
+        modelMatrix[1] = glm::vec4(r[1] * scale.y, 0.f);
+        modelMatrix[2] = glm::vec4(r[2] * scale.z, 0.f);
+        modelMatrix[3] = glm::vec4(translation, 1.f);
+
+        if (scale.x == scale.y && scale.x == scale.z) {
+            const float inverseScale = 1.f / scale.x;
+            normalMatrix = r * inverseScale;
+        }
+        else {
+            normalMatrix[0] = r[0] / scale.x;
+            normalMatrix[1] = r[1] / scale.y;
+            normalMatrix[2] = r[2] / scale.z;
+        }
+    }
+
+    /**
+     * @brief Builds the model and normal matrices of a batch of objects.
+     * @param input The SoA translations, rotations and scales.
+     * @param modelMatrices Receives input.count model matrices.
+     * @param normalMatrices Receives input.count normal matrices, may be nullptr.
+     * @param kernel The kernel to use, must be available in this binary.
+     */
+    void computeTransforms(
+        const lmTransformSoA& input, glm::mat4* modelMatrices, glm::mat3* normalMatrices, lmTransformKernel kernel) {
+
+        assert(isTransformKernelAvailable(kernel) && "Transform kernel not compiled into this binary");
+        assert((input.scaleY == nullptr) == (input.scaleZ == nullptr) && "scaleY and scaleZ must both be set or both be null");
+
+        size_t done = 0;
+
+#if defined(LM_TRANSFORM_KERNEL_SSE)
+        if (kernel != lmTransformKernel::Scalar) {
+            const size_t batched = input.count & ~size_t{ 3 };
+            computeTransformsSSE(input, done, batched, modelMatrices, normalMatrices);
+            done = batched;
+        }
+#endif
+
+        computeTransformsScalar(input, done, input.count, modelMatrices, normalMatrices);
+    }
+
+} // namespace lm
@@ -0,0 +1,53 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+
+namespace lm {
+
+    // Structure of arrays input of computeTransforms, every array holds count elements
+    struct lmTransformSoA {
+        const float* translationX = nullptr;
+        const float* translationY = nullptr;
+        const float* translationZ = nullptr;
+
+        // Unit quaternions
+        const float* rotationX = nullptr;
+        const float* rotationY = nullptr;
+        const float* rotationZ = nullptr;
+        const float* rotationW = nullptr;
+
+        // scaleY and scaleZ may be nullptr when every object is uniformly scaled by scaleX
+        const float* scaleX = nullptr;
+        const float* scaleY = nullptr;
+        const float* scaleZ = nullptr;
+
+        size_t count = 0;
+    };
+
+    // No AVX2 kernel, the matrix transposes and stores dominate and 8 lanes were no faster than SSE
+    enum class lmTransformKernel {
+        Scalar,
+        SSE     // 4 objects per iteration
+    };
+
+    // Widest kernel this binary was compiled for
+    lmTransformKernel getBestTransformKernel();
+    bool isTransformKernelAvailable(lmTransformKernel kernel);
+    const char* getTransformKernelName(lmTransformKernel kernel);
+
+    // Model = T * R * S and its normal matrix transpose(inverse(mat3(Model))) = R * S^-1 for one object
+    void computeTransform(
+        const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale,
+        glm::mat4& modelMatrix, glm::mat3& normalMatrix);
+
+    // Batched computeTransform, normalMatrices may be nullptr when only the model matrices are needed
+    void computeTransforms(
+        const lmTransformSoA& input, glm::mat4* modelMatrices, glm::mat3* normalMatrices,
+        lmTransformKernel kernel = getBestTransformKernel());
+
+} // namespace lm
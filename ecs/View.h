@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Archetype.h"
+#include "Entity.h"
+#include "../core/ThreadPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace lm {
+
+    // Components an lmView must not have, e.g. registry.view<TransformComponent>(exclude<PointLightComponent>)
+    template <typename... Es>
+    struct lmExclude {};
+
+    template <typename... Es>
+    inline constexpr lmExclude<Es...> exclude{};
+
+    // Least common multiple of the rows needed by each column to span a whole number of cache lines
+    template <typename... Ts>
+    constexpr size_t cacheAlignedRows() {
+        constexpr size_t lineSize = lmComponentColumn::CACHE_LINE_SIZE;
+        size_t rows = 1;
+        ((rows = std::lcm(rows, lineSize / std::gcd(lineSize, sizeof(Ts)))), ...);
+        return rows;
+    }
+
+    /*
+    * Typed query over the archetypes owning all of Ts and none of the excluded components.
+    *
+    * Matching happens per archetype, once: the view keeps the list of matching archetypes and
+    * only inspects archetypes created after its last refresh. Iteration then walks the dense
+    * component arrays of each archetype with no per-entity checks.
+    *
+    * The callback may take (lmEntity, Ts&...) or just (Ts&...). Like lmRegistry::forEach, it
+    * must not make structural changes, those go through an lmEntityCommandBuffer.
+    */
+    template <typename... Ts>
+    class lmView {
+    public:
+        static_assert(sizeof...(Ts) > 0, "A view needs at least one component type");
+
+        // Rows per chunk boundary so that every column of a chunk starts on a cache line
+        static constexpr size_t CHUNK_ALIGNMENT = cacheAlignedRows<Ts...>();
+
+        lmView(const std::vector<std::unique_ptr<lmArchetype>>& registryArchetypes, lmComponentMask excludedMask)
+            : archetypes{ registryArchetypes }, required{ componentMask<Ts...>() }, excluded{ excludedMask } {
+            refresh();
+        }
+
+        // Picks up the archetypes created since the view was built or last refreshed
+        void refresh() {
+            for (; scannedArchetypes < archetypes.size(); scannedArchetypes++) {
+                lmArchetype* archetype = archetypes[scannedArchetypes].get();
+                if (archetype->matches(required) && (archetype->getMask() & excluded) == 0) {
+                    matched.push_back(archetype);
+                }
+            }
+        }
+
+        size_t size() const {
+            size_t count = 0;
+            for (const lmArchetype* archetype : matched) {
+                count += archetype->size();
+            }
+            return count;
+        }
+
+        template <typename Func>
+        void each(Func&& fn) {
+            refresh();
+            for (lmArchetype* archetype : matched) {
+                run(*archetype, 0, archetype->size(), fn);
+            }
+        }
+
+        /*
+        * Splits every matching archetype into chunks of at least minChunkRows rows, rounded up to
+        * CHUNK_ALIGNMENT so that threads never write to the same cache line, and runs them on the pool.
+        * The callback runs concurrently and must only touch the components it is handed.
+        */
+        template <typename Func>
+        void parallelEach(lmThreadPool& threadPool, Func&& fn, size_t minChunkRows = DEFAULT_CHUNK_ROWS) {
+            refresh();
+
+            const size_t chunkRows = (std::max<size_t>(minChunkRows, 1) + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+
+            chunks.clear();
+            for (lmArchetype* archetype : matched) {
+                for (size_t begin = 0; begin < archetype->size(); begin += chunkRows) {
+                    chunks.push_back(Chunk{ archetype, begin, std::min(begin + chunkRows, archetype->size()) });
+                }
+            }
+
+            threadPool.parallelFor(chunks.size(), 1, [this, &fn](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    run(*chunks[i].archetype, chunks[i].begin, chunks[i].end, fn);
+                }
+            });
+        }
+
+    private:
+        static constexpr size_t DEFAULT_CHUNK_ROWS = 1024;
+
+        struct Chunk {
+            lmArchetype* archetype;
+            size_t begin;
+            size_t end;
+        };
+
+        template <typename Func>
+        static void run(lmArchetype& archetype, size_t begin, size_t end, Func& fn) {
+            const lmEntity* entities = archetype.getEntities().data();
+            const std::tuple<Ts*...> arrays{ archetype.getComponentArray<Ts>()... };
+
+            if constexpr (std::is_invocable_v<Func&, lmEntity, Ts&...>) {
+                for (size_t i = begin; i < end; i++) {
+                    fn(entities[i], std::get<Ts*>(arrays)[i]...);
+                }
+            }
+            else {
+                static_assert(std::is_invocable_v<Func&, Ts&...>, "View callback must take (lmEntity, Ts&...) or (Ts&...)");
+                for (size_t i = begin; i < end; i++) {
+                    fn(std::get<Ts*>(arrays)[i]...);
+                }
+            }
+        }
+
+        const std::vector<std::unique_ptr<lmArchetype>>& archetypes;
+        lmComponentMask required;
+        lmComponentMask excluded;
+        size_t scannedArchetypes = 0;
+        std::vector<lmArchetype*> matched;
+        std::vector<Chunk> chunks;
+    };
+
+} // namespace lm
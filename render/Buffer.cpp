@@ -30,6 +30,7 @@ namespace lm {
      * @param usageFlags Flags that define how the buffer will be used (e.g. VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
      * @param memoryPropertyFlags Flags that define the memory properties of the buffer (e.g. VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
      * @param minOffsetAlignment The minimum required alignment, in bytes, for the offset member (e.g. minUniformBufferOffsetAlignment)
+     * @param sharingMode VK_SHARING_MODE_CONCURRENT to use the buffer from several queue families without ownership transfers
      */
     lmBuffer::lmBuffer(
         lmDevice& device,
@@ -37,15 +38,17 @@ namespace lm {
         uint32_t instanceCount,
         VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
-        VkDeviceSize minOffsetAlignment)
+        VkDeviceSize minOffsetAlignment,
+        VkSharingMode sharingMode)
         : device{ device },
         instanceSize{ instanceSize },
         instanceCount{ instanceCount },
         usageFlags{ usageFlags },
-        memoryPropertyFlags{ memoryPropertyFlags } {
+        memoryPropertyFlags{ memoryPropertyFlags },
+        sharingMode{ sharingMode } {
             alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
             bufferSize = alignmentSize * instanceCount;
-            device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+            device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, allocation, sharingMode);
     }
 
     /**
@@ -53,21 +56,28 @@ namespace lm {
      */
     lmBuffer::~lmBuffer() {
         unmap();
-        vkDestroyBuffer(device.getDevice(), buffer, nullptr);
-        vkFreeMemory(device.getDevice(), memory, nullptr);
+        device.destroyBuffer(buffer, allocation);
     }
 
     /**
      * Map a memory range of this buffer. If successful, 'mapped' points to the specified buffer range.
      *
+     * @note The allocator maps the whole memory block the buffer lives in, size only documents the intended range
+     *
      * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete buffer range.
      * @param offset (Optional) Byte offset from the beginning
      *
      * @return VkResult of the buffer mapping call
      */
     VkResult lmBuffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(device.getDevice(), memory, offset, size, 0, &mapped);
+        assert(buffer && allocation && "Called map on buffer before create");
+        assert((size == VK_WHOLE_SIZE || offset + size <= bufferSize) && "Mapped range exceeds the buffer");
+
+        const VkResult result = vmaMapMemory(device.getAllocator(), allocation, &mapped);
+        if (result == VK_SUCCESS) {
+            mapped = static_cast<char*>(mapped) + offset;
+        }
+        return result;
     }
 
     /**
@@ -75,7 +85,7 @@ namespace lm {
      */
     void lmBuffer::unmap() {
         if (mapped) {
-            vkUnmapMemory(device.getDevice(), memory);
+            vmaUnmapMemory(device.getAllocator(), allocation);
             mapped = nullptr;
         }
     }
@@ -111,12 +121,7 @@ namespace lm {
      * @return VkResult of the flush call
      */
     VkResult lmBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkFlushMappedMemoryRanges(device.getDevice(), 1, &mappedRange);
+        return vmaFlushAllocation(device.getAllocator(), allocation, offset, size);
     }
 
     /**
@@ -130,12 +135,7 @@ namespace lm {
      * @return VkResult of the invalidate call
      */
     VkResult lmBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkInvalidateMappedMemoryRanges(device.getDevice(), 1, &mappedRange);
+        return vmaInvalidateAllocation(device.getAllocator(), allocation, offset, size);
     }
 
     /**
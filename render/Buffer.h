@@ -12,7 +12,8 @@ namespace lm {
             uint32_t instanceCount,
             VkBufferUsageFlags usageFlags,
             VkMemoryPropertyFlags memoryPropertyFlags,
-            VkDeviceSize minOffsetAlignment = 1);
+            VkDeviceSize minOffsetAlignment = 1,
+            VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE);
         ~lmBuffer();
 
         lmBuffer(const lmBuffer&) = delete;
@@ -38,6 +39,7 @@ namespace lm {
         VkDeviceSize getAlignmentSize() const { return instanceSize; }
         VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
         VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
+        VkSharingMode getSharingMode() const { return sharingMode; }
         VkDeviceSize getBufferSize() const { return bufferSize; }
 
     private:
@@ -46,7 +48,7 @@ namespace lm {
         lmDevice& device;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
@@ -54,6 +56,7 @@ namespace lm {
         VkDeviceSize alignmentSize;
         VkBufferUsageFlags usageFlags;
         VkMemoryPropertyFlags memoryPropertyFlags;
+        VkSharingMode sharingMode;
     };
 
 }  // namespace lm
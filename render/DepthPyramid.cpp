@@ -0,0 +1,313 @@
+/**
+ * @file DepthPyramid.cpp
+ * @brief Min/max depth pyramid built level by level with depth_pyramid.comp.
+ */
+
+#include "DepthPyramid.h"
+#include "SwapChain.h"
+#include "../core/Logger.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lm {
+
+    namespace {
+
+        // Levels of a 32768 pixel wide image, the largest maxImageDimension2D of current devices
+        constexpr uint32_t MAX_LEVEL_COUNT = 16;
+
+        // Matches the push constants of depth_pyramid.comp
+        struct PyramidPushConstants {
+            int32_t sourceWidth;
+            int32_t sourceHeight;
+            int32_t destinationWidth;
+            int32_t destinationHeight;
+            uint32_t fromDepth;
+        };
+
+        VkExtent2D getLevelExtent(VkExtent2D extent, uint32_t level) {
+            return VkExtent2D{ std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+        }
+
+    } // namespace
+
+    /**
+     * @brief Creates the sampler, the downsample pipeline when the device supports it, and a 1x1 pyramid.
+     * @param device The Vulkan device.
+     * @param pipelineRegistry The registry compiling the downsample pipeline.
+     */
+    lmDepthPyramid::lmDepthPyramid(lmDevice& device, lmPipelineRegistry& pipelineRegistry)
+        : device{ device }, supported{ device.hasStorageImageExtendedFormats() } {
+        createSampler();
+        if (supported) {
+            createPipeline(pipelineRegistry);
+        }
+        createImage(VkExtent2D{ 1, 1 });
+    }
+
+    lmDepthPyramid::~lmDepthPyramid() {
+        destroyImage();
+        vkDestroySampler(device.getDevice(), sampler, nullptr);
+    }
+
+    void lmDepthPyramid::createSampler() {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device.getDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            LOG_FATAL("Failed to create depth pyramid sampler!");
+        }
+    }
+
+    void lmDepthPyramid::createPipeline(lmPipelineRegistry& pipelineRegistry) {
+        shaderInterface = pipelineRegistry.reflectShaders({ "shaders/depth_pyramid.comp.spv" });
+        shaderInterface.checkPushConstants(sizeof(PyramidPushConstants), "PyramidPushConstants");
+
+        // The source level or depth, and the destination level
+        setLayout = shaderInterface.buildSetLayout(device, 0);
+
+        // Every level but the first, plus the first of every frame in flight
+        const uint32_t maxSets = MAX_LEVEL_COUNT - 1 + lmSwapChain::MAX_FRAMES_IN_FLIGHT;
+        pool = lmDescriptorPool::Builder(device)
+            .setMaxSets(maxSets)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets)
+            .build();
+
+        pipelineLayout = pipelineRegistry.getPipelineLayout(
+            { setLayout->getDescriptorSetLayout() },
+            shaderInterface.getPushConstantRanges());
+
+        pipeline = pipelineRegistry.requestComputePipeline("shaders/depth_pyramid.comp.spv", pipelineLayout);
+    }
+
+    /**
+     * @brief Creates the image, its views and the descriptor sets of every level, then moves every level to VK_IMAGE_LAYOUT_GENERAL.
+     * @param newExtent The extent of level 0.
+     */
+    void lmDepthPyramid::createImage(VkExtent2D newExtent) {
+        extent = newExtent;
+        levelCount = 1;
+        while ((std::max(extent.width, extent.height) >> levelCount) > 0) {
+            levelCount++;
+        }
+        assert(levelCount <= MAX_LEVEL_COUNT && "Depth pyramid has too many levels");
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { extent.width, extent.height, 1 };
+        imageInfo.mipLevels = levelCount;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32G32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | (supported ? VK_IMAGE_USAGE_STORAGE_BIT : 0);
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageAllocation);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32G32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = levelCount;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device.getDevice(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            LOG_FATAL("Failed to create depth pyramid image view!");
+        }
+
+        if (supported) {
+            levelViews.resize(levelCount);
+            for (uint32_t level = 0; level < levelCount; level++) {
+                viewInfo.subresourceRange.baseMipLevel = level;
+                viewInfo.subresourceRange.levelCount = 1;
+                if (vkCreateImageView(device.getDevice(), &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) {
+                    LOG_FATAL("Failed to create depth pyramid level view!");
+                }
+            }
+
+            levelSets.resize(levelCount - 1);
+            for (uint32_t level = 1; level < levelCount; level++) {
+                VkDescriptorImageInfo sourceInfo{ sampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL };
+                VkDescriptorImageInfo destinationInfo{ VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+                lmDescriptorWriter(*setLayout, *pool)
+                    .writeImage(0, &sourceInfo)
+                    .writeImage(1, &destinationInfo)
+                    .build(levelSets[level - 1]);
+            }
+
+            // Written with the depth view of the frame in build()
+            depthSets.resize(lmSwapChain::MAX_FRAMES_IN_FLIGHT);
+            for (VkDescriptorSet& depthSet : depthSets) {
+                pool->allocateDescriptor(setLayout->getDescriptorSetLayout(), depthSet);
+            }
+        }
+
+        VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = viewInfo.subresourceRange;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = levelCount;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        device.endSingleTimeCommands(commandBuffer);
+    }
+
+    void lmDepthPyramid::destroyImage() {
+        for (VkImageView levelView : levelViews) {
+            vkDestroyImageView(device.getDevice(), levelView, nullptr);
+        }
+        levelViews.clear();
+        levelSets.clear();
+        depthSets.clear();
+        if (pool) {
+            pool->resetPool();
+        }
+
+        vkDestroyImageView(device.getDevice(), imageView, nullptr);
+        device.destroyImage(image, imageAllocation);
+        imageView = VK_NULL_HANDLE;
+        image = VK_NULL_HANDLE;
+        imageAllocation = VK_NULL_HANDLE;
+    }
+
+    /**
+     * @brief Matches the pyramid to the extent of the depth it is built from.
+     *
+     * The image may be in use by the frames in flight, so the device is waited for before it is
+     * replaced. Descriptor sets pointing at descriptorInfo() must be rewritten when this returns true.
+     *
+     * @param newExtent The extent of the depth attachment.
+     * @return True if the image was recreated.
+     */
+    bool lmDepthPyramid::resize(VkExtent2D newExtent) {
+        if (!supported || (newExtent.width == extent.width && newExtent.height == extent.height)) {
+            return false;
+        }
+
+        vkDeviceWaitIdle(device.getDevice());
+        destroyImage();
+        createImage(newExtent);
+
+        LOG_INFO("Depth pyramid resized to {}x{} with {} levels", extent.width, extent.height, levelCount);
+        return true;
+    }
+
+    /**
+     * @brief Records the copy of the depth into level 0 and the downsample of every following level.
+     *
+     * Each level is made visible to the next dispatch, and the last one to every later compute shader
+     * read, such as the occlusion test. The writes wait for the reads of the previous build on the queue.
+     *
+     * @param commandBuffer The command buffer, outside of a render pass.
+     * @param frameIndex The frame in flight, selecting the descriptor set of the depth.
+     * @param depthView The depth to build from, of the pyramid's extent and in DEPTH_STENCIL_READ_ONLY_OPTIMAL.
+     */
+    void lmDepthPyramid::build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView) {
+        assert(supported && "Cannot build a depth pyramid without R32G32_SFLOAT storage images");
+
+        VkDescriptorImageInfo depthInfo{ sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+        VkDescriptorImageInfo levelInfo{ VK_NULL_HANDLE, levelViews[0], VK_IMAGE_LAYOUT_GENERAL };
+        lmDescriptorWriter(*setLayout, *pool)
+            .writeImage(0, &depthInfo)
+            .writeImage(1, &levelInfo)
+            .overwrite(depthSets[frameIndex]);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = levelCount;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        pipeline.wait().bind(commandBuffer);
+
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            const VkExtent2D destination = getLevelExtent(extent, level);
+            const VkExtent2D source = level == 0 ? destination : getLevelExtent(extent, level - 1);
+
+            PyramidPushConstants push{};
+            push.sourceWidth = static_cast<int32_t>(source.width);
+            push.sourceHeight = static_cast<int32_t>(source.height);
+            push.destinationWidth = static_cast<int32_t>(destination.width);
+            push.destinationHeight = static_cast<int32_t>(destination.height);
+            push.fromDepth = level == 0 ? 1 : 0;
+
+            VkDescriptorSet descriptorSet = level == 0 ? depthSets[frameIndex] : levelSets[level - 1];
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_COMPUTE,
+                pipelineLayout,
+                0, 1, &descriptorSet,
+                0, nullptr);
+            shaderInterface.pushConstants(commandBuffer, pipelineLayout, &push, sizeof(push));
+            vkCmdDispatch(
+                commandBuffer,
+                (destination.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                (destination.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                1);
+
+            barrier.subresourceRange.baseMipLevel = level;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+    }
+
+    /**
+     * @brief Retrieves the descriptor of the whole pyramid, sampled with nearest filtering and clamped coordinates.
+     * @return The image info, in VK_IMAGE_LAYOUT_GENERAL.
+     */
+    VkDescriptorImageInfo lmDepthPyramid::descriptorInfo() const {
+        return VkDescriptorImageInfo{ sampler, imageView, VK_IMAGE_LAYOUT_GENERAL };
+    }
+
+} // namespace lm
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Device.h"
+#include "Descriptors.h"
+#include "PipelineRegistry.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * A min/max hierarchical depth buffer built from a depth attachment by a compute downsample.
+    *
+    * The R32G32_SFLOAT image holds the nearest (R) and farthest (G) depth of the region each texel
+    * covers. Level 0 is a copy of the depth at full resolution and every level halves the previous one,
+    * an odd last row or column being folded into the last texel, so texel t of level L always covers
+    * the level 0 pixels [t << L, (t + 1) << L) and the last texel everything beyond. An occlusion test
+    * can then compare the nearest depth of an object with the farthest depth of at most 2x2 texels.
+    *
+    * Every level stays in VK_IMAGE_LAYOUT_GENERAL, written as a storage image and read through
+    * descriptorInfo() as a nearest, clamped sampler. Writing R32G32_SFLOAT storage images needs the
+    * shaderStorageImageExtendedFormats feature; without it the pyramid stays a 1x1 image that is valid
+    * to bind but never built.
+    */
+    class lmDepthPyramid {
+    public:
+        static constexpr uint32_t WORKGROUP_SIZE = 8;   // local_size_x and local_size_y of depth_pyramid.comp
+
+        lmDepthPyramid(lmDevice& device, lmPipelineRegistry& pipelineRegistry);
+        ~lmDepthPyramid();
+
+        lmDepthPyramid(const lmDepthPyramid&) = delete;
+        lmDepthPyramid& operator=(const lmDepthPyramid&) = delete;
+
+        bool isSupported() const { return supported; }
+
+        // Recreates the image for a new depth extent after waiting for the device, returns true if it did
+        bool resize(VkExtent2D extent);
+
+        // Records the downsample of depthView, in DEPTH_STENCIL_READ_ONLY_OPTIMAL, into every level.
+        // The descriptor of depthView is rewritten for frameIndex, whose previous use must have completed
+        void build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView);
+
+        VkDescriptorImageInfo descriptorInfo() const;
+        VkExtent2D getExtent() const { return extent; }
+        uint32_t getLevelCount() const { return levelCount; }
+
+    private:
+        void createSampler();
+        void createPipeline(lmPipelineRegistry& pipelineRegistry);
+        void createImage(VkExtent2D newExtent);
+        void destroyImage();
+
+        lmDevice& device;
+        bool supported;
+
+        VkImage image = VK_NULL_HANDLE;
+        VmaAllocation imageAllocation = VK_NULL_HANDLE;
+        VkImageView imageView = VK_NULL_HANDLE;
+        std::vector<VkImageView> levelViews;
+        VkExtent2D extent{ 0, 0 };
+        uint32_t levelCount = 0;
+
+        VkSampler sampler = VK_NULL_HANDLE;
+
+        lmPipelineInterface shaderInterface;
+        lmPipelineHandle pipeline;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;   // Owned by the registry
+        std::unique_ptr<lmDescriptorSetLayout> setLayout;
+        std::unique_ptr<lmDescriptorPool> pool;
+
+        // Level L > 0 reads level L - 1, level 0 reads the depth of the frame in flight
+        std::vector<VkDescriptorSet> levelSets;
+        std::vector<VkDescriptorSet> depthSets;
+    };
+
+} // namespace lm
@@ -1,7 +1,11 @@
 #include "Device.h"
 #include "../core/Logger.h"
+#include "../core/MappedFile.h"
 
+#include <algorithm>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -49,6 +53,32 @@ namespace lm {
             }
     }
 
+    namespace {
+
+        constexpr char PIPELINE_CACHE_MAGIC[8] = { 'L', 'M', 'P', 'C', 'A', 'C', 'H', 'E' };
+        constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+        // Precedes the data returned by vkGetPipelineCacheData in the cache file
+        struct PipelineCacheFileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t dataSize;
+            uint64_t dataHash;
+            uint64_t coldCreationMicroseconds;
+        };
+
+        // FNV-1a, catches truncated or corrupted data the driver would otherwise have to reject
+        uint64_t hashPipelineCacheData(const std::byte* data, size_t size) {
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+    } // namespace
+
     // Class member functions
     lmDevice::lmDevice(lmWindow& window) : window{ window } {
         createInstance();
@@ -56,11 +86,18 @@ namespace lm {
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
+        createAllocator();
         createCommandPool();
+        createPipelineCache();
     }
 
     lmDevice::~lmDevice() {
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
         vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyCommandPool(device, transferCommandPool, nullptr);
+        vkDestroyCommandPool(device, computeCommandPool, nullptr);
+        vmaDestroyAllocator(allocator);
         vkDestroyDevice(device, nullptr);
 
         if (enableValidationLayers) {
@@ -143,10 +180,12 @@ namespace lm {
     }
 
     void lmDevice::createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        queueFamilies = findQueueFamilies(physicalDevice);
+        const QueueFamilyIndices& indices = queueFamilies;
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+        std::set<uint32_t> uniqueQueueFamilies = {
+            indices.graphicsFamily, indices.presentFamily, indices.transferFamily, indices.computeFamily };
 
         float queuePriority = 1.0f;
 
@@ -159,18 +198,51 @@ namespace lm {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures = {};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        // Optional features are enabled when supported and reported through the device's has* accessors
+        const bool hasVulkan12 = properties.apiVersion >= VK_API_VERSION_1_2;
+
+        VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+        supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 supportedFeatures = {};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = hasVulkan12 ? &supportedVulkan12Features : nullptr;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+        VkPhysicalDeviceFeatures2 deviceFeatures = {};
+        deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures.pNext = hasVulkan12 ? &vulkan12Features : nullptr;
+        deviceFeatures.features.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.features.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+        deviceFeatures.features.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+        deviceFeatures.features.shaderStorageImageExtendedFormats = supportedFeatures.features.shaderStorageImageExtendedFormats;
+
+        multiDrawIndirect = deviceFeatures.features.multiDrawIndirect == VK_TRUE;
+        drawIndirectFirstInstance = deviceFeatures.features.drawIndirectFirstInstance == VK_TRUE;
+        drawIndirectCount = hasVulkan12 && vulkan12Features.drawIndirectCount == VK_TRUE;
+        storageImageExtendedFormats = deviceFeatures.features.shaderStorageImageExtendedFormats == VK_TRUE;
+
+        // Lets the allocator report the driver's per heap usage and budget
+        std::vector<const char*> enabledExtensions = deviceExtensions;
+        memoryBudget = isDeviceExtensionAvailable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudget) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &deviceFeatures;
 
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.pEnabledFeatures = nullptr;
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         // Might not really be necessary anymore because device specific validation layers
         // have been deprecated
@@ -188,22 +260,218 @@ namespace lm {
 
         vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily, 0, &transferQueue);
+        vkGetDeviceQueue(device, indices.computeFamily, 0, &computeQueue);
 
-        LOG_INFO("Logical device created");
+        LOG_INFO("Queue families: graphics {}, present {}, transfer {}{}, compute {}{}",
+            indices.graphicsFamily,
+            indices.presentFamily,
+            indices.transferFamily, indices.transferFamilyIsDedicated ? " (dedicated)" : "",
+            indices.computeFamily, indices.computeFamilyIsDedicated ? " (dedicated)" : "");
+
+        LOG_INFO("Logical device created (multiDrawIndirect: {}, drawIndirectFirstInstance: {}, drawIndirectCount: {}, storageImageExtendedFormats: {}, memoryBudget: {})",
+            multiDrawIndirect, drawIndirectFirstInstance, drawIndirectCount, storageImageExtendedFormats, memoryBudget);
+    }
+
+    /**
+     * @brief Creates the Vulkan Memory Allocator that suballocates every buffer and image.
+     *
+     * The allocator keeps a pool of large VkDeviceMemory blocks per memory type and places resources
+     * inside them, so the number of vkAllocateMemory calls grows with the memory used rather than with
+     * the number of resources and stays far below maxMemoryAllocationCount.
+     */
+    void lmDevice::createAllocator() {
+        // The allocator may only use what both the instance (1.3) and the physical device support
+        const uint32_t apiVersion = std::min(
+            VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion), 0),
+            VK_API_VERSION_1_3);
+
+        VmaAllocatorCreateInfo allocatorInfo = {};
+        allocatorInfo.instance = instance;
+        allocatorInfo.physicalDevice = physicalDevice;
+        allocatorInfo.device = device;
+        allocatorInfo.vulkanApiVersion = apiVersion;
+        allocatorInfo.preferredLargeHeapBlockSize = MEMORY_BLOCK_SIZE;
+        allocatorInfo.flags = memoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0;
+
+        if (vmaCreateAllocator(&allocatorInfo, &allocator) != VK_SUCCESS) {
+            LOG_FATAL("Failed to create memory allocator!");
+        }
+
+        LOG_INFO("Memory allocator created (maxMemoryAllocationCount: {})", properties.limits.maxMemoryAllocationCount);
+    }
+
+    /**
+     * @brief Creates the pipeline cache shared by every pipeline, seeded with the cache file of a previous run.
+     *
+     * The file is only used when its Vulkan header matches the vendor, device and pipelineCacheUUID of
+     * this physical device, so a driver update or another GPU starts from an empty cache.
+     */
+    void lmDevice::createPipelineCache() {
+        lmMappedFile file;
+        const std::byte* initialData = nullptr;
+        size_t initialDataSize = 0;
+
+        if (file.open(PIPELINE_CACHE_FILE)) {
+            PipelineCacheFileHeader header{};
+            VkPipelineCacheHeaderVersionOne cacheHeader{};
+            const char* rejection = nullptr;
+
+            if (file.size() < sizeof(header) + sizeof(cacheHeader)) {
+                rejection = "file too small";
+            }
+            else {
+                std::memcpy(&header, file.data(), sizeof(header));
+                std::memcpy(&cacheHeader, file.data() + sizeof(header), sizeof(cacheHeader));
+
+                if (std::memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC)) != 0 || header.version != PIPELINE_CACHE_VERSION) {
+                    rejection = "unknown format";
+                }
+                else if (header.dataSize != file.size() - sizeof(header)
+                    || header.dataHash != hashPipelineCacheData(file.data() + sizeof(header), header.dataSize)) {
+                    rejection = "corrupted data";
+                }
+                else if (cacheHeader.headerSize < sizeof(cacheHeader) || cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+                    rejection = "unknown Vulkan header";
+                }
+                else if (cacheHeader.vendorID != properties.vendorID || cacheHeader.deviceID != properties.deviceID
+                    || std::memcmp(cacheHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+                    rejection = "created by another device or driver";
+                }
+            }
+
+            if (rejection) {
+                LOG_WARN("Pipeline cache {} ignored: {}", PIPELINE_CACHE_FILE, rejection);
+            }
+            else {
+                initialData = file.data() + sizeof(header);
+                initialDataSize = static_cast<size_t>(header.dataSize);
+                coldPipelineCreationMicroseconds = header.coldCreationMicroseconds;
+                pipelineCacheWarm = true;
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = initialDataSize;
+        cacheInfo.pInitialData = initialData;
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            LOG_FATAL("Failed to create pipeline cache!");
+        }
+
+        if (pipelineCacheWarm) {
+            LOG_INFO("Pipeline cache loaded from {} ({} bytes)", PIPELINE_CACHE_FILE, initialDataSize);
+        }
+        else {
+            LOG_INFO("Pipeline cache created empty");
+        }
+    }
+
+    /**
+     * @brief Writes the pipeline cache to PIPELINE_CACHE_FILE.
+     *
+     * The file is written next to the target and renamed over it once complete, so an interrupted
+     * write never leaves a truncated cache behind.
+     */
+    void lmDevice::savePipelineCache() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            LOG_WARN("Pipeline cache not written: no data");
+            return;
+        }
+
+        std::vector<std::byte> data(dataSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+            LOG_WARN("Pipeline cache not written: cannot read the cache data");
+            return;
+        }
+        data.resize(dataSize);
+
+        PipelineCacheFileHeader header{};
+        std::memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC));
+        header.version = PIPELINE_CACHE_VERSION;
+        header.dataSize = dataSize;
+        header.dataHash = hashPipelineCacheData(data.data(), dataSize);
+        header.coldCreationMicroseconds = pipelineCacheWarm ? coldPipelineCreationMicroseconds : pipelineCreationMicroseconds.load();
+
+        const std::string path = PIPELINE_CACHE_FILE;
+        const std::string temporaryPath = path + ".tmp";
+        {
+            std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                LOG_WARN("Pipeline cache not written: cannot open {}", temporaryPath);
+                return;
+            }
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(dataSize));
+
+            if (!out) {
+                LOG_WARN("Pipeline cache not written: write to {} failed", temporaryPath);
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        if (error) {
+            LOG_WARN("Pipeline cache not written: {}", error.message());
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+
+        LOG_INFO("Pipeline cache written to {} ({} bytes)", path, dataSize);
+    }
+
+    /**
+     * @brief Accounts one pipeline creation call.
+     * @param duration The time the call took.
+     */
+    void lmDevice::recordPipelineCreation(std::chrono::steady_clock::duration duration) {
+        pipelineCreationMicroseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+        pipelineCreationCount++;
+    }
+
+    /**
+     * @brief Logs the time spent creating pipelines and, on a warm run, the time the cache saved.
+     */
+    void lmDevice::logPipelineCacheStats() {
+        const double milliseconds = pipelineCreationMicroseconds.load() / 1000.0;
+        if (!pipelineCacheWarm) {
+            LOG_INFO("{} pipelines created in {:.2f} ms with a cold pipeline cache", pipelineCreationCount.load(), milliseconds);
+            return;
+        }
+
+        const double coldMilliseconds = coldPipelineCreationMicroseconds / 1000.0;
+        LOG_INFO("{} pipelines created in {:.2f} ms with a warm pipeline cache, {:.2f} ms saved over the cold run ({:.2f} ms)",
+            pipelineCreationCount.load(), milliseconds, coldMilliseconds - milliseconds, coldMilliseconds);
     }
 
     void lmDevice::createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+        commandPool = createCommandPoolForFamily(queueFamilies.graphicsFamily);
+        transferCommandPool = createCommandPoolForFamily(queueFamilies.transferFamily);
+        computeCommandPool = createCommandPoolForFamily(queueFamilies.computeFamily);
+    }
 
+    /**
+     * @brief Creates a command pool whose command buffers can be submitted to the queues of a family.
+     * @param queueFamily The queue family index.
+     * @return The command pool, owned by the device.
+     */
+    VkCommandPool lmDevice::createCommandPoolForFamily(uint32_t queueFamily) {
         VkCommandPoolCreateInfo poolInfo = {};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+        poolInfo.queueFamilyIndex = queueFamily;
         poolInfo.flags =
             VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
             LOG_ERROR("Failed to create command pool!");
         }
+
+        return pool;
     }
 
     void lmDevice::createSurface() {
@@ -325,6 +593,23 @@ namespace lm {
         }
     }
 
+    /**
+     * @brief Checks whether the picked physical device supports an optional extension.
+     * @param extensionName The name of the extension.
+     * @return True if the extension can be enabled on the logical device.
+     */
+    bool lmDevice::isDeviceExtensionAvailable(const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        return std::any_of(availableExtensions.begin(), availableExtensions.end(), [extensionName](const VkExtensionProperties& extension) {
+            return std::strcmp(extension.extensionName, extensionName) == 0;
+        });
+    }
+
     bool lmDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -377,6 +662,33 @@ namespace lm {
             LOG_WARN("Queue families not found for some capabilities");
         }
 
+        // Dedicated families run on their own hardware queues, so uploads and compute can overlap rendering.
+        // Prefer a transfer only family (DMA engine), then any non graphics family that can transfer
+        indices.transferFamily = indices.graphicsFamily;
+        indices.computeFamily = indices.graphicsFamily;
+        int transferScore = 0;
+
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            const VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if (queueFamilies[family].queueCount == 0 || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+                continue;
+            }
+
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !indices.computeFamilyIsDedicated) {
+                indices.computeFamily = family;
+                indices.computeFamilyIsDedicated = true;
+            }
+
+            // Compute families support transfers even when they do not advertise the bit
+            const bool canTransfer = (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) != 0;
+            const int score = !canTransfer ? 0 : (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+            if (score > transferScore) {
+                indices.transferFamily = family;
+                indices.transferFamilyIsDedicated = true;
+                transferScore = score;
+            }
+        }
+
         return indices;
     }
 
@@ -448,38 +760,55 @@ namespace lm {
         LOG_ERROR("Failed to find suitable memory type!");
     }
 
-    // @TODO: Needs to be rewritten once Vulkan Memory Allocator is used in the project
+    /**
+     * @brief Creates a buffer and suballocates its memory from the pool of a matching memory type.
+     * @param size The size of the buffer in bytes.
+     * @param usage How the buffer is used.
+     * @param properties The memory properties the buffer requires, e.g. device local or host visible.
+     * @param buffer Receives the buffer.
+     * @param bufferAllocation Receives the allocation, released with destroyBuffer().
+     * @param sharingMode VK_SHARING_MODE_CONCURRENT shares the buffer between the graphics, transfer and compute
+     *                    families, so it can be written by one queue while another uses it without ownership transfers.
+     */
     void lmDevice::createBuffer(
         VkDeviceSize size,
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory) {
+        VmaAllocation& bufferAllocation,
+        VkSharingMode sharingMode) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-            LOG_ERROR("Failed to create vertex buffer!");
+        // Concurrent sharing needs at least two distinct families, with a single one exclusive is equivalent
+        const std::set<uint32_t> familySet = {
+            queueFamilies.graphicsFamily, queueFamilies.transferFamily, queueFamilies.computeFamily };
+        const std::vector<uint32_t> sharedFamilies(familySet.begin(), familySet.end());
+        if (sharingMode == VK_SHARING_MODE_CONCURRENT && sharedFamilies.size() > 1) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedFamilies.size());
+            bufferInfo.pQueueFamilyIndices = sharedFamilies.data();
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+        VmaAllocationCreateInfo allocationInfo{};
+        allocationInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+        allocationInfo.requiredFlags = properties;
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            LOG_ERROR("Failed to allocate vertex buffer memory!");
+        if (vmaCreateBuffer(allocator, &bufferInfo, &allocationInfo, &buffer, &bufferAllocation, nullptr) != VK_SUCCESS) {
+            LOG_ERROR("Failed to create buffer of {} bytes!", size);
         }
+    }
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
-
-        LOG_INFO("Buffer created...");
+    /**
+     * @brief Destroys a buffer created by createBuffer() and returns its memory to the pool.
+     * @param buffer The buffer to destroy.
+     * @param bufferAllocation The allocation returned with the buffer.
+     */
+    void lmDevice::destroyBuffer(VkBuffer buffer, VmaAllocation bufferAllocation) {
+        vmaDestroyBuffer(allocator, buffer, bufferAllocation);
     }
 
     VkCommandBuffer lmDevice::beginSingleTimeCommands() {
@@ -575,11 +904,23 @@ namespace lm {
         endSingleTimeCommands(commandBuffer);
     }
 
+    /**
+     * @brief Creates an image and allocates its memory.
+     *
+     * Render targets and images of at least DEDICATED_IMAGE_THRESHOLD bytes get a dedicated allocation:
+     * they are large, live as long as the swap chain and would otherwise pin or fragment whole blocks.
+     * Smaller images are suballocated like buffers.
+     *
+     * @param imageInfo The description of the image.
+     * @param properties The memory properties the image requires.
+     * @param image Receives the image.
+     * @param imageAllocation Receives the allocation, released with destroyImage().
+     */
     void lmDevice::createImageWithInfo(
         const VkImageCreateInfo& imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory) {
+        VmaAllocation& imageAllocation) {
 
         if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             LOG_ERROR("Failed to create image!");
@@ -588,18 +929,258 @@ namespace lm {
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        const bool renderTarget = (imageInfo.usage &
+            (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+
+        VmaAllocationCreateInfo allocationInfo{};
+        allocationInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+        allocationInfo.requiredFlags = properties;
+        if (renderTarget || memRequirements.size >= DEDICATED_IMAGE_THRESHOLD) {
+            allocationInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+        }
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+        if (vmaAllocateMemoryForImage(allocator, image, &allocationInfo, &imageAllocation, nullptr) != VK_SUCCESS) {
             LOG_ERROR("Failed to allocate image memory!");
         }
 
-        if (vkBindImageMemory(device, image, imageMemory, 0) != VK_SUCCESS) {
+        if (vmaBindImageMemory(allocator, imageAllocation, image) != VK_SUCCESS) {
             LOG_ERROR("Failed to bind image memory!");
         }
     }
 
+    /**
+     * @brief Destroys an image created by createImageWithInfo() and frees its memory.
+     * @param image The image to destroy.
+     * @param imageAllocation The allocation returned with the image.
+     */
+    void lmDevice::destroyImage(VkImage image, VmaAllocation imageAllocation) {
+        vmaDestroyImage(allocator, image, imageAllocation);
+    }
+
+    /**
+     * @brief Records the release half of a queue family ownership transfer of a whole buffer.
+     * @param commandBuffer A command buffer of the source queue family.
+     * @param buffer The buffer, created with VK_SHARING_MODE_EXCLUSIVE.
+     * @param srcQueueFamily The family that owns the buffer.
+     * @param dstQueueFamily The family that will own the buffer.
+     * @param srcStageMask The stages of the source queue that last accessed the buffer.
+     * @param srcAccessMask The writes of the source queue that must become available.
+     */
+    void lmDevice::releaseBufferOwnership(
+        VkCommandBuffer commandBuffer,
+        VkBuffer buffer,
+        uint32_t srcQueueFamily,
+        uint32_t dstQueueFamily,
+        VkPipelineStageFlags srcStageMask,
+        VkAccessFlags srcAccessMask) {
+        if (srcQueueFamily == dstQueueFamily) {
+            return;
+        }
+
+        // The destination access of a release is ignored, the acquire provides it
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            srcStageMask,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+    }
+
+    /**
+     * @brief Records the acquire half of a queue family ownership transfer of a whole buffer.
+     * @param commandBuffer A command buffer of the destination queue family, submitted after the release.
+     * @param buffer The buffer passed to the release.
+     * @param srcQueueFamily The family that released the buffer.
+     * @param dstQueueFamily The family acquiring the buffer.
+     * @param dstStageMask The stages of the destination queue that access the buffer next.
+     * @param dstAccessMask The accesses of the destination queue the data must be visible to.
+     */
+    void lmDevice::acquireBufferOwnership(
+        VkCommandBuffer commandBuffer,
+        VkBuffer buffer,
+        uint32_t srcQueueFamily,
+        uint32_t dstQueueFamily,
+        VkPipelineStageFlags dstStageMask,
+        VkAccessFlags dstAccessMask) {
+        if (srcQueueFamily == dstQueueFamily) {
+            return;
+        }
+
+        // The source access of an acquire is ignored, the release made the writes available
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            dstStageMask,
+            0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+    }
+
+    /**
+     * @brief Records the release half of a queue family ownership transfer of an image.
+     * @param commandBuffer A command buffer of the source queue family.
+     * @param image The image, created with VK_SHARING_MODE_EXCLUSIVE.
+     * @param subresourceRange The transferred subresources.
+     * @param oldLayout The layout of the image, must match the acquire.
+     * @param newLayout The layout after the transfer, must match the acquire.
+     * @param srcQueueFamily The family that owns the image.
+     * @param dstQueueFamily The family that will own the image.
+     * @param srcStageMask The stages of the source queue that last accessed the image.
+     * @param srcAccessMask The writes of the source queue that must become available.
+     */
+    void lmDevice::releaseImageOwnership(
+        VkCommandBuffer commandBuffer,
+        VkImage image,
+        const VkImageSubresourceRange& subresourceRange,
+        VkImageLayout oldLayout,
+        VkImageLayout newLayout,
+        uint32_t srcQueueFamily,
+        uint32_t dstQueueFamily,
+        VkPipelineStageFlags srcStageMask,
+        VkAccessFlags srcAccessMask) {
+        if (srcQueueFamily == dstQueueFamily) {
+            return;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.image = image;
+        barrier.subresourceRange = subresourceRange;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            srcStageMask,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+
+    /**
+     * @brief Records the acquire half of a queue family ownership transfer of an image.
+     * @param commandBuffer A command buffer of the destination queue family, submitted after the release.
+     * @param image The image passed to the release.
+     * @param subresourceRange The transferred subresources.
+     * @param oldLayout The old layout given to the release.
+     * @param newLayout The new layout given to the release.
+     * @param srcQueueFamily The family that released the image.
+     * @param dstQueueFamily The family acquiring the image.
+     * @param dstStageMask The stages of the destination queue that access the image next.
+     * @param dstAccessMask The accesses of the destination queue the data must be visible to.
+     */
+    void lmDevice::acquireImageOwnership(
+        VkCommandBuffer commandBuffer,
+        VkImage image,
+        const VkImageSubresourceRange& subresourceRange,
+        VkImageLayout oldLayout,
+        VkImageLayout newLayout,
+        uint32_t srcQueueFamily,
+        uint32_t dstQueueFamily,
+        VkPipelineStageFlags dstStageMask,
+        VkAccessFlags dstAccessMask) {
+        if (srcQueueFamily == dstQueueFamily) {
+            return;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = srcQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.image = image;
+        barrier.subresourceRange = subresourceRange;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            dstStageMask,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+
+    /**
+     * @brief Queries the allocator's usage and the driver's budget of every memory heap.
+     * @return One entry per heap, the budget is estimated from the heap size without VK_EXT_memory_budget.
+     */
+    std::vector<lmMemoryHeapBudget> lmDevice::getMemoryBudgets() {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+        vmaGetHeapBudgets(allocator, budgets);
+
+        std::vector<lmMemoryHeapBudget> heaps(memoryProperties->memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+            heaps[i].blockBytes = budgets[i].statistics.blockBytes;
+            heaps[i].allocationBytes = budgets[i].statistics.allocationBytes;
+            heaps[i].usage = budgets[i].usage;
+            heaps[i].budget = budgets[i].budget;
+            heaps[i].blockCount = budgets[i].statistics.blockCount;
+            heaps[i].allocationCount = budgets[i].statistics.allocationCount;
+            heaps[i].deviceLocal = (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        }
+
+        return heaps;
+    }
+
+    /**
+     * @brief Logs the allocations, blocks and budget of every memory heap in use.
+     */
+    void lmDevice::logMemoryStats() {
+        constexpr double MiB = 1024.0 * 1024.0;
+
+        const std::vector<lmMemoryHeapBudget> heaps = getMemoryBudgets();
+        for (size_t i = 0; i < heaps.size(); i++) {
+            const lmMemoryHeapBudget& heap = heaps[i];
+            if (heap.blockCount == 0) {
+                continue;
+            }
+
+            LOG_INFO("Memory heap {} ({}): {} allocations in {} blocks, {:.1f}/{:.1f} MiB used, {:.1f}/{:.1f} MiB of budget",
+                i,
+                heap.deviceLocal ? "device local" : "host",
+                heap.allocationCount,
+                heap.blockCount,
+                static_cast<double>(heap.allocationBytes) / MiB,
+                static_cast<double>(heap.blockBytes) / MiB,
+                static_cast<double>(heap.usage) / MiB,
+                static_cast<double>(heap.budget) / MiB);
+        }
+    }
+
 }// namespace lm
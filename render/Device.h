@@ -2,6 +2,10 @@
 
 #include "../core/Window.h"
 
+#include <vk_mem_alloc.h>
+
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -16,11 +20,27 @@ namespace lm {
 	struct QueueFamilyIndices {
 		uint32_t graphicsFamily;
 		uint32_t presentFamily;
+		// Fall back to the graphics family when the device has no dedicated family
+		uint32_t transferFamily;
+		uint32_t computeFamily;
 		bool graphicsFamilyHasValue = false;
 		bool presentFamilyHasValue = false;
+		bool transferFamilyIsDedicated = false;
+		bool computeFamilyIsDedicated = false;
 		bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 	};
 
+	// Memory of one heap, as seen by the allocator and, with VK_EXT_memory_budget, by the driver
+	struct lmMemoryHeapBudget {
+		VkDeviceSize blockBytes;		// Allocated from Vulkan in large blocks
+		VkDeviceSize allocationBytes;	// Occupied by resources inside those blocks
+		VkDeviceSize usage;				// Used by the whole process, including other allocators
+		VkDeviceSize budget;			// How much the process can use before allocations fail or degrade
+		uint32_t blockCount;
+		uint32_t allocationCount;
+		bool deviceLocal;
+	};
+
 	class lmDevice {
 	public:
 #ifdef NDEBUG
@@ -29,6 +49,13 @@ namespace lm {
 		const bool enableValidationLayers = true;
 #endif
 
+		// Images at least this large get their own VkDeviceMemory instead of sharing a block
+		static constexpr VkDeviceSize DEDICATED_IMAGE_THRESHOLD = 16ull * 1024 * 1024;
+		// Size of the blocks the per memory type pools suballocate from, on heaps larger than 1 GiB
+		static constexpr VkDeviceSize MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+		// Pipeline cache loaded from the working directory at startup and written back on shutdown
+		static constexpr const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
 		lmDevice(lmWindow& window);
 		~lmDevice();
 
@@ -39,10 +66,31 @@ namespace lm {
 		lmDevice& operator=(lmDevice&&) = delete;
 
 		VkCommandPool getCommandPool() { return commandPool; }
+		VkCommandPool getTransferCommandPool() { return transferCommandPool; }
+		VkCommandPool getComputeCommandPool() { return computeCommandPool; }
 		VkDevice getDevice() { return device; }
 		VkSurfaceKHR getSurface() { return surface; }
 		VkQueue getGraphicsQueue() { return graphicsQueue; }
 		VkQueue getPresentQueue() { return presentQueue; }
+		// The graphics queue when there is no dedicated family, work submitted there competes with rendering
+		VkQueue getTransferQueue() { return transferQueue; }
+		// Async compute is available but unused so far: GPU culling is still recorded on the graphics queue
+		VkQueue getComputeQueue() { return computeQueue; }
+		uint32_t getGraphicsQueueFamily() const { return queueFamilies.graphicsFamily; }
+		uint32_t getTransferQueueFamily() const { return queueFamilies.transferFamily; }
+		uint32_t getComputeQueueFamily() const { return queueFamilies.computeFamily; }
+		bool hasDedicatedTransferQueue() const { return queueFamilies.transferFamilyIsDedicated; }
+		bool hasDedicatedComputeQueue() const { return queueFamilies.computeFamilyIsDedicated; }
+		VmaAllocator getAllocator() { return allocator; }
+		// Shared by every pipeline creation, VkPipelineCache is internally synchronized
+		VkPipelineCache getPipelineCache() { return pipelineCache; }
+
+		// Optional features, enabled at device creation when the physical device supports them
+		bool hasMultiDrawIndirect() const { return multiDrawIndirect; }
+		bool hasDrawIndirectFirstInstance() const { return drawIndirectFirstInstance; }
+		bool hasDrawIndirectCount() const { return drawIndirectCount; }
+		bool hasStorageImageExtendedFormats() const { return storageImageExtendedFormats; }
+		bool hasMemoryBudget() const { return memoryBudget; }
 
 		SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -56,7 +104,9 @@ namespace lm {
 			VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties,
 			VkBuffer& buffer,
-			VkDeviceMemory& bufferMemory);
+			VmaAllocation& bufferAllocation,
+			VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE);
+		void destroyBuffer(VkBuffer buffer, VmaAllocation bufferAllocation);
 		VkCommandBuffer beginSingleTimeCommands();
 		void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 		void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -67,7 +117,55 @@ namespace lm {
 			const VkImageCreateInfo& imageInfo,
 			VkMemoryPropertyFlags properties,
 			VkImage& image,
-			VkDeviceMemory& imageMemory);
+			VmaAllocation& imageAllocation);
+		void destroyImage(VkImage image, VmaAllocation imageAllocation);
+
+		// Queue family ownership transfer of exclusive resources: the source queue records the release,
+		// the destination queue the matching acquire after waiting for the release, e.g. on a semaphore.
+		// Both are no-ops when the families are the same
+		static void releaseBufferOwnership(
+			VkCommandBuffer commandBuffer,
+			VkBuffer buffer,
+			uint32_t srcQueueFamily,
+			uint32_t dstQueueFamily,
+			VkPipelineStageFlags srcStageMask,
+			VkAccessFlags srcAccessMask);
+		static void acquireBufferOwnership(
+			VkCommandBuffer commandBuffer,
+			VkBuffer buffer,
+			uint32_t srcQueueFamily,
+			uint32_t dstQueueFamily,
+			VkPipelineStageFlags dstStageMask,
+			VkAccessFlags dstAccessMask);
+		static void releaseImageOwnership(
+			VkCommandBuffer commandBuffer,
+			VkImage image,
+			const VkImageSubresourceRange& subresourceRange,
+			VkImageLayout oldLayout,
+			VkImageLayout newLayout,
+			uint32_t srcQueueFamily,
+			uint32_t dstQueueFamily,
+			VkPipelineStageFlags srcStageMask,
+			VkAccessFlags srcAccessMask);
+		static void acquireImageOwnership(
+			VkCommandBuffer commandBuffer,
+			VkImage image,
+			const VkImageSubresourceRange& subresourceRange,
+			VkImageLayout oldLayout,
+			VkImageLayout newLayout,
+			uint32_t srcQueueFamily,
+			uint32_t dstQueueFamily,
+			VkPipelineStageFlags dstStageMask,
+			VkAccessFlags dstAccessMask);
+
+		// One entry per memory heap
+		std::vector<lmMemoryHeapBudget> getMemoryBudgets();
+		void logMemoryStats();
+
+		// Accounts the time spent in vkCreate*Pipelines, may be called from any thread
+		void recordPipelineCreation(std::chrono::steady_clock::duration duration);
+		// Logs the pipeline creation time so far and, with a warm cache, the time saved over the cold run
+		void logPipelineCacheStats();
 
 		VkPhysicalDeviceProperties properties;
 
@@ -77,7 +175,11 @@ namespace lm {
 		void createSurface();
 		void pickPhysicalDevice();
 		void createLogicalDevice();
+		void createAllocator();
 		void createCommandPool();
+		VkCommandPool createCommandPoolForFamily(uint32_t queueFamily);
+		void createPipelineCache();
+		void savePipelineCache();
 
 		// Helper functions
 		bool isDeviceSuitable(VkPhysicalDevice device);
@@ -87,6 +189,7 @@ namespace lm {
 		void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 		void hasGflwRequiredInstanceExtensions();
 		bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+		bool isDeviceExtensionAvailable(const char* extensionName);
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
 		VkInstance instance;
@@ -94,11 +197,30 @@ namespace lm {
 		VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 		lmWindow& window;
 		VkCommandPool commandPool;
+		VkCommandPool transferCommandPool;
+		VkCommandPool computeCommandPool;
 
 		VkDevice device;
 		VkSurfaceKHR surface;
 		VkQueue graphicsQueue;
 		VkQueue presentQueue;
+		VkQueue transferQueue;
+		VkQueue computeQueue;
+		QueueFamilyIndices queueFamilies;
+		VmaAllocator allocator = VK_NULL_HANDLE;
+
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		bool pipelineCacheWarm = false;
+		// Pipeline creation time of the run that filled the cache, carried over by warm runs
+		uint64_t coldPipelineCreationMicroseconds = 0;
+		std::atomic<uint64_t> pipelineCreationMicroseconds{ 0 };
+		std::atomic<uint32_t> pipelineCreationCount{ 0 };
+
+		bool multiDrawIndirect = false;
+		bool drawIndirectFirstInstance = false;
+		bool drawIndirectCount = false;
+		bool storageImageExtendedFormats = false;
+		bool memoryBudget = false;
 
 		const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 		const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
@@ -2,12 +2,19 @@
 
 #include "Camera.h"
 #include "../ecs/GameObject.h"
+#include "../ecs/EntityCommandBuffer.h"
+#include "../ecs/SpatialIndex.h"
+#include "../core/ThreadPool.h"
+#include "../ecs/TransformHierarchy.h"
 
 #include <vulkan/vulkan.hpp>
 
 namespace lm {
 
-	#define MAX_LIGHTS 10
+	class lmRenderer;
+
+	// Defined by CMake for the shaders too, see LM_MAX_LIGHTS
+	#define MAX_LIGHTS LM_MAX_LIGHTS
 
 	struct PointLight {
 		glm::vec4 position{};
@@ -27,9 +34,22 @@ namespace lm {
 		int frameIndex;
 		float frameTime;
 		VkCommandBuffer commandBuffer;
+		VkExtent2D extent;
+		// Depth kept by the renderer for the frame, VK_NULL_HANDLE when the depth is not kept
+		VkImageView depthImageView;
+		// Contents of the swap chain render passes. With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, systems
+		// drawing in them record secondary command buffers begun by the renderer and execute them in commandBuffer
+		VkSubpassContents subpassContents;
+		lmRenderer& renderer;
 		lmCamera& camera;
 		VkDescriptorSet globalDescriptorSet;
-		lmGameObject::Map& gameObjects;
+		lmRegistry& registry;
+		// Structural changes made while systems run must go through commands.local()
+		lmEntityCommandQueue& commands;
+		const lmTransformHierarchy& hierarchy;
+		const lmSpatialIndex& spatialIndex;
+		// Systems may fan work out with parallelFor or lmView::parallelEach
+		lmThreadPool& threadPool;
 	};
 
 }// namespace lm
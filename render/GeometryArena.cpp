@@ -0,0 +1,412 @@
+/**
+ * @file GeometryArena.cpp
+ * @brief Suballocation of every model's vertex streams and indices from one shared buffer.
+ */
+
+#include "GeometryArena.h"
+#include "../core/Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace lm {
+
+    namespace {
+
+        constexpr VkDeviceSize POSITION_STRIDE = sizeof(glm::vec3);
+        constexpr VkDeviceSize COLOR_STRIDE = sizeof(glm::vec3);
+        constexpr VkDeviceSize NORMAL_STRIDE = sizeof(glm::vec3);
+        constexpr VkDeviceSize UV_STRIDE = sizeof(glm::vec2);
+        constexpr VkDeviceSize INDEX_STRIDE = sizeof(uint32_t);
+
+        /**
+         * @brief Rounds a capacity up by doubling until it can hold the requested count.
+         * @param capacity The current capacity.
+         * @param required The minimum capacity.
+         * @return The grown capacity.
+         */
+        uint32_t growCapacity(uint32_t capacity, uint64_t required) {
+            uint64_t grown = std::max<uint64_t>(capacity, 1);
+            while (grown < required) {
+                grown *= 2;
+            }
+            assert(grown <= std::numeric_limits<uint32_t>::max() && "Geometry arena capacity overflow");
+            return static_cast<uint32_t>(grown);
+        }
+
+    } // namespace
+
+    /**
+     * @brief Creates the arena buffer with the given element capacities.
+     * @param device The Vulkan device used for creating the buffer.
+     * @param uploadQueue The queue staging the geometry of new allocations.
+     * @param vertexCapacity The number of vertices that fit before the arena has to grow.
+     * @param indexCapacity The number of indices that fit before the arena has to grow.
+     */
+    lmGeometryArena::lmGeometryArena(lmDevice& device, lmUploadQueue& uploadQueue, uint32_t vertexCapacity, uint32_t indexCapacity)
+        : device{ device },
+        uploadQueue{ uploadQueue },
+        layout{ computeLayout(vertexCapacity, indexCapacity) },
+        vertexAllocator{ vertexCapacity },
+        indexAllocator{ indexCapacity } {
+        buffer = createBuffer(device, layout);
+    }
+
+    /**
+     * @brief Destroys the arena buffer, every model allocated from it must already be destroyed.
+     */
+    lmGeometryArena::~lmGeometryArena() {
+        for (std::vector<Handle>& handles : retiredHandles) {
+            for (Handle handle : handles) {
+                release(handle);
+            }
+        }
+
+        if (allocationCount > 0) {
+            LOG_WARN("Geometry arena destroyed with {} live allocations", allocationCount);
+        }
+    }
+
+    /**
+     * @brief Computes the byte offset of every section in the buffer.
+     * @param vertexCapacity The number of elements of each vertex stream section.
+     * @param indexCapacity The number of elements of the index section.
+     * @return The section offsets and the total buffer size.
+     */
+    lmGeometryArena::Layout lmGeometryArena::computeLayout(uint32_t vertexCapacity, uint32_t indexCapacity) {
+        // Every stride is a multiple of 4, which keeps each section aligned for binding and copies
+        Layout result{};
+        result.positions = 0;
+        result.colors = result.positions + POSITION_STRIDE * vertexCapacity;
+        result.normals = result.colors + COLOR_STRIDE * vertexCapacity;
+        result.uvs = result.normals + NORMAL_STRIDE * vertexCapacity;
+        result.indices = result.uvs + UV_STRIDE * vertexCapacity;
+        result.size = result.indices + INDEX_STRIDE * indexCapacity;
+        return result;
+    }
+
+    /**
+     * @brief Creates the device local buffer backing a layout.
+     *
+     * The buffer is written by the transfer queue while the graphics queue draws from other ranges,
+     * so it is shared concurrently instead of changing owner with every upload.
+     *
+     * @param device The Vulkan device used for creating the buffer.
+     * @param layout The layout whose size is allocated.
+     * @return The new buffer.
+     */
+    std::unique_ptr<lmBuffer> lmGeometryArena::createBuffer(lmDevice& device, const Layout& layout) {
+        return std::make_unique<lmBuffer>(
+            device,
+            layout.size,
+            1,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            1,
+            VK_SHARING_MODE_CONCURRENT);
+    }
+
+    /**
+     * @brief Suballocates a mesh and stages its streams, the copies run with the upload queue's next batch.
+     * @param geometry The vertex streams and indices, only positions are required.
+     * @return The handle identifying the allocation.
+     */
+    lmGeometryArena::Handle lmGeometryArena::allocate(const lmGeometryUpload& geometry) {
+        assert(geometry.vertexCount >= 3 && "Vertex count must be at least 3");
+        assert(geometry.positions && "Geometry requires positions");
+        assert((geometry.indexCount == 0 || geometry.indices) && "Index count given without indices");
+
+        reserve(geometry.vertexCount, geometry.indexCount);
+
+        lmGeometryAllocation allocation{};
+        allocation.vertexCount = geometry.vertexCount;
+        allocation.indexCount = geometry.indexCount;
+        allocation.firstVertex = vertexAllocator.allocate(geometry.vertexCount);
+        if (geometry.indexCount > 0) {
+            allocation.firstIndex = indexAllocator.allocate(geometry.indexCount);
+        }
+        assert(allocation.firstVertex != lmRangeAllocator::INVALID_OFFSET && "Vertex allocation failed after reserve");
+        assert(allocation.firstIndex != lmRangeAllocator::INVALID_OFFSET && "Index allocation failed after reserve");
+
+        // Stage every stream, missing optional streams are zero filled
+        const VkDeviceSize vertexCount = geometry.vertexCount;
+        const std::array<VkDeviceSize, 5> sizes = {
+            POSITION_STRIDE * vertexCount,
+            COLOR_STRIDE * vertexCount,
+            NORMAL_STRIDE * vertexCount,
+            UV_STRIDE * vertexCount,
+            INDEX_STRIDE * geometry.indexCount
+        };
+        const std::array<const void*, 5> sources = {
+            geometry.positions, geometry.colors, geometry.normals, geometry.uvs, geometry.indices
+        };
+        const std::array<VkDeviceSize, 5> destinations = {
+            layout.positions + POSITION_STRIDE * allocation.firstVertex,
+            layout.colors + COLOR_STRIDE * allocation.firstVertex,
+            layout.normals + NORMAL_STRIDE * allocation.firstVertex,
+            layout.uvs + UV_STRIDE * allocation.firstVertex,
+            layout.indices + INDEX_STRIDE * allocation.firstIndex
+        };
+
+        std::vector<char> zeros;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (sizes[i] == 0) {
+                continue;
+            }
+
+            const void* source = sources[i];
+            if (!source) {
+                zeros.resize(std::max<size_t>(zeros.size(), sizes[i]));
+                source = zeros.data();
+            }
+            uploadQueue.enqueue(*buffer, destinations[i], source, sizes[i]);
+        }
+
+        Handle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        else {
+            handle = static_cast<Handle>(slots.size());
+            slots.emplace_back();
+        }
+
+        slots[handle].allocation = allocation;
+        slots[handle].live = true;
+        allocationCount++;
+        return handle;
+    }
+
+    /**
+     * @brief Retires an allocation, its ranges are released once the frames in flight are done with them.
+     * @param handle The handle returned by allocate(), invalid after the call.
+     */
+    void lmGeometryArena::free(Handle handle) {
+        assert(handle < slots.size() && slots[handle].live && "Freeing an invalid geometry handle");
+
+        if (currentFrame >= retiredHandles.size()) {
+            retiredHandles.resize(static_cast<size_t>(currentFrame) + 1);
+        }
+        retiredHandles[currentFrame].push_back(handle);
+    }
+
+    /**
+     * @brief Releases the allocations retired the last time a frame index was current.
+     * @param frameIndex The frame about to be recorded, its fence must have signaled.
+     */
+    void lmGeometryArena::beginFrame(uint32_t frameIndex) {
+        if (frameIndex < retiredHandles.size()) {
+            for (Handle handle : retiredHandles[frameIndex]) {
+                release(handle);
+            }
+            retiredHandles[frameIndex].clear();
+        }
+
+        currentFrame = frameIndex;
+    }
+
+    /**
+     * @brief Releases the ranges of an allocation, the GPU must no longer be reading them.
+     * @param handle A handle retired by free().
+     */
+    void lmGeometryArena::release(Handle handle) {
+        Slot& slot = slots[handle];
+        vertexAllocator.free(slot.allocation.firstVertex, slot.allocation.vertexCount);
+        if (slot.allocation.indexCount > 0) {
+            indexAllocator.free(slot.allocation.firstIndex, slot.allocation.indexCount);
+        }
+
+        slot.live = false;
+        freeHandles.push_back(handle);
+        allocationCount--;
+    }
+
+    /**
+     * @brief Retrieves the current ranges of an allocation, they change when the arena grows or compacts.
+     * @param handle The handle returned by allocate().
+     * @return The element ranges of the allocation.
+     */
+    const lmGeometryAllocation& lmGeometryArena::get(Handle handle) const {
+        assert(handle < slots.size() && slots[handle].live && "Invalid geometry handle");
+        return slots[handle].allocation;
+    }
+
+    /**
+     * @brief Binds every vertex stream and the index buffer of the arena.
+     * @param commandBuffer The Vulkan command buffer used for binding.
+     */
+    void lmGeometryArena::bind(VkCommandBuffer commandBuffer) const {
+        VkBuffer vertexBuffers[] = { buffer->getBuffer(), buffer->getBuffer(), buffer->getBuffer(), buffer->getBuffer() };
+        VkDeviceSize offsets[] = { layout.positions, layout.colors, layout.normals, layout.uvs };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 4, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, buffer->getBuffer(), layout.indices, VK_INDEX_TYPE_UINT32);
+    }
+
+    /**
+     * @brief Makes sure an allocation of the given size succeeds, doubling the capacities if needed.
+     * @param vertexCount The number of vertices about to be allocated.
+     * @param indexCount The number of indices about to be allocated.
+     */
+    void lmGeometryArena::reserve(uint32_t vertexCount, uint32_t indexCount) {
+        const bool vertexFits = vertexAllocator.getLargestFreeBlock() >= vertexCount;
+        const bool indexFits = indexCount == 0 || indexAllocator.getLargestFreeBlock() >= indexCount;
+        if (vertexFits && indexFits) {
+            return;
+        }
+
+        // Size for the worst case where the new range cannot reuse any hole
+        uint32_t vertexCapacity = vertexAllocator.getCapacity();
+        uint32_t indexCapacity = indexAllocator.getCapacity();
+        if (!vertexFits) {
+            vertexCapacity = growCapacity(vertexCapacity, static_cast<uint64_t>(vertexCapacity) + vertexCount);
+        }
+        if (!indexFits) {
+            indexCapacity = growCapacity(indexCapacity, static_cast<uint64_t>(indexCapacity) + indexCount);
+        }
+
+        LOG_INFO("Growing geometry arena to {} vertices and {} indices", vertexCapacity, indexCapacity);
+
+        std::vector<lmGeometryAllocation> allocations(slots.size());
+        for (size_t i = 0; i < slots.size(); i++) {
+            allocations[i] = slots[i].allocation;
+        }
+        relocate(vertexCapacity, indexCapacity, allocations);
+
+        vertexAllocator.grow(vertexCapacity);
+        indexAllocator.grow(indexCapacity);
+    }
+
+    /**
+     * @brief Packs every live allocation at the start of its section, in handle order.
+     */
+    void lmGeometryArena::compact() {
+        std::vector<lmGeometryAllocation> allocations(slots.size());
+        uint32_t vertexEnd = 0;
+        uint32_t indexEnd = 0;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (!slots[i].live) {
+                continue;
+            }
+
+            allocations[i] = slots[i].allocation;
+            allocations[i].firstVertex = vertexEnd;
+            vertexEnd += allocations[i].vertexCount;
+            if (allocations[i].indexCount > 0) {
+                allocations[i].firstIndex = indexEnd;
+                indexEnd += allocations[i].indexCount;
+            }
+            else {
+                allocations[i].firstIndex = 0;
+            }
+        }
+
+        const lmGeometryArenaStats before = getStats();
+        relocate(vertexAllocator.getCapacity(), indexAllocator.getCapacity(), allocations);
+        vertexAllocator.reset(vertexAllocator.getCapacity(), vertexEnd);
+        indexAllocator.reset(indexAllocator.getCapacity(), indexEnd);
+
+        LOG_INFO("Compacted geometry arena: {} -> 1 free vertex blocks, {} -> 1 free index blocks",
+            before.vertexFreeBlocks, before.indexFreeBlocks);
+    }
+
+    /**
+     * @brief Copies every live allocation into a new buffer and switches to it.
+     * @param vertexCapacity The vertex capacity of the new buffer.
+     * @param indexCapacity The index capacity of the new buffer.
+     * @param newAllocations The target ranges, indexed by handle, entries of dead slots are ignored.
+     */
+    void lmGeometryArena::relocate(
+        uint32_t vertexCapacity,
+        uint32_t indexCapacity,
+        const std::vector<lmGeometryAllocation>& newAllocations) {
+        const Layout newLayout = computeLayout(vertexCapacity, indexCapacity);
+        std::unique_ptr<lmBuffer> newBuffer = createBuffer(device, newLayout);
+
+        std::vector<VkBufferCopy> regions;
+        regions.reserve(slots.size() * 5);
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (!slots[i].live) {
+                continue;
+            }
+
+            const lmGeometryAllocation& from = slots[i].allocation;
+            const lmGeometryAllocation& to = newAllocations[i];
+            const VkDeviceSize vertexCount = from.vertexCount;
+
+            regions.push_back({ layout.positions + POSITION_STRIDE * from.firstVertex, newLayout.positions + POSITION_STRIDE * to.firstVertex, POSITION_STRIDE * vertexCount });
+            regions.push_back({ layout.colors + COLOR_STRIDE * from.firstVertex, newLayout.colors + COLOR_STRIDE * to.firstVertex, COLOR_STRIDE * vertexCount });
+            regions.push_back({ layout.normals + NORMAL_STRIDE * from.firstVertex, newLayout.normals + NORMAL_STRIDE * to.firstVertex, NORMAL_STRIDE * vertexCount });
+            regions.push_back({ layout.uvs + UV_STRIDE * from.firstVertex, newLayout.uvs + UV_STRIDE * to.firstVertex, UV_STRIDE * vertexCount });
+            if (from.indexCount > 0) {
+                regions.push_back({ layout.indices + INDEX_STRIDE * from.firstIndex, newLayout.indices + INDEX_STRIDE * to.firstIndex, INDEX_STRIDE * from.indexCount });
+            }
+        }
+
+        // Staged uploads still target the old buffer and frames in flight may still read it
+        uploadQueue.flush();
+        vkDeviceWaitIdle(device.getDevice());
+
+        if (!regions.empty()) {
+            VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+            vkCmdCopyBuffer(commandBuffer, buffer->getBuffer(), newBuffer->getBuffer(), static_cast<uint32_t>(regions.size()), regions.data());
+
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+            device.endSingleTimeCommands(commandBuffer);
+        }
+
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].live) {
+                slots[i].allocation = newAllocations[i];
+            }
+        }
+
+        buffer = std::move(newBuffer);
+        layout = newLayout;
+        generation++;
+    }
+
+    /**
+     * @brief Gathers the occupancy of the arena.
+     * @return The capacities, usage and fragmentation of both sections.
+     */
+    lmGeometryArenaStats lmGeometryArena::getStats() const {
+        lmGeometryArenaStats stats{};
+        stats.allocationCount = allocationCount;
+        stats.vertexCapacity = vertexAllocator.getCapacity();
+        stats.vertexUsed = vertexAllocator.getUsed();
+        stats.vertexFreeBlocks = vertexAllocator.getFreeBlockCount();
+        stats.largestFreeVertexBlock = vertexAllocator.getLargestFreeBlock();
+        stats.vertexFragmentation = vertexAllocator.getFragmentation();
+        stats.indexCapacity = indexAllocator.getCapacity();
+        stats.indexUsed = indexAllocator.getUsed();
+        stats.indexFreeBlocks = indexAllocator.getFreeBlockCount();
+        stats.largestFreeIndexBlock = indexAllocator.getLargestFreeBlock();
+        stats.indexFragmentation = indexAllocator.getFragmentation();
+        stats.bufferSize = layout.size;
+        return stats;
+    }
+
+    /**
+     * @brief Logs the occupancy of the arena.
+     */
+    void lmGeometryArena::logStats() const {
+        const lmGeometryArenaStats stats = getStats();
+        LOG_INFO("Geometry arena: {} allocations in {:.1f} MiB, vertices {}/{} ({:.0f}% fragmented), indices {}/{} ({:.0f}% fragmented)",
+            stats.allocationCount,
+            static_cast<double>(stats.bufferSize) / (1024.0 * 1024.0),
+            stats.vertexUsed, stats.vertexCapacity, stats.vertexFragmentation * 100.f,
+            stats.indexUsed, stats.indexCapacity, stats.indexFragmentation * 100.f);
+    }
+
+}  // namespace lm
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Device.h"
+#include "Buffer.h"
+#include "UploadQueue.h"
+#include "../core/RangeAllocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace lm {
+
+    // Vertex streams and indices of one mesh, every vertex array holds vertexCount elements
+    struct lmGeometryUpload {
+        const glm::vec3* positions = nullptr;
+        const glm::vec3* colors = nullptr;
+        const glm::vec3* normals = nullptr;
+        const glm::vec2* uvs = nullptr;
+        uint32_t vertexCount = 0;
+        const uint32_t* indices = nullptr;
+        uint32_t indexCount = 0;
+    };
+
+    // Element ranges of one mesh inside the arena, indices are relative to firstVertex
+    struct lmGeometryAllocation {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    struct lmGeometryArenaStats {
+        uint32_t allocationCount;
+        uint32_t vertexCapacity;
+        uint32_t vertexUsed;
+        uint32_t vertexFreeBlocks;
+        uint32_t largestFreeVertexBlock;
+        float vertexFragmentation;
+        uint32_t indexCapacity;
+        uint32_t indexUsed;
+        uint32_t indexFreeBlocks;
+        uint32_t largestFreeIndexBlock;
+        float indexFragmentation;
+        VkDeviceSize bufferSize;
+    };
+
+    /*
+    * Shared storage for the geometry of every model: one device local buffer, one memory allocation.
+    *
+    * The buffer holds a section per vertex stream (position, color, normal, uv) followed by the
+    * index section, each sized for the arena's capacity, so the whole scene is bound with one
+    * vkCmdBindVertexBuffers and one vkCmdBindIndexBuffer and every mesh is drawn with its
+    * firstIndex and vertexOffset. Vertex and index ranges are suballocated independently.
+    *
+    * Uploads go through an lmUploadQueue, a new mesh can be drawn by any command buffer submitted to
+    * the graphics queue after the queue's next submit().
+    *
+    * free() does not release the ranges right away, since frames in flight may still draw them: they are
+    * retired with the current frame index and released by the next beginFrame() with that index, once the
+    * renderer waited for the frame's fence.
+    *
+    * Growing and compacting rebuild the buffer and wait for the device to be idle, they are meant
+    * for loading screens, not for every frame. Both change the ranges of existing allocations and
+    * bump the generation, so cached draw commands must be rebuilt when it changes.
+    */
+    class lmGeometryArena {
+    public:
+        using Handle = uint32_t;
+        static constexpr Handle INVALID_HANDLE = std::numeric_limits<uint32_t>::max();
+
+        static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 1u << 18;
+        static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 1u << 20;
+
+        lmGeometryArena(
+            lmDevice& device,
+            lmUploadQueue& uploadQueue,
+            uint32_t vertexCapacity = DEFAULT_VERTEX_CAPACITY,
+            uint32_t indexCapacity = DEFAULT_INDEX_CAPACITY);
+        ~lmGeometryArena();
+
+        lmGeometryArena(const lmGeometryArena&) = delete;
+        lmGeometryArena& operator=(const lmGeometryArena&) = delete;
+
+        // Suballocates a mesh, growing the arena if needed, and stages its upload
+        Handle allocate(const lmGeometryUpload& geometry);
+        void free(Handle handle);
+
+        // Call once the frame's fence has signaled, releases the ranges freed while frameIndex was current
+        void beginFrame(uint32_t frameIndex);
+
+        const lmGeometryAllocation& get(Handle handle) const;
+
+        void bind(VkCommandBuffer commandBuffer) const;
+
+        // Packs every allocation at the start of its section, removing all holes
+        void compact();
+
+        lmGeometryArenaStats getStats() const;
+        void logStats() const;
+
+        uint64_t getGeneration() const { return generation; }
+        lmDevice& getDevice() const { return device; }
+
+    private:
+        // Byte offsets of the sections for the given capacities
+        struct Layout {
+            VkDeviceSize positions;
+            VkDeviceSize colors;
+            VkDeviceSize normals;
+            VkDeviceSize uvs;
+            VkDeviceSize indices;
+            VkDeviceSize size;
+        };
+
+        struct Slot {
+            lmGeometryAllocation allocation;
+            bool live = false;
+        };
+
+        static Layout computeLayout(uint32_t vertexCapacity, uint32_t indexCapacity);
+        static std::unique_ptr<lmBuffer> createBuffer(lmDevice& device, const Layout& layout);
+
+        void release(Handle handle);
+        void reserve(uint32_t vertexCount, uint32_t indexCount);
+        void relocate(uint32_t vertexCapacity, uint32_t indexCapacity, const std::vector<lmGeometryAllocation>& newAllocations);
+
+        lmDevice& device;
+        lmUploadQueue& uploadQueue;
+        std::unique_ptr<lmBuffer> buffer;
+        Layout layout;
+        lmRangeAllocator vertexAllocator;
+        lmRangeAllocator indexAllocator;
+
+        std::vector<Slot> slots;
+        std::vector<Handle> freeHandles;
+        uint32_t allocationCount = 0;
+
+        // Freed handles by the frame index current when they were freed, still live until released
+        std::vector<std::vector<Handle>> retiredHandles;
+        uint32_t currentFrame = 0;
+        uint64_t generation = 0;
+    };
+
+}  // namespace lm
@@ -0,0 +1,7 @@
+/**
+ * @file MemoryAllocator.cpp
+ * @brief Compiles the Vulkan Memory Allocator implementation used by lmDevice.
+ */
+
+#define VMA_IMPLEMENTATION
+#include <vk_mem_alloc.h>
@@ -1,34 +1,20 @@
 #include "Model.h"
 #include "Device.h"
-#include "Buffer.h"
 #include "../core/Logger.h"
 
+#include <algorithm>
 #include <cassert>
-#include <cstring>
+#include <cmath>
 
 namespace lm {
 
     /**
      * Constructor for the lmModel class.     
-     * @param device The Vulkan device used for creating the model.
+     * @param geometryArena The arena holding the model's vertex and index data.
      * @param data The model data containing vertices and indices.
      */
-    lmModel::lmModel(lmDevice& device, const lmModel::Data& data) : device{ device } {
-        createAttributeBuffers(data.vertices);
-        createIndexBuffer(data.indices);
-    }
-
-    /**
-     * Destructor for the lmModel class.
-     */
-    lmModel::~lmModel() {}
-
-    /**
-     * Create vertex attribute buffers for the model.     
-     * @param vertices The vector containing the vertex data.
-     */
-    void lmModel::createAttributeBuffers(const std::vector<Vertex>& vertices) {
-        vertexCount = static_cast<uint32_t>(vertices.size());
+    lmModel::lmModel(lmGeometryArena& geometryArena, const lmModel::Data& data) : geometryArena{ geometryArena } {
+        const uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size());
         assert(vertexCount >= 3 && "Vertex count must be at least 3");
 
         // Extract position, color, normal, and UV data from vertices
@@ -38,146 +24,79 @@ namespace lm {
         std::vector<glm::vec2> uvs(vertexCount);
 
         for (size_t i = 0; i < vertexCount; i++) {
-            positions[i] = vertices[i].position;
-            colors[i] = vertices[i].color;
-            normals[i] = vertices[i].normal;
-            uvs[i] = vertices[i].uv;
+            positions[i] = data.vertices[i].position;
+            colors[i] = data.vertices[i].color;
+            normals[i] = data.vertices[i].normal;
+            uvs[i] = data.vertices[i].uv;
+
+            boundingBox.expand(positions[i]);
         }
 
-        VkDeviceSize bufferSize = sizeof(glm::vec3) * vertexCount;
-
-        // Create a single staging buffer for transferring data to GPU
-        lmBuffer stagingBuffer{
-            device,
-            bufferSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-        stagingBuffer.map();
-
-        // Position Buffer
-        positionBuffer = std::make_unique<lmBuffer>(
-            device,
-            bufferSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        stagingBuffer.writeToBuffer(positions.data(), bufferSize);
-        device.copyBuffer(stagingBuffer.getBuffer(), positionBuffer->getBuffer(), bufferSize);
-
-        // Color Buffer
-        colorBuffer = std::make_unique<lmBuffer>(
-            device,
-            bufferSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        stagingBuffer.writeToBuffer(colors.data(), bufferSize);
-        device.copyBuffer(stagingBuffer.getBuffer(), colorBuffer->getBuffer(), bufferSize);
-
-        // Normal Buffer
-        normalBuffer = std::make_unique<lmBuffer>(
-            device,
-            bufferSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        stagingBuffer.writeToBuffer(normals.data(), bufferSize);
-        device.copyBuffer(stagingBuffer.getBuffer(), normalBuffer->getBuffer(), bufferSize);
-
-        // UV Buffer
-        uvBuffer = std::make_unique<lmBuffer>(
-            device,
-            sizeof(glm::vec2) * vertexCount,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        stagingBuffer.writeToBuffer(uvs.data(), sizeof(glm::vec2) * vertexCount);
-        device.copyBuffer(stagingBuffer.getBuffer(), uvBuffer->getBuffer(), sizeof(glm::vec2) * vertexCount);
+        // Centered on the box instead of the minimal center, a slightly looser sphere for a single extra pass
+        float radiusSquared = 0.f;
+        boundingSphere.center = boundingBox.getCenter();
+        for (const glm::vec3& position : positions) {
+            const glm::vec3 offset = position - boundingSphere.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        boundingSphere.radius = std::sqrt(radiusSquared);
+
+        lmGeometryUpload upload{};
+        upload.positions = positions.data();
+        upload.colors = colors.data();
+        upload.normals = normals.data();
+        upload.uvs = uvs.data();
+        upload.vertexCount = vertexCount;
+        upload.indices = data.indices.data();
+        upload.indexCount = static_cast<uint32_t>(data.indices.size());
+
+        geometryHandle = geometryArena.allocate(upload);
     }
 
     /**
-     * Create the index buffer for the model.     
-     * @param indices The vector containing the index data.
+     * Destructor for the lmModel class, retires the model's ranges of the arena until the frames in flight are done.
      */
-    void lmModel::createIndexBuffer(const std::vector<uint32_t>& indices) {
-        if (indices.empty()) {
-            hasIndexBuffer = false;
-            return;
-        }
-
-        indexCount = static_cast<uint32_t>(indices.size());
-        hasIndexBuffer = true;
-
-        VkDeviceSize indexBufferSize = sizeof(indices[0]) * indexCount;
-
-        // Create a staging buffer for transferring index data to GPU
-        lmBuffer indexStagingBuffer{
-            device,
-            indexBufferSize,
-            indexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-        indexStagingBuffer.map();
-        indexStagingBuffer.writeToBuffer(indices.data(), indexBufferSize);
-
-        // Create the index buffer on the GPU
-        indexBuffer = std::make_unique<lmBuffer>(
-            device,
-            indexBufferSize,
-            indexCount,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        // Copy index data to the GPU index buffer
-        device.copyBuffer(indexStagingBuffer.getBuffer(), indexBuffer->getBuffer(), indexBufferSize);
+    lmModel::~lmModel() {
+        geometryArena.free(geometryHandle);
     }
 
     /**
-     * Draw the model using the given command buffer.     
+     * Draw instances of the model using the given command buffer.     
      * @param commandBuffer The Vulkan command buffer used for drawing.
+     * @param instanceCount The number of instances to draw.
+     * @param firstInstance The first instance, which offsets gl_InstanceIndex in the shaders.
      */
-    void lmModel::draw(VkCommandBuffer commandBuffer) {
-        if (hasIndexBuffer) {
-            vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+    void lmModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+        const lmGeometryAllocation& allocation = getAllocation();
+        if (allocation.indexCount > 0) {
+            vkCmdDrawIndexed(
+                commandBuffer,
+                allocation.indexCount,
+                instanceCount,
+                allocation.firstIndex,
+                static_cast<int32_t>(allocation.firstVertex),
+                firstInstance);
         }
         else {
-            vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, allocation.vertexCount, instanceCount, allocation.firstVertex, firstInstance);
         }
     }
 
     /**
-     * Bind the model's attribute buffers and index buffer to the given command buffer.     
+     * Check whether two models bind the same attribute and index buffers.
+     * @param other The model to compare with.
+     * @return True if bind() records the same state for both models.
+     */
+    bool lmModel::sharesBuffersWith(const lmModel& other) const {
+        return &geometryArena == &other.geometryArena;
+    }
+
+    /**
+     * Bind the attribute buffers and index buffer of the model's arena to the given command buffer.     
      * @param commandBuffer The Vulkan command buffer used for binding.
      */
     void lmModel::bind(VkCommandBuffer commandBuffer) {
-        VkDeviceSize offsets[] = { 0 };
-
-        if (positionBuffer) {
-            VkBuffer positionBuffers[] = { positionBuffer->getBuffer() };
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, positionBuffers, offsets);
-        }
-
-        if (colorBuffer) {
-            VkBuffer colorBuffers[] = { colorBuffer->getBuffer() };
-            vkCmdBindVertexBuffers(commandBuffer, 1, 1, colorBuffers, offsets);
-        }
-
-        if (normalBuffer) {
-            VkBuffer normalBuffers[] = { normalBuffer->getBuffer() };
-            vkCmdBindVertexBuffers(commandBuffer, 2, 1, normalBuffers, offsets);
-        }
-
-        if (uvBuffer) {
-            VkBuffer uvBuffers[] = { uvBuffer->getBuffer() };
-            vkCmdBindVertexBuffers(commandBuffer, 3, 1, uvBuffers, offsets);
-        }
-
-        if (hasIndexBuffer) {
-            vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
-        }
+        geometryArena.bind(commandBuffer);
     }
 
     /**
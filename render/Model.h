@@ -1,7 +1,8 @@
 #pragma once
 
 #include "Device.h"
-#include "Buffer.h"
+#include "GeometryArena.h"
+#include "../ecs/Bounds.h"
 
 #include <vulkan/vulkan.hpp>
 
@@ -10,7 +11,6 @@
 #include <glm/glm.hpp>
 
 #include <vector>
-#include <memory>
 
 namespace lm {
 
@@ -29,7 +29,7 @@ namespace lm {
             std::vector<uint32_t> indices{};
         };
 
-        lmModel(lmDevice& device, const lmModel::Data& data);
+        lmModel(lmGeometryArena& geometryArena, const lmModel::Data& data);
         ~lmModel();
 
         lmModel(const lmModel&) = delete;
@@ -39,21 +39,32 @@ namespace lm {
         static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 
         void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+        // Parameters of a VkDrawIndexedIndirectCommand drawing this model
+        // Ranges are read from the arena on every call because growing or compacting it moves them
+        bool isIndexed() const { return getAllocation().indexCount > 0; }
+        uint32_t getIndexCount() const { return getAllocation().indexCount; }
+        uint32_t getFirstIndex() const { return getAllocation().firstIndex; }
+        int32_t getVertexOffset() const { return static_cast<int32_t>(getAllocation().firstVertex); }
+
+        // Models binding the same buffers can be drawn by a single multi-draw after one bind()
+        bool sharesBuffersWith(const lmModel& other) const;
+
+        lmGeometryArena& getGeometryArena() const { return geometryArena; }
+
+        // Local space bounds of the vertices, computed once at load time
+        const lmAabb& getBoundingBox() const { return boundingBox; }
+        const lmSphere& getBoundingSphere() const { return boundingSphere; }
 
     private:
-        void createAttributeBuffers(const std::vector<Vertex>& vertices);
-        void createIndexBuffer(const std::vector<uint32_t>& indices);
-
-        lmDevice& device;
-        std::unique_ptr<lmBuffer> positionBuffer;
-        std::unique_ptr<lmBuffer> colorBuffer;
-        std::unique_ptr<lmBuffer> normalBuffer;
-        std::unique_ptr<lmBuffer> uvBuffer;
-        std::unique_ptr<lmBuffer> indexBuffer;
-        uint32_t vertexCount;
-        uint32_t indexCount;
-        bool hasIndexBuffer = false;
+        const lmGeometryAllocation& getAllocation() const { return geometryArena.get(geometryHandle); }
+
+        lmGeometryArena& geometryArena;
+        lmGeometryArena::Handle geometryHandle = lmGeometryArena::INVALID_HANDLE;
+
+        lmAabb boundingBox;
+        lmSphere boundingSphere;
     };
 
 }  // namespace lm
@@ -1,13 +1,13 @@
 /**
  * @file Pipeline.h
- * @brief This file contains the lmPipeline class that represents a graphics pipeline in Vulkan.
+ * @brief This file contains the lmPipeline class that represents a graphics or compute pipeline in Vulkan.
  */
 
 #include "../core/Logger.h"
 #include "Pipeline.h"
 #include "Model.h"
 
-#include <fstream>
+#include <chrono>
 #include <cassert>
 
 namespace lm {
@@ -16,49 +16,35 @@ namespace lm {
      * @brief Construct a new lmPipeline object.
      *
      * @param device The lmDevice instance used to create the pipeline.
+     * @param shaderLibrary The library providing the shader modules.
      * @param vertFilePath The file path to the vertex shader.
      * @param fragFilePath The file path to the fragment shader.
      * @param configInfo The PipelineConfigInfo struct containing configuration information for the pipeline.
      */
-    lmPipeline::lmPipeline(lmDevice& device, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo)
-        : device{ device } {
+    lmPipeline::lmPipeline(lmDevice& device, lmShaderLibrary& shaderLibrary, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo)
+        : device{ device }, shaderLibrary{ shaderLibrary } {
             createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
     }
 
     /**
-     * @brief Destroy the lmPipeline object.
-     *        This will also destroy the associated shader modules and graphics pipeline.
+     * @brief Construct a new compute lmPipeline object.
+     *
+     * @param device The lmDevice instance used to create the pipeline.
+     * @param shaderLibrary The library providing the shader module.
+     * @param compFilePath The file path to the compute shader.
+     * @param pipelineLayout The layout of the descriptor sets and push constants used by the shader.
      */
-    lmPipeline::~lmPipeline() {
-        vkDestroyShaderModule(device.getDevice(), vertShaderModule, nullptr);
-        vkDestroyShaderModule(device.getDevice(), fragShaderModule, nullptr);
-        vkDestroyPipeline(device.getDevice(), graphicsPipeline, nullptr);
+    lmPipeline::lmPipeline(lmDevice& device, lmShaderLibrary& shaderLibrary, const std::string& compFilePath, VkPipelineLayout pipelineLayout)
+        : device{ device }, shaderLibrary{ shaderLibrary }, bindPoint{ VK_PIPELINE_BIND_POINT_COMPUTE } {
+            createComputePipeline(compFilePath, pipelineLayout);
     }
 
     /**
-     * @brief Read the binary content of a file.
-     *
-     * @param filePath The path to the file to read.
-     * @return A vector of characters containing the binary data from the file.
-     * @throw std::runtime_error if the file cannot be opened or read.
+     * @brief Destroy the lmPipeline object.
+     *        This will also release the shader modules, destroyed with their last pipeline.
      */
-    std::vector<char> lmPipeline::readFile(const std::string& filePath) {
-        std::ifstream file{ filePath, std::ios::ate | std::ios::binary };
-
-        if (!file.is_open()) {
-            LOG_ERROR("Failed to open file: " + filePath);
-        }
-
-        size_t fileSize = static_cast<size_t>(file.tellg());
-
-        std::vector<char> buffer(fileSize);
-
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-
-        file.close();
-
-        return buffer;
+    lmPipeline::~lmPipeline() {
+        vkDestroyPipeline(device.getDevice(), pipeline, nullptr);
     }
 
     /**
@@ -73,27 +59,36 @@ namespace lm {
         assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
         assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-        auto vertCode = readFile(vertFilePath);
-        auto fragCode = readFile(fragFilePath);
+        vertShaderModule = shaderLibrary.load(vertFilePath);
+        fragShaderModule = shaderLibrary.load(fragFilePath);
+        if (!vertShaderModule || !fragShaderModule) {
+            LOG_FATAL("Cannot create graphics pipeline without its shader modules");
+            return;
+        }
 
-        createShaderModule(vertCode, &vertShaderModule);
-        createShaderModule(fragCode, &fragShaderModule);
+        // Constant ids a stage does not declare are ignored, so both stages share the constants
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationEntries.size());
+        specializationInfo.pMapEntries = configInfo.specializationEntries.data();
+        specializationInfo.dataSize = configInfo.specializationData.size() * sizeof(uint32_t);
+        specializationInfo.pData = configInfo.specializationData.data();
+        const VkSpecializationInfo* pSpecializationInfo = configInfo.specializationEntries.empty() ? nullptr : &specializationInfo;
 
         VkPipelineShaderStageCreateInfo shaderStages[2];
         shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shaderStages[0].module = vertShaderModule;
+        shaderStages[0].module = vertShaderModule->getShaderModule();
         shaderStages[0].pName = "main";
         shaderStages[0].flags = 0;
         shaderStages[0].pNext = nullptr;
-        shaderStages[0].pSpecializationInfo = nullptr;
+        shaderStages[0].pSpecializationInfo = pSpecializationInfo;
         shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shaderStages[1].module = fragShaderModule;
+        shaderStages[1].module = fragShaderModule->getShaderModule();
         shaderStages[1].pName = "main";
         shaderStages[1].flags = 0;
         shaderStages[1].pNext = nullptr;
-        shaderStages[1].pSpecializationInfo = nullptr;
+        shaderStages[1].pSpecializationInfo = pSpecializationInfo;
 
         auto& bindingDescriptions = configInfo.bindingDescriptions;
         auto& attributeDescriptions = configInfo.attributeDescriptions;
@@ -124,35 +119,58 @@ namespace lm {
         pipelineInfo.basePipelineIndex = -1;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-        if (vkCreateGraphicsPipelines(device.getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+        const auto start = std::chrono::steady_clock::now();
+        const VkResult result = vkCreateGraphicsPipelines(device.getDevice(), device.getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
+        device.recordPipelineCreation(std::chrono::steady_clock::now() - start);
+
+        if (result != VK_SUCCESS) {
             LOG_FATAL("Failed to create graphics pipeline");
         }
     }
 
     /**
-     * @brief Create a shader module from the binary shader code.
+     * @brief Create the compute pipeline running the given shader.
      *
-     * @param code The binary shader code.
-     * @param shaderModule A pointer to the shader module object to be created.
-     * @throw std::runtime_error if the shader module creation fails.
+     * @param compFilePath The file path to the compute shader.
+     * @param pipelineLayout The layout of the descriptor sets and push constants used by the shader.
      */
-    void lmPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        if (vkCreateShaderModule(device.getDevice(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-            LOG_ERROR("Failed to create shader module");
+    void lmPipeline::createComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout) {
+        assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+        compShaderModule = shaderLibrary.load(compFilePath);
+        if (!compShaderModule) {
+            LOG_FATAL("Cannot create compute pipeline without its shader module");
+            return;
+        }
+
+        VkPipelineShaderStageCreateInfo shaderStage{};
+        shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        shaderStage.module = compShaderModule->getShaderModule();
+        shaderStage.pName = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStage;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineIndex = -1;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        const auto start = std::chrono::steady_clock::now();
+        const VkResult result = vkCreateComputePipelines(device.getDevice(), device.getPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
+        device.recordPipelineCreation(std::chrono::steady_clock::now() - start);
+
+        if (result != VK_SUCCESS) {
+            LOG_FATAL("Failed to create compute pipeline");
         }
     }
 
     /**
-     * @brief Bind the graphics pipeline to the specified command buffer.     
+     * @brief Bind the pipeline to the graphics or compute bind point of the specified command buffer.
      * @param commandBuffer The command buffer to bind the pipeline to.
      */
     void lmPipeline::bind(VkCommandBuffer commandBuffer) {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
     }
 
     /**
@@ -252,4 +270,26 @@ namespace lm {
         configInfo.colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
     }
 
+    /**
+     * @brief Set a specialization constant of both shader stages, replacing a previous value of the same id.
+     * @param configInfo The PipelineConfigInfo struct to be modified.
+     * @param constantId The constant_id of the constant in the shaders.
+     * @param value The 32-bit value of the constant.
+     */
+    void lmPipeline::setSpecializationConstant(PipelineConfigInfo& configInfo, uint32_t constantId, uint32_t value) {
+        for (const VkSpecializationMapEntry& entry : configInfo.specializationEntries) {
+            if (entry.constantID == constantId) {
+                configInfo.specializationData[entry.offset / sizeof(uint32_t)] = value;
+                return;
+            }
+        }
+
+        VkSpecializationMapEntry entry{};
+        entry.constantID = constantId;
+        entry.offset = static_cast<uint32_t>(configInfo.specializationData.size() * sizeof(uint32_t));
+        entry.size = sizeof(uint32_t);
+        configInfo.specializationEntries.push_back(entry);
+        configInfo.specializationData.push_back(value);
+    }
+
 }  // namespace lm
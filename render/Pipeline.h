@@ -1,7 +1,9 @@
 #pragma once
 
 #include "../render/Device.h"
+#include "../render/ShaderLibrary.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,19 +27,34 @@ namespace lm {
 		VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
 		std::vector<VkDynamicState> dynamicStateEnables;
 		VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+		// Specialization constants of both stages, see lmPipeline::setSpecializationConstant
+		std::vector<VkSpecializationMapEntry> specializationEntries{};
+		std::vector<uint32_t> specializationData{};
 		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 		VkRenderPass renderPass = VK_NULL_HANDLE;
 		uint32_t subpass = 0;
 	};
 
+	/*
+	* A graphics pipeline built from a vertex and a fragment shader, or a compute pipeline built from
+	* a compute shader. bind() binds it to the matching bind point. The shader modules come from an
+	* lmShaderLibrary and are held for the lifetime of the pipeline, so its variants reuse them.
+	*/
 	class lmPipeline {
 	public:
 		lmPipeline(
 			lmDevice& device,
+			lmShaderLibrary& shaderLibrary,
 			const std::string& vertFilePath,
 			const std::string& fragFilePath,
 			const PipelineConfigInfo& configInfo);
 
+		lmPipeline(
+			lmDevice& device,
+			lmShaderLibrary& shaderLibrary,
+			const std::string& compFilePath,
+			VkPipelineLayout pipelineLayout);
+
 		~lmPipeline();
 
 		lmPipeline(const lmPipeline&) = delete;
@@ -45,24 +62,29 @@ namespace lm {
 
 		void bind(VkCommandBuffer commandBuffer);
 
+		VkPipelineBindPoint getBindPoint() const { return bindPoint; }
+
 		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 		static void enableAlphaBlending(PipelineConfigInfo& configInfo);
+		// Sets a 32-bit specialization constant, bools are given as VkBool32
+		static void setSpecializationConstant(PipelineConfigInfo& configInfo, uint32_t constantId, uint32_t value);
 
 	private:
-		static std::vector<char> readFile(const std::string& filepath);
-
 		void createGraphicsPipeline(
 			const std::string& vertFilePath,
 			const std::string& fragFilePath,
 			const PipelineConfigInfo& configInfo);
 
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+		void createComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout);
 
 		lmDevice& device;
+		lmShaderLibrary& shaderLibrary;
 
-		VkPipeline graphicsPipeline;
-		VkShaderModule vertShaderModule;
-		VkShaderModule fragShaderModule;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		std::shared_ptr<const lmShaderModule> vertShaderModule;
+		std::shared_ptr<const lmShaderModule> fragShaderModule;
+		std::shared_ptr<const lmShaderModule> compShaderModule;
 
 	};
 
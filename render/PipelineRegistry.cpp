@@ -0,0 +1,361 @@
+/**
+ * @file PipelineRegistry.cpp
+ * @brief Deduplicated pipeline creation compiled in the background on a dedicated thread.
+ */
+
+#include "PipelineRegistry.h"
+#include "../core/Logger.h"
+
+#include <cassert>
+#include <type_traits>
+
+namespace lm {
+
+    namespace {
+
+        template <typename T>
+        void appendKey(std::string& key, const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "Pipeline keys are built from raw bytes");
+            key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void appendKey(std::string& key, const std::vector<T>& values) {
+            appendKey(key, values.size());
+            for (const T& value : values) {
+                appendKey(key, value);
+            }
+        }
+
+        void appendKey(std::string& key, const std::string& value) {
+            appendKey(key, value.size());
+            key.append(value);
+        }
+
+        // Every state read by lmPipeline::createGraphicsPipeline, pointers excluded
+        void appendConfigKey(std::string& key, const PipelineConfigInfo& configInfo) {
+            appendKey(key, configInfo.bindingDescriptions);
+            appendKey(key, configInfo.attributeDescriptions);
+
+            appendKey(key, configInfo.viewportInfo.viewportCount);
+            appendKey(key, configInfo.viewportInfo.scissorCount);
+
+            appendKey(key, configInfo.inputAssemblyInfo.topology);
+            appendKey(key, configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+            const VkPipelineRasterizationStateCreateInfo& rasterization = configInfo.rasterizationInfo;
+            appendKey(key, rasterization.depthClampEnable);
+            appendKey(key, rasterization.rasterizerDiscardEnable);
+            appendKey(key, rasterization.polygonMode);
+            appendKey(key, rasterization.cullMode);
+            appendKey(key, rasterization.frontFace);
+            appendKey(key, rasterization.depthBiasEnable);
+            appendKey(key, rasterization.depthBiasConstantFactor);
+            appendKey(key, rasterization.depthBiasClamp);
+            appendKey(key, rasterization.depthBiasSlopeFactor);
+            appendKey(key, rasterization.lineWidth);
+
+            const VkPipelineMultisampleStateCreateInfo& multisample = configInfo.multisampleInfo;
+            appendKey(key, multisample.rasterizationSamples);
+            appendKey(key, multisample.sampleShadingEnable);
+            appendKey(key, multisample.minSampleShading);
+            appendKey(key, multisample.alphaToCoverageEnable);
+            appendKey(key, multisample.alphaToOneEnable);
+
+            appendKey(key, configInfo.colorBlendAttachment);
+            appendKey(key, configInfo.colorBlendInfo.logicOpEnable);
+            appendKey(key, configInfo.colorBlendInfo.logicOp);
+            appendKey(key, configInfo.colorBlendInfo.attachmentCount);
+            appendKey(key, configInfo.colorBlendInfo.blendConstants);
+
+            const VkPipelineDepthStencilStateCreateInfo& depthStencil = configInfo.depthStencilInfo;
+            appendKey(key, depthStencil.depthTestEnable);
+            appendKey(key, depthStencil.depthWriteEnable);
+            appendKey(key, depthStencil.depthCompareOp);
+            appendKey(key, depthStencil.depthBoundsTestEnable);
+            appendKey(key, depthStencil.stencilTestEnable);
+            appendKey(key, depthStencil.front);
+            appendKey(key, depthStencil.back);
+            appendKey(key, depthStencil.minDepthBounds);
+            appendKey(key, depthStencil.maxDepthBounds);
+
+            appendKey(key, configInfo.dynamicStateEnables);
+            appendKey(key, configInfo.specializationEntries);
+            appendKey(key, configInfo.specializationData);
+
+            appendKey(key, configInfo.pipelineLayout);
+            appendKey(key, configInfo.renderPass);
+            appendKey(key, configInfo.subpass);
+        }
+
+        // PipelineConfigInfo points into itself, so the copy repoints the blend attachment and dynamic states
+        void copyConfigInfo(const PipelineConfigInfo& source, PipelineConfigInfo& destination) {
+            destination.bindingDescriptions = source.bindingDescriptions;
+            destination.attributeDescriptions = source.attributeDescriptions;
+            destination.viewportInfo = source.viewportInfo;
+            destination.inputAssemblyInfo = source.inputAssemblyInfo;
+            destination.rasterizationInfo = source.rasterizationInfo;
+            destination.multisampleInfo = source.multisampleInfo;
+            destination.colorBlendAttachment = source.colorBlendAttachment;
+            destination.colorBlendInfo = source.colorBlendInfo;
+            destination.colorBlendInfo.pAttachments = &destination.colorBlendAttachment;
+            destination.depthStencilInfo = source.depthStencilInfo;
+            destination.dynamicStateEnables = source.dynamicStateEnables;
+            destination.dynamicStateInfo = source.dynamicStateInfo;
+            destination.dynamicStateInfo.pDynamicStates = destination.dynamicStateEnables.data();
+            destination.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(destination.dynamicStateEnables.size());
+            destination.specializationEntries = source.specializationEntries;
+            destination.specializationData = source.specializationData;
+            destination.pipelineLayout = source.pipelineLayout;
+            destination.renderPass = source.renderPass;
+            destination.subpass = source.subpass;
+        }
+
+    } // namespace
+
+    /**
+     * @brief Checks whether the requested pipeline has been compiled, ignoring the fallback.
+     * @return True if get() returns the requested pipeline.
+     */
+    bool lmPipelineHandle::isReady() const {
+        return entry && entry->ready.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Retrieves the pipeline without blocking.
+     * @return The requested pipeline if compiled, else the compiled fallback, else nullptr.
+     */
+    lmPipeline* lmPipelineHandle::get() const {
+        if (isReady()) {
+            return entry->pipeline.get();
+        }
+        if (fallback && fallback->ready.load(std::memory_order_acquire)) {
+            return fallback->pipeline.get();
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Blocks until the requested pipeline is compiled by the compile thread.
+     * @return The requested pipeline.
+     */
+    lmPipeline& lmPipelineHandle::wait() const {
+        assert(isValid() && "Cannot wait on an empty pipeline handle");
+
+        entry->ready.wait(false, std::memory_order_acquire);
+        return *entry->pipeline;
+    }
+
+    /**
+     * @brief Creates an empty registry and starts its compile thread.
+     * @param device The device the pipelines are created on.
+     * @param shaderLibrary The library providing the shader modules.
+     */
+    lmPipelineRegistry::lmPipelineRegistry(lmDevice& device, lmShaderLibrary& shaderLibrary)
+        : device{ device }, shaderLibrary{ shaderLibrary } {
+        compileThread = std::thread(&lmPipelineRegistry::compileLoop, this);
+    }
+
+    /**
+     * @brief Finishes the queued compilations and destroys the pipeline layouts, the pipelines live on with their last handle.
+     */
+    lmPipelineRegistry::~lmPipelineRegistry() {
+        {
+            std::lock_guard<std::mutex> lock(compileMutex);
+            stopping = true;
+        }
+        compileCondition.notify_one();
+        compileThread.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [key, pipelineLayout] : pipelineLayouts) {
+            vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
+        }
+
+        LOG_INFO("Pipeline registry destroyed ({} pipelines, {} pipeline layouts, {} duplicate requests shared)",
+            entries.size(), pipelineLayouts.size(), deduplicatedCount.load());
+    }
+
+    /**
+     * @brief Requests a graphics pipeline, compiled on the compile thread unless an identical one exists.
+     *
+     * @param vertFilePath The file path to the vertex shader.
+     * @param fragFilePath The file path to the fragment shader.
+     * @param configInfo The configuration of the pipeline, copied for the compilation.
+     * @param fallback Returned by get() on the new handle until the pipeline is compiled.
+     * @return A handle sharing the pipeline with every identical request.
+     */
+    lmPipelineHandle lmPipelineRegistry::requestGraphicsPipeline(
+        const std::string& vertFilePath,
+        const std::string& fragFilePath,
+        const PipelineConfigInfo& configInfo,
+        const lmPipelineHandle& fallback) {
+
+        assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot request graphics pipeline: no pipelineLayout provided in configInfo");
+        assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot request graphics pipeline: no renderPass provided in configInfo");
+
+        std::string key = "graphics";
+        appendKey(key, vertFilePath);
+        appendKey(key, fragFilePath);
+        appendConfigKey(key, configInfo);
+
+        bool inserted = false;
+        auto entry = findOrInsert(key, inserted);
+        if (inserted) {
+            auto config = std::make_shared<PipelineConfigInfo>();
+            copyConfigInfo(configInfo, *config);
+
+            submitCompilation([this, entry, config, vertFilePath, fragFilePath]() {
+                entry->pipeline = std::make_unique<lmPipeline>(device, shaderLibrary, vertFilePath, fragFilePath, *config);
+                finishCompilation(*entry);
+            });
+        }
+
+        return lmPipelineHandle{ std::move(entry), fallback.entry };
+    }
+
+    /**
+     * @brief Requests a compute pipeline, compiled on the compile thread unless an identical one exists.
+     *
+     * @param compFilePath The file path to the compute shader.
+     * @param pipelineLayout The layout of the descriptor sets and push constants used by the shader.
+     * @return A handle sharing the pipeline with every identical request.
+     */
+    lmPipelineHandle lmPipelineRegistry::requestComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout) {
+        assert(pipelineLayout != VK_NULL_HANDLE && "Cannot request compute pipeline: no pipelineLayout provided");
+
+        std::string key = "compute";
+        appendKey(key, compFilePath);
+        appendKey(key, pipelineLayout);
+
+        bool inserted = false;
+        auto entry = findOrInsert(key, inserted);
+        if (inserted) {
+            submitCompilation([this, entry, compFilePath, pipelineLayout]() {
+                entry->pipeline = std::make_unique<lmPipeline>(device, shaderLibrary, compFilePath, pipelineLayout);
+                finishCompilation(*entry);
+            });
+        }
+
+        return lmPipelineHandle{ std::move(entry), nullptr };
+    }
+
+    /**
+     * @brief Reflects the shaders of a pipeline, keeping their modules loaded for its compilation.
+     * @param shaderFilePaths The SPIR-V files of the stages.
+     * @return The merged interface of the stages, without the files that failed to load.
+     */
+    lmPipelineInterface lmPipelineRegistry::reflectShaders(std::initializer_list<std::string> shaderFilePaths) {
+        std::vector<std::shared_ptr<const lmShaderModule>> modules;
+        std::vector<const lmShaderReflection*> stages;
+        for (const std::string& path : shaderFilePaths) {
+            if (auto module = shaderLibrary.load(path)) {
+                stages.push_back(&module->getReflection());
+                modules.push_back(std::move(module));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        reflectedModules.insert(reflectedModules.end(), modules.begin(), modules.end());
+        return lmPipelineInterface{ stages };
+    }
+
+    /**
+     * @brief Retrieves the pipeline layout of the given sets and push constants, creating it on the first request.
+     *
+     * @param setLayouts The descriptor set layouts, indexed by set number.
+     * @param pushConstantRanges The push constant ranges, usually the ones of an lmPipelineInterface.
+     * @return The layout shared by every identical request, destroyed with the registry.
+     */
+    VkPipelineLayout lmPipelineRegistry::getPipelineLayout(
+        const std::vector<VkDescriptorSetLayout>& setLayouts,
+        const std::vector<VkPushConstantRange>& pushConstantRanges) {
+
+        std::string key;
+        appendKey(key, setLayouts);
+        appendKey(key, pushConstantRanges);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, isNew] = pipelineLayouts.try_emplace(key, VK_NULL_HANDLE);
+        if (!isNew) {
+            return it->second;
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+        pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+        if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &it->second) != VK_SUCCESS) {
+            LOG_FATAL("Failed to create pipeline layout");
+        }
+
+        return it->second;
+    }
+
+    /**
+     * @brief Retrieves the number of distinct pipelines requested so far.
+     * @return The number of pipelines, compiled or not.
+     */
+    size_t lmPipelineRegistry::getPipelineCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    std::shared_ptr<lmPipelineHandle::Entry> lmPipelineRegistry::findOrInsert(const std::string& key, bool& inserted) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto [it, isNew] = entries.try_emplace(key);
+        if (isNew) {
+            it->second = std::make_shared<lmPipelineHandle::Entry>();
+            pendingCount++;
+        }
+        else {
+            deduplicatedCount++;
+        }
+
+        inserted = isNew;
+        return it->second;
+    }
+
+    void lmPipelineRegistry::finishCompilation(lmPipelineHandle::Entry& entry) {
+        if (--pendingCount == 0) {
+            device.logPipelineCacheStats();
+        }
+        entry.ready.store(true, std::memory_order_release);
+        entry.ready.notify_all();
+    }
+
+    void lmPipelineRegistry::submitCompilation(std::function<void()> compilation) {
+        {
+            std::lock_guard<std::mutex> lock(compileMutex);
+            compileQueue.push_back(std::move(compilation));
+        }
+        compileCondition.notify_one();
+    }
+
+    /**
+     * @brief Main loop of the compile thread, runs the queued compilations in request order until the registry is destroyed.
+     */
+    void lmPipelineRegistry::compileLoop() {
+        while (true) {
+            std::function<void()> compilation;
+            {
+                std::unique_lock<std::mutex> lock(compileMutex);
+                compileCondition.wait(lock, [this]() { return stopping || !compileQueue.empty(); });
+
+                if (stopping && compileQueue.empty()) {
+                    return;
+                }
+
+                compilation = std::move(compileQueue.front());
+                compileQueue.pop_front();
+            }
+
+            compilation();
+        }
+    }
+
+} // namespace lm
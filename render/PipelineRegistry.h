@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Device.h"
+#include "Pipeline.h"
+#include "ShaderLibrary.h"
+#include "ShaderReflection.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lm {
+
+    class lmPipelineRegistry;
+
+    /*
+    * A shared reference to a pipeline of an lmPipelineRegistry, which may still be compiling.
+    *
+    * get() never blocks: it returns the pipeline once compiled, otherwise the fallback pipeline given
+    * with the request if that one is compiled, otherwise nullptr. wait() blocks until the pipeline is
+    * compiled, it is meant for loading and shutdown, never for the frame path.
+    */
+    class lmPipelineHandle {
+    public:
+        lmPipelineHandle() = default;
+
+        bool isValid() const { return entry != nullptr; }
+        bool isReady() const;
+
+        lmPipeline* get() const;
+        lmPipeline& wait() const;
+
+    private:
+        friend class lmPipelineRegistry;
+
+        struct Entry {
+            std::unique_ptr<lmPipeline> pipeline;
+            std::atomic<bool> ready{ false };
+        };
+
+        lmPipelineHandle(std::shared_ptr<Entry> entry, std::shared_ptr<Entry> fallback)
+            : entry{ std::move(entry) }, fallback{ std::move(fallback) } {}
+
+        std::shared_ptr<Entry> entry;
+        std::shared_ptr<Entry> fallback;
+    };
+
+    /*
+    * Creates every pipeline once and compiles it on a dedicated background thread.
+    *
+    * Requests are keyed by the shader files, the pipeline layout, the render pass and subpass, and all
+    * the fixed function state and specialization constants of the PipelineConfigInfo, so identical
+    * requests share one pipeline and one compilation. The request returns immediately, the configuration being copied for the
+    * compilation; the pipeline layout and render pass must stay valid until the handle is ready.
+    * The compile thread has its own queue, so threads waiting on frame work (lmThreadPool::parallelFor,
+    * lmScheduler::run) never pick up a compilation that would stall the frame. Whenever the last
+    * pending compilation finishes, the device logs the pipeline creation time. The registry finishes
+    * the queued compilations when destroyed.
+    *
+    * reflectShaders() merges the reflection of the shaders of a pipeline, from which the systems build
+    * their set layouts and check their C++ structs; the reflected modules stay loaded with the registry
+    * so the compilations reuse them. getPipelineLayout() shares one layout between every request with
+    * the same set layouts and push constant ranges, and the registry destroys them.
+    */
+    class lmPipelineRegistry {
+    public:
+        lmPipelineRegistry(lmDevice& device, lmShaderLibrary& shaderLibrary);
+        ~lmPipelineRegistry();
+
+        lmPipelineRegistry(const lmPipelineRegistry&) = delete;
+        lmPipelineRegistry& operator=(const lmPipelineRegistry&) = delete;
+
+        // The fallback is returned by get() on the new handle until the requested pipeline is compiled
+        lmPipelineHandle requestGraphicsPipeline(
+            const std::string& vertFilePath,
+            const std::string& fragFilePath,
+            const PipelineConfigInfo& configInfo,
+            const lmPipelineHandle& fallback = {});
+
+        lmPipelineHandle requestComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout);
+
+        lmPipelineInterface reflectShaders(std::initializer_list<std::string> shaderFilePaths);
+        VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+        size_t getPipelineCount() const;
+        size_t getDeduplicatedCount() const { return deduplicatedCount; }
+
+    private:
+        // Returns the entry of the key, inserting an empty one and setting inserted if there was none
+        std::shared_ptr<lmPipelineHandle::Entry> findOrInsert(const std::string& key, bool& inserted);
+        // Publishes a compiled pipeline, the last pending one logs the pipeline creation time
+        void finishCompilation(lmPipelineHandle::Entry& entry);
+        void submitCompilation(std::function<void()> compilation);
+        void compileLoop();
+
+        lmDevice& device;
+        lmShaderLibrary& shaderLibrary;
+
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<lmPipelineHandle::Entry>> entries;
+        std::unordered_map<std::string, VkPipelineLayout> pipelineLayouts;
+        std::vector<std::shared_ptr<const lmShaderModule>> reflectedModules;
+        std::atomic<size_t> deduplicatedCount{ 0 };
+        std::atomic<size_t> pendingCount{ 0 };
+
+        std::mutex compileMutex;
+        std::condition_variable compileCondition;
+        std::deque<std::function<void()>> compileQueue;
+        bool stopping = false;
+        std::thread compileThread;
+    };
+
+} // namespace lm
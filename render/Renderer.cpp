@@ -1,5 +1,6 @@
 #include "../render/Renderer.h"
 #include "../core/Logger.h"
+#include "../core/ThreadPool.h"
 
 #include <memory>
 #include <array>
@@ -7,17 +8,24 @@
 namespace lm {
 
 	// Constructor: Initializes the lmRenderer object with lmWindow and lmDevice references
-	lmRenderer::lmRenderer(lm::lmWindow& window, lm::lmDevice& device) : window{ window }, device{ device } {
+	lmRenderer::lmRenderer(lm::lmWindow& window, lm::lmDevice& device, bool keepDepth, uint32_t recordingThreadCount)
+		: window{ window }, device{ device }, recordingThreadCount{ recordingThreadCount }, keepDepth{ keepDepth } {
+		assert(recordingThreadCount > 0 && "At least the main thread records command buffers");
+
 		// Recreate the swap chain and create command buffers
 		recreateSwapChain();
 		createCommandBuffers();
+		createRecordingPools();
 
 		// Log initialization information
 		LOG_INFO("Application initialized");
 	}
 
 	// Destructor: Frees the command buffers used by the renderer
-	lmRenderer::~lmRenderer() { freeCommandBuffers(); }
+	lmRenderer::~lmRenderer() {
+		freeCommandBuffers();
+		destroyRecordingPools();
+	}
 
 	// Recreates the swap chain when the window is resized or first initialized
 	void lmRenderer::recreateSwapChain() {
@@ -37,11 +45,11 @@ namespace lm {
 
 		// Create or recreate the swap chain based on its current state
 		if (lmSwapChain == nullptr) {
-			lmSwapChain = std::make_unique<lm::lmSwapChain>(device, extent);
+			lmSwapChain = std::make_unique<lm::lmSwapChain>(device, extent, keepDepth);
 		}
 		else {
 			std::shared_ptr<lm::lmSwapChain> oldSwapChain = std::move(lmSwapChain);
-			lmSwapChain = std::make_unique<lm::lmSwapChain>(device, extent, oldSwapChain);
+			lmSwapChain = std::make_unique<lm::lmSwapChain>(device, extent, oldSwapChain, keepDepth);
 
 			// Compare the swap chain formats to ensure compatibility
 			if (!oldSwapChain->compareSwapFormats(*lmSwapChain.get())) {
@@ -85,6 +93,32 @@ namespace lm {
 		}
 	}
 
+	// Creates a transient command pool per frame in flight and recording thread, for the secondary command buffers
+	void lmRenderer::createRecordingPools() {
+		recordingPools.resize(static_cast<size_t>(lmSwapChain::MAX_FRAMES_IN_FLIGHT) * recordingThreadCount);
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = device.getGraphicsQueueFamily();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		for (RecordingPool& recordingPool : recordingPools) {
+			if (vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &recordingPool.commandPool) != VK_SUCCESS) {
+				LOG_FATAL("Failed to create recording command pool");
+			}
+		}
+
+		LOG_INFO("Recording command pools created for {} threads", recordingThreadCount);
+	}
+
+	// Destroys the recording pools, which frees their secondary command buffers
+	void lmRenderer::destroyRecordingPools() {
+		for (RecordingPool& recordingPool : recordingPools) {
+			vkDestroyCommandPool(device.getDevice(), recordingPool.commandPool, nullptr);
+		}
+		recordingPools.clear();
+	}
+
 	// Begins the rendering process for a new frame and returns the associated Vulkan command buffer
 	VkCommandBuffer lmRenderer::beginFrame() {
 		assert(!isFrameStarted && "Cannot call beginFrame while already in progress");
@@ -104,6 +138,15 @@ namespace lm {
 
 		isFrameStarted = true;
 
+		// The frame's previous submission has completed, so its secondary command buffers can be recycled
+		for (uint32_t thread = 0; thread < recordingThreadCount; thread++) {
+			RecordingPool& recordingPool = recordingPools[currentFrameIndex * recordingThreadCount + thread];
+			if (recordingPool.usedCount > 0) {
+				vkResetCommandPool(device.getDevice(), recordingPool.commandPool, 0);
+				recordingPool.usedCount = 0;
+			}
+		}
+
 		// Get the Vulkan command buffer associated with the new frame
 		auto commandBuffer = getCurrentCommandBuffer();
 
@@ -147,7 +190,7 @@ namespace lm {
 	}
 
 	// Begins a new render pass for the current frame and sets up rendering parameters like viewport and scissor
-	void lmRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+	void lmRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
 		assert(isFrameStarted && "Cannot call beginSwapChainRenderPass if frame is not in progress");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Cannot begin render pass on a command buffer from a different frame");
 
@@ -165,9 +208,91 @@ namespace lm {
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		// Begin the render pass in the specified command buffer
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Begin the render pass in the specified command buffer, secondary command buffers set their own viewport and scissor
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+		activeRenderPass = renderPassInfo.renderPass;
+		if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+			setViewportAndScissor(commandBuffer);
+		}
+	}
+
+	// Begins the resume render pass, continuing the frame on its color and depth after the kept depth was read
+	void lmRenderer::resumeSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+		assert(isFrameStarted && "Cannot call resumeSwapChainRenderPass if frame is not in progress");
+		assert(keepDepth && "Cannot resume the render pass when the depth is not kept");
+		assert(commandBuffer == getCurrentCommandBuffer() && "Cannot resume render pass on a command buffer from a different frame");
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = lmSwapChain->getResumeRenderPass();
+		renderPassInfo.framebuffer = lmSwapChain->getFrameBuffer(currentImageIndex);
+
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = lmSwapChain->getSwapChainExtent();
+
+		// Both attachments are loaded, so no clear values are needed
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+		activeRenderPass = renderPassInfo.renderPass;
+		if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+			setViewportAndScissor(commandBuffer);
+		}
+	}
+
+	// Begins a secondary command buffer of the calling thread inheriting the active render pass
+	VkCommandBuffer lmRenderer::beginSecondaryCommandBuffer() {
+		assert(isFrameStarted && "Cannot begin a secondary command buffer if frame is not in progress");
+		assert(activeRenderPass != VK_NULL_HANDLE && "Cannot begin a secondary command buffer outside of a render pass");
+
+		const uint32_t threadIndex = lmThreadPool::getCurrentThreadIndex();
+		assert(threadIndex < recordingThreadCount && "Thread has no recording command pool");
+
+		// Only the calling thread touches its pool, so no lock is needed
+		RecordingPool& recordingPool = recordingPools[currentFrameIndex * recordingThreadCount + threadIndex];
+		if (recordingPool.usedCount == recordingPool.secondaryBuffers.size()) {
+			VkCommandBufferAllocateInfo allocateInfo{};
+			allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocateInfo.commandPool = recordingPool.commandPool;
+			allocateInfo.commandBufferCount = 1;
+
+			VkCommandBuffer secondaryBuffer;
+			if (vkAllocateCommandBuffers(device.getDevice(), &allocateInfo, &secondaryBuffer) != VK_SUCCESS) {
+				LOG_FATAL("Failed to allocate secondary command buffer");
+			}
+			recordingPool.secondaryBuffers.push_back(secondaryBuffer);
+		}
+
+		VkCommandBuffer commandBuffer = recordingPool.secondaryBuffers[recordingPool.usedCount++];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = activeRenderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = lmSwapChain->getFrameBuffer(currentImageIndex);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			LOG_ERROR("Failed to begin recording secondary command buffer");
+		}
+
+		// Dynamic state is not inherited from the primary command buffer
+		setViewportAndScissor(commandBuffer);
+		return commandBuffer;
+	}
+
+	// Ends a secondary command buffer begun by beginSecondaryCommandBuffer
+	void lmRenderer::endSecondaryCommandBuffer(VkCommandBuffer commandBuffer) {
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			LOG_ERROR("Failed to record secondary command buffer");
+		}
+	}
 
+	// Sets the viewport and scissor covering the whole swap chain extent
+	void lmRenderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
@@ -189,6 +314,7 @@ namespace lm {
 
 		// End the current render pass in the specified command buffer
 		vkCmdEndRenderPass(commandBuffer);
+		activeRenderPass = VK_NULL_HANDLE;
 	}
 
 } // namespace lm
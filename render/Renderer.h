@@ -12,7 +12,9 @@ namespace lm {
 
 	class lmRenderer {
 	public:
-		lmRenderer(lmWindow& window, lmDevice& device);
+		// keepDepth keeps the depth of the swap chain render pass for shaders, see lmSwapChain
+		// recordingThreadCount is the number of lmThreadPool threads that may record secondary command buffers
+		lmRenderer(lmWindow& window, lmDevice& device, bool keepDepth = false, uint32_t recordingThreadCount = 1);
 		~lmRenderer();
 
 		lmRenderer(const lmRenderer&) = delete;
@@ -22,6 +24,17 @@ namespace lm {
 
 		float getAspectRatio() const { return lmSwapChain->extentAspectRatio(); }
 
+		VkExtent2D getSwapChainExtent() const { return lmSwapChain->getSwapChainExtent(); }
+
+		bool isDepthKept() const { return keepDepth; }
+
+		// Depth of the frame in progress, readable between endSwapChainRenderPass and resumeSwapChainRenderPass
+		VkImageView getCurrentDepthImageView() const {
+			assert(isFrameStarted && "Cannot get depth image view when frame not in progress");
+			assert(keepDepth && "Cannot get depth image view when the depth is not kept");
+			return lmSwapChain->getDepthImageView(static_cast<int>(currentImageIndex));
+		}
+
 		bool isFrameInProgress() const { return isFrameStarted; }
 
 		VkCommandBuffer getCurrentCommandBuffer() const {
@@ -36,22 +49,47 @@ namespace lm {
 
 		VkCommandBuffer beginFrame();
 		void endFrame();
-		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		// With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the render pass may only execute secondary command buffers
+		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+		void resumeSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+		// Thread safe across lmThreadPool threads: begins a secondary command buffer from the calling thread's
+		// pool of the current frame, continuing the active render pass with the viewport and scissor set.
+		// It is valid until the frame index comes back around and must be executed in the active render pass
+		VkCommandBuffer beginSecondaryCommandBuffer();
+		void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+
 	private:
 		void createCommandBuffers();
 		void freeCommandBuffers();
+		void createRecordingPools();
+		void destroyRecordingPools();
 		void recreateSwapChain();
+		void setViewportAndScissor(VkCommandBuffer commandBuffer);
 
 		lmWindow& window;
 		lmDevice& device;
 		std::unique_ptr<lmSwapChain> lmSwapChain;
 		std::vector<VkCommandBuffer> commandBuffers;
 
+		// Command pool of one recording thread for one frame in flight, reset when the frame begins again.
+		// Aligned so that threads recording concurrently never share a cache line
+		struct alignas(64) RecordingPool {
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> secondaryBuffers;
+			size_t usedCount = 0;
+		};
+
+		// Indexed by frameIndex * recordingThreadCount + threadIndex
+		std::vector<RecordingPool> recordingPools;
+		uint32_t recordingThreadCount;
+		VkRenderPass activeRenderPass = VK_NULL_HANDLE;
+
 		uint32_t currentImageIndex;
 		int currentFrameIndex{ 0 };
 		bool isFrameStarted = false;
+		bool keepDepth;
 	};
 
 } //namespace lm
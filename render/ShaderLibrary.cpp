@@ -0,0 +1,129 @@
+/**
+ * @file ShaderLibrary.cpp
+ * @brief Shader modules created once from memory-mapped SPIR-V files and shared by reference.
+ */
+
+#include "ShaderLibrary.h"
+#include "../core/Logger.h"
+#include "../core/MappedFile.h"
+
+#include <cstring>
+#include <utility>
+
+namespace lm {
+
+    namespace {
+
+        constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+    } // namespace
+
+    /**
+     * @brief Creates the shader module from SPIR-V code and reflects its interface.
+     *
+     * @param device The Vulkan device.
+     * @param path The file the code was read from, kept for diagnostics.
+     * @param code The SPIR-V words, only read during the call.
+     * @param codeSize The size of the code in bytes, a multiple of 4.
+     */
+    lmShaderModule::lmShaderModule(lmDevice& device, std::string path, const uint32_t* code, size_t codeSize)
+        : device{ device }, path{ std::move(path) } {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = codeSize;
+        createInfo.pCode = code;
+
+        if (vkCreateShaderModule(device.getDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            LOG_ERROR("Failed to create shader module: {}", this->path);
+        }
+
+        std::string error;
+        if (!lmShaderReflection::parse(code, codeSize / sizeof(uint32_t), reflection, error)) {
+            LOG_WARN("Failed to reflect shader module {}: {}", this->path, error);
+        }
+    }
+
+    lmShaderModule::~lmShaderModule() {
+        vkDestroyShaderModule(device.getDevice(), shaderModule, nullptr);
+    }
+
+    /**
+     * @brief Creates an empty library.
+     * @param device The device the shader modules are created on.
+     */
+    lmShaderLibrary::lmShaderLibrary(lmDevice& device) : device{ device } {}
+
+    lmShaderLibrary::~lmShaderLibrary() {
+        LOG_INFO("Shader library destroyed ({} modules created, {} loads shared an existing module)", createdCount.load(), sharedCount.load());
+    }
+
+    /**
+     * @brief Retrieves the shader module of a SPIR-V file, creating it if no pipeline holds it.
+     * @param path The SPIR-V file.
+     * @return The shared module, or nullptr if the file cannot be mapped or is not SPIR-V.
+     */
+    std::shared_ptr<const lmShaderModule> lmShaderLibrary::load(const std::string& path) {
+        std::promise<ModulePtr> promise;
+        std::shared_future<ModulePtr> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            CacheEntry& cached = modules[path];
+            if (auto module = cached.module.lock()) {
+                sharedCount++;
+                return module;
+            }
+
+            if (cached.pending.valid()) {
+                pending = cached.pending;
+            }
+            else {
+                cached.pending = promise.get_future().share();
+            }
+        }
+
+        // Another thread is creating the module, wait for it without holding the lock
+        if (pending.valid()) {
+            ModulePtr module = pending.get();
+            if (module) {
+                sharedCount++;
+            }
+            return module;
+        }
+
+        // Mapping the file, creating the module and reflecting it happen outside of the lock
+        ModulePtr module = createModule(path);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            CacheEntry& cached = modules[path];
+            cached.module = module;
+            cached.pending = {};
+        }
+
+        promise.set_value(module);
+        return module;
+    }
+
+    lmShaderLibrary::ModulePtr lmShaderLibrary::createModule(const std::string& path) {
+        lmMappedFile file;
+        if (!file.open(path)) {
+            LOG_ERROR("Failed to open file: {}", path);
+            return nullptr;
+        }
+
+        // Mappings are page aligned, so the words can be handed to the driver in place
+        uint32_t magic = 0;
+        if (file.size() >= sizeof(magic)) {
+            std::memcpy(&magic, file.data(), sizeof(magic));
+        }
+        if (magic != SPIRV_MAGIC || file.size() % sizeof(uint32_t) != 0) {
+            LOG_ERROR("Not a SPIR-V file: {}", path);
+            return nullptr;
+        }
+
+        createdCount++;
+        return std::make_shared<const lmShaderModule>(
+            device, path, reinterpret_cast<const uint32_t*>(file.data()), file.size());
+    }
+
+} // namespace lm
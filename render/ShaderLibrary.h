@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Device.h"
+#include "ShaderReflection.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace lm {
+
+    // A VkShaderModule shared by every pipeline built from the same SPIR-V file, with the reflection of its interface
+    class lmShaderModule {
+    public:
+        lmShaderModule(lmDevice& device, std::string path, const uint32_t* code, size_t codeSize);
+        ~lmShaderModule();
+
+        lmShaderModule(const lmShaderModule&) = delete;
+        lmShaderModule& operator=(const lmShaderModule&) = delete;
+
+        VkShaderModule getShaderModule() const { return shaderModule; }
+        const std::string& getPath() const { return path; }
+        const lmShaderReflection& getReflection() const { return reflection; }
+
+    private:
+        lmDevice& device;
+        std::string path;
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        lmShaderReflection reflection;
+    };
+
+    /*
+    * Creates each shader module once, straight from a memory mapping of its SPIR-V file.
+    *
+    * load() returns the module of a file as long as some pipeline still holds it, so pipeline variants
+    * built from the same shaders cost no file I/O and no module creation. The library only keeps weak
+    * references: a module is destroyed with its last user and reloaded on the next request.
+    * load() may be called from any thread. The lock only guards the cache: a module is created outside
+    * of it, and concurrent loads of the same file wait on the future of the first one.
+    */
+    class lmShaderLibrary {
+    public:
+        explicit lmShaderLibrary(lmDevice& device);
+        ~lmShaderLibrary();
+
+        lmShaderLibrary(const lmShaderLibrary&) = delete;
+        lmShaderLibrary& operator=(const lmShaderLibrary&) = delete;
+
+        // nullptr if the file cannot be mapped or is not SPIR-V
+        std::shared_ptr<const lmShaderModule> load(const std::string& path);
+
+    private:
+        using ModulePtr = std::shared_ptr<const lmShaderModule>;
+
+        // The live module of a file, or the future of the load creating it
+        struct CacheEntry {
+            std::weak_ptr<const lmShaderModule> module;
+            std::shared_future<ModulePtr> pending;
+        };
+
+        ModulePtr createModule(const std::string& path);
+
+        lmDevice& device;
+
+        std::mutex mutex;
+        std::unordered_map<std::string, CacheEntry> modules;
+        std::atomic<size_t> createdCount{ 0 };
+        std::atomic<size_t> sharedCount{ 0 };
+    };
+
+} // namespace lm
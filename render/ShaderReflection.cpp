@@ -0,0 +1,785 @@
+/**
+ * @file ShaderReflection.cpp
+ * @brief Minimal SPIR-V reflection of descriptor bindings, push constants and vertex inputs.
+ */
+
+#include "ShaderReflection.h"
+#include "../core/Logger.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace lm {
+
+    namespace {
+
+        constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+        constexpr uint32_t SPIRV_HEADER_WORDS = 5;
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+        // The few opcodes, decorations, storage classes and execution models the reflection reads
+        enum Op : uint32_t {
+            OpName = 5,
+            OpEntryPoint = 15,
+            OpTypeBool = 20,
+            OpTypeInt = 21,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeMatrix = 24,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpTypeForwardPointer = 39,
+            OpConstant = 43,
+            OpSpecConstant = 50,
+            OpFunction = 54,
+            OpVariable = 59,
+            OpAccessChain = 65,
+            OpInBoundsAccessChain = 66,
+            OpDecorate = 71,
+            OpMemberDecorate = 72
+        };
+
+        enum Decoration : uint32_t {
+            DecorationBlock = 2,
+            DecorationBufferBlock = 3,
+            DecorationRowMajor = 4,
+            DecorationArrayStride = 6,
+            DecorationMatrixStride = 7,
+            DecorationBuiltIn = 11,
+            DecorationLocation = 30,
+            DecorationBinding = 33,
+            DecorationDescriptorSet = 34,
+            DecorationOffset = 35
+        };
+
+        enum StorageClass : uint32_t {
+            StorageUniformConstant = 0,
+            StorageInput = 1,
+            StorageUniform = 2,
+            StoragePushConstant = 9,
+            StorageStorageBuffer = 12
+        };
+
+        constexpr uint32_t DIM_BUFFER = 5;
+
+        struct Member {
+            uint32_t offset = 0;
+            uint32_t matrixStride = 0;
+            bool rowMajor = false;
+        };
+
+        struct Id {
+            uint32_t opcode = 0;
+            std::vector<uint32_t> operands;     // Words following the result id, for constants every word but the opcode
+            std::string name;
+            uint32_t set = NONE;
+            uint32_t binding = NONE;
+            uint32_t location = NONE;
+            uint32_t arrayStride = 0;
+            bool block = false;
+            bool bufferBlock = false;
+            bool builtIn = false;
+            bool referenced = false;
+            std::vector<Member> members;
+        };
+
+        // A member decoration, applied once the whole module is parsed since it may precede its struct
+        struct MemberDecoration {
+            uint32_t target;
+            uint32_t member;
+            uint32_t decoration;
+            uint32_t literal;
+        };
+
+        bool isType(const std::vector<Id>& ids, uint32_t id) {
+            return id < ids.size() && ids[id].opcode >= OpTypeBool && ids[id].opcode <= OpTypePointer;
+        }
+
+        // Checks that a type has the operands the Parser reads and only names types declared before it,
+        // which SPIR-V requires and which keeps the Parser's recursion free of cycles. Struct members may
+        // also be forward declared pointers, which the Parser never follows
+        bool checkTypeOperands(
+            const std::vector<Id>& ids,
+            const std::vector<bool>& forwardPointers,
+            uint32_t opcode,
+            const uint32_t* operands,
+            size_t operandCount) {
+            auto isMemberType = [&](uint32_t member) {
+                return isType(ids, member) || (member < forwardPointers.size() && forwardPointers[member]);
+            };
+
+            switch (opcode) {
+            case OpTypeInt:
+                return operandCount >= 2;
+            case OpTypeFloat:
+                return operandCount >= 1;
+            case OpTypeVector:
+                return operandCount >= 2 && isType(ids, operands[0]) && operands[1] >= 1 && operands[1] <= 4;
+            case OpTypeMatrix:
+                return operandCount >= 2 && isType(ids, operands[0]) && ids[operands[0]].opcode == OpTypeVector;
+            case OpTypeImage:
+                return operandCount >= 7 && isType(ids, operands[0]);
+            case OpTypeSampledImage:
+            case OpTypeRuntimeArray:
+                return operandCount >= 1 && isType(ids, operands[0]);
+            case OpTypeArray:
+                return operandCount >= 2 && isType(ids, operands[0]) && operands[1] < ids.size();
+            case OpTypeStruct:
+                return std::all_of(operands, operands + operandCount, isMemberType);
+            case OpTypePointer:
+                // The pointee may be declared later, the Parser never follows pointers
+                return operandCount >= 2 && operands[1] < ids.size();
+            default:
+                return true;
+            }
+        }
+
+        std::string readString(const uint32_t* words, size_t wordCount) {
+            std::string string;
+            for (size_t i = 0; i < wordCount; i++) {
+                for (uint32_t byte = 0; byte < 4; byte++) {
+                    const char c = static_cast<char>((words[i] >> (byte * 8)) & 0xFF);
+                    if (c == '\0') {
+                        return string;
+                    }
+                    string.push_back(c);
+                }
+            }
+            return string;
+        }
+
+        VkShaderStageFlagBits getStage(uint32_t executionModel) {
+            switch (executionModel) {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default: return VK_SHADER_STAGE_ALL;
+            }
+        }
+
+        // Reads the types parse() recorded, whose operands checkTypeOperands() validated
+        class Parser {
+        public:
+            explicit Parser(std::vector<Id>& ids) : ids{ ids } {}
+
+            uint32_t constant(uint32_t id) const {
+                const Id& value = ids[id];
+                const bool isConstant = value.opcode == OpConstant || value.opcode == OpSpecConstant;
+                return isConstant && value.operands.size() > 2 ? value.operands[2] : 0;
+            }
+
+            // Size in bytes of a type, following the explicit layout decorations of buffer blocks
+            uint32_t size(uint32_t typeId, const Member& layout = {}) const {
+                const Id& type = ids[typeId];
+                switch (type.opcode) {
+                case OpTypeBool:
+                    return 4;
+                case OpTypeInt:
+                case OpTypeFloat:
+                    return type.operands[0] / 8;
+                case OpTypeVector:
+                    return size(type.operands[0]) * type.operands[1];
+                case OpTypeMatrix: {
+                    const uint32_t columns = type.operands[1];
+                    const uint32_t rows = ids[type.operands[0]].operands[1];
+                    if (layout.matrixStride == 0) {
+                        return columns * size(type.operands[0]);
+                    }
+                    return (layout.rowMajor ? rows : columns) * layout.matrixStride;
+                }
+                case OpTypeArray: {
+                    const uint32_t length = constant(type.operands[1]);
+                    const uint32_t stride = type.arrayStride != 0 ? type.arrayStride : size(type.operands[0]);
+                    return length * stride;
+                }
+                case OpTypeStruct: {
+                    uint32_t end = 0;
+                    for (size_t i = 0; i < type.operands.size(); i++) {
+                        const Member member = i < type.members.size() ? type.members[i] : Member{};
+                        end = std::max(end, member.offset + size(type.operands[i], member));
+                    }
+                    return end;
+                }
+                default:
+                    return 0;   // Runtime arrays and opaque types
+                }
+            }
+
+            VkFormat format(uint32_t typeId) const {
+                const Id& type = ids[typeId];
+                uint32_t componentCount = 1;
+                const Id* component = &type;
+                if (type.opcode == OpTypeVector) {
+                    componentCount = type.operands[1];
+                    component = &ids[type.operands[0]];
+                }
+
+                if (component->opcode == OpTypeFloat && component->operands[0] == 32) {
+                    constexpr VkFormat formats[] = {
+                        VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+                    return formats[componentCount - 1];
+                }
+                if (component->opcode == OpTypeInt && component->operands[0] == 32) {
+                    constexpr VkFormat signedFormats[] = {
+                        VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+                    constexpr VkFormat unsignedFormats[] = {
+                        VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+                    return component->operands[1] ? signedFormats[componentCount - 1] : unsignedFormats[componentCount - 1];
+                }
+                return VK_FORMAT_UNDEFINED;
+            }
+
+        private:
+            std::vector<Id>& ids;
+        };
+
+        uint32_t alignUp(uint32_t value, uint32_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+    } // namespace
+
+    /**
+     * @brief Reflects the interface of the first entry point of a SPIR-V module.
+     *
+     * @param code The SPIR-V words.
+     * @param wordCount The number of words.
+     * @param reflection Receives the interface.
+     * @param error Receives the reason when the code cannot be reflected.
+     * @return True if the code was reflected.
+     */
+    bool lmShaderReflection::parse(const uint32_t* code, size_t wordCount, lmShaderReflection& reflection, std::string& error) {
+        if (wordCount < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+            error = "not SPIR-V";
+            return false;
+        }
+
+        const uint32_t bound = code[3];
+        std::vector<Id> ids(bound);
+        std::vector<uint32_t> variables;
+        std::vector<MemberDecoration> memberDecorations;
+        std::vector<bool> forwardPointers(bound);
+        uint32_t pushConstantVariable = NONE;
+        bool inFunctions = false;
+        bool hasEntryPoint = false;
+
+        // Push constant members selected by an access chain, all of them when the block is used otherwise
+        std::vector<bool> pushConstantMembersUsed;
+        bool pushConstantBlockUsed = false;
+
+        const Parser parser{ ids };
+
+        for (size_t offset = SPIRV_HEADER_WORDS; offset < wordCount;) {
+            const uint32_t instructionWords = code[offset] >> 16;
+            const uint32_t opcode = code[offset] & 0xFFFF;
+            if (instructionWords == 0 || offset + instructionWords > wordCount) {
+                error = "truncated instruction";
+                return false;
+            }
+
+            const uint32_t* words = code + offset;
+            offset += instructionWords;
+
+            auto id = [&](uint32_t word) -> Id* {
+                return word < instructionWords && words[word] < bound ? &ids[words[word]] : nullptr;
+            };
+
+            if (inFunctions) {
+                for (uint32_t word = 1; word < instructionWords; word++) {
+                    if (words[word] >= bound) {
+                        continue;
+                    }
+                    ids[words[word]].referenced = true;
+
+                    if (words[word] == pushConstantVariable) {
+                        const bool isAccessChain = opcode == OpAccessChain || opcode == OpInBoundsAccessChain;
+                        if (isAccessChain && word == 3 && instructionWords > 4 && words[4] < bound) {
+                            const uint32_t member = parser.constant(words[4]);
+                            if (member < pushConstantMembersUsed.size()) {
+                                pushConstantMembersUsed[member] = true;
+                                continue;
+                            }
+                        }
+                        pushConstantBlockUsed = true;
+                    }
+                }
+                continue;
+            }
+
+            switch (opcode) {
+            case OpName:
+                if (Id* target = id(1)) {
+                    target->name = readString(words + 2, instructionWords - 2);
+                }
+                break;
+
+            case OpEntryPoint:
+                if (!hasEntryPoint && instructionWords > 2) {
+                    reflection.stage = getStage(words[1]);
+                    hasEntryPoint = true;
+                }
+                break;
+
+            case OpDecorate:
+                if (Id* target = id(1); target && instructionWords > 2) {
+                    const uint32_t literal = instructionWords > 3 ? words[3] : 0;
+                    switch (words[2]) {
+                    case DecorationBlock: target->block = true; break;
+                    case DecorationBufferBlock: target->bufferBlock = true; break;
+                    case DecorationArrayStride: target->arrayStride = literal; break;
+                    case DecorationBuiltIn: target->builtIn = true; break;
+                    case DecorationLocation: target->location = literal; break;
+                    case DecorationBinding: target->binding = literal; break;
+                    case DecorationDescriptorSet: target->set = literal; break;
+                    default: break;
+                    }
+                }
+                break;
+
+            case OpMemberDecorate:
+                if (id(1) && instructionWords > 3) {
+                    memberDecorations.push_back({ words[1], words[2], words[3], instructionWords > 4 ? words[4] : 0 });
+                }
+                break;
+
+            case OpTypeBool:
+            case OpTypeInt:
+            case OpTypeFloat:
+            case OpTypeVector:
+            case OpTypeMatrix:
+            case OpTypeImage:
+            case OpTypeSampler:
+            case OpTypeSampledImage:
+            case OpTypeArray:
+            case OpTypeRuntimeArray:
+            case OpTypeStruct:
+            case OpTypePointer:
+                if (Id* type = id(1)) {
+                    if (type->opcode != 0 || !checkTypeOperands(ids, forwardPointers, opcode, words + 2, instructionWords - 2)) {
+                        error = "invalid type instruction";
+                        return false;
+                    }
+                    type->opcode = opcode;
+                    type->operands.assign(words + 2, words + instructionWords);
+                }
+                break;
+
+            case OpTypeForwardPointer:
+                if (instructionWords > 1 && words[1] < bound) {
+                    forwardPointers[words[1]] = true;
+                }
+                break;
+
+            case OpConstant:
+            case OpSpecConstant:
+                if (Id* constant = id(2)) {
+                    if (constant->opcode != 0) {
+                        error = "id defined twice";
+                        return false;
+                    }
+                    constant->opcode = opcode;
+                    constant->operands.assign(words + 1, words + instructionWords);
+                }
+                break;
+
+            case OpVariable:
+                if (Id* variable = id(2); variable && instructionWords > 3) {
+                    if (variable->opcode != 0 || words[1] >= bound) {
+                        error = "invalid variable";
+                        return false;
+                    }
+                    variable->opcode = opcode;
+                    variable->operands = { words[1], words[3] };  // Pointer type, storage class
+                    variables.push_back(words[2]);
+
+                    if (words[3] == StoragePushConstant) {
+                        pushConstantVariable = words[2];
+                        const Id& pointer = ids[words[1]];
+                        const uint32_t memberCount = pointer.operands.size() > 1
+                            ? static_cast<uint32_t>(ids[pointer.operands[1]].operands.size()) : 0;
+                        pushConstantMembersUsed.assign(memberCount, false);
+                    }
+                }
+                break;
+
+            case OpFunction:
+                inFunctions = true;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if (!hasEntryPoint) {
+            error = "no entry point";
+            return false;
+        }
+
+        for (const MemberDecoration& decoration : memberDecorations) {
+            Id& target = ids[decoration.target];
+            if (target.opcode != OpTypeStruct || decoration.member >= target.operands.size()) {
+                error = "member decoration out of range";
+                return false;
+            }
+            target.members.resize(target.operands.size());
+
+            Member& member = target.members[decoration.member];
+            switch (decoration.decoration) {
+            case DecorationOffset: member.offset = decoration.literal; break;
+            case DecorationMatrixStride: member.matrixStride = decoration.literal; break;
+            case DecorationRowMajor: member.rowMajor = true; break;
+            default: break;
+            }
+        }
+
+        for (uint32_t variableId : variables) {
+            const Id& variable = ids[variableId];
+            const Id& pointer = ids[variable.operands[0]];
+            const uint32_t storageClass = variable.operands[1];
+            if (pointer.opcode != OpTypePointer || pointer.operands.size() < 2) {
+                continue;
+            }
+            uint32_t typeId = pointer.operands[1];
+
+            if (storageClass == StorageInput) {
+                if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && variable.location != NONE && !variable.builtIn) {
+                    reflection.vertexInputs.push_back({ variable.location, parser.format(typeId), variable.referenced, variable.name });
+                }
+                continue;
+            }
+
+            if (storageClass == StoragePushConstant) {
+                const Id& block = ids[typeId];
+                reflection.pushConstantSize = parser.size(typeId);
+
+                uint32_t begin = NONE;
+                uint32_t end = 0;
+                for (size_t i = 0; i < block.operands.size(); i++) {
+                    const bool memberUsed = i < pushConstantMembersUsed.size() && pushConstantMembersUsed[i];
+                    if (!pushConstantBlockUsed && !memberUsed) {
+                        continue;
+                    }
+                    const Member member = i < block.members.size() ? block.members[i] : Member{};
+                    begin = std::min(begin, member.offset);
+                    end = std::max(end, member.offset + parser.size(block.operands[i], member));
+                }
+                if (begin < end) {
+                    reflection.pushConstantUsedBegin = begin;
+                    reflection.pushConstantUsedEnd = end;
+                }
+                continue;
+            }
+
+            const bool isResource = storageClass == StorageUniformConstant || storageClass == StorageUniform || storageClass == StorageStorageBuffer;
+            if (!isResource || variable.set == NONE || variable.binding == NONE) {
+                continue;
+            }
+
+            lmReflectedBinding binding{};
+            binding.set = variable.set;
+            binding.binding = variable.binding;
+            binding.count = 1;
+            binding.stages = variable.referenced ? static_cast<VkShaderStageFlags>(reflection.stage) : 0;
+            binding.name = variable.name;
+
+            if (ids[typeId].opcode == OpTypeArray) {
+                binding.count = parser.constant(ids[typeId].operands[1]);
+                typeId = ids[typeId].operands[0];
+            }
+
+            const Id& type = ids[typeId];
+            switch (type.opcode) {
+            case OpTypeStruct: {
+                const bool storage = storageClass == StorageStorageBuffer || type.bufferBlock;
+                binding.type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                binding.blockSize = parser.size(typeId);
+                if (!type.operands.empty() && ids[type.operands.back()].opcode == OpTypeRuntimeArray) {
+                    binding.elementStride = ids[type.operands.back()].arrayStride;
+                }
+                if (binding.name.empty()) {
+                    binding.name = type.name;
+                }
+                break;
+            }
+            case OpTypeSampledImage:
+                binding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                break;
+            case OpTypeSampler:
+                binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+                break;
+            case OpTypeImage: {
+                const bool buffer = type.operands[1] == DIM_BUFFER;
+                const bool storage = type.operands[5] == 2;
+                binding.type = storage
+                    ? (buffer ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+                    : (buffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+                break;
+            }
+            default:
+                continue;
+            }
+
+            reflection.bindings.push_back(std::move(binding));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Merges the interfaces of the stages of a pipeline.
+     * @param stages The reflection of every stage.
+     */
+    lmPipelineInterface::lmPipelineInterface(const std::vector<const lmShaderReflection*>& stages) {
+        std::vector<VkShaderStageFlags> declaringStages;
+
+        for (const lmShaderReflection* stage : stages) {
+            for (const lmReflectedBinding& binding : stage->bindings) {
+                auto it = std::find_if(bindings.begin(), bindings.end(), [&](const lmReflectedBinding& other) {
+                    return other.set == binding.set && other.binding == binding.binding;
+                });
+
+                if (it == bindings.end()) {
+                    bindings.push_back(binding);
+                    declaringStages.push_back(stage->stage);
+                    continue;
+                }
+
+                if (it->type != binding.type || it->count != binding.count) {
+                    LOG_WARN("Shader stages disagree on set {} binding {} ({} and {})", binding.set, binding.binding, it->name, binding.name);
+                }
+                it->stages |= binding.stages;
+                it->blockSize = std::max(it->blockSize, binding.blockSize);
+                declaringStages[it - bindings.begin()] |= stage->stage;
+            }
+
+            if (stage->pushConstantUsedEnd > stage->pushConstantUsedBegin) {
+                const uint32_t offset = stage->pushConstantUsedBegin;
+                const uint32_t size = stage->pushConstantUsedEnd - stage->pushConstantUsedBegin;
+                auto it = std::find_if(pushConstantRanges.begin(), pushConstantRanges.end(), [&](const VkPushConstantRange& range) {
+                    return range.offset == offset && range.size == size;
+                });
+
+                if (it != pushConstantRanges.end()) {
+                    it->stageFlags |= stage->stage;
+                }
+                else {
+                    pushConstantRanges.push_back({ static_cast<VkShaderStageFlags>(stage->stage), offset, size });
+                }
+            }
+            pushConstantSize = std::max(pushConstantSize, stage->pushConstantSize);
+
+            if (stage->stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                vertexInputs = stage->vertexInputs;
+                hasVertexStage = true;
+            }
+        }
+
+        // Bindings no stage reads stay visible to the stages declaring them, so that the sets remain writable
+        for (size_t i = 0; i < bindings.size(); i++) {
+            if (bindings[i].stages == 0) {
+                bindings[i].stages = declaringStages[i];
+            }
+        }
+
+        std::sort(bindings.begin(), bindings.end(), [](const lmReflectedBinding& a, const lmReflectedBinding& b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+    }
+
+    /**
+     * @brief Finds a binding of the interface.
+     * @param set The descriptor set.
+     * @param binding The binding inside the set.
+     * @return The binding, or nullptr if no stage declares it.
+     */
+    const lmReflectedBinding* lmPipelineInterface::findBinding(uint32_t set, uint32_t binding) const {
+        for (const lmReflectedBinding& reflected : bindings) {
+            if (reflected.set == set && reflected.binding == binding) {
+                return &reflected;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Builds the layout of one descriptor set, each binding visible to the stages using it.
+     * @param device The Vulkan device.
+     * @param set The descriptor set.
+     * @return The set layout.
+     */
+    std::unique_ptr<lmDescriptorSetLayout> lmPipelineInterface::buildSetLayout(lmDevice& device, uint32_t set) const {
+        lmDescriptorSetLayout::Builder builder{ device };
+        for (const lmReflectedBinding& binding : bindings) {
+            if (binding.set == set) {
+                builder.addBinding(binding.binding, binding.type, binding.stages, binding.count);
+            }
+        }
+        return builder.build();
+    }
+
+    /**
+     * @brief Records a push constant update, split so that each piece names exactly the stages whose ranges cover it.
+     *
+     * @param commandBuffer The command buffer to record into.
+     * @param pipelineLayout A layout created with getPushConstantRanges().
+     * @param data The whole push constant block.
+     * @param size The size of the block in bytes.
+     */
+    void lmPipelineInterface::pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const void* data, uint32_t size) const {
+        std::vector<uint32_t> boundaries{ 0, size };
+        for (const VkPushConstantRange& range : pushConstantRanges) {
+            boundaries.push_back(std::min(range.offset, size));
+            boundaries.push_back(std::min(range.offset + range.size, size));
+        }
+        std::sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        uint32_t pieceBegin = 0;
+        VkShaderStageFlags pieceStages = 0;
+
+        auto flush = [&](uint32_t pieceEnd) {
+            if (pieceStages != 0 && pieceEnd > pieceBegin) {
+                vkCmdPushConstants(commandBuffer, pipelineLayout, pieceStages, pieceBegin, pieceEnd - pieceBegin, bytes + pieceBegin);
+            }
+        };
+
+        // Adjacent pieces covered by the same stages are pushed together
+        for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+            VkShaderStageFlags stages = 0;
+            for (const VkPushConstantRange& range : pushConstantRanges) {
+                if (range.offset <= boundaries[i] && range.offset + range.size >= boundaries[i + 1]) {
+                    stages |= range.stageFlags;
+                }
+            }
+
+            if (stages != pieceStages) {
+                flush(boundaries[i]);
+                pieceBegin = boundaries[i];
+                pieceStages = stages;
+            }
+        }
+        flush(size);
+    }
+
+    /**
+     * @brief Removes the vertex attributes the vertex shader does not read and checks the formats of the others.
+     * @param attributeDescriptions The attributes of the pipeline configuration.
+     * @param name The pipeline, for the log.
+     * @return False if an attribute format does not match or an input has no attribute.
+     */
+    bool lmPipelineInterface::filterVertexInput(std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, const char* name) const {
+        if (!hasVertexStage) {
+            return true;
+        }
+
+        bool matches = true;
+        std::string dropped;
+        auto findInput = [&](uint32_t location) -> const lmReflectedVertexInput* {
+            for (const lmReflectedVertexInput& input : vertexInputs) {
+                if (input.location == location) {
+                    return &input;
+                }
+            }
+            return nullptr;
+        };
+
+        std::erase_if(attributeDescriptions, [&](const VkVertexInputAttributeDescription& attribute) {
+            const lmReflectedVertexInput* input = findInput(attribute.location);
+            if (!input || !input->used) {
+                dropped += (dropped.empty() ? "" : ", ") + std::to_string(attribute.location);
+                return true;
+            }
+            if (input->format != VK_FORMAT_UNDEFINED && input->format != attribute.format) {
+                LOG_WARN("{}: vertex attribute {} ({}) has format {}, the vertex shader reads {}",
+                    name, attribute.location, input->name, static_cast<int>(attribute.format), static_cast<int>(input->format));
+                matches = false;
+            }
+            return false;
+        });
+
+        for (const lmReflectedVertexInput& input : vertexInputs) {
+            const bool provided = std::any_of(attributeDescriptions.begin(), attributeDescriptions.end(),
+                [&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; });
+            if (input.used && !provided) {
+                LOG_WARN("{}: the vertex shader reads location {} ({}) but no attribute provides it", name, input.location, input.name);
+                matches = false;
+            }
+        }
+
+        if (!dropped.empty()) {
+            LOG_INFO("{}: vertex attributes at locations {} dropped, the vertex shader does not read them", name, dropped);
+        }
+        return matches;
+    }
+
+    /**
+     * @brief Checks the size of the C++ push constant struct against the block the shaders declare.
+     * @param size sizeof the C++ struct.
+     * @param name The struct, for the log.
+     * @return False if the shaders read past the struct or the struct pushes bytes no shader declares.
+     */
+    bool lmPipelineInterface::checkPushConstants(uint32_t size, const char* name) const {
+        if (size < pushConstantSize) {
+            LOG_WARN("{} is {} bytes but the shaders declare a {} byte push constant block", name, size, pushConstantSize);
+            return false;
+        }
+        if (size > alignUp(pushConstantSize, 4)) {
+            LOG_WARN("{} pushes {} bytes but the shaders only declare {}", name, size, pushConstantSize);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks the size of the C++ struct filling a uniform buffer against the std140 block.
+     * @param set The descriptor set of the block.
+     * @param binding The binding of the block.
+     * @param size sizeof the C++ struct.
+     * @param name The struct, for the log.
+     * @return False if the binding is not a uniform buffer or the sizes differ beyond the block's 16 byte alignment.
+     */
+    bool lmPipelineInterface::checkUniformBlock(uint32_t set, uint32_t binding, uint32_t size, const char* name) const {
+        const lmReflectedBinding* reflected = findBinding(set, binding);
+        if (!reflected || reflected->type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            LOG_WARN("{}: no shader declares a uniform buffer at set {} binding {}", name, set, binding);
+            return false;
+        }
+        if (size < reflected->blockSize || size > alignUp(reflected->blockSize, 16)) {
+            LOG_WARN("{} is {} bytes but {} is {} bytes", name, size, reflected->name, reflected->blockSize);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks the size of the C++ element struct of a storage buffer against the stride of its runtime array.
+     * @param set The descriptor set of the buffer.
+     * @param binding The binding of the buffer.
+     * @param stride sizeof the C++ element struct.
+     * @param name The struct, for the log.
+     * @return False if the binding is not a storage buffer ending with a runtime array of that stride.
+     */
+    bool lmPipelineInterface::checkStorageElement(uint32_t set, uint32_t binding, uint32_t stride, const char* name) const {
+        const lmReflectedBinding* reflected = findBinding(set, binding);
+        if (!reflected || reflected->type != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+            LOG_WARN("{}: no shader declares a storage buffer at set {} binding {}", name, set, binding);
+            return false;
+        }
+        if (reflected->elementStride != stride) {
+            LOG_WARN("{} is {} bytes but the elements of {} are {} bytes apart", name, stride, reflected->name, reflected->elementStride);
+            return false;
+        }
+        return true;
+    }
+
+} // namespace lm
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Device.h"
+#include "Descriptors.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lm {
+
+    struct lmReflectedBinding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        uint32_t count;
+        VkShaderStageFlags stages;      // Stages statically using the binding, the declaring stages if none does
+        uint32_t blockSize;             // Size of a buffer block without its runtime array, 0 for images and samplers
+        uint32_t elementStride;         // ArrayStride of the runtime array ending a buffer block, 0 if none
+        std::string name;
+    };
+
+    struct lmReflectedVertexInput {
+        uint32_t location;
+        VkFormat format;
+        bool used;
+        std::string name;
+    };
+
+    /*
+    * The interface of one SPIR-V entry point: its descriptor bindings, the bytes of its push constant
+    * block it reads, and for vertex shaders its input attributes.
+    *
+    * Usage is static and conservative: a variable counts as used when any instruction of a function
+    * refers to it, and a push constant member when an access chain selects it or the whole block is
+    * loaded.
+    */
+    struct lmShaderReflection {
+        VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+        std::vector<lmReflectedBinding> bindings;
+        uint32_t pushConstantSize = 0;          // Declared size of the push constant block, 0 without one
+        uint32_t pushConstantUsedBegin = 0;     // Bytes [begin, end) of the block read by the stage
+        uint32_t pushConstantUsedEnd = 0;
+        std::vector<lmReflectedVertexInput> vertexInputs;
+
+        // Returns false and sets error if the code is not SPIR-V this parser understands
+        static bool parse(const uint32_t* code, size_t wordCount, lmShaderReflection& reflection, std::string& error);
+    };
+
+    /*
+    * The merged interface of the stages of a pipeline, from which its minimal layouts are derived.
+    *
+    * Each binding is visible to the stages using it only, and each stage gets a push constant range
+    * covering the bytes it reads; stages reading the same bytes share a range. pushConstants() splits
+    * an update into the pieces those ranges allow. The check functions log a warning for every
+    * mismatch between the C++ side and the shaders and return false if there was one.
+    */
+    class lmPipelineInterface {
+    public:
+        lmPipelineInterface() = default;
+        explicit lmPipelineInterface(const std::vector<const lmShaderReflection*>& stages);
+
+        const std::vector<lmReflectedBinding>& getBindings() const { return bindings; }
+        const lmReflectedBinding* findBinding(uint32_t set, uint32_t binding) const;
+        const std::vector<VkPushConstantRange>& getPushConstantRanges() const { return pushConstantRanges; }
+        uint32_t getPushConstantSize() const { return pushConstantSize; }
+
+        std::unique_ptr<lmDescriptorSetLayout> buildSetLayout(lmDevice& device, uint32_t set) const;
+        void pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const void* data, uint32_t size) const;
+
+        // The attributes the vertex shader does not read are dropped from the configuration
+        bool filterVertexInput(std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, const char* name) const;
+
+        bool checkPushConstants(uint32_t size, const char* name) const;
+        bool checkUniformBlock(uint32_t set, uint32_t binding, uint32_t size, const char* name) const;
+        bool checkStorageElement(uint32_t set, uint32_t binding, uint32_t stride, const char* name) const;
+
+    private:
+        std::vector<lmReflectedBinding> bindings;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        uint32_t pushConstantSize = 0;
+        std::vector<lmReflectedVertexInput> vertexInputs;
+        bool hasVertexStage = false;
+    };
+
+} // namespace lm
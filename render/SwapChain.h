@@ -14,8 +14,9 @@ namespace lm {
     public:
         static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
-        lmSwapChain(lmDevice& device, VkExtent2D windowExtent);
-        lmSwapChain(lmDevice& device, VkExtent2D windowExtent, std::shared_ptr<lmSwapChain> previous);
+        // keepDepth stores the depth of the render pass and adds a resume render pass, see getResumeRenderPass
+        lmSwapChain(lmDevice& device, VkExtent2D windowExtent, bool keepDepth = false);
+        lmSwapChain(lmDevice& device, VkExtent2D windowExtent, std::shared_ptr<lmSwapChain> previous, bool keepDepth = false);
         ~lmSwapChain();
 
         lmSwapChain(const lmSwapChain&) = delete;
@@ -24,6 +25,13 @@ namespace lm {
         VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
         VkRenderPass getRenderPass() { return renderPass; }
         VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+
+        // With keepDepth, the render pass ends with the depth stored in DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+        // readable by shaders, and the compatible resume render pass continues drawing on the same
+        // framebuffer, loading color and depth, before presenting
+        bool isDepthKept() const { return keepDepth; }
+        VkRenderPass getResumeRenderPass() { return resumeRenderPass; }
+        VkImageView getDepthImageView(int index) { return depthImageViews[index]; }
         size_t imageCount() { return swapChainImages.size(); }
         VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
         VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -49,6 +57,7 @@ namespace lm {
         void createImageViews();
         void createDepthResources();
         void createRenderPass();
+        void createResumeRenderPass();
         void createFramebuffers();
         void createSyncObjects();
 
@@ -65,9 +74,11 @@ namespace lm {
 
         std::vector<VkFramebuffer> swapChainFramebuffers;
         VkRenderPass renderPass;
+        VkRenderPass resumeRenderPass = VK_NULL_HANDLE;
+        bool keepDepth;
 
         std::vector<VkImage> depthImages;
-        std::vector<VkDeviceMemory> depthImageMemorys;
+        std::vector<VmaAllocation> depthImageAllocations;
         std::vector<VkImageView> depthImageViews;
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
@@ -0,0 +1,410 @@
+/**
+ * @file UploadQueue.cpp
+ * @brief Batched host to device buffer uploads through a staging ring tracked with fences.
+ */
+
+#include "UploadQueue.h"
+#include "../core/Logger.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace lm {
+
+    namespace {
+
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+    } // namespace
+
+    /**
+     * @brief Creates the staging ring and the command pool of the upload batches.
+     * @param device The Vulkan device the uploads are submitted to.
+     * @param ringSize The size of the staging ring in bytes.
+     */
+    lmUploadQueue::lmUploadQueue(lmDevice& device, VkDeviceSize ringSize)
+        : device{ device },
+        dedicatedTransfer{ device.hasDedicatedTransferQueue() },
+        ringSize{ ringSize } {
+        assert(ringSize >= STAGING_ALIGNMENT && "Staging ring is too small");
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = device.getTransferQueueFamily();
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            LOG_ERROR("Failed to create upload command pool!");
+        }
+
+        if (dedicatedTransfer) {
+            poolInfo.queueFamilyIndex = device.getGraphicsQueueFamily();
+            if (vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &acquireCommandPool) != VK_SUCCESS) {
+                LOG_ERROR("Failed to create upload acquire command pool!");
+            }
+        }
+
+        ring = std::make_unique<lmBuffer>(
+            device,
+            ringSize,
+            1,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        ring->map();
+        ringMemory = static_cast<char*>(ring->getMappedMemory());
+    }
+
+    /**
+     * @brief Waits for the submitted batches, pending copies that were never submitted are dropped.
+     */
+    lmUploadQueue::~lmUploadQueue() {
+        if (!pendingCopies.empty()) {
+            LOG_WARN("Upload queue destroyed with {} pending copies", pendingCopies.size());
+        }
+
+        while (!inFlight.empty()) {
+            waitOldest();
+        }
+
+        for (const BatchResources& resources : freeResources) {
+            vkDestroyFence(device.getDevice(), resources.fence, nullptr);
+            if (resources.semaphore != VK_NULL_HANDLE) {
+                vkDestroySemaphore(device.getDevice(), resources.semaphore, nullptr);
+            }
+        }
+        vkDestroyCommandPool(device.getDevice(), commandPool, nullptr);
+        if (acquireCommandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device.getDevice(), acquireCommandPool, nullptr);
+        }
+    }
+
+    /**
+     * @brief Copies data into the staging ring and records its copy to the destination buffer.
+     * @param dstBuffer The buffer receiving the data, it needs VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+     *                  Exclusive buffers are released to the graphics family by the batch.
+     * @param dstOffset The byte offset in the destination buffer.
+     * @param data The data to upload, it can be released as soon as the call returns.
+     * @param size The number of bytes to upload.
+     */
+    void lmUploadQueue::enqueue(const lmBuffer& dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+        const auto* source = static_cast<const char*>(data);
+        const bool transferOwnership = dedicatedTransfer && dstBuffer.getSharingMode() == VK_SHARING_MODE_EXCLUSIVE;
+
+        // Uploads larger than half the ring are split so that one chunk always fits once the ring drains
+        const VkDeviceSize maxChunk = std::max(ringSize / 2, STAGING_ALIGNMENT);
+        while (size > 0) {
+            const VkDeviceSize chunk = std::min(size, maxChunk);
+            const VkDeviceSize stagingOffset = allocateStaging(chunk);
+            std::memcpy(ringMemory + stagingOffset, source, chunk);
+
+            pendingCopies.push_back(PendingCopy{ dstBuffer.getBuffer(), VkBufferCopy{ stagingOffset, dstOffset, chunk }, transferOwnership });
+            uploadedBytes += chunk;
+
+            source += chunk;
+            dstOffset += chunk;
+            size -= chunk;
+        }
+    }
+
+    /**
+     * @brief Reserves ring space without waiting.
+     * @param size The number of bytes to reserve.
+     * @param offset Receives the offset of the space in the ring.
+     * @return False if the free space next to the head is too small.
+     */
+    bool lmUploadQueue::tryAllocateStaging(VkDeviceSize size, VkDeviceSize& offset) {
+        if (ringUsed == 0) {
+            ringHead = 0;
+            ringTail = 0;
+        }
+
+        const VkDeviceSize start = alignUp(ringHead, STAGING_ALIGNMENT);
+        const bool wrapped = ringHead < ringTail || (ringHead == ringTail && ringUsed > 0);
+
+        if (!wrapped) {
+            // Free space is [head, end) followed by [0, tail)
+            if (start + size <= ringSize) {
+                offset = start;
+            }
+            else if (size <= ringTail) {
+                // Skip the end of the ring, the padding is released with the batch
+                offset = 0;
+            }
+            else {
+                return false;
+            }
+        }
+        else {
+            // Free space is [head, tail)
+            if (start + size > ringTail) {
+                return false;
+            }
+            offset = start;
+        }
+
+        const VkDeviceSize consumed = offset == 0 && ringHead != 0
+            ? (ringSize - ringHead) + size
+            : (offset - ringHead) + size;
+        ringHead = offset + size;
+        ringUsed += consumed;
+        pendingRingBytes += consumed;
+        return true;
+    }
+
+    /**
+     * @brief Reserves ring space, submitting the pending copies and waiting for old batches when it is full.
+     * @param size The number of bytes to reserve, at most half the ring.
+     * @return The offset of the space in the ring.
+     */
+    VkDeviceSize lmUploadQueue::allocateStaging(VkDeviceSize size) {
+        VkDeviceSize offset = 0;
+        if (tryAllocateStaging(size, offset)) {
+            return offset;
+        }
+
+        // The pending copies hold the rest of the ring, they have to go before their space can be reused
+        collect();
+        if (!pendingCopies.empty()) {
+            submit();
+        }
+
+        while (!tryAllocateStaging(size, offset)) {
+            assert(!inFlight.empty() && "Staging ring cannot hold the upload");
+            waitOldest();
+        }
+
+        return offset;
+    }
+
+    /**
+     * @brief Takes a recycled command buffer and fence, or creates new ones.
+     * @return Resources ready to record and submit a batch.
+     */
+    lmUploadQueue::BatchResources lmUploadQueue::acquireBatchResources() {
+        if (!freeResources.empty()) {
+            BatchResources resources = freeResources.back();
+            freeResources.pop_back();
+            vkResetFences(device.getDevice(), 1, &resources.fence);
+            vkResetCommandBuffer(resources.commandBuffer, 0);
+            if (resources.acquireCommandBuffer != VK_NULL_HANDLE) {
+                vkResetCommandBuffer(resources.acquireCommandBuffer, 0);
+            }
+            return resources;
+        }
+
+        BatchResources resources{};
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &resources.commandBuffer) != VK_SUCCESS) {
+            LOG_ERROR("Failed to allocate upload command buffer!");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &resources.fence) != VK_SUCCESS) {
+            LOG_ERROR("Failed to create upload fence!");
+        }
+
+        if (dedicatedTransfer) {
+            allocInfo.commandPool = acquireCommandPool;
+            if (vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &resources.acquireCommandBuffer) != VK_SUCCESS) {
+                LOG_ERROR("Failed to allocate upload acquire command buffer!");
+            }
+
+            VkSemaphoreCreateInfo semaphoreInfo{};
+            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            if (vkCreateSemaphore(device.getDevice(), &semaphoreInfo, nullptr, &resources.semaphore) != VK_SUCCESS) {
+                LOG_ERROR("Failed to create upload semaphore!");
+            }
+        }
+
+        return resources;
+    }
+
+    /**
+     * @brief Records every pending copy into one command buffer and submits it.
+     * @return The id of the submitted batch, or of the last submitted batch when nothing was pending.
+     */
+    lmUploadQueue::BatchId lmUploadQueue::submit() {
+        if (pendingCopies.empty()) {
+            return lastSubmittedBatch;
+        }
+
+        BatchResources resources = acquireBatchResources();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(resources.commandBuffer, &beginInfo);
+
+        // One copy command per run of copies to the same buffer, in enqueue order
+        std::vector<VkBufferCopy> regions;
+        regions.reserve(pendingCopies.size());
+        for (size_t i = 0; i < pendingCopies.size();) {
+            const VkBuffer dstBuffer = pendingCopies[i].dstBuffer;
+            regions.clear();
+            for (; i < pendingCopies.size() && pendingCopies[i].dstBuffer == dstBuffer; i++) {
+                regions.push_back(pendingCopies[i].region);
+            }
+
+            vkCmdCopyBuffer(
+                resources.commandBuffer,
+                ring->getBuffer(),
+                dstBuffer,
+                static_cast<uint32_t>(regions.size()),
+                regions.data());
+        }
+
+        // Everything the uploaded buffers can be used for on the graphics queue
+        constexpr VkAccessFlags consumerAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        constexpr VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        if (!dedicatedTransfer) {
+            // Same queue as rendering: one barrier orders the copies before every later submission
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = consumerAccess;
+            vkCmdPipelineBarrier(
+                resources.commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                consumerStages,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+            vkEndCommandBuffer(resources.commandBuffer);
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &resources.commandBuffer;
+
+            if (vkQueueSubmit(device.getTransferQueue(), 1, &submitInfo, resources.fence) != VK_SUCCESS) {
+                LOG_ERROR("Failed to submit upload batch!");
+            }
+        }
+        else {
+            // Exclusive destinations are released by the transfer queue and acquired by the graphics queue
+            std::vector<VkBuffer> transferredBuffers;
+            for (const PendingCopy& copy : pendingCopies) {
+                if (copy.transferOwnership
+                    && std::find(transferredBuffers.begin(), transferredBuffers.end(), copy.dstBuffer) == transferredBuffers.end()) {
+                    transferredBuffers.push_back(copy.dstBuffer);
+                }
+            }
+
+            for (VkBuffer buffer : transferredBuffers) {
+                lmDevice::releaseBufferOwnership(
+                    resources.commandBuffer,
+                    buffer,
+                    device.getTransferQueueFamily(),
+                    device.getGraphicsQueueFamily(),
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT);
+            }
+            vkEndCommandBuffer(resources.commandBuffer);
+
+            VkSubmitInfo transferSubmitInfo{};
+            transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            transferSubmitInfo.commandBufferCount = 1;
+            transferSubmitInfo.pCommandBuffers = &resources.commandBuffer;
+            transferSubmitInfo.signalSemaphoreCount = 1;
+            transferSubmitInfo.pSignalSemaphores = &resources.semaphore;
+
+            if (vkQueueSubmit(device.getTransferQueue(), 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                LOG_ERROR("Failed to submit upload batch!");
+            }
+
+            // The semaphore makes the copies of concurrent buffers available and visible to the graphics queue
+            vkBeginCommandBuffer(resources.acquireCommandBuffer, &beginInfo);
+            for (VkBuffer buffer : transferredBuffers) {
+                lmDevice::acquireBufferOwnership(
+                    resources.acquireCommandBuffer,
+                    buffer,
+                    device.getTransferQueueFamily(),
+                    device.getGraphicsQueueFamily(),
+                    consumerStages,
+                    consumerAccess);
+            }
+            vkEndCommandBuffer(resources.acquireCommandBuffer);
+
+            // Waiting on all commands keeps every later graphics submission behind the copies
+            const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            VkSubmitInfo acquireSubmitInfo{};
+            acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquireSubmitInfo.waitSemaphoreCount = 1;
+            acquireSubmitInfo.pWaitSemaphores = &resources.semaphore;
+            acquireSubmitInfo.pWaitDstStageMask = &waitStage;
+            acquireSubmitInfo.commandBufferCount = 1;
+            acquireSubmitInfo.pCommandBuffers = &resources.acquireCommandBuffer;
+
+            if (vkQueueSubmit(device.getGraphicsQueue(), 1, &acquireSubmitInfo, resources.fence) != VK_SUCCESS) {
+                LOG_ERROR("Failed to submit upload acquire batch!");
+            }
+        }
+
+        inFlight.push_back(Batch{ ++lastSubmittedBatch, resources, ringHead, pendingRingBytes });
+        pendingRingBytes = 0;
+        pendingCopies.clear();
+        return lastSubmittedBatch;
+    }
+
+    /**
+     * @brief Returns the ring space and the resources of a completed batch.
+     * @param batch The oldest batch in flight, its fence must be signaled.
+     */
+    void lmUploadQueue::retire(Batch& batch) {
+        ringTail = batch.ringEnd;
+        ringUsed -= batch.ringBytes;
+        completedBatch = batch.id;
+        freeResources.push_back(batch.resources);
+        inFlight.pop_front();
+    }
+
+    /**
+     * @brief Retires every batch whose fence is signaled, in submission order.
+     */
+    void lmUploadQueue::collect() {
+        while (!inFlight.empty() && vkGetFenceStatus(device.getDevice(), inFlight.front().resources.fence) == VK_SUCCESS) {
+            retire(inFlight.front());
+        }
+    }
+
+    /**
+     * @brief Blocks until the oldest batch in flight has completed, then retires it.
+     */
+    void lmUploadQueue::waitOldest() {
+        Batch& batch = inFlight.front();
+        vkWaitForFences(device.getDevice(), 1, &batch.resources.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        retire(batch);
+    }
+
+    /**
+     * @brief Blocks until a batch has completed.
+     * @param batch The id returned by submit().
+     */
+    void lmUploadQueue::wait(BatchId batch) {
+        assert(batch <= lastSubmittedBatch && "Waiting for a batch that was not submitted");
+        while (!isComplete(batch)) {
+            waitOldest();
+        }
+    }
+
+    /**
+     * @brief Submits the pending copies and waits until every batch has completed.
+     */
+    void lmUploadQueue::flush() {
+        wait(submit());
+    }
+
+}  // namespace lm
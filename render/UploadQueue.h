@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Device.h"
+#include "Buffer.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace lm {
+
+    /*
+    * Batches host to device buffer copies through a persistently mapped staging ring.
+    *
+    * enqueue() copies the data into the ring right away and records the copy; submit() records every
+    * pending copy into one command buffer, followed by the synchronization that makes the writes
+    * visible to vertex input, shader and indirect reads, and submits it with a fence. Ring space is reclaimed
+    * once collect() sees the batch's fence signaled, so the CPU only waits when the ring is full.
+    *
+    * Batches are submitted to the device's transfer queue. With a dedicated transfer family the copies
+    * run on their own queue and a short graphics submission waits for them on a semaphore, acquiring
+    * ownership of exclusive destination buffers released by the transfer queue; concurrent buffers
+    * need no ownership transfer. Either way, every later graphics submission, such as the next frame,
+    * sees the uploaded data. Exclusive destinations are handed to the graphics family, so they should
+    * only be filled once, buffers written repeatedly while in use must be created concurrent.
+    * Destination buffers must stay alive until the batch writing them has completed.
+    */
+    class lmUploadQueue {
+    public:
+        using BatchId = uint64_t;
+
+        static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+        static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+        explicit lmUploadQueue(lmDevice& device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+        ~lmUploadQueue();
+
+        lmUploadQueue(const lmUploadQueue&) = delete;
+        lmUploadQueue& operator=(const lmUploadQueue&) = delete;
+
+        // Stages size bytes for dstBuffer at dstOffset, larger uploads than the ring are split
+        void enqueue(const lmBuffer& dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+        // Submits the pending copies, returns the id of the batch or of the last one if nothing was pending
+        BatchId submit();
+
+        // Releases the ring space of every completed batch, never blocks
+        void collect();
+
+        bool isComplete(BatchId batch) const { return batch <= completedBatch; }
+        void wait(BatchId batch);
+
+        // Submits the pending copies and waits for every batch
+        void flush();
+
+        bool hasPending() const { return !pendingCopies.empty(); }
+        VkDeviceSize getRingSize() const { return ringSize; }
+        VkDeviceSize getRingUsed() const { return ringUsed; }
+        size_t getInFlightBatchCount() const { return inFlight.size(); }
+        uint64_t getUploadedBytes() const { return uploadedBytes; }
+
+    private:
+        struct PendingCopy {
+            VkBuffer dstBuffer;
+            VkBufferCopy region;
+            bool transferOwnership;
+        };
+
+        // Command buffers, semaphore and fence of a submission, recycled once the fence is signaled
+        // The acquire command buffer and the semaphore are only used with a dedicated transfer family
+        struct BatchResources {
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+        };
+
+        struct Batch {
+            BatchId id;
+            BatchResources resources;
+            VkDeviceSize ringEnd;    // Ring head when the batch was submitted, the new tail once it completes
+            VkDeviceSize ringBytes;  // Ring bytes consumed by the batch, alignment and wrap padding included
+        };
+
+        bool tryAllocateStaging(VkDeviceSize size, VkDeviceSize& offset);
+        VkDeviceSize allocateStaging(VkDeviceSize size);
+        BatchResources acquireBatchResources();
+        void waitOldest();
+        void retire(Batch& batch);
+
+        lmDevice& device;
+        bool dedicatedTransfer;
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+
+        std::unique_ptr<lmBuffer> ring;
+        char* ringMemory = nullptr;
+        VkDeviceSize ringSize;
+        VkDeviceSize ringHead = 0;
+        VkDeviceSize ringTail = 0;
+        VkDeviceSize ringUsed = 0;
+        VkDeviceSize pendingRingBytes = 0;
+
+        std::vector<PendingCopy> pendingCopies;
+        std::deque<Batch> inFlight;
+        std::vector<BatchResources> freeResources;
+
+        BatchId lastSubmittedBatch = 0;
+        BatchId completedBatch = 0;
+        uint64_t uploadedBytes = 0;
+    };
+
+}  // namespace lm
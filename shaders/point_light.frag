@@ -14,7 +14,7 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    PointLight pointLights[MAX_LIGHTS];
     int numLights;
 } ubo;
 
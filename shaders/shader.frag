@@ -17,14 +17,13 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    PointLight pointLights[MAX_LIGHTS];
     int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;  
-    mat3 normalMatrix; 
-} push;
+// Specialization constants, set per pipeline variant by RenderSystem
+layout(constant_id = 0) const int LIGHT_COUNT = -1;     // Lights shaded, -1 reads ubo.numLights
+layout(constant_id = 1) const bool SPECULAR = true;
 
 void main() {
     vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
@@ -34,7 +33,9 @@ void main() {
     vec3 cameraPosWorld = ubo.invView[3].xyz;
     vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
-    for (int i = 0; i < ubo.numLights; i++) {
+    // A specialized count lets the driver unroll the loop
+    int lightCount = LIGHT_COUNT >= 0 ? LIGHT_COUNT : ubo.numLights;
+    for (int i = 0; i < lightCount; i++) {
         PointLight light = ubo.pointLights[i];
         vec3 directionToLight = light.position.xyz - fragPosWorld;
         float attenuation = 1.0 / dot(directionToLight, directionToLight); // Distance squared
@@ -46,11 +47,13 @@ void main() {
         diffuseLight += intensity * cosAngIncidence;
 
         // Specular lighting
-        vec3 halfAngle =  normalize(directionToLight + viewDirection);
-        float blinnTerm = dot(surfaceNormal, halfAngle);
-        blinnTerm = clamp(blinnTerm, 0, 1);
-        blinnTerm = pow(blinnTerm, 512.0);
-        specularLight += intensity * blinnTerm;
+        if (SPECULAR) {
+            vec3 halfAngle =  normalize(directionToLight + viewDirection);
+            float blinnTerm = dot(surfaceNormal, halfAngle);
+            blinnTerm = clamp(blinnTerm, 0, 1);
+            blinnTerm = pow(blinnTerm, 512.0);
+            specularLight += intensity * blinnTerm;
+        }
     }   
 
     outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, 1.0);
@@ -19,19 +19,30 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    PointLight pointLights[MAX_LIGHTS];
     int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
+struct InstanceData {
     mat4 modelMatrix;
-    mat3 normalMatrix;
-} push;
+    mat4 normalMatrix;
+};
+
+// One entry per drawn object, the draws of a model start at their firstInstance
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+// Instances that passed frustum culling, compacted to the start of each model's range
+layout(std430, set = 1, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visibleInstances[];
+};
 
 void main() {
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+    InstanceData instance = instances[visibleInstances[gl_InstanceIndex]];
+    vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);
     gl_Position = ubo.projection * (ubo.view * positionWorld);
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
     fragPosWorld = positionWorld.xyz;
     fragColor = color;    
 }
\ No newline at end of file
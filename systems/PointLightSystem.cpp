@@ -1,13 +1,14 @@
 #include "../systems/PointLightSystem.h"
+#include "../render/Renderer.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <algorithm>
 #include <array>
 #include <memory>
-#include <map>
 
 namespace lm {
 
@@ -19,38 +20,24 @@ namespace lm {
 
 	PointLightSystem::PointLightSystem(
 		lmDevice& device,
+		lmRegistry& registry,
+		lmPipelineRegistry& pipelineRegistry,
 		VkRenderPass renderPass,
-		VkDescriptorSetLayout globalSetLayout) : device{ device } {
-		createPipelineLayout(globalSetLayout);
-		createPipeline(renderPass);
+		VkDescriptorSetLayout globalSetLayout)
+		: device{ device }, lightView{ registry.view<TransformComponent, PointLightComponent>() } {
+		createPipelineLayout(pipelineRegistry, globalSetLayout);
+		createPipeline(pipelineRegistry, renderPass);
 	}
 
-	PointLightSystem::~PointLightSystem() {
-		vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
-	}
-
-	void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(PointLightPushConstants);
+	void PointLightSystem::createPipelineLayout(lmPipelineRegistry& pipelineRegistry, VkDescriptorSetLayout globalSetLayout) {
+		shaderInterface = pipelineRegistry.reflectShaders({ "shaders/point_light.vert.spv", "shaders/point_light.frag.spv" });
+		shaderInterface.checkPushConstants(sizeof(PointLightPushConstants), "PointLightPushConstants");
 
 		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
-
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-		if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-			LOG_FATAL("Failed to create pipeline layout");
-		}		
+		pipelineLayout = pipelineRegistry.getPipelineLayout(descriptorSetLayouts, shaderInterface.getPushConstantRanges());
 	}
 
-	void PointLightSystem::createPipeline(VkRenderPass renderPass) {
+	void PointLightSystem::createPipeline(lmPipelineRegistry& pipelineRegistry, VkRenderPass renderPass) {
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
 		PipelineConfigInfo pipelineConfig{};
@@ -63,8 +50,7 @@ namespace lm {
 		pipelineConfig.renderPass = renderPass;
 		pipelineConfig.pipelineLayout = pipelineLayout;
 
-		pipeline = std::make_unique<lmPipeline>(
-			device,
+		pipeline = pipelineRegistry.requestGraphicsPipeline(
 			"shaders/point_light.vert.spv",
 			"shaders/point_light.frag.spv",
 			pipelineConfig);		
@@ -78,42 +64,58 @@ namespace lm {
 
 		int lightIndex = 0;
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
-			if (obj.pointLight == nullptr) continue;
-
-			assert(lightIndex < MAX_LIGHTS && "Point light exceed maximum specified");
+		lightView.each(
+			[&](lmEntity entity, TransformComponent& transform, PointLightComponent& pointLight) {
+				assert(lightIndex < MAX_LIGHTS && "Point light exceed maximum specified");
 
-			// Update light position
-			obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
+				// Update light position
+				transform.setTranslation(glm::vec3(rotateLight * glm::vec4(transform.translation, 1.f)));
+				frameInfo.registry.markChanged<TransformComponent>(entity);
 
-			// Copy light to ubo
-			ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-			ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
+				// Copy light to ubo
+				ubo.pointLights[lightIndex].position = glm::vec4(transform.translation, 1.f);
+				ubo.pointLights[lightIndex].color = glm::vec4(pointLight.color, pointLight.lightIntensity);
 
-			lightIndex += 1;
-		}
+				lightIndex += 1;
+			});
 
 		ubo.numLights = lightIndex;
 	}
 
 	void PointLightSystem::render(FrameInfo& frameInfo) {
-			// Sort lights
-			std::map<float, lmGameObject::id_type> sorted;
-			for (auto& kv : frameInfo.gameObjects) {
-				auto& obj = kv.second;
-				if (obj.pointLight == nullptr) continue;
+		// The lights are not drawn until their pipeline has compiled
+		if (!pipeline.isReady()) {
+			return;
+		}
 
-				// Calculate distance
-				auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
-				float distSquared = glm::dot(offset, offset);
-				sorted[distSquared] = obj.getID();
-			}
+		// The lights nearest to the camera, nearest first
+		const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+		frameInfo.spatialIndex.queryNearest(cameraPosition, MAX_LIGHTS, sortedLights, SPATIAL_LAYER_LIGHTS);
+
+		// Blend back to front by the distance of the light centers
+		std::sort(sortedLights.begin(), sortedLights.end(), [&](lmEntity a, lmEntity b) {
+			const glm::vec3 offsetA = frameInfo.registry.get<TransformComponent>(a).translation - cameraPosition;
+			const glm::vec3 offsetB = frameInfo.registry.get<TransformComponent>(b).translation - cameraPosition;
+			return glm::dot(offsetA, offsetA) > glm::dot(offsetB, offsetB);
+		});
+
+		// A handful of draws, recorded by the calling thread
+		if (frameInfo.subpassContents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) {
+			VkCommandBuffer commandBuffer = frameInfo.renderer.beginSecondaryCommandBuffer();
+			recordDraws(frameInfo, commandBuffer);
+			frameInfo.renderer.endSecondaryCommandBuffer(commandBuffer);
+			vkCmdExecuteCommands(frameInfo.commandBuffer, 1, &commandBuffer);
+		}
+		else {
+			recordDraws(frameInfo, frameInfo.commandBuffer);
+		}
+	}
 
-		pipeline->bind(frameInfo.commandBuffer);
+	void PointLightSystem::recordDraws(FrameInfo& frameInfo, VkCommandBuffer commandBuffer) {
+		pipeline.get()->bind(commandBuffer);
 
 		vkCmdBindDescriptorSets(
-			frameInfo.commandBuffer,
+			commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
 			0,
@@ -122,25 +124,19 @@ namespace lm {
 			0,
 			nullptr);
 
-		// Iterate thru sorted lights in reverse order
-		for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-			// Use game object ID to find light object
-			auto& obj = frameInfo.gameObjects.at(it->second);			
+		for (lmEntity entity : sortedLights) {
+			// Use the entity to find the light components
+			auto& transform = frameInfo.registry.get<TransformComponent>(entity);
+			auto& pointLight = frameInfo.registry.get<PointLightComponent>(entity);
 
 			PointLightPushConstants push{};
-			push.position = glm::vec4(obj.transform.translation, 1.f);
-			push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-			push.radius = obj.transform.scale.x;
-
-			vkCmdPushConstants(
-				frameInfo.commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(PointLightPushConstants),
-				&push);
-
-			vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+			push.position = glm::vec4(transform.translation, 1.f);
+			push.color = glm::vec4(pointLight.color, pointLight.lightIntensity);
+			push.radius = transform.scale.x;
+
+			shaderInterface.pushConstants(commandBuffer, pipelineLayout, &push, sizeof(PointLightPushConstants));
+
+			vkCmdDraw(commandBuffer, 6, 1, 0, 0);
 		}		
 	}
 
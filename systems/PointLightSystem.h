@@ -2,7 +2,7 @@
 
 #include "../render/Camera.h"
 #include "../render/Device.h"
-#include "../render/Pipeline.h"
+#include "../render/PipelineRegistry.h"
 #include "../render/FrameInfo.h"
 #include "../ecs/GameObject.h"
 
@@ -13,8 +13,12 @@ namespace lm {
 
 	class PointLightSystem {
 	public:
-		PointLightSystem(lmDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
-		~PointLightSystem();
+		PointLightSystem(
+			lmDevice& device,
+			lmRegistry& registry,
+			lmPipelineRegistry& pipelineRegistry,
+			VkRenderPass renderPass,
+			VkDescriptorSetLayout globalSetLayout);
 
 		PointLightSystem(const PointLightSystem&) = delete;
 		PointLightSystem& operator = (const PointLightSystem&) = delete;
@@ -23,13 +27,23 @@ namespace lm {
 		void render(FrameInfo& frameInfo);
 
 	private:
-		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-		void createPipeline(VkRenderPass renderPass);
+		void createPipelineLayout(lmPipelineRegistry& pipelineRegistry, VkDescriptorSetLayout globalSetLayout);
+		void createPipeline(lmPipelineRegistry& pipelineRegistry, VkRenderPass renderPass);
+		void recordDraws(FrameInfo& frameInfo, VkCommandBuffer commandBuffer);
 
 		lmDevice& device;
 
-		std::unique_ptr<lmPipeline> pipeline;
-		VkPipelineLayout pipelineLayout;
+		// Kept across frames so that the matched archetypes are not searched again every update
+		lmView<TransformComponent, PointLightComponent> lightView;
+
+		// Reflected from the shaders, each stage only gets the push constants it reads
+		lmPipelineInterface shaderInterface;
+
+		lmPipelineHandle pipeline;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;	// Owned by the registry
+
+		// Lights drawn this frame, kept to reuse the allocation
+		std::vector<lmEntity> sortedLights;
 	};
 
 } //namespace lm
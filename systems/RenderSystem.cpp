@@ -1,4 +1,7 @@
 #include "../systems/RenderSystem.h"
+#include "../render/Model.h"
+#include "../render/Renderer.h"
+#include "../render/SwapChain.h"
 #include "../core/Logger.h"
 
 #define GLM_FORCE_RADIANS
@@ -6,102 +9,1214 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <algorithm>
 #include <memory>
 #include <array>
+#include <numeric>
 
 namespace lm {
 
-	struct PushConstantData {
-		glm::mat4 modelMatrix{1.f};
-		glm::mat4 normalMatrix{1.f};
+	// Matches InstanceData in shader.vert (std430), the normal matrix is padded to a mat4
+	struct InstanceData {
+		glm::mat4 modelMatrix{ 1.f };
+		glm::mat4 normalMatrix{ 1.f };
 	};
 
+	// Matches DrawData in cull.comp (std430)
+	struct GpuDrawData {
+		glm::vec4 boundingSphere;	// Local center and radius
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t indexed;
+		uint32_t runFirstDraw;	// Count slot and first compacted command of the group's run
+	};
+
+	// Matches CullParams in cull.comp (std140)
+	struct CullParams {
+		glm::vec4 frustumPlanes[lmFrustum::PLANE_COUNT];
+		glm::mat4 viewProjection;
+		uint32_t instanceCount;
+		uint32_t occlusion;
+		uint32_t drawCount;
+		uint32_t padding;
+	};
+
+	// Matches the push constants of cull.comp
+	struct CullPushConstants {
+		uint32_t phase;
+	};
+
+	constexpr uint32_t CULL_PHASE_EARLY = 0;
+	constexpr uint32_t CULL_PHASE_LATE = 1;
+	constexpr uint32_t CULL_PHASE_COMPACT = 2;
+
 	RenderSystem::RenderSystem(
 		lmDevice& device,
+		lmRegistry& registry,
+		lmGeometryArena& geometryArena,
+		lmPipelineRegistry& pipelineRegistry,
 		VkRenderPass renderPass,
-		VkDescriptorSetLayout globalSetLayout) : device{ device } {
+		VkDescriptorSetLayout globalSetLayout)
+		: device{ device }, geometryArena{ geometryArena }, pipelineRegistry{ pipelineRegistry },
+		modelView{ registry.view<TransformComponent, ModelComponent>() }, lightView{ registry.view<TransformComponent, PointLightComponent>() } {
+			graphicsInterface = pipelineRegistry.reflectShaders({ "shaders/shader.vert.spv", "shaders/shader.frag.spv" });
+			cullInterface = pipelineRegistry.reflectShaders({ "shaders/cull.comp.spv" });
+			checkShaderInterfaces();
+
+			createInstanceResources();
 			createPipelineLayout(globalSetLayout);
 			createPipeline(renderPass);
+			createCullPipeline();
 	}
 
-	RenderSystem::~RenderSystem() {
-		vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
+	/**
+	 * @brief Checks the structs shared with the shaders against their reflection, logging every mismatch.
+	 */
+	void RenderSystem::checkShaderInterfaces() const {
+		graphicsInterface.checkStorageElement(1, 0, sizeof(InstanceData), "InstanceData");
+		graphicsInterface.checkStorageElement(1, 1, sizeof(uint32_t), "visible instance index");
+
+		cullInterface.checkStorageElement(0, 0, sizeof(InstanceData), "InstanceData");
+		cullInterface.checkStorageElement(0, 2, sizeof(GpuDrawData), "GpuDrawData");
+		cullInterface.checkStorageElement(0, 3, sizeof(VkDrawIndexedIndirectCommand), "VkDrawIndexedIndirectCommand");
+		cullInterface.checkStorageElement(0, 7, sizeof(VkDrawIndexedIndirectCommand), "VkDrawIndexedIndirectCommand");
+		cullInterface.checkUniformBlock(0, CULL_PARAMS_BINDING, sizeof(CullParams), "CullParams");
+		cullInterface.checkPushConstants(sizeof(CullPushConstants), "CullPushConstants");
 	}
 
-	void RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+	/**
+	 * @brief Resizes every component array of the bounds.
+	 * @param count The number of instances.
+	 */
+	void RenderSystem::InstanceBounds::resize(size_t count) {
+		for (std::vector<float>* component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ }) {
+			component->resize(count);
+		}
+	}
+
+	/**
+	 * @brief Retrieves a range of the bounds as the input of the culling kernel.
+	 * @param first The first instance of the range.
+	 * @param count The number of instances in the range.
+	 * @return The SoA view of the range.
+	 */
+	lmAabbSoA RenderSystem::InstanceBounds::getRange(size_t first, size_t count) const {
+		return lmAabbSoA{
+			centerX.data() + first, centerY.data() + first, centerZ.data() + first,
+			extentX.data() + first, extentY.data() + first, extentZ.data() + first,
+			count };
+	}
+
+	/**
+	 * @brief Creates the instance and culling descriptor set layouts, the occlusion resources, and the buffers and descriptor sets of every frame in flight.
+	 */
+	void RenderSystem::createInstanceResources() {
+		// Instances and visible indices of shader.vert
+		instanceSetLayout = graphicsInterface.buildSetLayout(device, 1);
 
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(PushConstantData);
+		// An early and a late instance set per frame
+		instancePool = lmDescriptorPool::Builder(device)
+			.setMaxSets(2 * lmSwapChain::MAX_FRAMES_IN_FLIGHT)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * lmSwapChain::MAX_FRAMES_IN_FLIGHT)
+			.build();
 
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+		// Instances, instance draws, draw data, commands, visible indices, stats, visibility, compacted
+		// commands and draw counts of cull.comp, then the depth pyramid and the culling parameters
+		cullSetLayout = cullInterface.buildSetLayout(device, 0);
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		// An early and a late culling set per frame
+		constexpr uint32_t cullSetCount = 2 * lmSwapChain::MAX_FRAMES_IN_FLIGHT;
+		cullPool = lmDescriptorPool::Builder(device)
+			.setMaxSets(cullSetCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, CULL_STORAGE_BINDING_COUNT * cullSetCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, cullSetCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, cullSetCount)
+			.build();
 
-		if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-			LOG_FATAL("Failed to create pipeline layout");
+		// Bound by every culling set, so they exist whether occlusion culling is enabled or not
+		depthPyramid = std::make_unique<lmDepthPyramid>(device, pipelineRegistry);
+		reserveVisibility(INITIAL_INSTANCE_CAPACITY);
+
+		frames.resize(lmSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (FrameResources& frame : frames) {
+			frame.statsBuffer = std::make_unique<lmBuffer>(
+				device,
+				sizeof(uint32_t),
+				1,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			frame.statsBuffer->map();
+
+			frame.cullParamsBuffer = std::make_unique<lmBuffer>(
+				device,
+				sizeof(CullParams),
+				1,
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			frame.cullParamsBuffer->map();
+
+			reserveInstances(frame, INITIAL_INSTANCE_CAPACITY);
+			reserveDraws(frame, INITIAL_DRAW_CAPACITY);
+		}
+	}
+
+	/**
+	 * @brief Grows the per-instance buffers of a frame so that they hold at least instanceCount instances.
+	 *
+	 * The buffers of a frame are only read by that frame's command buffer, which has completed once the
+	 * renderer hands the frame index out again, so they can be replaced and the descriptor set rewritten here.
+	 *
+	 * @param frame The frame in flight owning the buffers.
+	 * @param instanceCount The number of instances the frame is about to draw.
+	 */
+	void RenderSystem::reserveInstances(FrameResources& frame, size_t instanceCount) {
+		if (frame.instanceBuffer && frame.instanceBuffer->getInstanceCount() >= instanceCount) {
+			return;
+		}
+
+		// Grow geometrically so that a growing scene reallocates a handful of times
+		uint32_t capacity = frame.instanceBuffer ? frame.instanceBuffer->getInstanceCount() : INITIAL_INSTANCE_CAPACITY;
+		while (capacity < instanceCount) {
+			capacity *= 2;
 		}
 
-		LOG_INFO("Pipeline layout created successfully");
+		frame.instanceBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(InstanceData),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.instanceBuffer->map();
+		frame.instanceVersion = 0;
+
+		frame.visibleBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(uint32_t),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.visibleBuffer->map();
+
+		frame.instanceDrawBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(uint32_t),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.instanceDrawBuffer->map();
+
+		frame.lateVisibleBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(uint32_t),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		auto bufferInfo = frame.instanceBuffer->descriptorInfo();
+		auto visibleInfo = frame.visibleBuffer->descriptorInfo();
+		auto lateVisibleInfo = frame.lateVisibleBuffer->descriptorInfo();
+		auto writeInstanceSet = [&](VkDescriptorBufferInfo& visibleBufferInfo, VkDescriptorSet& descriptorSet) {
+			lmDescriptorWriter writer{ *instanceSetLayout, *instancePool };
+			writer.writeBuffer(0, &bufferInfo);
+			writer.writeBuffer(1, &visibleBufferInfo);
+
+			if (descriptorSet == VK_NULL_HANDLE) {
+				writer.build(descriptorSet);
+			}
+			else {
+				writer.overwrite(descriptorSet);
+			}
+		};
+		writeInstanceSet(visibleInfo, frame.instanceDescriptorSet);
+		writeInstanceSet(lateVisibleInfo, frame.lateInstanceDescriptorSet);
+
+		writeCullDescriptorSet(frame);
+	}
+
+	/**
+	 * @brief Grows the per-draw buffers of a frame so that they hold at least drawCount draws.
+	 * @param frame The frame in flight owning the buffers.
+	 * @param drawCount The number of indirect commands the frame is about to submit.
+	 */
+	void RenderSystem::reserveDraws(FrameResources& frame, size_t drawCount) {
+		if (frame.indirectBuffer && frame.indirectBuffer->getInstanceCount() >= drawCount) {
+			return;
+		}
+
+		uint32_t capacity = frame.indirectBuffer ? frame.indirectBuffer->getInstanceCount() : INITIAL_DRAW_CAPACITY;
+		while (capacity < drawCount) {
+			capacity *= 2;
+		}
+
+		// Also the source of the commands GPU culling resets and fills in every frame
+		frame.indirectBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(VkDrawIndexedIndirectCommand),
+			capacity,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.indirectBuffer->map();
+
+		frame.gpuIndirectBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(VkDrawIndexedIndirectCommand),
+			capacity,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		frame.lateIndirectBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(VkDrawIndexedIndirectCommand),
+			capacity,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		frame.drawDataBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(GpuDrawData),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.drawDataBuffer->map();
+
+		// Written by the compaction dispatch only, the counts are indexed by the first draw of each run
+		auto createCompactedBuffers = [&](std::unique_ptr<lmBuffer>& compactedBuffer, std::unique_ptr<lmBuffer>& countBuffer) {
+			compactedBuffer = std::make_unique<lmBuffer>(
+				device,
+				sizeof(VkDrawIndexedIndirectCommand),
+				capacity,
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			countBuffer = std::make_unique<lmBuffer>(
+				device,
+				sizeof(uint32_t),
+				capacity,
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		};
+		createCompactedBuffers(frame.compactedIndirectBuffer, frame.countBuffer);
+		createCompactedBuffers(frame.lateCompactedIndirectBuffer, frame.lateCountBuffer);
+
+		frame.indirectVersion = 0;
+		writeCullDescriptorSet(frame);
+	}
+
+	/**
+	 * @brief Grows the shared visibility buffer so that it holds at least instanceCount instances.
+	 *
+	 * The buffer is used by every frame in flight, so the device is waited for before it is replaced,
+	 * and the culling descriptor sets of every frame are rewritten. The new buffer must be reset before use.
+	 *
+	 * @param instanceCount The number of instances about to be culled.
+	 */
+	void RenderSystem::reserveVisibility(size_t instanceCount) {
+		if (visibilityBuffer && visibilityBuffer->getInstanceCount() >= instanceCount) {
+			return;
+		}
+
+		uint32_t capacity = visibilityBuffer ? visibilityBuffer->getInstanceCount() : INITIAL_INSTANCE_CAPACITY;
+		while (capacity < instanceCount) {
+			capacity *= 2;
+		}
+
+		if (visibilityBuffer) {
+			vkDeviceWaitIdle(device.getDevice());
+		}
+
+		visibilityBuffer = std::make_unique<lmBuffer>(
+			device,
+			sizeof(uint32_t),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		visibilityVersion = 0;
+
+		for (FrameResources& frame : frames) {
+			writeCullDescriptorSet(frame);
+		}
+	}
+
+	/**
+	 * @brief Points the frame's early and late culling descriptor sets at the current buffers, once both the per-instance and per-draw buffers exist.
+	 *
+	 * The two sets only differ by the commands, visible indices, compacted commands and draw counts the phase writes.
+	 *
+	 * @param frame The frame in flight owning the buffers.
+	 */
+	void RenderSystem::writeCullDescriptorSet(FrameResources& frame) {
+		if (!frame.instanceBuffer || !frame.gpuIndirectBuffer) {
+			return;
+		}
+
+		auto pyramidInfo = depthPyramid->descriptorInfo();
+		auto paramsInfo = frame.cullParamsBuffer->descriptorInfo();
+		auto writeSet = [&](
+			lmBuffer& commands,
+			lmBuffer& visibleIndices,
+			lmBuffer& compactedCommands,
+			lmBuffer& drawCounts,
+			VkDescriptorSet& descriptorSet) {
+			std::array<VkDescriptorBufferInfo, CULL_STORAGE_BINDING_COUNT> bufferInfos{
+				frame.instanceBuffer->descriptorInfo(),
+				frame.instanceDrawBuffer->descriptorInfo(),
+				frame.drawDataBuffer->descriptorInfo(),
+				commands.descriptorInfo(),
+				visibleIndices.descriptorInfo(),
+				frame.statsBuffer->descriptorInfo(),
+				visibilityBuffer->descriptorInfo(),
+				compactedCommands.descriptorInfo(),
+				drawCounts.descriptorInfo()
+			};
+
+			lmDescriptorWriter writer{ *cullSetLayout, *cullPool };
+			for (uint32_t binding = 0; binding < bufferInfos.size(); binding++) {
+				writer.writeBuffer(binding, &bufferInfos[binding]);
+			}
+			writer.writeImage(CULL_PYRAMID_BINDING, &pyramidInfo);
+			writer.writeBuffer(CULL_PARAMS_BINDING, &paramsInfo);
+
+			if (descriptorSet == VK_NULL_HANDLE) {
+				writer.build(descriptorSet);
+			}
+			else {
+				writer.overwrite(descriptorSet);
+			}
+		};
+
+		writeSet(*frame.gpuIndirectBuffer, *frame.visibleBuffer, *frame.compactedIndirectBuffer, *frame.countBuffer, frame.cullDescriptorSet);
+		writeSet(
+			*frame.lateIndirectBuffer,
+			*frame.lateVisibleBuffer,
+			*frame.lateCompactedIndirectBuffer,
+			*frame.lateCountBuffer,
+			frame.lateCullDescriptorSet);
+	}
+
+	void RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{
+			globalSetLayout,
+			instanceSetLayout->getDescriptorSetLayout()
+		};
+
+		pipelineLayout = pipelineRegistry.getPipelineLayout(descriptorSetLayouts, graphicsInterface.getPushConstantRanges());
 	}
 
 	void RenderSystem::createPipeline(VkRenderPass renderPass) {
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
+		this->renderPass = renderPass;
+		attributeDescriptions = lmModel::getAttributeDescriptions();
+		graphicsInterface.filterVertexInput(attributeDescriptions, "RenderSystem");
+
+		// Every variant is requested while loading so that none is compiled on first use. The generic
+		// variants come first in the compile queue, the frames are skipped until one of them is ready
+		pipelineVariants.resize(static_cast<size_t>(MAX_LIGHTS - DYNAMIC_LIGHT_COUNT + 1) * 2);
+		for (bool specularVariant : { true, false }) {
+			pipelineVariants[getVariantIndex(DYNAMIC_LIGHT_COUNT, specularVariant)] = requestPipelineVariant(DYNAMIC_LIGHT_COUNT, specularVariant);
+		}
+		for (bool specularVariant : { true, false }) {
+			for (int lightCount = 0; lightCount <= MAX_LIGHTS; lightCount++) {
+				pipelineVariants[getVariantIndex(lightCount, specularVariant)] = requestPipelineVariant(lightCount, specularVariant);
+			}
+		}
+		LOG_INFO("Requested {} pipeline variants", pipelineVariants.size());
+	}
+
+	/**
+	 * @brief Retrieves the index of a pipeline variant in pipelineVariants.
+	 * @param lightCount The number of lights the variant shades, DYNAMIC_LIGHT_COUNT for the generic variant.
+	 * @param specularVariant Whether the variant computes the specular term.
+	 * @return The index of the variant.
+	 */
+	size_t RenderSystem::getVariantIndex(int lightCount, bool specularVariant) {
+		return static_cast<size_t>(lightCount - DYNAMIC_LIGHT_COUNT) * 2 + (specularVariant ? 1 : 0);
+	}
+
+	/**
+	 * @brief Requests the pipeline variant for a light count and specular setting.
+	 *
+	 * @param lightCount The number of lights the variant shades, DYNAMIC_LIGHT_COUNT for the generic variant.
+	 * @param specularVariant Whether the variant computes the specular term.
+	 * @return The handle of the variant, falling back to the generic variant until compiled.
+	 */
+	lmPipelineHandle RenderSystem::requestPipelineVariant(int lightCount, bool specularVariant) {
 		PipelineConfigInfo pipelineConfig{};
 		lmPipeline::defaultPipelineConfigInfo(pipelineConfig);
 
 		pipelineConfig.renderPass = renderPass;
 		pipelineConfig.pipelineLayout = pipelineLayout;
+		pipelineConfig.attributeDescriptions = attributeDescriptions;
+		lmPipeline::setSpecializationConstant(pipelineConfig, SPECULAR_CONSTANT_ID, specularVariant ? VK_TRUE : VK_FALSE);
 
-		pipeline = std::make_unique<lmPipeline>(
-			device,
+		lmPipelineHandle fallback;
+		if (lightCount != DYNAMIC_LIGHT_COUNT) {
+			lmPipeline::setSpecializationConstant(pipelineConfig, LIGHT_COUNT_CONSTANT_ID, static_cast<uint32_t>(lightCount));
+			fallback = pipelineVariants[getVariantIndex(DYNAMIC_LIGHT_COUNT, specularVariant)];
+		}
+
+		return pipelineRegistry.requestGraphicsPipeline(
 			"shaders/shader.vert.spv",
 			"shaders/shader.frag.spv",
-			pipelineConfig);
+			pipelineConfig,
+			fallback);
+	}
 
-		LOG_INFO("Pipeline created successfully");
+	/**
+	 * @brief Selects the pipeline variant matching the lights counted by prepareFrame(), without blocking.
+	 * @return The specialized variant once compiled, the generic variant until then, nullptr before either is compiled.
+	 */
+	lmPipeline* RenderSystem::selectPipeline() const {
+		return pipelineVariants[getVariantIndex(frameLightCount, specular)].get();
 	}
 
-	void RenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-		pipeline->bind(frameInfo.commandBuffer);	
+	void RenderSystem::createCullPipeline() {
+		cullPipelineLayout = pipelineRegistry.getPipelineLayout(
+			{ cullSetLayout->getDescriptorSetLayout() },
+			cullInterface.getPushConstantRanges());
+
+		cullPipeline = pipelineRegistry.requestComputePipeline("shaders/cull.comp.spv", cullPipelineLayout);
+	}
 
+	/**
+	 * @brief Selects how the objects are submitted.
+	 * @param newMode Instanced or Indirect, Indirect needs the drawIndirectFirstInstance feature.
+	 */
+	void RenderSystem::setMode(Mode newMode) {
+		if (newMode == Mode::Indirect && !device.hasDrawIndirectFirstInstance()) {
+			LOG_WARN("Indirect rendering needs drawIndirectFirstInstance, keeping instanced rendering");
+			return;
+		}
+
+		mode = newMode;
+		if (mode == Mode::Instanced && culling == Culling::GPU) {
+			LOG_WARN("GPU culling needs indirect rendering, switching to CPU culling");
+			setCulling(Culling::CPU);
+		}
+	}
+
+	/**
+	 * @brief Selects where the instances are culled.
+	 * @param newCulling None, CPU or GPU, GPU needs Indirect mode.
+	 */
+	void RenderSystem::setCulling(Culling newCulling) {
+		if (newCulling == Culling::GPU && mode != Mode::Indirect) {
+			LOG_WARN("GPU culling needs indirect rendering, using CPU culling");
+			newCulling = Culling::CPU;
+		}
+
+		if (newCulling != Culling::GPU && occlusionCulling) {
+			LOG_WARN("Occlusion culling needs GPU culling, disabling it");
+			occlusionCulling = false;
+		}
+
+		// The command templates and the CPU bounds depend on the culling, rebuild them for every frame
+		culling = newCulling;
+		for (FrameResources& frame : frames) {
+			frame.instanceVersion = 0;
+			frame.indirectVersion = 0;
+		}
+		boundsVersion = 0;
+	}
+
+	/**
+	 * @brief Enables or disables the two-phase occlusion culling.
+	 *
+	 * Every instance is assumed visible when it gets enabled, so the first early phase draws everything in the frustum.
+	 *
+	 * @param enabled True to enable it, which needs GPU culling and the shaderStorageImageExtendedFormats feature.
+	 */
+	void RenderSystem::setOcclusionCulling(bool enabled) {
+		if (enabled && culling != Culling::GPU) {
+			LOG_WARN("Occlusion culling needs GPU culling, keeping it disabled");
+			return;
+		}
+
+		if (enabled && !depthPyramid->isSupported()) {
+			LOG_WARN("Occlusion culling needs shaderStorageImageExtendedFormats, keeping it disabled");
+			return;
+		}
+
+		occlusionCulling = enabled;
+		visibilityVersion = 0;
+	}
+
+	/**
+	 * @brief Checks whether anything drawn changed since the last frame.
+	 *
+	 * Relies on the registry's change tracking: models added or replaced (with markChanged), transforms
+	 * recomputed by the hierarchy sync, world matrices updated by the hierarchy and destroyed entities.
+	 * A component removal is caught by the change in the number of drawn objects, and a geometry arena
+	 * that grew or compacted by its generation, as the first index and vertex offset of its models moved.
+	 *
+	 * @param frameInfo The current frame.
+	 * @param objectCount The number of entities with a ModelComponent this frame.
+	 * @return True if the draw data must be rebuilt.
+	 */
+	bool RenderSystem::detectChanges(FrameInfo& frameInfo, size_t objectCount) const {
+		const lmRegistry& registry = frameInfo.registry;
+		if (objectCount != lastObjectCount
+			|| geometryArena.getGeneration() != lastArenaGeneration
+			|| !registry.getChanged<ModelComponent>().empty()
+			|| !registry.getDestroyed().empty()) {
+			return true;
+		}
+
+		auto isDrawn = [&registry](lmEntity entity) { return registry.has<ModelComponent>(entity); };
+		const auto& changedTransforms = registry.getChanged<TransformComponent>();
+		const auto& movedEntities = frameInfo.hierarchy.getUpdatedEntities();
+		return std::any_of(changedTransforms.begin(), changedTransforms.end(), isDrawn)
+			|| std::any_of(movedEntities.begin(), movedEntities.end(), isDrawn);
+	}
+
+	/**
+	 * @brief Groups the drawn entities by model, assigns each group its instance range and splits the groups into runs.
+	 * @param frameInfo The current frame.
+	 */
+	void RenderSystem::buildDrawGroups(FrameInfo& frameInfo) {
+		groupLookup.clear();
+		drawGroups.clear();
+		drawRuns.clear();
+
+		// Count the instances of every model and remember where each entity goes within its group
+		modelView.each(
+			[&](lmEntity entity, TransformComponent&, ModelComponent& modelComponent) {
+				if (entitySlots.size() <= entity.index()) {
+					entitySlots.resize(static_cast<size_t>(entity.index()) + 1);
+				}
+
+				lmModel* model = modelComponent.model.get();
+				if (!model) {
+					entitySlots[entity.index()] = InstanceSlot{ NO_GROUP, 0 };
+					return;
+				}
+
+				auto [it, inserted] = groupLookup.try_emplace(model, static_cast<uint32_t>(drawGroups.size()));
+				if (inserted) {
+					drawGroups.push_back(DrawGroup{ model, 0, 0 });
+				}
+
+				entitySlots[entity.index()] = InstanceSlot{ it->second, drawGroups[it->second].instanceCount++ };
+			});
+
+		// Give every group a contiguous range of the instance buffer
+		uint32_t instanceCount = 0;
+		for (DrawGroup& group : drawGroups) {
+			group.firstInstance = instanceCount;
+			instanceCount += group.instanceCount;
+		}
+		lastInstanceCount = instanceCount;
+
+		// Consecutive indexed groups whose models bind the same buffers share one indirect call
+		for (uint32_t group = 0; group < drawGroups.size(); group++) {
+			lmModel* model = drawGroups[group].model;
+			if (!drawRuns.empty()) {
+				DrawRun& run = drawRuns.back();
+				if (run.indexed && model->isIndexed() && run.model->sharesBuffersWith(*model)) {
+					run.groupCount++;
+					continue;
+				}
+			}
+
+			drawRuns.push_back(DrawRun{ model, group, 1, model->isIndexed() });
+		}
+	}
+
+	/**
+	 * @brief Writes the model and normal matrices of every drawn entity to the frame's instance buffer, in parallel.
+	 *
+	 * The world space bounds are shared by the frames in flight, so they are only recomputed by the
+	 * first frame rebuilding its instances for a new version of the scene.
+	 *
+	 * @param frameInfo The current frame.
+	 * @param frame The frame in flight whose buffer is written.
+	 */
+	void RenderSystem::writeInstances(FrameInfo& frameInfo, FrameResources& frame) {
+		reserveInstances(frame, lastInstanceCount);
+		auto* instances = static_cast<InstanceData*>(frame.instanceBuffer->getMappedMemory());
+
+		auto* instanceDraws = static_cast<uint32_t*>(frame.instanceDrawBuffer->getMappedMemory());
+
+		// Only CPU culling reads the bounds
+		const bool writeBounds = culling == Culling::CPU && boundsVersion != sceneVersion;
+		if (writeBounds) {
+			instanceBounds.resize(lastInstanceCount);
+		}
+
+		modelView.parallelEach(
+			frameInfo.threadPool,
+			[&](lmEntity entity, TransformComponent& transform, ModelComponent&) {
+				const InstanceSlot slot = entitySlots[entity.index()];
+				if (slot.group == NO_GROUP) {
+					return;
+				}
+
+				const DrawGroup& group = drawGroups[slot.group];
+				const uint32_t instanceIndex = group.firstInstance + slot.index;
+				instanceDraws[instanceIndex] = slot.group;
+				InstanceData& instance = instances[instanceIndex];
+				// Entities attached to the hierarchy are drawn with their world matrix
+				// The normal matrices are cached and keep lighting correct under non-uniform scaling
+				if (frameInfo.hierarchy.contains(entity)) {
+					instance.modelMatrix = frameInfo.hierarchy.getWorldMatrix(entity);
+					instance.normalMatrix = frameInfo.hierarchy.getNormalMatrix(entity);
+				}
+				else {
+					instance.modelMatrix = transform.getMatrix();
+					instance.normalMatrix = transform.getNormalMatrix();
+				}
+
+				if (writeBounds) {
+					const lmAabb worldBox = group.model->getBoundingBox().transformed(instance.modelMatrix);
+					const glm::vec3 center = worldBox.getCenter();
+					const glm::vec3 extents = worldBox.getExtents();
+					instanceBounds.centerX[instanceIndex] = center.x;
+					instanceBounds.centerY[instanceIndex] = center.y;
+					instanceBounds.centerZ[instanceIndex] = center.z;
+					instanceBounds.extentX[instanceIndex] = extents.x;
+					instanceBounds.extentY[instanceIndex] = extents.y;
+					instanceBounds.extentZ[instanceIndex] = extents.z;
+				}
+			});
+
+		if (writeBounds) {
+			boundsVersion = sceneVersion;
+		}
+	}
+
+	/**
+	 * @brief Writes one indirect command and culling draw data per draw group to the frame's buffers.
+	 *
+	 * With GPU culling the commands are templates with a zero instance count, copied every frame to the
+	 * buffer the compute pass counts the visible instances in.
+	 *
+	 * @param frameInfo The current frame.
+	 * @param frame The frame in flight whose buffers are written.
+	 */
+	void RenderSystem::writeIndirectCommands(FrameInfo& frameInfo, FrameResources& frame) {
+		reserveDraws(frame, drawGroups.size());
+		auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(frame.indirectBuffer->getMappedMemory());
+		auto* drawData = static_cast<GpuDrawData*>(frame.drawDataBuffer->getMappedMemory());
+		const bool gpuCulling = culling == Culling::GPU;
+
+		frameInfo.threadPool.parallelFor(drawGroups.size(), PARALLEL_DRAW_GRAIN_SIZE, [&](size_t begin, size_t end) {
+			for (size_t group = begin; group < end; group++) {
+				const DrawGroup& drawGroup = drawGroups[group];
+				VkDrawIndexedIndirectCommand& command = commands[group];
+
+				// Non indexed models are drawn directly, their command is left empty
+				command.indexCount = drawGroup.model->isIndexed() ? drawGroup.model->getIndexCount() : 0;
+				command.instanceCount = gpuCulling ? 0 : drawGroup.instanceCount;
+				command.firstIndex = drawGroup.model->getFirstIndex();
+				command.vertexOffset = drawGroup.model->getVertexOffset();
+				command.firstInstance = drawGroup.firstInstance;
+
+				const lmSphere& sphere = drawGroup.model->getBoundingSphere();
+				drawData[group].boundingSphere = glm::vec4(sphere.center, sphere.radius);
+				drawData[group].firstInstance = drawGroup.firstInstance;
+				drawData[group].instanceCount = drawGroup.instanceCount;
+				drawData[group].indexed = drawGroup.model->isIndexed() ? 1 : 0;
+			}
+		});
+
+		// The compaction packs the visible commands of a run from its first draw on
+		for (const DrawRun& drawRun : drawRuns) {
+			for (uint32_t group = drawRun.firstGroup; group < drawRun.firstGroup + drawRun.groupCount; group++) {
+				drawData[group].runFirstDraw = drawRun.firstGroup;
+			}
+		}
+
+		lastCommandCount = drawGroups.size();
+	}
+
+	/**
+	 * @brief Culls the instances against the camera frustum and compacts the visible ones of every group.
+	 *
+	 * The boxes are tested in parallel chunks by the SIMD kernel. Each group then writes the indices of
+	 * its visible instances to the start of its range of the frame's visible index buffer, so drawing
+	 * visibleCounts[group] instances from its firstInstance only touches visible ones. In Indirect mode
+	 * the instance counts of the frame's commands are updated too.
+	 *
+	 * @param frameInfo The current frame, providing the camera and the thread pool.
+	 * @param frame The frame in flight whose visible index and indirect buffers are written.
+	 */
+	void RenderSystem::cullInstances(FrameInfo& frameInfo, FrameResources& frame) {
+		visibleFlags.resize(lastInstanceCount);
+		visibleCounts.resize(drawGroups.size());
+
+		if (culling == Culling::CPU) {
+			const lmFrustum frustum = lmFrustum::fromMatrix(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+			frameInfo.threadPool.parallelFor(lastInstanceCount, PARALLEL_CULL_GRAIN_SIZE, [&](size_t begin, size_t end) {
+				cullAabbs(frustum, instanceBounds.getRange(begin, end - begin), visibleFlags.data() + begin, cullingKernel);
+			});
+		}
+		else {
+			std::fill(visibleFlags.begin(), visibleFlags.end(), uint8_t{ 1 });
+		}
+
+		auto* visibleIndices = static_cast<uint32_t*>(frame.visibleBuffer->getMappedMemory());
+		auto* commands = mode == Mode::Indirect
+			? static_cast<VkDrawIndexedIndirectCommand*>(frame.indirectBuffer->getMappedMemory())
+			: nullptr;
+
+		frameInfo.threadPool.parallelFor(drawGroups.size(), PARALLEL_DRAW_GRAIN_SIZE, [&](size_t begin, size_t end) {
+			for (size_t group = begin; group < end; group++) {
+				const DrawGroup& drawGroup = drawGroups[group];
+				const uint32_t lastInstance = drawGroup.firstInstance + drawGroup.instanceCount;
+
+				// Branchless compaction: every index is written, only visible ones advance the output
+				uint32_t visibleCount = 0;
+				for (uint32_t instance = drawGroup.firstInstance; instance < lastInstance; instance++) {
+					visibleIndices[drawGroup.firstInstance + visibleCount] = instance;
+					visibleCount += visibleFlags[instance];
+				}
+
+				visibleCounts[group] = visibleCount;
+				if (commands) {
+					commands[group].instanceCount = visibleCount;
+				}
+			}
+		});
+
+		lastVisibleCount = std::accumulate(visibleCounts.begin(), visibleCounts.end(), size_t{ 0 });
+	}
+
+	/**
+	 * @brief Records the GPU culling pass: resets the frame's commands and counts, tests every instance, compacts the draws and makes the results visible to them.
+	 *
+	 * The visible count written by the previous use of this frame's buffers is read back first, its
+	 * command buffer having completed by the time the renderer hands the frame index out again.
+	 * With occlusion culling this is the early phase, which also resets the late commands and, when the
+	 * instances were reordered, marks every instance visible.
+	 *
+	 * @param frameInfo The current frame, providing the camera and the command buffer, outside of the render pass.
+	 * @param frame The frame in flight whose buffers are used.
+	 */
+	void RenderSystem::dispatchCulling(FrameInfo& frameInfo, FrameResources& frame) {
+		if (frame.statsPending) {
+			lastVisibleCount = *static_cast<const uint32_t*>(frame.statsBuffer->getMappedMemory());
+			frame.statsPending = false;
+		}
+
+		if (drawGroups.empty()) {
+			lastVisibleCount = 0;
+			return;
+		}
+
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+		VkBufferCopy region{};
+		region.size = drawGroups.size() * sizeof(VkDrawIndexedIndirectCommand);
+		vkCmdCopyBuffer(commandBuffer, frame.indirectBuffer->getBuffer(), frame.gpuIndirectBuffer->getBuffer(), 1, &region);
+		vkCmdFillBuffer(commandBuffer, frame.statsBuffer->getBuffer(), 0, sizeof(uint32_t), 0);
+
+		const VkDeviceSize countSize = drawGroups.size() * sizeof(uint32_t);
+		if (device.hasDrawIndirectCount()) {
+			vkCmdFillBuffer(commandBuffer, frame.countBuffer->getBuffer(), 0, countSize, 0);
+		}
+
+		if (occlusionCulling) {
+			vkCmdCopyBuffer(commandBuffer, frame.indirectBuffer->getBuffer(), frame.lateIndirectBuffer->getBuffer(), 1, &region);
+			if (device.hasDrawIndirectCount()) {
+				vkCmdFillBuffer(commandBuffer, frame.lateCountBuffer->getBuffer(), 0, countSize, 0);
+			}
+
+			// The visibility is indexed like the instance buffer, which a rebuild reorders. The previous
+			// frame's late phase may still be writing it
+			if (visibilityVersion != sceneVersion) {
+				VkMemoryBarrier visibilityBarrier{};
+				visibilityBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				visibilityBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				visibilityBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(
+					commandBuffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					0, 1, &visibilityBarrier, 0, nullptr, 0, nullptr);
+
+				vkCmdFillBuffer(commandBuffer, visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 1);
+				visibilityVersion = sceneVersion;
+			}
+		}
+
+		// Also orders the previous frame's late phase writes of the visibility before this frame's reads
+		VkMemoryBarrier resetBarrier{};
+		resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+		CullParams params{};
+		const glm::mat4 viewProjection = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+		const lmFrustum frustum = lmFrustum::fromMatrix(viewProjection);
+		std::copy(frustum.planes.begin(), frustum.planes.end(), params.frustumPlanes);
+		params.viewProjection = viewProjection;
+		params.instanceCount = static_cast<uint32_t>(lastInstanceCount);
+		params.occlusion = occlusionCulling ? 1 : 0;
+		params.drawCount = static_cast<uint32_t>(drawGroups.size());
+		frame.cullParamsBuffer->writeToBuffer(&params);
+
+		CullPushConstants push{ CULL_PHASE_EARLY };
+		cullPipeline.wait().bind(commandBuffer);
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			cullPipelineLayout,
+			0, 1, &frame.cullDescriptorSet,
+			0, nullptr);
+		cullInterface.pushConstants(commandBuffer, cullPipelineLayout, &push, sizeof(push));
+		vkCmdDispatch(commandBuffer, (params.instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+		compactDraws(commandBuffer);
+
+		// The draws read the commands and the visible indices, the host reads the visible count after the frame's fence
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+		frame.statsPending = true;
+	}
+
+	/**
+	 * @brief Records the compaction of the commands a culling dispatch just counted the visible instances of.
+	 *
+	 * Every indexed command left with instances is appended to its run in the compacted buffer of the bound
+	 * culling set, and counted at the run's first draw, for vkCmdDrawIndexedIndirectCount. Nothing is
+	 * recorded without the drawIndirectCount feature, the draws then read the commands directly.
+	 *
+	 * @param commandBuffer The command buffer with the culling pipeline and set bound, after the culling dispatch.
+	 */
+	void RenderSystem::compactDraws(VkCommandBuffer commandBuffer) {
+		if (!device.hasDrawIndirectCount()) {
+			return;
+		}
+
+		// The instance counts are final once every culling invocation has completed
+		VkMemoryBarrier countBarrier{};
+		countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		countBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &countBarrier, 0, nullptr, 0, nullptr);
+
+		CullPushConstants push{ CULL_PHASE_COMPACT };
+		cullInterface.pushConstants(commandBuffer, cullPipelineLayout, &push, sizeof(push));
+		vkCmdDispatch(commandBuffer, (static_cast<uint32_t>(drawGroups.size()) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+	}
+
+	/**
+	 * @brief Records the late occlusion phase: builds the depth pyramid from the early phase's depth and tests every instance against it.
+	 *
+	 * The early and late phases write the same stats, and the visibility the late phase leaves is read
+	 * by the next frame's early phase.
+	 *
+	 * @param frameInfo The current frame, outside of the render pass and with the depth kept by the renderer.
+	 */
+	void RenderSystem::cullLate(FrameInfo& frameInfo) {
+		if (!occlusionCulling || drawGroups.empty()) {
+			return;
+		}
+
+		assert(frameInfo.depthImageView != VK_NULL_HANDLE && "Occlusion culling needs the renderer to keep the depth");
+
+		FrameResources& frame = frames[frameInfo.frameIndex];
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+		depthPyramid->build(commandBuffer, frameInfo.frameIndex, frameInfo.depthImageView);
+
+		CullPushConstants push{ CULL_PHASE_LATE };
+		cullPipeline.wait().bind(commandBuffer);
 		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			cullPipelineLayout,
+			0, 1, &frame.lateCullDescriptorSet,
+			0, nullptr);
+		cullInterface.pushConstants(commandBuffer, cullPipelineLayout, &push, sizeof(push));
+		vkCmdDispatch(commandBuffer, (static_cast<uint32_t>(lastInstanceCount) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+		compactDraws(commandBuffer);
+
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	/**
+	 * @brief Brings the frame's draw data up to date with the scene and culls the instances.
+	 * @param frameInfo The current frame, its command buffer must not be inside a render pass.
+	 */
+	void RenderSystem::prepareFrame(FrameInfo& frameInfo) {
+		FrameResources& frame = frames[frameInfo.frameIndex];
+
+		// size() does not pick up new archetypes by itself
+		lightView.refresh();
+		modelView.refresh();
+
+		// Counted like PointLightSystem::update fills the UBO, selects the pipeline variant of the frame
+		frameLightCount = static_cast<int>(std::min<size_t>(lightView.size(), MAX_LIGHTS));
+
+		const size_t objectCount = modelView.size();
+		if (detectChanges(frameInfo, objectCount)) {
+			sceneVersion++;
+		}
+		lastObjectCount = objectCount;
+		lastArenaGeneration = geometryArena.getGeneration();
+
+		// Rebuild only the buffers that were written for an older version of the scene
+		const bool rebuildInstances = frame.instanceVersion != sceneVersion;
+		const bool rebuildCommands = mode == Mode::Indirect && frame.indirectVersion != sceneVersion;
+		lastFrameReused = !rebuildInstances && !rebuildCommands;
+
+		if (rebuildInstances || rebuildCommands) {
+			if (groupsVersion != sceneVersion) {
+				buildDrawGroups(frameInfo);
+				groupsVersion = sceneVersion;
+			}
+		}
+
+		if (rebuildInstances) {
+			writeInstances(frameInfo, frame);
+			frame.instanceVersion = sceneVersion;
+		}
+
+		if (rebuildCommands) {
+			writeIndirectCommands(frameInfo, frame);
+			frame.indirectVersion = sceneVersion;
+		}
+
+		// Resizing waits for the device and rewrites the culling sets, which this frame has not bound yet
+		if (occlusionCulling) {
+			reserveVisibility(lastInstanceCount);
+			if (depthPyramid->resize(frameInfo.extent)) {
+				for (FrameResources& frameResources : frames) {
+					writeCullDescriptorSet(frameResources);
+				}
+			}
+		}
+
+		// The camera moves independently of the scene, so culling runs every frame
+		if (culling == Culling::GPU) {
+			dispatchCulling(frameInfo, frame);
+		}
+		else {
+			cullInstances(frameInfo, frame);
+		}
+	}
+
+	/**
+	 * @brief Draws the instances left by the culling of prepareFrame(), the early phase with occlusion culling.
+	 * @param frameInfo The current frame, its command buffer must be inside the render pass.
+	 */
+	void RenderSystem::renderGameObjects(FrameInfo& frameInfo) {
+		FrameResources& frame = frames[frameInfo.frameIndex];
+
+		// GPU culling fills in the device local copy of the commands
+		VkBuffer indirectBuffer = VK_NULL_HANDLE;
+		if (mode == Mode::Indirect) {
+			indirectBuffer = culling == Culling::GPU ? frame.gpuIndirectBuffer->getBuffer() : frame.indirectBuffer->getBuffer();
+		}
+
+		recordDraws(frameInfo, indirectBuffer, frame.instanceDescriptorSet, false);
+	}
+
+	/**
+	 * @brief Draws the instances the late occlusion phase of cullLate() found newly visible.
+	 * @param frameInfo The current frame, its command buffer must be inside the resumed render pass.
+	 */
+	void RenderSystem::renderLateGameObjects(FrameInfo& frameInfo) {
+		if (!occlusionCulling) {
+			return;
+		}
+
+		FrameResources& frame = frames[frameInfo.frameIndex];
+		recordDraws(frameInfo, frame.lateIndirectBuffer->getBuffer(), frame.lateInstanceDescriptorSet, true);
+	}
+
+	/**
+	 * @brief Records the draws of every run, inline or split into secondary command buffers across the thread pool.
+	 *
+	 * With secondary command buffers every chunk of PARALLEL_RECORD_GRAIN_SIZE draw groups is recorded by
+	 * whichever thread runs it, into a buffer from that thread's pool, and the buffers are executed in
+	 * chunk order so that the draws keep their order. Indirect mode records one multi-draw per run, so
+	 * below PARALLEL_RECORD_MIN_RUNS runs it records a single secondary on the calling thread instead:
+	 * splitting would cost more than the few commands and would cut runs into several multi-draws.
+	 *
+	 * @param frameInfo The current frame, its command buffer must be inside a render pass.
+	 * @param indirectBuffer The commands of the draw groups in Indirect mode, ignored in Instanced mode.
+	 * @param instanceDescriptorSet The instance set whose visible indices match the commands.
+	 * @param lateDraws True for the late occlusion phase, which skips the non indexed runs already drawn.
+	 */
+	void RenderSystem::recordDraws(FrameInfo& frameInfo, VkBuffer indirectBuffer, VkDescriptorSet instanceDescriptorSet, bool lateDraws) {
+		if (drawGroups.empty()) {
+			return;
+		}
+
+		// Skipped until a pipeline is compiled, the frame path never waits for one
+		lmPipeline* drawPipeline = selectPipeline();
+		if (!drawPipeline) {
+			return;
+		}
+
+		const size_t groupCount = drawGroups.size();
+		if (frameInfo.subpassContents == VK_SUBPASS_CONTENTS_INLINE) {
+			recordGroups(frameInfo, frameInfo.commandBuffer, *drawPipeline, indirectBuffer, instanceDescriptorSet, lateDraws, 0, groupCount);
+			return;
+		}
+
+		if (mode == Mode::Indirect && drawRuns.size() < PARALLEL_RECORD_MIN_RUNS) {
+			VkCommandBuffer commandBuffer = frameInfo.renderer.beginSecondaryCommandBuffer();
+			recordGroups(frameInfo, commandBuffer, *drawPipeline, indirectBuffer, instanceDescriptorSet, lateDraws, 0, groupCount);
+			frameInfo.renderer.endSecondaryCommandBuffer(commandBuffer);
+			vkCmdExecuteCommands(frameInfo.commandBuffer, 1, &commandBuffer);
+			return;
+		}
+
+		secondaryCommandBuffers.assign((groupCount + PARALLEL_RECORD_GRAIN_SIZE - 1) / PARALLEL_RECORD_GRAIN_SIZE, VK_NULL_HANDLE);
+		frameInfo.threadPool.parallelFor(groupCount, PARALLEL_RECORD_GRAIN_SIZE, [&](size_t begin, size_t end) {
+			VkCommandBuffer commandBuffer = frameInfo.renderer.beginSecondaryCommandBuffer();
+			recordGroups(frameInfo, commandBuffer, *drawPipeline, indirectBuffer, instanceDescriptorSet, lateDraws, begin, end);
+			frameInfo.renderer.endSecondaryCommandBuffer(commandBuffer);
+			secondaryCommandBuffers[begin / PARALLEL_RECORD_GRAIN_SIZE] = commandBuffer;
+		});
+
+		vkCmdExecuteCommands(
 			frameInfo.commandBuffer,
+			static_cast<uint32_t>(secondaryCommandBuffers.size()),
+			secondaryCommandBuffers.data());
+	}
+
+	/**
+	 * @brief Records the draws of the groups in [groupBegin, groupEnd), binding the pipeline and descriptor sets first.
+	 *
+	 * A run cut by the range is drawn by parts, with one multi-draw per part; the count buffer only
+	 * serves runs drawn whole.
+	 *
+	 * @param frameInfo The current frame.
+	 * @param commandBuffer The command buffer to record into, inside the render pass.
+	 * @param drawPipeline The pipeline variant selected by recordDraws().
+	 * @param indirectBuffer The commands of the draw groups in Indirect mode, ignored in Instanced mode.
+	 * @param instanceDescriptorSet The instance set whose visible indices match the commands.
+	 * @param lateDraws True for the late occlusion phase, which skips the non indexed runs already drawn.
+	 * @param groupBegin The first draw group.
+	 * @param groupEnd One past the last draw group.
+	 */
+	void RenderSystem::recordGroups(
+		FrameInfo& frameInfo,
+		VkCommandBuffer commandBuffer,
+		lmPipeline& drawPipeline,
+		VkBuffer indirectBuffer,
+		VkDescriptorSet instanceDescriptorSet,
+		bool lateDraws,
+		size_t groupBegin,
+		size_t groupEnd) {
+		FrameResources& frame = frames[frameInfo.frameIndex];
+
+		drawPipeline.bind(commandBuffer);
+
+		const std::array<VkDescriptorSet, 2> descriptorSets{
+			frameInfo.globalDescriptorSet,
+			instanceDescriptorSet
+		};
+
+		vkCmdBindDescriptorSets(
+			commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
 			0,
-			1,
-			&frameInfo.globalDescriptorSet,
+			static_cast<uint32_t>(descriptorSets.size()),
+			descriptorSets.data(),
 			0,
 			nullptr);
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
+		// Runs are split by the buffers their models bind, so each run binds at most once
+		const lmModel* boundModel = nullptr;
+		auto bindRun = [&](const DrawRun& drawRun) {
+			if (!boundModel || !boundModel->sharesBuffersWith(*drawRun.model)) {
+				drawRun.model->bind(commandBuffer);
+				boundModel = drawRun.model;
+			}
+		};
+
+		// GPU culling never culls non indexed instances
+		const bool gpuCulling = culling == Culling::GPU;
+		constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		// The last run starting at or before groupBegin, the first run always starts at group 0
+		auto firstRun = std::upper_bound(drawRuns.begin(), drawRuns.end(), groupBegin,
+			[](size_t group, const DrawRun& drawRun) { return group < drawRun.firstGroup; });
+
+		for (size_t run = static_cast<size_t>(firstRun - drawRuns.begin()) - 1; run < drawRuns.size() && drawRuns[run].firstGroup < groupEnd; run++) {
+			const DrawRun& drawRun = drawRuns[run];
+			const uint32_t firstGroup = std::max(drawRun.firstGroup, static_cast<uint32_t>(groupBegin));
+			const uint32_t lastGroup = std::min(drawRun.firstGroup + drawRun.groupCount, static_cast<uint32_t>(groupEnd));
+
+			if (mode == Mode::Instanced) {
+				bindRun(drawRun);
+				for (uint32_t group = firstGroup; group < lastGroup; group++) {
+					if (visibleCounts[group] > 0) {
+						drawGroups[group].model->draw(commandBuffer, visibleCounts[group], drawGroups[group].firstInstance);
+					}
+				}
+				continue;
+			}
 
-			if (obj.model == nullptr) continue;
+			if (!drawRun.indexed && lateDraws) {
+				continue;
+			}
 
-			PushConstantData push{};			
-			push.modelMatrix = obj.transform.getMatrix();
-			// Ensures that lighting calculations remain correct when non-uniform scaling is applied to a model
-			push.normalMatrix = glm::transpose(glm::inverse(glm::mat3(obj.transform.getMatrix())));
+			bindRun(drawRun);
 
-			vkCmdPushConstants(
-				frameInfo.commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(PushConstantData),
-				&push);
+			if (!drawRun.indexed) {
+				const uint32_t group = drawRun.firstGroup;
+				const uint32_t instanceCount = gpuCulling ? drawGroups[group].instanceCount : visibleCounts[group];
+				if (instanceCount > 0) {
+					drawRun.model->draw(commandBuffer, instanceCount, drawGroups[group].firstInstance);
+				}
+				continue;
+			}
 
-			obj.model->bind(frameInfo.commandBuffer);
-			obj.model->draw(frameInfo.commandBuffer);
+			// A whole run culled on the GPU draws only the commands the compaction kept, the count
+			// starting at the run's first draw like its commands
+			const uint32_t drawCount = lastGroup - firstGroup;
+			const VkDeviceSize offset = static_cast<VkDeviceSize>(firstGroup) * stride;
+			if (gpuCulling && device.hasDrawIndirectCount() && drawCount == drawRun.groupCount) {
+				const lmBuffer& compactedBuffer = lateDraws ? *frame.lateCompactedIndirectBuffer : *frame.compactedIndirectBuffer;
+				const lmBuffer& countBuffer = lateDraws ? *frame.lateCountBuffer : *frame.countBuffer;
+				vkCmdDrawIndexedIndirectCount(
+					commandBuffer,
+					compactedBuffer.getBuffer(),
+					offset,
+					countBuffer.getBuffer(),
+					static_cast<VkDeviceSize>(firstGroup) * sizeof(uint32_t),
+					drawCount,
+					stride);
+			}
+			else if (device.hasMultiDrawIndirect()) {
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset, drawCount, stride);
+			}
+			else {
+				for (uint32_t i = 0; i < drawCount; i++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, offset + i * stride, 1, stride);
+				}
+			}
 		}
 	}
 
@@ -2,36 +2,305 @@
 
 #include "../render/Camera.h"
 #include "../render/Device.h"
-#include "../render/Pipeline.h"
+#include "../render/PipelineRegistry.h"
 #include "../render/FrameInfo.h"
+#include "../render/Buffer.h"
+#include "../render/Descriptors.h"
+#include "../render/GeometryArena.h"
+#include "../render/DepthPyramid.h"
+#include "../ecs/CullingKernel.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace lm {
 
+	class lmModel;
+
+	/*
+	* Draws every entity with a ModelComponent, one instanced draw per model.
+	*
+	* Entities sharing the same lmModel are grouped every frame, their model and normal matrices are
+	* written to a per-frame-in-flight storage buffer, contiguous per group, and the vertex shader
+	* fetches them with gl_InstanceIndex. Each group is drawn with firstInstance set to the start of
+	* its range, so the cost scales with the number of unique meshes rather than the number of objects.
+	*
+	* In Indirect mode the draws are also written to a per-frame VkDrawIndexedIndirectCommand buffer
+	* and submitted with vkCmdDrawIndexedIndirect, one call per run of models sharing the same
+	* vertex and index buffers. The instance and draw data are rebuilt in parallel, and only when a
+	* model, a drawn transform or the set of drawn entities changed since that frame's buffers were written.
+	*
+	* Models live in a shared lmGeometryArena, so the geometry is bound once per frame and every run
+	* spans all indexed models; the commands are rebuilt when the arena grows or compacts.
+	*
+	* With CPU culling, the world space bounding boxes of the instances, rebuilt with the instance data,
+	* are tested every frame against the camera frustum by the SIMD culling kernel. The indices of the
+	* visible instances are compacted to the start of each group's range of a per-frame visible index
+	* buffer, which the vertex shader reads through gl_InstanceIndex, and the instance counts are lowered
+	* to the visible counts.
+	*
+	* With GPU culling (Indirect mode only) prepareFrame() instead records a compute dispatch testing each
+	* instance's bounding sphere against the frustum. The shader appends the visible instances to the
+	* visible index buffer and counts them in a device local copy of the indirect commands, which the
+	* draws consume, so a frame whose scene did not change costs no per-object CPU work at all. With the
+	* drawIndirectCount feature a second dispatch appends the commands left with visible instances to a
+	* compacted buffer, counting them per run, and each run is drawn with vkCmdDrawIndexedIndirectCount
+	* so that the culled models cost no draw at all.
+	*
+	* Occlusion culling extends GPU culling in two phases around a depth pyramid. The early phase only
+	* draws the frustum visible instances that were visible last frame, the depth they leave is reduced
+	* into an lmDepthPyramid by cullLate(), and the late phase tests every indexed instance against it,
+	* drawing the newly visible ones with renderLateGameObjects() and recording each instance's visibility
+	* for the next early phase. Objects coming into view are drawn the frame they appear instead of a frame
+	* late, and those turning hidden stop being drawn the next frame.
+	*
+	* When the render passes take secondary command buffers, the draws are split into chunks of draw groups
+	* recorded in parallel by the thread pool, each into a secondary command buffer of the recording thread
+	* (see lmRenderer::beginSecondaryCommandBuffer), and executed in chunk order by the primary.
+	*
+	* prepareFrame() must be recorded outside of the render pass, before renderGameObjects(). With occlusion
+	* culling, cullLate() is recorded after the render pass kept the depth (see lmRenderer) and
+	* renderLateGameObjects() inside the resumed render pass.
+	*/
 	class RenderSystem {
 	public:
+		enum class Mode {
+			Instanced,	// One vkCmdDrawIndexed per model
+			Indirect	// One indirect multi-draw per run of models sharing buffers
+		};
+
+		enum class Culling {
+			None,	// Every instance is drawn, the visible index buffer maps every instance to itself
+			CPU,	// SIMD frustum test of the instance boxes on the thread pool
+			GPU		// Compute frustum test of the instance spheres writing the indirect commands
+		};
+
 		RenderSystem(
 			lmDevice& device,
+			lmRegistry& registry,
+			lmGeometryArena& geometryArena,
+			lmPipelineRegistry& pipelineRegistry,
 			VkRenderPass renderPass,
 			VkDescriptorSetLayout globalSetLayout);
 
-		~RenderSystem();
-
 		RenderSystem(const RenderSystem&) = delete;
 		RenderSystem& operator = (const RenderSystem&) = delete;
 
+		// Rebuilds the draw data if needed and culls the instances, records compute work with GPU culling
+		void prepareFrame(FrameInfo& frameInfo);
 		void renderGameObjects(FrameInfo& frameInfo);
 
+		// Occlusion culling only, between the render pass keeping the depth and the resumed render pass
+		void cullLate(FrameInfo& frameInfo);
+		void renderLateGameObjects(FrameInfo& frameInfo);
+
+		// Falls back to Instanced when the device cannot draw indirect with a non zero firstInstance
+		void setMode(Mode mode);
+		Mode getMode() const { return mode; }
+
+		// GPU culling needs Indirect mode, it falls back to CPU culling otherwise
+		void setCulling(Culling culling);
+		Culling getCulling() const { return culling; }
+
+		// Occlusion culling needs GPU culling and R32G32_SFLOAT storage images, it stays disabled otherwise
+		void setOcclusionCulling(bool enabled);
+		bool isOcclusionCullingEnabled() const { return occlusionCulling; }
+
+		// Selects the pipeline variants with or without the specular term, both sets are compiled up front
+		void setSpecular(bool enabled) { specular = enabled; }
+		bool isSpecularEnabled() const { return specular; }
+
+		size_t getLastDrawCount() const { return drawGroups.size(); }
+		size_t getLastInstanceCount() const { return lastInstanceCount; }
+		size_t getLastCommandCount() const { return lastCommandCount; }
+		bool wasLastFrameReused() const { return lastFrameReused; }
+
+		// With GPU culling the visible count is read back MAX_FRAMES_IN_FLIGHT frames late
+		size_t getLastVisibleCount() const { return lastVisibleCount; }
+		size_t getLastCulledCount() const { return lastInstanceCount - std::min(lastVisibleCount, lastInstanceCount); }
+
 	private:
+		static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+		static constexpr uint32_t INITIAL_DRAW_CAPACITY = 256;
+		static constexpr uint32_t NO_GROUP = UINT32_MAX;
+		static constexpr size_t PARALLEL_DRAW_GRAIN_SIZE = 64;
+		static constexpr size_t PARALLEL_CULL_GRAIN_SIZE = 1024;
+		static constexpr size_t PARALLEL_RECORD_GRAIN_SIZE = 512;	// Draw groups per secondary command buffer
+		static constexpr size_t PARALLEL_RECORD_MIN_RUNS = 256;	// Multi-draws below which Indirect mode records a single secondary
+		static constexpr uint32_t CULL_WORKGROUP_SIZE = 64;	// local_size_x of cull.comp
+		static constexpr uint32_t CULL_STORAGE_BINDING_COUNT = 9;	// Storage buffers of cull.comp, followed by the pyramid and the parameters
+		static constexpr uint32_t CULL_PYRAMID_BINDING = 9;
+		static constexpr uint32_t CULL_PARAMS_BINDING = 10;
+		static constexpr uint32_t LIGHT_COUNT_CONSTANT_ID = 0;	// Specialization constants of shader.frag
+		static constexpr uint32_t SPECULAR_CONSTANT_ID = 1;
+		static constexpr int DYNAMIC_LIGHT_COUNT = -1;	// LIGHT_COUNT of the generic variants, reading the count from the UBO
+
+		// Instances of one model, stored at [firstInstance, firstInstance + instanceCount) in the instance buffer
+		struct DrawGroup {
+			lmModel* model;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+		};
+
+		// Consecutive draw groups whose models share buffers, submitted by one indirect call. Commands map 1:1 to groups
+		// Non indexed models always form a run of their own and are drawn directly
+		struct DrawRun {
+			lmModel* model;
+			uint32_t firstGroup;
+			uint32_t groupCount;
+			bool indexed;
+		};
+
+		// Where an entity's instance goes: its group and its index within the group
+		struct InstanceSlot {
+			uint32_t group;
+			uint32_t index;
+		};
+
+		// World space boxes of the instances as centers and half extents, indexed like the instance buffer
+		struct InstanceBounds {
+			std::vector<float> centerX, centerY, centerZ;
+			std::vector<float> extentX, extentY, extentZ;
+
+			void resize(size_t count);
+			lmAabbSoA getRange(size_t first, size_t count) const;
+		};
+
+		struct FrameResources {
+			std::unique_ptr<lmBuffer> instanceBuffer;
+			std::unique_ptr<lmBuffer> visibleBuffer;
+			VkDescriptorSet instanceDescriptorSet = VK_NULL_HANDLE;
+			std::unique_ptr<lmBuffer> indirectBuffer;
+
+			// GPU culling inputs and outputs: the draw of each instance, the bounds of each draw, the
+			// commands the compute pass fills in and the visible instance count it reports
+			std::unique_ptr<lmBuffer> instanceDrawBuffer;
+			std::unique_ptr<lmBuffer> drawDataBuffer;
+			std::unique_ptr<lmBuffer> gpuIndirectBuffer;
+			std::unique_ptr<lmBuffer> statsBuffer;
+			std::unique_ptr<lmBuffer> cullParamsBuffer;
+			VkDescriptorSet cullDescriptorSet = VK_NULL_HANDLE;
+
+			// Commands left with visible instances, packed per run, and the number of them each run
+			// counts at its first draw, both written by the compaction dispatch
+			std::unique_ptr<lmBuffer> compactedIndirectBuffer;
+			std::unique_ptr<lmBuffer> countBuffer;
+			bool statsPending = false;
+
+			// Commands and visible indices of the late occlusion phase, drawn through their own instance set
+			std::unique_ptr<lmBuffer> lateIndirectBuffer;
+			std::unique_ptr<lmBuffer> lateVisibleBuffer;
+			std::unique_ptr<lmBuffer> lateCompactedIndirectBuffer;
+			std::unique_ptr<lmBuffer> lateCountBuffer;
+			VkDescriptorSet lateInstanceDescriptorSet = VK_NULL_HANDLE;
+			VkDescriptorSet lateCullDescriptorSet = VK_NULL_HANDLE;
+
+			// Scene version the buffers were last written for, 0 when they must be rebuilt
+			uint64_t instanceVersion = 0;
+			uint64_t indirectVersion = 0;
+		};
+
+		void checkShaderInterfaces() const;
+		void createInstanceResources();
+		void reserveInstances(FrameResources& frame, size_t instanceCount);
+		void reserveDraws(FrameResources& frame, size_t drawCount);
+		bool detectChanges(FrameInfo& frameInfo, size_t objectCount) const;
+		void buildDrawGroups(FrameInfo& frameInfo);
+		void writeInstances(FrameInfo& frameInfo, FrameResources& frame);
+		void writeIndirectCommands(FrameInfo& frameInfo, FrameResources& frame);
+		void cullInstances(FrameInfo& frameInfo, FrameResources& frame);
+		void reserveVisibility(size_t instanceCount);
+		void writeCullDescriptorSet(FrameResources& frame);
+		void dispatchCulling(FrameInfo& frameInfo, FrameResources& frame);
+		void compactDraws(VkCommandBuffer commandBuffer);
+		void recordDraws(FrameInfo& frameInfo, VkBuffer indirectBuffer, VkDescriptorSet instanceDescriptorSet, bool lateDraws);
+		void recordGroups(
+			FrameInfo& frameInfo,
+			VkCommandBuffer commandBuffer,
+			lmPipeline& drawPipeline,
+			VkBuffer indirectBuffer,
+			VkDescriptorSet instanceDescriptorSet,
+			bool lateDraws,
+			size_t groupBegin,
+			size_t groupEnd);
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 		void createPipeline(VkRenderPass renderPass);
+		static size_t getVariantIndex(int lightCount, bool specularVariant);
+		lmPipelineHandle requestPipelineVariant(int lightCount, bool specularVariant);
+		lmPipeline* selectPipeline() const;
+		void createCullPipeline();
 
 		lmDevice& device;
+		lmGeometryArena& geometryArena;
+		lmPipelineRegistry& pipelineRegistry;
+
+		// Built once so that the matched archetypes are kept across frames, each() only scans new archetypes
+		lmView<TransformComponent, ModelComponent> modelView;
+		lmView<TransformComponent, PointLightComponent> lightView;
+
+		// Reflected from the shaders, the layouts below are derived from them
+		lmPipelineInterface graphicsInterface;
+		lmPipelineInterface cullInterface;
+
+		// Variants of the pipeline by light count and specular term, all requested at creation and indexed
+		// by getVariantIndex(). A variant specialized for a light count falls back to the generic one
+		// until it is compiled
+		std::vector<lmPipelineHandle> pipelineVariants;
+		int frameLightCount = 0;
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;	// Filtered by the reflection once
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;	// Owned by the registry
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		bool specular = true;
+
+		lmPipelineHandle cullPipeline;
+		VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;	// Owned by the registry
+		std::unique_ptr<lmDescriptorSetLayout> cullSetLayout;
+		std::unique_ptr<lmDescriptorPool> cullPool;
+
+		// Occlusion state shared by the frames in flight, whose accesses are ordered by barriers on the
+		// graphics queue: one uint per instance, valid for visibilityVersion, and the depth pyramid
+		bool occlusionCulling = false;
+		std::unique_ptr<lmDepthPyramid> depthPyramid;
+		std::unique_ptr<lmBuffer> visibilityBuffer;
+		uint64_t visibilityVersion = 0;
+
+		Mode mode = Mode::Instanced;
+
+		// Per frame in flight instance, visible index, indirect command and draw count buffers
+		std::unique_ptr<lmDescriptorSetLayout> instanceSetLayout;
+		std::unique_ptr<lmDescriptorPool> instancePool;
+		std::vector<FrameResources> frames;
+
+		// Bumped whenever the drawn objects change, starts at 1 so that version 0 means "never built"
+		uint64_t sceneVersion = 1;
+		uint64_t groupsVersion = 0;
+		size_t lastObjectCount = 0;
+		uint64_t lastArenaGeneration = 0;
+
+		// Draw state of the last build, valid for every frame whose buffers match sceneVersion
+		std::unordered_map<const lmModel*, uint32_t> groupLookup;
+		std::vector<DrawGroup> drawGroups;
+		std::vector<DrawRun> drawRuns;
+		std::vector<InstanceSlot> entitySlots;
+		size_t lastInstanceCount = 0;
+		size_t lastCommandCount = 0;
+		bool lastFrameReused = false;
+
+		// Culling state, the bounds follow sceneVersion while the flags and visible counts are redone every frame
+		Culling culling = Culling::CPU;
+		lmCullingKernel cullingKernel = getBestCullingKernel();
+		InstanceBounds instanceBounds;
+		uint64_t boundsVersion = 0;
+		std::vector<uint8_t> visibleFlags;
+		std::vector<uint32_t> visibleCounts;
+		size_t lastVisibleCount = 0;
 
-		std::unique_ptr<lmPipeline> pipeline;
-		VkPipelineLayout pipelineLayout;
+		// Secondary command buffers of the last recordDraws(), in draw order
+		std::vector<VkCommandBuffer> secondaryCommandBuffers;
 	};
 
 } //namespace lm
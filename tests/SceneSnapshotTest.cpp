@@ -0,0 +1,141 @@
+/**
+ * @file SceneSnapshotTest.cpp
+ * @brief Checks that checkSnapshot accepts a well-formed snapshot and rejects out-of-range references.
+ *
+ * The snapshots are built in memory with a placeholder vertex, since validation only depends on
+ * the vertex size.
+ */
+
+#include "../core/SnapshotFormat.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+    using namespace lm;
+
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t VERTEX_SIZE = 32;
+    constexpr uint64_t SOURCE_KEY = 0x1234;
+
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    // One model of three vertices drawn as a triangle, referenced by one entity
+    struct TestSnapshot {
+        SnapshotHeader header{};
+        SnapshotModel model{};
+        uint32_t indices[3] = { 0, 1, 2 };
+        SnapshotEntity entity{};
+
+        // 16-byte storage, matching the alignment the sections are read with
+        std::vector<uint64_t> write() const {
+            std::vector<uint64_t> storage((header.fileSize + 15) / 16 * 2, 0);
+            auto* bytes = reinterpret_cast<char*>(storage.data());
+            std::memcpy(bytes, &header, sizeof(header));
+            std::memcpy(bytes + header.modelsOffset, &model, sizeof(model));
+            std::memcpy(bytes + header.indicesOffset, indices, sizeof(indices));
+            std::memcpy(bytes + header.entitiesOffset, &entity, sizeof(entity));
+            return storage;
+        }
+    };
+
+    TestSnapshot makeSnapshot() {
+        TestSnapshot snapshot;
+
+        SnapshotHeader& header = snapshot.header;
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = VERSION;
+        header.vertexSize = VERTEX_SIZE;
+        header.sourceKey = SOURCE_KEY;
+        header.modelCount = 1;
+        header.entityCount = 1;
+        header.vertexCount = 3;
+        header.indexCount = 3;
+        header.modelsOffset = alignSnapshotSection(sizeof(SnapshotHeader));
+        header.verticesOffset = alignSnapshotSection(header.modelsOffset + sizeof(SnapshotModel));
+        header.indicesOffset = alignSnapshotSection(header.verticesOffset + header.vertexCount * VERTEX_SIZE);
+        header.entitiesOffset = alignSnapshotSection(header.indicesOffset + header.indexCount * sizeof(uint32_t));
+        header.fileSize = header.entitiesOffset + sizeof(SnapshotEntity);
+
+        snapshot.model.vertexCount = 3;
+        snapshot.model.indexCount = 3;
+
+        snapshot.entity.parent = SNAPSHOT_NO_INDEX;
+        snapshot.entity.model = 0;
+        return snapshot;
+    }
+
+    SnapshotCheck checkWritten(const TestSnapshot& snapshot, std::string& reason) {
+        const std::vector<uint64_t> storage = snapshot.write();
+        SnapshotSections sections;
+        return checkSnapshot(
+            reinterpret_cast<const std::byte*>(storage.data()), snapshot.header.fileSize,
+            VERSION, VERTEX_SIZE, SOURCE_KEY, sections, reason);
+    }
+
+    void validSnapshot() {
+        std::string reason;
+        check(checkWritten(makeSnapshot(), reason) == SnapshotCheck::Valid, "a well-formed snapshot is accepted");
+    }
+
+    void indexOutsideModel() {
+        TestSnapshot snapshot = makeSnapshot();
+        snapshot.indices[2] = 3;
+
+        std::string reason;
+        check(checkWritten(snapshot, reason) == SnapshotCheck::Corrupted, "an index equal to the model's vertex count is rejected");
+        check(reason.find("index") != std::string::npos, "the rejection names the index");
+    }
+
+    void indexInsideFileButOutsideModel() {
+        // The vertex section holds three vertices, but the model only owns the first two
+        TestSnapshot snapshot = makeSnapshot();
+        snapshot.model.vertexCount = 2;
+        snapshot.indices[2] = 2;
+
+        std::string reason;
+        check(checkWritten(snapshot, reason) == SnapshotCheck::Corrupted, "an index past the model's own vertices is rejected");
+    }
+
+    void staleSnapshot() {
+        TestSnapshot snapshot = makeSnapshot();
+        snapshot.header.sourceKey = SOURCE_KEY + 1;
+
+        std::string reason;
+        check(checkWritten(snapshot, reason) == SnapshotCheck::Mismatch, "a snapshot of other source files is a mismatch");
+    }
+
+    void invalidEntityModel() {
+        TestSnapshot snapshot = makeSnapshot();
+        snapshot.entity.model = 1;
+
+        std::string reason;
+        check(checkWritten(snapshot, reason) == SnapshotCheck::Corrupted, "an entity referencing a missing model is rejected");
+    }
+
+} // namespace
+
+int main() {
+    validSnapshot();
+    indexOutsideModel();
+    indexInsideFileButOutsideModel();
+    staleSnapshot();
+    invalidEntityModel();
+
+    if (failures > 0) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    std::printf("All scene snapshot checks passed\n");
+    return 0;
+}
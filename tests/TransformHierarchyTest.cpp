@@ -0,0 +1,144 @@
+/**
+ * @file TransformHierarchyTest.cpp
+ * @brief Checks that lmTransformHierarchy drops destroyed entities and survives the reuse of their index.
+ *
+ * A destroyed parent must not leave its children inheriting its world matrix, and adding an entity
+ * that recycled the index of a node still linked into the hierarchy must not corrupt the child lists.
+ */
+
+#include "../ecs/TransformHierarchy.h"
+#include "../ecs/GameObject.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+    using namespace lm;
+
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    bool equal(const glm::mat4& a, const glm::mat4& b) {
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                if (glm::abs(a[column][row] - b[column][row]) > 1e-5f) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Destroys enough other entities after the given one that the registry's next create() reuses its index
+    lmEntity recycle(lmRegistry& registry, lmEntity entity) {
+        std::vector<lmEntity> fillers;
+        for (size_t i = 0; i <= lmHandleAllocator<lmEntity>::MIN_FREE_SLOTS; i++) {
+            fillers.push_back(registry.create());
+        }
+
+        registry.destroy(entity);
+        for (lmEntity filler : fillers) {
+            registry.destroy(filler);
+        }
+
+        return registry.create();
+    }
+
+    void destroyedParent() {
+        lmRegistry registry;
+        lmTransformHierarchy hierarchy;
+
+        const lmEntity parent = registry.create();
+        const lmEntity child = registry.create();
+        hierarchy.add(parent);
+        hierarchy.add(child, parent);
+
+        const glm::mat4 parentLocal = glm::translate(glm::mat4(1.f), glm::vec3(5.f, 0.f, 0.f));
+        const glm::mat4 childLocal = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 1.f, 0.f));
+        hierarchy.setLocalMatrix(parent, parentLocal);
+        hierarchy.setLocalMatrix(child, childLocal);
+        hierarchy.update(registry);
+        check(equal(hierarchy.getWorldMatrix(child), parentLocal * childLocal), "child inherits its parent's world matrix");
+
+        registry.nextFrame();
+        registry.destroy(parent);
+        hierarchy.update(registry);
+
+        check(!hierarchy.contains(parent), "destroyed parent is removed");
+        check(hierarchy.size() == 1, "node count drops with the destroyed parent");
+        check(hierarchy.getParent(child).isNull(), "child of a destroyed parent becomes a root");
+        check(equal(hierarchy.getWorldMatrix(child), childLocal), "child stops inheriting the destroyed parent's matrix");
+    }
+
+    void recycledParentIndex() {
+        lmRegistry registry;
+        lmTransformHierarchy hierarchy;
+
+        const lmEntity parent = registry.create();
+        const lmEntity first = registry.create();
+        const lmEntity second = registry.create();
+        hierarchy.add(parent);
+        hierarchy.add(first, parent);
+        hierarchy.add(second, parent);
+
+        const glm::mat4 parentLocal = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, 3.f));
+        const glm::mat4 firstLocal = glm::translate(glm::mat4(1.f), glm::vec3(1.f, 0.f, 0.f));
+        const glm::mat4 secondLocal = glm::scale(glm::mat4(1.f), glm::vec3(2.f));
+        hierarchy.setLocalMatrix(parent, parentLocal);
+        hierarchy.setLocalMatrix(first, firstLocal);
+        hierarchy.setLocalMatrix(second, secondLocal);
+        hierarchy.update(registry);
+        registry.nextFrame();
+
+        // The new entity is added before update() sees the destruction, while the old node is still linked
+        const lmEntity recycled = recycle(registry, parent);
+        check(recycled.index() == parent.index() && recycled != parent, "the parent's index is recycled");
+
+        hierarchy.add(recycled);
+        check(hierarchy.size() == 3, "the stale node is replaced rather than counted twice");
+        check(hierarchy.getParent(first).isNull() && hierarchy.getParent(second).isNull(), "children of the stale node become roots");
+
+        hierarchy.add(registry.create(), recycled);
+        check(hierarchy.size() == 4, "a child can be attached to the recycled entity");
+
+        const glm::mat4 recycledLocal = glm::translate(glm::mat4(1.f), glm::vec3(0.f, -4.f, 0.f));
+        hierarchy.setLocalMatrix(recycled, recycledLocal);
+        hierarchy.update(registry);
+
+        check(hierarchy.size() == 4, "update() leaves the node count unchanged");
+        check(equal(hierarchy.getWorldMatrix(recycled), recycledLocal), "recycled entity has its own world matrix");
+        check(equal(hierarchy.getWorldMatrix(first), firstLocal), "first orphan keeps only its local matrix");
+        check(equal(hierarchy.getWorldMatrix(second), secondLocal), "second orphan keeps only its local matrix");
+
+        // Reparenting both orphans walks the sibling links the stale node used to share
+        hierarchy.setParent(first, recycled);
+        hierarchy.setParent(second, recycled);
+        hierarchy.update(registry);
+        check(hierarchy.getParent(first) == recycled && hierarchy.getParent(second) == recycled, "orphans can be reparented");
+        check(equal(hierarchy.getWorldMatrix(first), recycledLocal * firstLocal), "first child follows the recycled parent");
+        check(equal(hierarchy.getWorldMatrix(second), recycledLocal * secondLocal), "second child follows the recycled parent");
+    }
+
+} // namespace
+
+int main() {
+    destroyedParent();
+    recycledParentIndex();
+
+    if (failures > 0) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    std::printf("All transform hierarchy checks passed\n");
+    return 0;
+}